@@ -0,0 +1,98 @@
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+static void AddBlock(Arena &arena, size_t size) {
+    arena.blocks.push_back(make_pair(new char[size], size));
+    arena.heapCalls++;
+    arena.current = arena.blocks.size() - 1;
+    arena.used = 0;
+}
+
+void ArenaInit(Arena &arena, size_t firstBlockSize) {
+    arena.blocks.clear();
+    arena.heapCalls = 0;
+    AddBlock(arena, max(firstBlockSize, (size_t)64));
+}
+
+void ArenaFree(Arena &arena) {
+    for (auto it = arena.blocks.begin(); it != arena.blocks.end(); ++it) {
+        delete[] it->first;
+    }
+    arena.blocks.clear();
+    arena.current = 0;
+    arena.used = 0;
+}
+
+void *ArenaAllocate(Arena &arena, size_t size, size_t alignment) {
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    assert(!arena.blocks.empty());
+
+    pair<char *, size_t> &block = arena.blocks[arena.current];
+    // Blocks of new[] are aligned for any fundamental type, so offsets are aligned instead of addresses.
+    size_t offset = (arena.used + alignment - 1) & ~(alignment - 1);
+    if (offset + size <= block.second) {
+        arena.used = offset + size;
+        return block.first + offset;
+    }
+
+    // Blocks grow geometrically, so a big invocation makes only a few heap calls.
+    AddBlock(arena, max(size, block.second * 2));
+    arena.used = size;
+    return arena.blocks.back().first;
+}
+
+void ArenaReset(Arena &arena) {
+    assert(!arena.blocks.empty());
+    if (arena.blocks.size() > 1) {
+        size_t total = 0;
+        for (auto it = arena.blocks.begin(); it != arena.blocks.end(); ++it) {
+            total += it->second;
+        }
+        ArenaFree(arena);
+        AddBlock(arena, total);
+    }
+    arena.current = 0;
+    arena.used = 0;
+}
+
+#ifdef DEBUG
+void ArenaTest() {
+    Arena arena;
+    ArenaInit(arena, 100);
+    assert(1 == arena.heapCalls);
+
+    char *c = (char *)ArenaAllocate(arena, 1, 1);
+    uint64_t *u = (uint64_t *)ArenaAllocate(arena, sizeof(uint64_t), alignof(uint64_t));
+    assert((uintptr_t)u % alignof(uint64_t) == 0 && (char *)u > c);
+    assert(1 == arena.heapCalls);
+
+    // the same work after a reset fits into the merged block
+    auto work = [&arena]() {
+        vector<int, ArenaAllocator<int>> numbers{ ArenaAllocator<int>(arena) };
+        for (int i = 0; i < 1000; ++i) {
+            numbers.push_back(i);
+        }
+        assert(999 == numbers.back());
+    };
+    work();
+    size_t coldCalls = arena.heapCalls;
+    assert(coldCalls > 1);
+    ArenaReset(arena);
+    assert(1 == arena.blocks.size());
+    size_t resetCalls = arena.heapCalls;
+    work();
+    assert(resetCalls == arena.heapCalls);
+    ArenaReset(arena);
+    work();
+    assert(resetCalls == arena.heapCalls);
+
+    ArenaFree(arena);
+    assert(arena.blocks.empty());
+}
+#endif
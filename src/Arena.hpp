@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Monotonic arena for temporaries of one invocation (the rows of the dialog list are built in it on every update):
+// an allocation only moves a pointer, nothing is freed until the arena is reset.
+//
+// A reset keeps the memory (several blocks are merged into one of their total size),
+// so a warm invocation which needs no more memory than the previous one makes no heap calls at all.
+
+typedef struct tArena {
+    std::vector<std::pair<char *, size_t>> blocks; // data and size
+    size_t current;   // the block being filled
+    size_t used;      // bytes used in the current block
+    size_t heapCalls; // blocks allocated from the heap since the arena was created
+} Arena;
+
+void ArenaInit(Arena &arena, size_t firstBlockSize);
+
+/** Frees all blocks, the arena may be initialized again. */
+void ArenaFree(Arena &arena);
+
+/** alignment must be a power of two not greater than alignof(std::max_align_t). */
+void *ArenaAllocate(Arena &arena, size_t size, size_t alignment);
+
+/** Forgets all allocations. */
+void ArenaReset(Arena &arena);
+
+/** Allocator of standard containers whose memory is returned to the arena only by its reset. */
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+
+    Arena *arena;
+
+    explicit ArenaAllocator(Arena &arena) : arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(ArenaAllocate(*arena, n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t) {}
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &x, const ArenaAllocator<U> &y) {
+    return x.arena == y.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &x, const ArenaAllocator<U> &y) {
+    return x.arena != y.arena;
+}
+
+#ifdef DEBUG
+void ArenaTest();
+#endif
@@ -1,6 +1,7 @@
 #include "CmdLine.hpp"
 
 #include <cassert>
+#include <cwctype>
 
 using namespace std;
 
@@ -54,21 +55,101 @@ wstring GetSuggestedSuffix(const CmdLine &cmdLine) {
     return GetRange(cmdLine, GetSuggestedSuffixRange(cmdLine));
 }
 
-static Range ReplaceRange(CmdLine &cmdLine, Range range, const wstring &str) {
-    cmdLine.line.replace(range.first, RangeLength(range), str);
-    Range newRange = Range(range.first, range.first + (int)str.length());
+static vector<Range> GetWordRanges(const CmdLine &cmdLine, int end) {
+    vector<Range> words;
+    int i = 0;
+    while (i < end) {
+        if (iswspace(cmdLine.line.at(i))) {
+            i++;
+            continue;
+        }
+        int start = i;
+        while (i < end && !iswspace(cmdLine.line.at(i))) {
+            i++;
+        }
+        words.push_back(Range(start, i));
+    }
+    return words;
+}
+
+static vector<wstring> GetWords(const CmdLine &cmdLine, int end) {
+    vector<Range> ranges = GetWordRanges(cmdLine, end);
+    vector<wstring> words;
+    for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+        words.push_back(GetRange(cmdLine, *it));
+    }
+    return words;
+}
+
+vector<wstring> GetPrecedingWords(const CmdLine &cmdLine) {
+    return GetWords(cmdLine, GetUserPrefixRange(cmdLine).first);
+}
+
+vector<wstring> GetWords(const CmdLine &cmdLine) {
+    return GetWords(cmdLine, (int)cmdLine.line.length());
+}
+
+vector<CmdLineToken> GetTokens(const CmdLine &cmdLine) {
+    vector<CmdLineToken> tokens;
+    vector<Range> words = GetWordRanges(cmdLine, (int)cmdLine.line.length());
+    for (size_t w = 0; w < words.size(); ++w) {
+        int start = words[w].first;
+        int end = words[w].second;
+        int i = start;
+        while (i <= end) {
+            bool separator = (i + 1 < end && cmdLine.line.compare(i, 2, L"..") == 0);
+            if (i == end || separator) {
+                if (i > start) {
+                    CmdLineToken token = { start, i, w };
+                    tokens.push_back(token);
+                }
+                if (i == end) {
+                    break;
+                }
+                i += (i + 2 < end && cmdLine.line.at(i + 2) == L'.') ? 3 : 2;
+                start = i;
+            } else {
+                i++;
+            }
+        }
+    }
+    return tokens;
+}
+
+static Range ReplaceRange(CmdLine &cmdLine, Range range, const wchar_t *str, size_t length) {
+    cmdLine.line.replace(range.first, RangeLength(range), str, length);
+    Range newRange = Range(range.first, range.first + (int)length);
     return newRange;
 }
 
 void ReplaceUserPrefix(CmdLine &cmdLine, const wstring &newPrefix) {
-    Range range = ReplaceRange(cmdLine, GetUserPrefixRange(cmdLine), newPrefix);
+    ReplaceUserPrefix(cmdLine, newPrefix.c_str(), newPrefix.length());
+}
+
+void ReplaceUserPrefix(CmdLine &cmdLine, const wchar_t *newPrefix, size_t length) {
+    Range range = ReplaceRange(cmdLine, GetUserPrefixRange(cmdLine), newPrefix, length);
     cmdLine.curPos = range.second;
     cmdLine.selectionStart = -1;
     cmdLine.selectionEnd = -1;
 }
 
+void ReplaceToken(CmdLine &cmdLine, const CmdLineToken &token, const wstring &text) {
+    Range range = ReplaceRange(cmdLine, Range(token.start, token.end), text.c_str(), text.length());
+    if (cmdLine.curPos >= token.end) {
+        cmdLine.curPos += range.second - token.end;
+    } else if (cmdLine.curPos > token.start) {
+        cmdLine.curPos = range.second;
+    }
+    cmdLine.selectionStart = -1;
+    cmdLine.selectionEnd = -1;
+}
+
 void ReplaceSuggestedSuffix(CmdLine &cmdLine, const wstring &newSuffix) {
-    Range range = ReplaceRange(cmdLine, GetSuggestedSuffixRange(cmdLine), newSuffix);
+    ReplaceSuggestedSuffix(cmdLine, newSuffix.c_str(), newSuffix.length());
+}
+
+void ReplaceSuggestedSuffix(CmdLine &cmdLine, const wchar_t *newSuffix, size_t length) {
+    Range range = ReplaceRange(cmdLine, GetSuggestedSuffixRange(cmdLine), newSuffix, length);
     cmdLine.curPos = range.second;
     if (RangeLength(range) > 0) {
         cmdLine.selectionStart = range.first;
@@ -87,6 +168,9 @@ void CmdLineTest() {
 
     assert(wstring(L"ba") == GetUserPrefix(cmdLine));
     assert(wstring(L"") == GetSuggestedSuffix(cmdLine));
+    assert((vector<wstring>{ wstring(L"foo") }) == GetPrecedingWords(cmdLine));
+    assert(GetPrecedingWords(CmdLineCreate(wstring(L"  ab"), 4, -1, 0)).empty());
+    assert((vector<wstring>{ wstring(L"git"), wstring(L"fetch") }) == GetPrecedingWords(CmdLineCreate(wstring(L" git  fetch "), 12, -1, 0)));
 
     ReplaceUserPrefix(cmdLine, wstring(L"ijk"));
     assert(wstring(L"foo ijk baz") == cmdLine.line);
@@ -111,5 +195,28 @@ void CmdLineTest() {
     assert(7 == cmdLine.curPos);
     assert(-1 == cmdLine.selectionStart);
     assert(-1 == cmdLine.selectionEnd);
+
+    {
+        CmdLine cmdLine = CmdLineCreate(wstring(L"git diff fe..ma x...y ..z"), 25, -1, 0);
+        assert((vector<wstring>{ L"git", L"diff", L"fe..ma", L"x...y", L"..z" }) == GetWords(cmdLine));
+        vector<CmdLineToken> tokens = GetTokens(cmdLine);
+        assert(7 == tokens.size());
+        assert(9 == tokens[2].start && 11 == tokens[2].end && 2 == tokens[2].word);
+        assert(13 == tokens[3].start && 15 == tokens[3].end && 2 == tokens[3].word);
+        assert(16 == tokens[4].start && 17 == tokens[4].end);
+        assert(20 == tokens[5].start && 21 == tokens[5].end && 3 == tokens[5].word);
+        assert(24 == tokens[6].start && 25 == tokens[6].end && 4 == tokens[6].word);
+
+        ReplaceToken(cmdLine, tokens[3], wstring(L"master"));
+        ReplaceToken(cmdLine, tokens[2], wstring(L"feature/x"));
+        assert(wstring(L"git diff feature/x..master x...y ..z") == cmdLine.line);
+        assert(36 == cmdLine.curPos);
+
+        cmdLine.curPos = 10; // in "feature/x"
+        CmdLineToken replaced = { 9, 18, 2 };
+        ReplaceToken(cmdLine, replaced, wstring(L"fe"));
+        assert(wstring(L"git diff fe..master x...y ..z") == cmdLine.line);
+        assert(11 == cmdLine.curPos);
+    }
 }
 #endif
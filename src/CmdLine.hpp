@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 typedef struct tCmdLine {
     std::wstring line;
@@ -14,10 +15,36 @@ std::wstring GetUserPrefix(const CmdLine &cmdLine);
 
 std::wstring GetSuggestedSuffix(const CmdLine &cmdLine);
 
+/** Whitespace separated words before the user prefix. */
+std::vector<std::wstring> GetPrecedingWords(const CmdLine &cmdLine);
+
+/** All whitespace separated words of the line. */
+std::vector<std::wstring> GetWords(const CmdLine &cmdLine);
+
+/** A part of a word, e.g. "a" and "b" of the revision range "a..b". */
+typedef struct tCmdLineToken {
+    int start, end;
+    size_t word; // index of the word in GetWords
+} CmdLineToken;
+
+/** Non-empty parts of all words, words are split by ".." and "...". */
+std::vector<CmdLineToken> GetTokens(const CmdLine &cmdLine);
+
+/**
+ * The text after the token is shifted, so several tokens are replaced from right to left.
+ * The cursor stays after the token if it was in or after it, the selection is dropped.
+ */
+void ReplaceToken(CmdLine &cmdLine, const CmdLineToken &token, const std::wstring &text);
+
 void ReplaceUserPrefix(CmdLine &cmdLine, const std::wstring &newPrefix);
 
+/** The same, but the text is referenced where it is, e.g. in a pool of names. */
+void ReplaceUserPrefix(CmdLine &cmdLine, const wchar_t *newPrefix, size_t length);
+
 void ReplaceSuggestedSuffix(CmdLine &cmdLine, const std::wstring &newSuffix);
 
+void ReplaceSuggestedSuffix(CmdLine &cmdLine, const wchar_t *newSuffix, size_t length);
+
 #ifdef DEBUG
 void CmdLineTest();
 #endif
@@ -0,0 +1,122 @@
+#include "CompletionContext.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "Utils.hpp"
+
+using namespace std;
+
+static bool OneOf(const string &word, const vector<string> &words) {
+    return find(words.begin(), words.end(), word) != words.end();
+}
+
+static bool IsOption(const string &word) {
+    return StartsWith(word, string("-"));
+}
+
+/** Git options which take the next word as their argument. */
+static const vector<string> GIT_OPTIONS_WITH_ARGUMENT = { "-C", "-c", "--git-dir", "--work-tree", "--namespace", "--exec-path" };
+
+static const vector<string> CONFIG_OPTIONS_WITH_ARGUMENT = { "-f", "--file", "--blob", "-t", "--type", "--default" };
+
+static const vector<string> REMOTE_SUBCOMMANDS = {
+    "fetch", "push", "pull",
+};
+
+static const vector<string> STASH_SUBCOMMANDS_OF_ENTRY = {
+    "show", "apply", "pop", "drop",
+};
+
+static const vector<string> REMOTE_SUBCOMMANDS_OF_REMOTE = {
+    "show", "prune", "remove", "rm", "rename", "set-url", "get-url", "set-head", "set-branches", "update",
+};
+
+/** Returns the arguments of the subcommand which are not options, skipping arguments of the listed options. */
+static vector<string> Arguments(vector<string>::const_iterator begin, vector<string>::const_iterator end, const vector<string> &optionsWithArgument) {
+    vector<string> arguments;
+    for (auto it = begin; it != end; ++it) {
+        if (*it == "--") {
+            arguments.insert(arguments.end(), it + 1, end);
+            break;
+        }
+        if (IsOption(*it)) {
+            if (OneOf(*it, optionsWithArgument) && it + 1 != end) {
+                ++it;
+            }
+        } else {
+            arguments.push_back(*it);
+        }
+    }
+    return arguments;
+}
+
+CompletionContext DetectCompletionContext(const vector<string> &words, const string &userPrefix) {
+    if (words.empty() || words[0] != "git" || IsOption(userPrefix)) {
+        return CONTEXT_REFS;
+    }
+
+    auto subcommand = words.begin() + 1;
+    while (subcommand != words.end() && IsOption(*subcommand)) {
+        if (OneOf(*subcommand, GIT_OPTIONS_WITH_ARGUMENT)) {
+            ++subcommand;
+            if (subcommand == words.end()) {
+                return CONTEXT_REFS; // the user prefix is an argument of the option
+            }
+        }
+        ++subcommand;
+    }
+    if (subcommand == words.end()) {
+        return CONTEXT_SUBCOMMANDS;
+    }
+
+    if (OneOf(*subcommand, REMOTE_SUBCOMMANDS)) {
+        return Arguments(subcommand + 1, words.end(), vector<string>()).empty() ? CONTEXT_REMOTES : CONTEXT_REFS;
+    }
+    if (*subcommand == "remote") {
+        vector<string> arguments = Arguments(subcommand + 1, words.end(), vector<string>());
+        return (arguments.size() == 1 && OneOf(arguments[0], REMOTE_SUBCOMMANDS_OF_REMOTE)) ? CONTEXT_REMOTES : CONTEXT_REFS;
+    }
+    if (*subcommand == "stash") {
+        vector<string> arguments = Arguments(subcommand + 1, words.end(), vector<string>());
+        return (arguments.size() == 1 && OneOf(arguments[0], STASH_SUBCOMMANDS_OF_ENTRY)) ? CONTEXT_STASH : CONTEXT_REFS;
+    }
+    if (*subcommand == "config") {
+        return Arguments(subcommand + 1, words.end(), CONFIG_OPTIONS_WITH_ARGUMENT).empty() ? CONTEXT_CONFIG_KEYS : CONTEXT_REFS;
+    }
+    return CONTEXT_REFS;
+}
+
+const char *CompletionContextName(CompletionContext context) {
+    switch (context) {
+        case CONTEXT_REFS:        return "refs";
+        case CONTEXT_REMOTES:     return "remotes";
+        case CONTEXT_CONFIG_KEYS: return "config keys";
+        case CONTEXT_SUBCOMMANDS: return "subcommands";
+        case CONTEXT_STASH:       return "stash entries";
+    }
+    return "?";
+}
+
+#ifdef DEBUG
+void CompletionContextTest() {
+    typedef vector<string> Words;
+    assert(CONTEXT_REFS == DetectCompletionContext(Words{}, string("ma")));
+    assert(CONTEXT_REFS == DetectCompletionContext(Words{ "gco" }, string("ma")));
+    assert(CONTEXT_SUBCOMMANDS == DetectCompletionContext(Words{ "git" }, string("c")));
+    assert(CONTEXT_SUBCOMMANDS == DetectCompletionContext(Words{ "git", "-C", "dir", "--no-pager" }, string("c")));
+    assert(CONTEXT_REFS == DetectCompletionContext(Words{ "git", "-C" }, string("d")));
+    assert(CONTEXT_REFS == DetectCompletionContext(Words{ "git" }, string("--ver")));
+    assert(CONTEXT_REMOTES == DetectCompletionContext(Words{ "git", "fetch" }, string("or")));
+    assert(CONTEXT_REMOTES == DetectCompletionContext(Words{ "git", "push", "-f" }, string("or")));
+    assert(CONTEXT_REFS == DetectCompletionContext(Words{ "git", "push", "origin" }, string("ma")));
+    assert(CONTEXT_REMOTES == DetectCompletionContext(Words{ "git", "remote", "show" }, string("")));
+    assert(CONTEXT_REFS == DetectCompletionContext(Words{ "git", "remote", "add" }, string("")));
+    assert(CONTEXT_CONFIG_KEYS == DetectCompletionContext(Words{ "git", "config", "--global" }, string("user.")));
+    assert(CONTEXT_CONFIG_KEYS == DetectCompletionContext(Words{ "git", "config", "-f", "file" }, string("user.")));
+    assert(CONTEXT_REFS == DetectCompletionContext(Words{ "git", "config", "user.name" }, string("")));
+    assert(CONTEXT_REFS == DetectCompletionContext(Words{ "git", "checkout" }, string("ma")));
+    assert(CONTEXT_STASH == DetectCompletionContext(Words{ "git", "stash", "pop", "--index" }, string("")));
+    assert(CONTEXT_REFS == DetectCompletionContext(Words{ "git", "stash", "push" }, string("")));
+}
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// What is completed depends on the words before the user prefix:
+//
+//   git fetch <remote>, git push <remote>, git remote show <remote>
+//   git config <key>
+//   git stash show <stash entry> (also apply, pop, drop)
+//   git <alias>
+//   anything else <ref>
+
+typedef enum tCompletionContext {
+    CONTEXT_REFS,
+    CONTEXT_REMOTES,
+    CONTEXT_CONFIG_KEYS,
+    CONTEXT_SUBCOMMANDS,
+    CONTEXT_STASH,
+} CompletionContext;
+
+CompletionContext DetectCompletionContext(const std::vector<std::string> &precedingWords, const std::string &userPrefix);
+
+const char *CompletionContextName(CompletionContext context);
+
+#ifdef DEBUG
+void CompletionContextTest();
+#endif
@@ -0,0 +1,202 @@
+#include "CompletionSource.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+#include "Log.hpp"
+
+using namespace std;
+
+static const double OBSERVATION_WEIGHT = 0.3;
+
+static double MicrosSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+}
+
+SourceStats SourceStatsCreate() {
+    SourceStats stats = { 0, 0, 0, 0 };
+    return stats;
+}
+
+static void ObserveQuery(SourceStats *stats, size_t count, double micros) {
+    if (stats == nullptr) {
+        return;
+    }
+    stats->queries++;
+    stats->lastCount = count;
+    stats->queryMicros = (stats->queryMicros == 0) ? micros : (stats->queryMicros * (1 - OBSERVATION_WEIGHT) + micros * OBSERVATION_WEIGHT);
+}
+
+vector<CompletionSource> ApplicableSources(vector<CompletionSource> sources, const SourceRequest &request) {
+    sources.erase(remove_if(sources.begin(), sources.end(), [&request](const CompletionSource &source) -> bool {
+        return !source.applicable(request);
+    }), sources.end());
+    return sources;
+}
+
+vector<string> MergeSortedLists(const vector<vector<string>> &lists) {
+    // (list, position) of the current head of every list, the smallest head is on the top.
+    typedef pair<size_t, size_t> Head;
+    auto greater = [&lists](const Head &x, const Head &y) -> bool {
+        return lists[y.first][y.second] < lists[x.first][x.second];
+    };
+    priority_queue<Head, vector<Head>, decltype(greater)> heads(greater);
+    size_t total = 0;
+    for (size_t i = 0; i < lists.size(); ++i) {
+        assert(is_sorted(lists[i].begin(), lists[i].end()));
+        if (!lists[i].empty()) {
+            heads.push(Head(i, 0));
+        }
+        total += lists[i].size();
+    }
+
+    vector<string> merged;
+    merged.reserve(total);
+    while (!heads.empty()) {
+        Head head = heads.top();
+        heads.pop();
+        const string &item = lists[head.first][head.second];
+        if (merged.empty() || merged.back() != item) {
+            merged.push_back(item);
+        }
+        if (head.second + 1 < lists[head.first].size()) {
+            heads.push(Head(head.first, head.second + 1));
+        }
+    }
+    return merged;
+}
+
+/** Results of one source, shared by the querying thread and the waiting one. */
+typedef struct tSourceRun {
+    vector<string> result;
+    double micros;
+    bool done;
+} SourceRun;
+
+vector<string> QuerySources(const vector<CompletionSource> &sources, const SourceRequest &request, chrono::milliseconds deadline) {
+    if (sources.size() == 1) {
+        const CompletionSource &source = sources[0];
+        atomic<bool> cancelled(false);
+        vector<string> result;
+        auto start = chrono::steady_clock::now();
+        source.query(request, cancelled, result);
+        ObserveQuery(source.stats, result.size(), MicrosSince(start));
+        LOG("Source " << source.name.c_str() << ": " << result.size() << " candidates");
+        return result;
+    }
+
+    mutex lock;
+    condition_variable finished;
+    atomic<bool> cancelled(false);
+    vector<SourceRun> runs(sources.size(), SourceRun{ vector<string>(), 0, false });
+    vector<thread> threads;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        threads.push_back(thread([&, i]() {
+            vector<string> result;
+            auto start = chrono::steady_clock::now();
+            sources[i].query(request, cancelled, result);
+            double micros = MicrosSince(start);
+            lock_guard<mutex> guard(lock);
+            runs[i].result.swap(result);
+            runs[i].micros = micros;
+            runs[i].done = true;
+            finished.notify_all();
+        }));
+    }
+
+    // Late results are dropped even if they arrive before the threads are joined.
+    vector<bool> inTime(sources.size(), false);
+    {
+        unique_lock<mutex> guard(lock);
+        finished.wait_until(guard, chrono::steady_clock::now() + deadline, [&runs]() -> bool {
+            return all_of(runs.begin(), runs.end(), [](const SourceRun &run) -> bool { return run.done; });
+        });
+        transform(runs.begin(), runs.end(), inTime.begin(), [](const SourceRun &run) -> bool { return run.done; });
+    }
+    cancelled = true;
+    for_each(threads.begin(), threads.end(), [](thread &t) { t.join(); });
+
+    // Sources may log too, so nothing is logged while they run.
+    vector<vector<string>> results;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (inTime[i]) {
+            ObserveQuery(sources[i].stats, runs[i].result.size(), runs[i].micros);
+            LOG("Source " << sources[i].name.c_str() << ": " << runs[i].result.size() << " candidates in " << (size_t)runs[i].micros << " us");
+            results.push_back(move(runs[i].result));
+        } else {
+            if (sources[i].stats != nullptr) {
+                sources[i].stats->timeouts++;
+            }
+            LOG("Source " << sources[i].name.c_str() << " missed the deadline");
+        }
+    }
+
+    return MergeSortedLists(results);
+}
+
+double BenchmarkSource(const CompletionSource &source, const SourceRequest &request, size_t repetitions) {
+    assert(repetitions > 0);
+    atomic<bool> cancelled(false);
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < repetitions; ++i) {
+        vector<string> result;
+        source.query(request, cancelled, result);
+    }
+    return MicrosSince(start) / repetitions;
+}
+
+#ifdef DEBUG
+static CompletionSource FixedSource(const string &name, CompletionContext context, const vector<string> &names, chrono::milliseconds delay, SourceStats *stats) {
+    CompletionSource source;
+    source.name = name;
+    source.applicable = [context](const SourceRequest &request) -> bool {
+        return request.context == context;
+    };
+    source.query = [names, delay](const SourceRequest &, const atomic<bool> &cancelled, vector<string> &result) {
+        auto until = chrono::steady_clock::now() + delay;
+        while (chrono::steady_clock::now() < until && !cancelled) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        result.insert(result.end(), names.begin(), names.end());
+    };
+    source.stats = stats;
+    return source;
+}
+
+void CompletionSourceTest() {
+    assert((vector<string>{ "a", "b", "c", "d", "e" }) == MergeSortedLists(vector<vector<string>>{
+        { "b", "d" }, {}, { "a", "b", "c", "e" }, { "d" } }));
+    assert(MergeSortedLists(vector<vector<string>>()).empty());
+
+    SourceStats fastStats = SourceStatsCreate();
+    SourceStats slowStats = SourceStatsCreate();
+    SourceStats otherStats = SourceStatsCreate();
+    vector<CompletionSource> sources = {
+        FixedSource("fast", CONTEXT_REFS, { "master", "stash@{0}" }, chrono::milliseconds(0), &fastStats),
+        FixedSource("slow", CONTEXT_REFS, { "feature", "master" }, chrono::milliseconds(20), &slowStats),
+        FixedSource("other", CONTEXT_REMOTES, { "origin" }, chrono::milliseconds(0), &otherStats),
+    };
+    SourceRequest request = { CONTEXT_REFS, vector<string>{ "git", "show" }, string("") };
+    vector<CompletionSource> applicable = ApplicableSources(sources, request);
+    assert(2 == applicable.size());
+
+    assert((vector<string>{ "feature", "master", "stash@{0}" }) == QuerySources(applicable, request, chrono::milliseconds(5000)));
+    assert(1 == fastStats.queries && 1 == slowStats.queries && 0 == otherStats.queries);
+    assert(2 == slowStats.lastCount && slowStats.queryMicros > 0);
+
+    // the slow source is cancelled and its results are dropped
+    assert((vector<string>{ "master", "stash@{0}" }) == QuerySources(applicable, request, chrono::milliseconds(1)));
+    assert(1 == slowStats.timeouts && 1 == slowStats.queries && 2 == fastStats.queries);
+
+    SourceRequest remotes = { CONTEXT_REMOTES, vector<string>{ "git", "fetch" }, string("o") };
+    assert((vector<string>{ "origin" }) == QuerySources(ApplicableSources(sources, remotes), remotes, chrono::milliseconds(1)));
+
+    assert(BenchmarkSource(sources[1], request, 2) >= 20000);
+    assert(1 == slowStats.queries);
+}
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "CompletionContext.hpp"
+
+// Federated completion: every kind of names (refs, stash entries, remotes, config keys, ...)
+// has its own source with its own cache, but the user sees one list.
+//
+// Applicable sources are queried concurrently with a shared deadline, their sorted results are
+// merged by a k-way merge, and then the merged list is completed as a snapshot of refs
+// (so the common prefix is computed across all sources).
+
+/** What is being completed, it is copied to the threads of sources. */
+typedef struct tSourceRequest {
+    CompletionContext context;
+    std::vector<std::string> precedingWords;
+    std::string currentPrefix;
+} SourceRequest;
+
+/** Observed costs of a source, in microseconds. */
+typedef struct tSourceStats {
+    size_t queries;
+    size_t timeouts;     // queries whose results were dropped because of the deadline
+    size_t lastCount;
+    double queryMicros;  // moving average
+} SourceStats;
+
+SourceStats SourceStatsCreate();
+
+typedef struct tCompletionSource {
+    std::string name;
+    std::function<bool (const SourceRequest &request)> applicable;
+    /**
+     * Appends sorted unique candidates for the user prefix. Candidates may be a superset of matched
+     * names, the final matching is done on the merged list. Runs on its own thread while the
+     * main thread waits, so it should check cancelled in long loops.
+     */
+    std::function<void (const SourceRequest &request, const std::atomic<bool> &cancelled, std::vector<std::string> &result)> query;
+    SourceStats *stats; // lives longer than the source, e.g. per repository
+} CompletionSource;
+
+/** Sources which are applicable to the request, the others are dropped (a temporary list is not copied). */
+std::vector<CompletionSource> ApplicableSources(std::vector<CompletionSource> sources, const SourceRequest &request);
+
+/** Merges sorted lists into one sorted list without duplicates. */
+std::vector<std::string> MergeSortedLists(const std::vector<std::vector<std::string>> &lists);
+
+/**
+ * Queries sources concurrently (a single source is queried on the calling thread) and merges results.
+ * Results of sources which miss the deadline are dropped, the sources are cancelled and joined.
+ */
+std::vector<std::string> QuerySources(const std::vector<CompletionSource> &sources, const SourceRequest &request, std::chrono::milliseconds deadline);
+
+/** Average time of the query in microseconds, statistics of the source are not touched. */
+double BenchmarkSource(const CompletionSource &source, const SourceRequest &request, size_t repetitions);
+
+#ifdef DEBUG
+void CompletionSourceTest();
+#endif
@@ -0,0 +1,289 @@
+#include "Files.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Utils.hpp"
+
+using namespace std;
+
+static atomic<unsigned> temporaryCount(0);
+
+/** Temporary file of one writer: processes and threads which replace the same file never share it. */
+static string TemporaryPath(const string &path) {
+#ifdef _WIN32
+    unsigned long process = GetCurrentProcessId();
+#else
+    unsigned long process = (unsigned long)getpid();
+#endif
+    return path + "." + to_string(process) + "." + to_string(++temporaryCount) + ".tmp";
+}
+
+#ifdef _WIN32
+FileStamp StampFile(const string &path) {
+    FileStamp stamp = { path, false, 0, 0 };
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (GetFileAttributesExW(mb2w(path).c_str(), GetFileExInfoStandard, &data)) {
+        stamp.exists = true;
+        stamp.modified = ((int64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+        stamp.size = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? 0 : (((int64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow);
+    }
+    return stamp;
+}
+
+size_t ListDir(const string &dir, vector<string> &dirs, vector<string> *files) {
+    size_t count = 0;
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileW(mb2w(dir + "/*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    do {
+        wstring name(data.cFileName);
+        if (name == L"." || name == L"..") {
+            continue;
+        }
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            dirs.push_back(w2mb(name));
+        } else {
+            if (files != nullptr) {
+                files->push_back(w2mb(name));
+            }
+            count++;
+        }
+    } while (FindNextFileW(find, &data));
+    FindClose(find);
+    return count;
+}
+
+bool ReadFileFrom(const string &path, int64_t offset, string &contents) {
+    HANDLE file = CreateFileW(mb2w(path).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER position;
+    position.QuadPart = offset;
+    if (offset != 0 && !SetFilePointerEx(file, position, nullptr, FILE_BEGIN)) {
+        CloseHandle(file);
+        return false;
+    }
+    contents.clear();
+    char buffer[64 * 1024];
+    DWORD read = 0;
+    while (ReadFile(file, buffer, sizeof(buffer), &read, nullptr) && read > 0) {
+        contents.append(buffer, read);
+    }
+    CloseHandle(file);
+    return true;
+}
+
+bool WriteFileContents(const string &path, const string &contents) {
+    string temporary = TemporaryPath(path);
+    HANDLE file = CreateFileW(mb2w(temporary).c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    DWORD written = 0;
+    bool ok = contents.empty() || (WriteFile(file, contents.data(), (DWORD)contents.length(), &written, nullptr) && written == contents.length());
+    CloseHandle(file);
+    if (!ok || !MoveFileExW(mb2w(temporary).c_str(), mb2w(path).c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileW(mb2w(temporary).c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool CreateDir(const string &path) {
+    return CreateDirectoryW(mb2w(path).c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+string EnvironmentVariable(const string &name) {
+    wstring wideName = mb2w(name);
+    DWORD size = GetEnvironmentVariableW(wideName.c_str(), nullptr, 0);
+    if (size == 0) {
+        return string("");
+    }
+    wstring value(size, L'\0');
+    DWORD length = GetEnvironmentVariableW(wideName.c_str(), &value[0], size);
+    return (length > 0 && length < size) ? w2mb(value.substr(0, length)) : string("");
+}
+
+string HomeDir() {
+    // the same order as in Git for Windows
+    string home = EnvironmentVariable("HOME");
+    return home.empty() ? EnvironmentVariable("USERPROFILE") : home;
+}
+
+static const char PATH_SEPARATOR = ';';
+#else
+FileStamp StampFile(const string &path) {
+    FileStamp stamp = { path, false, 0, 0 };
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        stamp.exists = true;
+#ifdef __linux__
+        stamp.modified = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+        stamp.modified = (int64_t)st.st_mtime;
+#endif
+        stamp.size = S_ISDIR(st.st_mode) ? 0 : (int64_t)st.st_size;
+    }
+    return stamp;
+}
+
+size_t ListDir(const string &dir, vector<string> &dirs, vector<string> *files) {
+    size_t count = 0;
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+        return 0;
+    }
+    while (struct dirent *entry = readdir(d)) {
+        string name(entry->d_name);
+        if (name == "." || name == "..") {
+            continue;
+        }
+        struct stat st;
+        if (stat((dir + "/" + name).c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            dirs.push_back(name);
+        } else {
+            if (files != nullptr) {
+                files->push_back(name);
+            }
+            count++;
+        }
+    }
+    closedir(d);
+    return count;
+}
+
+bool ReadFileFrom(const string &path, int64_t offset, string &contents) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    if (offset != 0 && fseeko(file, (off_t)offset, SEEK_SET) != 0) {
+        fclose(file);
+        return false;
+    }
+    contents.clear();
+    char buffer[64 * 1024];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, read);
+    }
+    fclose(file);
+    return true;
+}
+
+bool WriteFileContents(const string &path, const string &contents) {
+    string temporary = TemporaryPath(path);
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = fwrite(contents.data(), 1, contents.length(), file) == contents.length();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool CreateDir(const string &path) {
+    return mkdir(path.c_str(), 0777) == 0 || errno == EEXIST;
+}
+
+string EnvironmentVariable(const string &name) {
+    const char *value = getenv(name.c_str());
+    return (value != nullptr) ? string(value) : string("");
+}
+
+string HomeDir() {
+    return EnvironmentVariable("HOME");
+}
+
+static const char PATH_SEPARATOR = ':';
+#endif
+
+bool ReadFileContents(const string &path, string &contents) {
+    return ReadFileFrom(path, 0, contents);
+}
+
+bool CreateDirs(const string &path) {
+    // Parents first, a drive ("C:") or the root is never created.
+    for (size_t i = 1; i < path.length(); ++i) {
+        if ((path[i] == '/' || path[i] == '\\') && path[i - 1] != ':' && path[i - 1] != '/' && path[i - 1] != '\\') {
+            if (!CreateDir(path.substr(0, i))) {
+                return false;
+            }
+        }
+    }
+    return CreateDir(path);
+}
+
+vector<string> SearchPathDirs() {
+    return SplitPathList(EnvironmentVariable("PATH"));
+}
+
+vector<string> SplitPathList(const string &path) {
+    vector<string> dirs;
+    size_t start = 0;
+    while (start <= path.length()) {
+        size_t end = path.find(PATH_SEPARATOR, start);
+        if (end == string::npos) {
+            end = path.length();
+        }
+        string dir = path.substr(start, end - start);
+        if (dir.length() >= 2 && dir.front() == '"' && dir.back() == '"') {
+            dir = dir.substr(1, dir.length() - 2);
+        }
+        if (!dir.empty() && find(dirs.begin(), dirs.end(), dir) == dirs.end()) {
+            dirs.push_back(dir);
+        }
+        start = end + 1;
+    }
+    return dirs;
+}
+
+bool StampsUnchanged(const vector<FileStamp> &stamps) {
+    for (auto it = stamps.begin(); it != stamps.end(); ++it) {
+        FileStamp stamp = StampFile(it->path);
+        if (stamp.exists != it->exists || stamp.modified != it->modified || stamp.size != it->size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef DEBUG
+void FilesTest() {
+    FileStamp missing = StampFile(string("surely/not/existing/file"));
+    assert(!missing.exists);
+    assert(StampsUnchanged(vector<FileStamp>{ missing }));
+
+    string contents("untouched");
+    assert(!ReadFileContents(string("surely/not/existing/file"), contents));
+    assert(string("untouched") == contents);
+
+    assert(!WriteFileContents(string("surely/not/existing/file"), contents));
+    string temporary = TemporaryPath(string("file"));
+    assert(temporary != TemporaryPath(string("file")) && temporary.compare(0, 5, "file.") == 0);
+    assert(!ReadFileFrom(string("surely/not/existing/file"), 10, contents));
+
+    vector<string> dirs = SplitPathList(string("a") + PATH_SEPARATOR + "\"b c\"" + PATH_SEPARATOR + PATH_SEPARATOR + "a");
+    assert((vector<string>{ string("a"), string("b c") }) == dirs);
+}
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Small portable layer over the file system.
+// Paths are in UTF-8 like the paths returned by libgit2, "/" is accepted as a separator everywhere.
+
+typedef struct tFileStamp {
+    std::string path;
+    bool exists;
+    int64_t modified; // in file system specific units
+    int64_t size;
+} FileStamp;
+
+FileStamp StampFile(const std::string &path);
+
+/** Returns true if every file still has its stamp (size of directories is not compared). */
+bool StampsUnchanged(const std::vector<FileStamp> &stamps);
+
+/** Appends names of subdirectories to dirs and returns the number of other entries, also appended to files if it is not null. */
+size_t ListDir(const std::string &dir, std::vector<std::string> &dirs, std::vector<std::string> *files = nullptr);
+
+bool ReadFileContents(const std::string &path, std::string &contents);
+
+/** Reads the file from the byte offset to its end, e.g. the part appended since the last read. */
+bool ReadFileFrom(const std::string &path, int64_t offset, std::string &contents);
+
+/** Replaces the file at once: the contents are written to a temporary file which is then renamed. */
+bool WriteFileContents(const std::string &path, const std::string &contents);
+
+/** Creates the directory and its missing parents, returns true if it exists then. */
+bool CreateDirs(const std::string &path);
+
+/** Empty string if the variable is not set. */
+std::string EnvironmentVariable(const std::string &name);
+
+/** The directory which "~" means for git, or empty string. */
+std::string HomeDir();
+
+/** Directories of the PATH environment variable in their order. */
+std::vector<std::string> SearchPathDirs();
+
+/** Splits a list of paths like PATH (quoted items are unquoted, empty and repeated ones are dropped). */
+std::vector<std::string> SplitPathList(const std::string &list);
+
+#ifdef DEBUG
+void FilesTest();
+#endif
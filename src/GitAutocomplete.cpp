@@ -16,6 +16,31 @@
 #include "Logic.hpp"
 #include "Trie.hpp"
 #include "Utils.hpp"
+#include "RefsFilter.hpp"
+#include "RefsTree.hpp"
+#include "RefStream.hpp"
+#include "RefsLoader.hpp"
+#include "RefsDialog.h"
+#include "RefFiles.hpp"
+#include "RefsSnapshot.hpp"
+#include "RefsPlan.hpp"
+#include "Files.hpp"
+#include "GitConfig.hpp"
+#include "CompletionContext.hpp"
+#include "Unicode.hpp"
+#include "CompletionSource.hpp"
+#include "SeenRefs.hpp"
+#include "LocalRefs.hpp"
+#include "Arena.hpp"
+#include "ShellHistory.hpp"
+#include "MultiPrefix.hpp"
+#include "NumericRefs.hpp"
+#include "RefBitmap.hpp"
+#include "RefTable.hpp"
+#include "RefQuery.hpp"
+#include "RefPacking.hpp"
+#include "Speculation.hpp"
+#include "Subcommands.hpp"
 
 using namespace std;
 
@@ -39,7 +64,7 @@ void WINAPI GetGlobalInfoW(struct GlobalInfo *GInfo) {
 #else
     logFile = new wostream(nullptr);
 #endif
-    *logFile << "I am started" << endl;
+    LOG("I am started");
     // TODO: add time
 
     git_libgit2_init();
@@ -49,14 +74,41 @@ void WINAPI GetGlobalInfoW(struct GlobalInfo *GInfo) {
     trie_test();
     CmdLineTest();
     LogicTest();
+    RefsFilterTest();
+    RefsTreeTest();
+    RefStreamTest();
+    RefsLoaderTest();
+    RefFilesTest();
+    RefsSnapshotTest();
+    RefsPlanTest();
+    FilesTest();
+    GitConfigTest();
+    CompletionContextTest();
+    UnicodeTest();
+    CompletionSourceTest();
+    SeenRefsTest();
+    LocalRefsTest();
+    ArenaTest();
+    ShellHistoryTest();
+    MultiPrefixTest();
+    NumericRefsTest();
+    RefBitmapTest();
+    RefTableTest();
+    RefQueryTest();
+    RefPackingTest();
+    SpeculationTest();
+    SubcommandsTest();
 #endif
 
 }
 
 void WINAPI ExitFARW(const struct ExitInfo *EInfo) {
+    StopSubcommandsRefresh();
+    StopRefPacking();
+    StopSpeculation();
     git_libgit2_shutdown();
 
-    *logFile << L"I am closed" << endl;
+    LOG(L"I am closed");
 #ifdef DEBUG
     dynamic_cast<wofstream*>(logFile)->close();
 #endif
@@ -69,18 +121,39 @@ const wchar_t *GetMsg(int MsgId) {
 
 static const wchar_t *OPT_SHOW_DIALOG = L"ShowDialog";
 static const wchar_t *OPT_STRIP_REMOTE_NAME = L"StripRemoteName";
+static const wchar_t *OPT_SHOW_REFS_TREE = L"ShowRefsTree";
+static const wchar_t *OPT_LOCALE_ORDER = L"LocaleOrder";
+static const wchar_t *OPT_NEW_REFS_FIRST = L"NewRefsFirst";
+static const wchar_t *OPT_LOCAL_REMOTE_REFS = L"LocalRemoteRefs";
+static const wchar_t *OPT_HISTORY_RANK = L"HistoryRank";
+static const wchar_t *OPT_ALL_REF_TOKENS = L"AllRefTokens";
+static const wchar_t *OPT_PACK_LOOSE_REFS = L"PackLooseRefs";
 
 static void LoadGlobalOptionsFromPluginSettings() {
     PluginSettings settings(MainGuid, Info.SettingsControl);
     globalOptions.showDialog = settings.Get(0, OPT_SHOW_DIALOG, true);
     globalOptions.stripRemoteName = settings.Get(0, OPT_STRIP_REMOTE_NAME, true);
     globalOptions.suggestNextSuffix = true; // it is always true in global options
+    globalOptions.showRefsTree = settings.Get(0, OPT_SHOW_REFS_TREE, false);
+    globalOptions.localeOrder = settings.Get(0, OPT_LOCALE_ORDER, false);
+    globalOptions.newRefsFirst = settings.Get(0, OPT_NEW_REFS_FIRST, false);
+    globalOptions.localRemoteRefs = settings.Get(0, OPT_LOCAL_REMOTE_REFS, false);
+    globalOptions.historyRank = settings.Get(0, OPT_HISTORY_RANK, false);
+    globalOptions.allRefTokens = settings.Get(0, OPT_ALL_REF_TOKENS, false);
+    globalOptions.packLooseRefs = settings.Get(0, OPT_PACK_LOOSE_REFS, false);
 }
 
 static void StoreGlobalOptionsToPluginSettings() {
     PluginSettings settings(MainGuid, Info.SettingsControl);
     settings.Set(0, OPT_SHOW_DIALOG, globalOptions.showDialog);
     settings.Set(0, OPT_STRIP_REMOTE_NAME, globalOptions.stripRemoteName);
+    settings.Set(0, OPT_SHOW_REFS_TREE, globalOptions.showRefsTree);
+    settings.Set(0, OPT_LOCALE_ORDER, globalOptions.localeOrder);
+    settings.Set(0, OPT_NEW_REFS_FIRST, globalOptions.newRefsFirst);
+    settings.Set(0, OPT_LOCAL_REMOTE_REFS, globalOptions.localRemoteRefs);
+    settings.Set(0, OPT_HISTORY_RANK, globalOptions.historyRank);
+    settings.Set(0, OPT_ALL_REF_TOKENS, globalOptions.allRefTokens);
+    settings.Set(0, OPT_PACK_LOOSE_REFS, globalOptions.packLooseRefs);
 }
 
 void WINAPI SetStartupInfoW(const struct PluginStartupInfo *psi) {
@@ -94,6 +167,13 @@ intptr_t WINAPI ConfigureW(const ConfigureInfo* CfgInfo) {
 
     Builder.AddCheckbox(MShowDialog, &globalOptions.showDialog);
     Builder.AddCheckbox(MStripRemoteName, &globalOptions.stripRemoteName);
+    Builder.AddCheckbox(MShowRefsTree, &globalOptions.showRefsTree);
+    Builder.AddCheckbox(MLocaleOrder, &globalOptions.localeOrder);
+    Builder.AddCheckbox(MNewRefsFirst, &globalOptions.newRefsFirst);
+    Builder.AddCheckbox(MLocalRemoteRefs, &globalOptions.localRemoteRefs);
+    Builder.AddCheckbox(MHistoryRank, &globalOptions.historyRank);
+    Builder.AddCheckbox(MAllRefTokens, &globalOptions.allRefTokens);
+    Builder.AddCheckbox(MPackLooseRefs, &globalOptions.packLooseRefs);
 
     Builder.AddOKCancel(MOk, MCancel);
 
@@ -157,7 +237,7 @@ static wstring GetActivePanelDir() {
     Info.PanelControl(PANEL_ACTIVE, FCTL_GETPANELDIRECTORY, fpdSize, dir);
 
     if (wcslen(dir->File) != 0) {
-        *logFile << "GetActivePanelDir, FCTL_GETPANELDIRECTORY()->File = " << dir->File << endl;
+        LOG("GetActivePanelDir, FCTL_GETPANELDIRECTORY()->File = " << dir->File);
         return wstring(L"");
     }
 
@@ -175,10 +255,40 @@ static void ParseOption(Options &options, const wstring &str) {
         options.stripRemoteName = true;
     } else if (wstring(L"FullRemoteName") == str) {
         options.stripRemoteName = false;
+    } else if (wstring(L"RefsTree") == str) {
+        options.showRefsTree = true;
+    } else if (wstring(L"RefsList") == str) {
+        options.showRefsTree = false;
+    } else if (wstring(L"LocaleOrder") == str) {
+        options.localeOrder = true;
+    } else if (wstring(L"CodePointOrder") == str) {
+        options.localeOrder = false;
+    } else if (wstring(L"NewRefsFirst") == str) {
+        options.newRefsFirst = true;
+    } else if (wstring(L"NewRefsInPlace") == str) {
+        options.newRefsFirst = false;
+    } else if (wstring(L"LocalRemoteRefs") == str) {
+        options.localRemoteRefs = true;
+    } else if (wstring(L"FetchedRefsOnly") == str) {
+        options.localRemoteRefs = false;
+    } else if (wstring(L"HistoryRank") == str) {
+        options.historyRank = true;
+    } else if (wstring(L"NoHistoryRank") == str) {
+        options.historyRank = false;
+    } else if (wstring(L"AllRefTokens") == str) {
+        options.allRefTokens = true;
+    } else if (wstring(L"CursorRefToken") == str) {
+        options.allRefTokens = false;
+    } else if (wstring(L"PackLooseRefs") == str) {
+        options.packLooseRefs = true;
+    } else if (wstring(L"KeepLooseRefs") == str) {
+        options.packLooseRefs = false;
     } else if (wstring(L"ShowPreviousInlineSuggestion") == str) {
         options.suggestNextSuffix = false;
+    } else if (str.compare(0, 6, L"Query=") == 0) {
+        options.query = w2mb(str.substr(6));
     } else {
-        *logFile << "Unknown option \"" << str << "\"" << endl;
+        LOG("Unknown option \"" << str << "\"");
     }
 }
 
@@ -186,7 +296,7 @@ static void ParseOptionsFromMacro(Options &options, OpenMacroInfo *MInfo) {
     for (size_t i = 0; i < MInfo->Count; i++) {
         FarMacroValue value = MInfo->Values[i];
         if (value.Type != FMVT_STRING) {
-            *logFile << "Unexpected macro argument of type " << value.Type << endl;
+            LOG("Unexpected macro argument of type " << value.Type);
             continue;
         }
         ParseOption(options, wstring(value.String));
@@ -194,64 +304,80 @@ static void ParseOptionsFromMacro(Options &options, OpenMacroInfo *MInfo) {
 }
 
 HANDLE WINAPI OpenW(const struct OpenInfo *OInfo) {
-    *logFile << "=====================================================" << endl;
+    LOG("=====================================================");
 
     Options options = globalOptions;
     switch (OInfo->OpenFrom) {
         case OPEN_PLUGINSMENU:
-            *logFile << "I am opened from plugins menu" << endl;
+            LOG("I am opened from plugins menu");
             break;
 
         case OPEN_FROMMACRO: {
             // To record such macro: Ctrl + .; a; Ctrl + Shift + .; <hotkey>; enter one of following:
             // Plugin.Call("89DF1D5B-F5BB-415B-993D-D34C5FFE049F", "SuggestionsDialog", "ShortRemoteName", "SortByName")
             // Plugin.Call("89DF1D5B-F5BB-415B-993D-D34C5FFE049F", "InlineSuggestions", "FullRemoteName", "SortByTime")
-            *logFile << "I am opened from macro" << endl;
+            LOG("I am opened from macro");
             ParseOptionsFromMacro(options, (OpenMacroInfo*)OInfo->Data);
             break;
         }
 
         default:
-            *logFile << "OpenW, bad OpenFrom" << endl;
+            LOG("OpenW, bad OpenFrom");
             return INVALID_HANDLE_VALUE;
     }
-    *logFile << "options: "
+    LOG("options: "
         << "showDialog = " << options.showDialog << " "
         << "stripRemoteName = " << options.stripRemoteName << " "
-        << "suggestNextSuffix = " << options.suggestNextSuffix << endl;
+        << "suggestNextSuffix = " << options.suggestNextSuffix << " "
+        << "showRefsTree = " << options.showRefsTree << " "
+        << "localeOrder = " << options.localeOrder << " "
+        << "newRefsFirst = " << options.newRefsFirst << " "
+        << "localRemoteRefs = " << options.localRemoteRefs << " "
+        << "historyRank = " << options.historyRank << " "
+        << "allRefTokens = " << options.allRefTokens << " "
+        << "packLooseRefs = " << options.packLooseRefs << " "
+        << "query = \"" << options.query.c_str() << "\"");
 
     wstring curDir = GetActivePanelDir();
     if (curDir.empty()) {
-        *logFile << "Bad current dir" << endl;
+        LOG("Bad current dir");
         return nullptr;
     }
-    *logFile << "curDir = " << curDir.c_str() << endl;
+    LOG("curDir = " << curDir.c_str());
 
     git_repository *repo = OpenGitRepo(curDir);
     if (repo == nullptr) {
-        *logFile << "Git repo is not opened" << endl;
+        LOG("Git repo is not opened");
         return nullptr;
     }
 
     CmdLine cmdLine = GetCmdLine();
 
-    *logFile << "Before transformation:" << endl;
-    *logFile << "cmdLine = \"" << cmdLine.line.c_str() << "\"" << endl;
-    *logFile << "cursor pos = " << cmdLine.curPos << endl;
-    *logFile << "selection start = " << cmdLine.selectionStart << endl;
-    *logFile << "selection end   = " << cmdLine.selectionEnd << endl;
+    LOG("Before transformation:");
+    LOG("cmdLine = \"" << cmdLine.line.c_str() << "\"");
+    LOG("cursor pos = " << cmdLine.curPos);
+    LOG("selection start = " << cmdLine.selectionStart);
+    LOG("selection end   = " << cmdLine.selectionEnd);
 
     TransformCmdLine(options, cmdLine, repo);
     git_repository_free(repo);
 
-    *logFile << "After transformation:" << endl;
-    *logFile << "cmdLine = \"" << cmdLine.line.c_str() << "\"" << endl;
-    *logFile << "cursor pos = " << cmdLine.curPos << endl;
-    *logFile << "selection start = " << cmdLine.selectionStart << endl;
-    *logFile << "selection end   = " << cmdLine.selectionEnd << endl;
+    LOG("After transformation:");
+    LOG("cmdLine = \"" << cmdLine.line.c_str() << "\"");
+    LOG("cursor pos = " << cmdLine.curPos);
+    LOG("selection start = " << cmdLine.selectionStart);
+    LOG("selection end   = " << cmdLine.selectionEnd);
 
     SetCmdLine(cmdLine);
 
     return nullptr;
 }
 
+intptr_t WINAPI ProcessSynchroEventW(const struct ProcessSynchroEventInfo *SInfo) {
+    if (SInfo->Event == SE_COMMONSYNCHRO) {
+        // refs are loaded in the background for the opened dialog
+        ProcessRefsDialogSynchro();
+    }
+    return 0;
+}
+
@@ -3,8 +3,8 @@
 #include <fstream>
 #include <plugin.hpp>
 
-extern struct PluginStartupInfo Info;
+#include "Log.hpp"
 
-extern std::wostream *logFile;
+extern struct PluginStartupInfo Info;
 
 const wchar_t *GetMsg(int MsgId);
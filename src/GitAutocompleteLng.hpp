@@ -3,7 +3,16 @@ enum {
 
   MShowDialog,
   MStripRemoteName,
+  MShowRefsTree,
+  MLocaleOrder,
+  MNewRefsFirst,
+  MLocalRemoteRefs,
+  MHistoryRank,
+  MAllRefTokens,
+  MPackLooseRefs,
 
   MOk,
   MCancel,
+
+  MLoading,
 };
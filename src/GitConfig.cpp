@@ -0,0 +1,405 @@
+#include "GitConfig.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+
+#include "Utils.hpp"
+
+using namespace std;
+
+// The same limit as in git, it also stops include cycles.
+static const int MAX_INCLUDE_DEPTH = 10;
+
+static bool IsKeyChar(char c) {
+    return isalnum((unsigned char)c) || c == '-';
+}
+
+static bool IsBlank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+/** p points after "[", section gets "name" or "name.subsection". */
+static bool ParseSectionHeader(const char *&p, string &section) {
+    string name;
+    while (IsKeyChar(*p) || *p == '.') {
+        name += (char)tolower((unsigned char)*(p++));
+    }
+    if (name.empty()) {
+        return false;
+    }
+
+    if (IsBlank(*p)) {
+        while (IsBlank(*p)) {
+            p++;
+        }
+        if (*(p++) != '"') {
+            return false;
+        }
+        string subsection;
+        while (*p != '"') {
+            if (*p == '\\') {
+                p++;
+            }
+            if (*p == '\0' || *p == '\n') {
+                return false;
+            }
+            subsection += *(p++);
+        }
+        p++;
+        name += "." + subsection;
+    }
+
+    if (*(p++) != ']') {
+        return false;
+    }
+    section = name;
+    return true;
+}
+
+/** p points after "=", stops at the end of the line. */
+static bool ParseValue(const char *&p, string &value) {
+    while (IsBlank(*p)) {
+        p++;
+    }
+    bool quoted = false;
+    size_t significantLength = 0; // trailing blanks outside of quotes are dropped
+    for (;;) {
+        char c = *p;
+        if (c == '\0' || c == '\n') {
+            break;
+        }
+        if (!quoted && (c == '#' || c == ';')) {
+            while (*p != '\0' && *p != '\n') {
+                p++;
+            }
+            break;
+        }
+        p++;
+        if (c == '\\') {
+            char escaped = *(p++);
+            switch (escaped) {
+                case '\n': continue; // the value continues on the next line
+                case 't':  value += '\t'; break;
+                case 'b':  value += '\b'; break;
+                case 'n':  value += '\n'; break;
+                case '\\': value += '\\'; break;
+                case '"':  value += '"'; break;
+                default:   return false;
+            }
+        } else if (c == '"') {
+            quoted = !quoted;
+        } else {
+            value += c;
+            if (quoted || !IsBlank(c)) {
+                significantLength = value.length();
+            }
+            continue;
+        }
+        significantLength = value.length();
+    }
+    value.resize(significantLength);
+    return !quoted;
+}
+
+bool ParseConfigText(const string &rawText, vector<ConfigEntry> &entries) {
+    string text;
+    text.reserve(rawText.length());
+    size_t start = StartsWith(rawText, string("\xEF\xBB\xBF")) ? 3 : 0;
+    for (size_t i = start; i < rawText.length(); ++i) {
+        if (rawText[i] != '\r' || i + 1 >= rawText.length() || rawText[i + 1] != '\n') {
+            text += rawText[i];
+        }
+    }
+
+    const char *p = text.c_str();
+    string section;
+    for (;;) {
+        while (IsBlank(*p) || *p == '\n') {
+            p++;
+        }
+        char c = *p;
+        if (c == '\0') {
+            return true;
+        } else if (c == '#' || c == ';') {
+            while (*p != '\0' && *p != '\n') {
+                p++;
+            }
+        } else if (c == '[') {
+            p++;
+            if (!ParseSectionHeader(p, section)) {
+                return false;
+            }
+        } else if (isalpha((unsigned char)c) && !section.empty()) {
+            ConfigEntry entry;
+            entry.key = section + ".";
+            while (IsKeyChar(*p)) {
+                entry.key += (char)tolower((unsigned char)*(p++));
+            }
+            while (IsBlank(*p)) {
+                p++;
+            }
+            if (*p == '=') {
+                p++;
+                if (!ParseValue(p, entry.value)) {
+                    return false;
+                }
+            } else if (*p == '\0' || *p == '\n' || *p == '#' || *p == ';') {
+                entry.value = "true"; // a key without value is a true boolean
+            } else {
+                return false;
+            }
+            entries.push_back(entry);
+        } else {
+            return false;
+        }
+    }
+}
+
+static bool CharsEqual(char x, char y, bool ignoreCase) {
+    return ignoreCase ? tolower((unsigned char)x) == tolower((unsigned char)y) : x == y;
+}
+
+static bool PathMatches(const char *p, const char *s, bool ignoreCase) {
+    while (*p != '\0') {
+        if (p[0] == '*' && p[1] == '*') {
+            const char *rest = p + 2;
+            if (*rest == '/') {
+                // "**/" matches zero or more whole directories
+                rest++;
+                if (PathMatches(rest, s, ignoreCase)) {
+                    return true;
+                }
+                for (const char *t = s; *t != '\0'; ++t) {
+                    if (*t == '/' && PathMatches(rest, t + 1, ignoreCase)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            for (const char *t = s; ; ++t) {
+                if (PathMatches(rest, t, ignoreCase)) {
+                    return true;
+                }
+                if (*t == '\0') {
+                    return false;
+                }
+            }
+        }
+        if (*p == '*') {
+            p++;
+            for (const char *t = s; ; ++t) {
+                if (PathMatches(p, t, ignoreCase)) {
+                    return true;
+                }
+                if (*t == '\0' || *t == '/') {
+                    return false;
+                }
+            }
+        }
+        if (*s == '\0') {
+            return false;
+        }
+        if (*p == '?') {
+            if (*s == '/') {
+                return false;
+            }
+        } else if (!CharsEqual(*p, *s, ignoreCase)) {
+            return false;
+        }
+        p++;
+        s++;
+    }
+    return *s == '\0';
+}
+
+static string WithSlashes(string path) {
+    replace(path.begin(), path.end(), '\\', '/');
+    return path;
+}
+
+bool ConfigPathMatches(const string &pattern, const string &path, bool ignoreCase) {
+    return PathMatches(WithSlashes(pattern).c_str(), WithSlashes(path).c_str(), ignoreCase);
+}
+
+static bool IsAbsolutePath(const string &path) {
+    return StartsWith(path, string("/")) || StartsWith(path, string("\\"))
+        || (path.length() >= 2 && isalpha((unsigned char)path[0]) && path[1] == ':');
+}
+
+/** The directory of the file with a trailing slash. */
+static string DirName(const string &path) {
+    size_t slash = path.find_last_of("/\\");
+    return (slash == string::npos) ? string("") : path.substr(0, slash + 1);
+}
+
+static string ReadCurrentBranch(const string &headFile) {
+    string head;
+    if (headFile.empty() || !ReadFileContents(headFile, head)) {
+        return string("");
+    }
+    string prefix("ref: refs/heads/");
+    if (!StartsWith(head, prefix)) {
+        return string(""); // detached HEAD
+    }
+    size_t end = head.find_first_of("\r\n");
+    return head.substr(prefix.length(), (end == string::npos) ? string::npos : end - prefix.length());
+}
+
+static bool IncludeConditionHolds(GitConfig &config, const string &condition, const string &configPath) {
+    bool ignoreCase = StartsWith(condition, string("gitdir/i:"));
+    if (ignoreCase || StartsWith(condition, string("gitdir:"))) {
+        string pattern = condition.substr(condition.find(':') + 1);
+        if (StartsWith(pattern, string("~/"))) {
+            pattern = config.sources.home + pattern.substr(1);
+        } else if (StartsWith(pattern, string("./"))) {
+            pattern = DirName(configPath) + pattern.substr(2);
+        } else if (!IsAbsolutePath(pattern)) {
+            pattern = "**/" + pattern;
+        }
+        if (!pattern.empty() && pattern.back() == '/') {
+            pattern += "**";
+        }
+        string gitDir = config.sources.gitDir;
+        if (!gitDir.empty() && (gitDir.back() == '/' || gitDir.back() == '\\')) {
+            gitDir.pop_back();
+        }
+        return ConfigPathMatches(pattern, gitDir, ignoreCase);
+    }
+
+    if (StartsWith(condition, string("onbranch:"))) {
+        config.dependsOnBranch = true;
+        string pattern = condition.substr(9);
+        if (!pattern.empty() && pattern.back() == '/') {
+            pattern += "**";
+        }
+        return !config.branch.empty() && ConfigPathMatches(pattern, config.branch, false);
+    }
+
+    return false; // unknown conditions never hold, as in git
+}
+
+static void LoadConfigFile(GitConfig &config, const string &path, int depth) {
+    config.stamps.push_back(StampFile(path));
+    string text;
+    if (!ReadFileContents(path, text)) {
+        return;
+    }
+    vector<ConfigEntry> entries;
+    ParseConfigText(text, entries);
+
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        config.entries.push_back(*it);
+
+        const string &key = it->key;
+        string includePath;
+        if (key == "include.path") {
+            includePath = it->value;
+        } else if (StartsWith(key, string("includeif.")) && key.length() > 15 && key.compare(key.length() - 5, 5, ".path") == 0) {
+            string condition = key.substr(10, key.length() - 15);
+            if (IncludeConditionHolds(config, condition, path)) {
+                includePath = it->value;
+            }
+        }
+        if (includePath.empty() || depth >= MAX_INCLUDE_DEPTH) {
+            continue;
+        }
+
+        if (StartsWith(includePath, string("~/"))) {
+            if (config.sources.home.empty()) {
+                continue;
+            }
+            includePath = config.sources.home + includePath.substr(1);
+        } else if (!IsAbsolutePath(includePath)) {
+            includePath = DirName(path) + includePath;
+        }
+        // entries of the included file follow the include
+        LoadConfigFile(config, includePath, depth + 1);
+    }
+}
+
+static void SortUnique(vector<string> &items) {
+    sort(items.begin(), items.end());
+    items.erase(unique(items.begin(), items.end()), items.end());
+}
+
+GitConfig LoadGitConfig(const GitConfigSources &sources) {
+    GitConfig config;
+    config.sources = sources;
+    config.dependsOnBranch = false;
+    config.branch = ReadCurrentBranch(sources.headFile);
+    for (auto it = sources.files.begin(); it != sources.files.end(); ++it) {
+        LoadConfigFile(config, *it, 0);
+    }
+
+    for (auto it = config.entries.begin(); it != config.entries.end(); ++it) {
+        const string &key = it->key;
+        config.keys.push_back(key);
+        size_t lastDot = key.rfind('.');
+        if (StartsWith(key, string("remote.")) && lastDot > 7) {
+            config.remotes.push_back(key.substr(7, lastDot - 7));
+        }
+        if (StartsWith(key, string("alias.")) && lastDot == 5) {
+            config.aliases.push_back(key.substr(6));
+        }
+    }
+    SortUnique(config.keys);
+    SortUnique(config.remotes);
+    SortUnique(config.aliases);
+    return config;
+}
+
+bool GitConfigUnchanged(const GitConfig &config) {
+    if (!StampsUnchanged(config.stamps)) {
+        return false;
+    }
+    return !config.dependsOnBranch || ReadCurrentBranch(config.sources.headFile) == config.branch;
+}
+
+#ifdef DEBUG
+void GitConfigTest() {
+    {
+        vector<ConfigEntry> entries;
+        string text =
+            "# comment\r\n"
+            "[core]\r\n"
+            "\tEditor = \"vim -f\"  ; comment\r\n"
+            "\tbare\r\n"
+            "[remote \"Origin\"]\n"
+            "    url = https://example.com/repo.git\n"
+            "[alias]\n"
+            "    co = checkout\n"
+            "    lg = log \\\n"
+            "         --oneline # comment\n"
+            "[Branch.master] remote = origin\n";
+        assert(ParseConfigText(text, entries));
+        assert(6 == entries.size());
+        assert(string("core.editor") == entries[0].key && string("vim -f") == entries[0].value);
+        assert(string("core.bare") == entries[1].key && string("true") == entries[1].value);
+        assert(string("remote.Origin.url") == entries[2].key);
+        assert(string("alias.lg") == entries[4].key && (string("log ") + string(9, ' ') + "--oneline") == entries[4].value);
+        assert(string("branch.master.remote") == entries[5].key && string("origin") == entries[5].value);
+    }
+    {
+        vector<ConfigEntry> entries;
+        assert(!ParseConfigText(string("[core]\nname = \"unterminated\n[next]\n"), entries));
+        assert(!ParseConfigText(string("key = outside of sections\n"), entries));
+    }
+
+    assert(ConfigPathMatches(string("**/work/**"), string("/home/me/work/project/.git"), false));
+    assert(ConfigPathMatches(string("/home/*/work/**"), string("/home/me/work/project/.git"), false));
+    assert(!ConfigPathMatches(string("/home/*/work/**"), string("/home/me/other/work/project/.git"), false));
+    assert(ConfigPathMatches(string("C:/Work/**"), string("c:\\work\\project\\.git"), true));
+    assert(!ConfigPathMatches(string("C:/Work/**"), string("c:/work/project/.git"), false));
+    assert(ConfigPathMatches(string("feature/**"), string("feature/a/b"), false));
+    assert(ConfigPathMatches(string("**/.git"), string(".git"), false));
+
+    {
+        GitConfigSources sources;
+        sources.files = { string("surely/not/existing/config") };
+        GitConfig config = LoadGitConfig(sources);
+        assert(config.entries.empty() && 1 == config.stamps.size());
+        assert(GitConfigUnchanged(config));
+    }
+}
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Files.hpp"
+
+// Parsed git configuration of a repository: system, global, repository and worktree files
+// with all their include and includeIf chains.
+// It is parsed once and is reused while the stamps of all files of the chains are unchanged.
+
+typedef struct tConfigEntry {
+    std::string key;   // "section.subsection.name", section and name are lowercased
+    std::string value;
+} ConfigEntry;
+
+typedef struct tGitConfigSources {
+    std::vector<std::string> files; // in the order of precedence, the last one wins
+    std::string gitDir;             // for "gitdir:" conditions
+    std::string headFile;           // for "onbranch:" conditions
+    std::string home;               // for "~/" in paths
+} GitConfigSources;
+
+typedef struct tGitConfig {
+    GitConfigSources sources;
+    std::vector<ConfigEntry> entries;
+    std::vector<FileStamp> stamps;  // every file of the chains, including missing ones
+    bool dependsOnBranch;
+    std::string branch;             // the branch "onbranch:" conditions were evaluated for
+
+    // sorted and unique
+    std::vector<std::string> keys;
+    std::vector<std::string> remotes;
+    std::vector<std::string> aliases;
+} GitConfig;
+
+/** Parses text of a config file, returns false on a syntax error (entries before it are kept). */
+bool ParseConfigText(const std::string &text, std::vector<ConfigEntry> &entries);
+
+GitConfig LoadGitConfig(const GitConfigSources &sources);
+
+/** Returns false if any file of the chains or the branch (if it matters) has changed. */
+bool GitConfigUnchanged(const GitConfig &config);
+
+/** Matches git's wildmatch with "**" for whole path components. */
+bool ConfigPathMatches(const std::string &pattern, const std::string &path, bool ignoreCase);
+
+#ifdef DEBUG
+void GitConfigTest();
+#endif
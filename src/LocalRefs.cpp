@@ -0,0 +1,284 @@
+#include "LocalRefs.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+
+#include "Files.hpp"
+#include "Utils.hpp"
+
+using namespace std;
+
+static bool IsAbsolutePath(const string &path) {
+    return StartsWith(path, string("/")) || StartsWith(path, string("\\"))
+        || (path.length() >= 2 && isalpha((unsigned char)path[0]) && path[1] == ':');
+}
+
+static string WithTrailingSlash(const string &path) {
+    if (path.empty() || path.back() == '/' || path.back() == '\\') {
+        return path;
+    }
+    return path + "/";
+}
+
+static string WithoutTrailingSlashes(string path) {
+    while (path.length() > 1 && (path.back() == '/' || path.back() == '\\')) {
+        path.pop_back();
+    }
+    return path;
+}
+
+static string ResolvePath(const string &path, const string &baseDir) {
+    return IsAbsolutePath(path) ? path : WithTrailingSlash(baseDir) + path;
+}
+
+/** The first line without the line break and trailing blanks. */
+static string FirstLine(const string &text) {
+    string line = text.substr(0, text.find('\n'));
+    while (!line.empty() && isspace((unsigned char)line.back())) {
+        line.pop_back();
+    }
+    return line;
+}
+
+string LocalUrlPath(const string &url) {
+    static const string FILE_SCHEME("file://");
+    if (StartsWith(url, FILE_SCHEME)) {
+        string path = url.substr(FILE_SCHEME.length());
+        // "file:///C:/repo" on Windows
+        if (path.length() >= 3 && path[0] == '/' && isalpha((unsigned char)path[1]) && path[2] == ':') {
+            path.erase(0, 1);
+        }
+        return path;
+    }
+    if (url.empty() || url.find("://") != string::npos) {
+        return string("");
+    }
+    if (IsAbsolutePath(url)) {
+        return url;
+    }
+    // "host:path" is an scp-like URL unless a slash comes before the colon
+    size_t colon = url.find(':');
+    size_t slash = url.find_first_of("/\\");
+    if (colon != string::npos && (slash == string::npos || colon < slash)) {
+        return string("");
+    }
+    return url;
+}
+
+string LocalGitDir(const string &path) {
+    string dir = WithTrailingSlash(WithoutTrailingSlashes(path));
+    if (dir.empty()) {
+        return string("");
+    }
+
+    // a bare repository, or a git dir itself
+    if (StampFile(dir + "HEAD").exists && StampFile(dir + "refs").exists) {
+        return dir;
+    }
+
+    string dotGit = dir + ".git";
+    if (StampFile(dotGit + "/HEAD").exists) {
+        return dotGit + "/";
+    }
+
+    // ".git" of a linked worktree or of a submodule is a file: "gitdir: <path>"
+    string link;
+    if (!ReadFileContents(dotGit, link) || !StartsWith(link, string("gitdir: "))) {
+        return string("");
+    }
+    string linked = WithTrailingSlash(ResolvePath(FirstLine(link.substr(8)), dir));
+    // Refs of a linked worktree are stored in the common dir.
+    string common;
+    if (ReadFileContents(linked + "commondir", common)) {
+        linked = WithTrailingSlash(ResolvePath(FirstLine(common), linked));
+    }
+    return StampFile(linked + "HEAD").exists ? linked : string("");
+}
+
+/** "/srv/project.git/" and "/home/me/project/.git/" are both named "project". */
+static string RepoDirName(const string &gitDir) {
+    string dir = WithoutTrailingSlashes(gitDir);
+    size_t slash = dir.find_last_of("/\\");
+    if (slash != string::npos && dir.substr(slash + 1) == ".git") {
+        dir.erase(slash);
+        slash = dir.find_last_of("/\\");
+    }
+    string name = (slash == string::npos) ? dir : dir.substr(slash + 1);
+    if (name.length() > 4 && name.compare(name.length() - 4, 4, ".git") == 0) {
+        name.erase(name.length() - 4);
+    }
+    return name;
+}
+
+vector<LocalRepo> FindLocalRepos(const vector<pair<string, string>> &remoteUrls, const string &baseDir, const string &gitDir) {
+    vector<LocalRepo> repos;
+    auto add = [&repos](const string &name, const string &repoGitDir) {
+        if (repoGitDir.empty()) {
+            return;
+        }
+        bool known = any_of(repos.begin(), repos.end(), [&repoGitDir](const LocalRepo &repo) -> bool {
+            return repo.gitDir == repoGitDir;
+        });
+        if (!known) {
+            repos.push_back(LocalRepo{ name, repoGitDir });
+        }
+    };
+
+    for (auto it = remoteUrls.begin(); it != remoteUrls.end(); ++it) {
+        string path = LocalUrlPath(it->second);
+        if (!path.empty()) {
+            add(it->first, LocalGitDir(ResolvePath(path, baseDir)));
+        }
+    }
+
+    // Every line is an objects dir of another repository, relative ones are relative to our objects dir.
+    string objectsDir = gitDir + "objects/";
+    string alternates;
+    if (ReadFileContents(objectsDir + "info/alternates", alternates)) {
+        size_t begin = 0;
+        while (begin < alternates.length()) {
+            size_t end = alternates.find('\n', begin);
+            if (end == string::npos) {
+                end = alternates.length();
+            }
+            string line = FirstLine(alternates.substr(begin, end - begin));
+            begin = end + 1;
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            string objects = WithoutTrailingSlashes(ResolvePath(line, objectsDir));
+            size_t slash = objects.find_last_of("/\\");
+            if (slash == string::npos) {
+                continue;
+            }
+            string repoGitDir = LocalGitDir(objects.substr(0, slash + 1));
+            add(RepoDirName(repoGitDir), repoGitDir);
+        }
+    }
+    return repos;
+}
+
+void ParsePackedRefs(const string &text, const vector<string> &namespaces, vector<string> &fullNames) {
+    size_t begin = 0;
+    while (begin < text.length()) {
+        size_t end = text.find('\n', begin);
+        if (end == string::npos) {
+            end = text.length();
+        }
+        // "<oid> <name>", comments start with "#", peeled tags start with "^"
+        size_t space = text.find(' ', begin);
+        if (text[begin] != '#' && text[begin] != '^' && space != string::npos && space < end) {
+            size_t nameEnd = end;
+            if (nameEnd > space + 1 && text[nameEnd - 1] == '\r') {
+                nameEnd--;
+            }
+            string name = text.substr(space + 1, nameEnd - space - 1);
+            bool known = any_of(namespaces.begin(), namespaces.end(), [&name](const string &prefix) -> bool {
+                return StartsWith(name, prefix) && name.length() > prefix.length();
+            });
+            if (known) {
+                fullNames.push_back(name);
+            }
+        }
+        begin = end + 1;
+    }
+}
+
+/** Appends names of the loose refs under the directory, e.g. "refs/heads". */
+static void ListLooseRefs(const string &gitDir, const string &refsDir, vector<string> &fullNames) {
+    vector<string> pending = { refsDir };
+    while (!pending.empty()) {
+        string dir = pending.back();
+        pending.pop_back();
+
+        vector<string> subdirs;
+        vector<string> files;
+        ListDir(gitDir + dir, subdirs, &files);
+        for (auto it = files.begin(); it != files.end(); ++it) {
+            // a ref which is being updated right now keeps its old value in the loose file
+            bool lock = it->length() > 5 && it->compare(it->length() - 5, 5, ".lock") == 0;
+            if (!lock) {
+                fullNames.push_back(dir + "/" + *it);
+            }
+        }
+        for (auto it = subdirs.begin(); it != subdirs.end(); ++it) {
+            pending.push_back(dir + "/" + *it);
+        }
+    }
+}
+
+vector<string> ReadRefFiles(const string &gitDir, const vector<string> &namespaces) {
+    vector<string> fullNames;
+    string packed;
+    if (ReadFileContents(gitDir + "packed-refs", packed)) {
+        ParsePackedRefs(packed, namespaces, fullNames);
+    }
+    for (auto it = namespaces.begin(); it != namespaces.end(); ++it) {
+        assert(!it->empty() && it->back() == '/');
+        ListLooseRefs(gitDir, it->substr(0, it->length() - 1), fullNames);
+    }
+    sort(fullNames.begin(), fullNames.end());
+    fullNames.erase(unique(fullNames.begin(), fullNames.end()), fullNames.end());
+    return fullNames;
+}
+
+const vector<string> &CachedLocalBranches(LocalBranches &cache, const string &gitDir) {
+    if (!cache.fingerprint.stamps.empty() && RefFilesUnchanged(cache.fingerprint)) {
+        return cache.fullNames;
+    }
+
+    // The survey goes first: if refs change while they are read, the next fingerprint differs.
+    cache.fingerprint = SurveyRefFiles(gitDir).fingerprint;
+    cache.fullNames = ReadRefFiles(gitDir, vector<string>{ string("refs/heads/") });
+    return cache.fullNames;
+}
+
+string AsRemoteBranch(const LocalRepo &repo, const string &fullName) {
+    static const string BRANCHES("refs/heads/");
+    assert(StartsWith(fullName, BRANCHES));
+    return "refs/remotes/" + repo.name + "/" + fullName.substr(BRANCHES.length());
+}
+
+#ifdef DEBUG
+void LocalRefsTest() {
+    assert(string("/srv/mirrors/project.git") == LocalUrlPath(string("/srv/mirrors/project.git")));
+    assert(string("../sibling") == LocalUrlPath(string("../sibling")));
+    assert(string("C:\\repos\\x") == LocalUrlPath(string("C:\\repos\\x")));
+    assert(string("/srv/x") == LocalUrlPath(string("file:///srv/x")));
+    assert(string("C:/repos/x") == LocalUrlPath(string("file:///C:/repos/x")));
+    assert(string("") == LocalUrlPath(string("https://example.com/x.git")));
+    assert(string("") == LocalUrlPath(string("git@example.com:x.git")));
+    assert(string("") == LocalUrlPath(string("")));
+
+    assert(string("") == LocalGitDir(string("surely/not/existing")));
+    assert(string("project") == RepoDirName(string("/srv/project.git/")));
+    assert(string("project") == RepoDirName(string("/home/me/project/.git/")));
+
+    vector<LocalRepo> repos = FindLocalRepos({ make_pair(string("mirror"), string("surely/not/existing")) },
+        string("/"), string("surely/not/existing/.git/"));
+    assert(repos.empty());
+
+    vector<string> names;
+    string packed(
+        "# pack-refs with: peeled fully-peeled sorted \n"
+        "0123456789012345678901234567890123456789 refs/heads/master\n"
+        "0123456789012345678901234567890123456789 refs/remotes/origin/master\n"
+        "0123456789012345678901234567890123456789 refs/tags/v1\n"
+        "^0123456789012345678901234567890123456789\n"
+        "0123456789012345678901234567890123456789 refs/heads/feature/x\r\n"
+        "0123456789012345678901234567890123456789 refs/heads/");
+    ParsePackedRefs(packed, vector<string>{ string("refs/heads/") }, names);
+    assert((vector<string>{ string("refs/heads/master"), string("refs/heads/feature/x") }) == names);
+    names.clear();
+    ParsePackedRefs(packed, vector<string>{ string("refs/tags/"), string("refs/remotes/") }, names);
+    assert((vector<string>{ string("refs/remotes/origin/master"), string("refs/tags/v1") }) == names);
+    assert(ReadRefFiles(string("surely/not/existing/.git/"), vector<string>{ string("refs/heads/") }).empty());
+
+    LocalRepo mirror = { string("mirror"), string("/srv/mirror.git/") };
+    assert(string("refs/remotes/mirror/feature/x") == AsRemoteBranch(mirror, string("refs/heads/feature/x")));
+
+    LocalBranches cache;
+    assert(CachedLocalBranches(cache, string("surely/not/existing/.git/")).empty());
+}
+#endif
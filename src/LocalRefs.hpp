@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "RefFiles.hpp"
+
+// Branches of repositories on the same machine which are not fetched yet:
+// remotes whose URL is a local path (a mirror or a sibling checkout) and alternates of the object store.
+//
+// Their "packed-refs" and loose refs are read directly, without libgit2 and without a fetch,
+// and are reread only when the fingerprint of their ref files changes.
+
+typedef struct tLocalRepo {
+    std::string name;   // name of the remote, or the directory name of an alternate
+    std::string gitDir; // with a trailing slash
+} LocalRepo;
+
+typedef struct tLocalBranches {
+    RefFilesFingerprint fingerprint;
+    std::vector<std::string> fullNames; // "refs/heads/...", sorted and unique
+} LocalBranches;
+
+/** Returns the path of a URL which points to this machine ("/srv/x.git", "../x", "file:///x"), or empty string. */
+std::string LocalUrlPath(const std::string &url);
+
+/**
+ * Git dir (with a trailing slash) of a bare repository or of a checkout (its ".git" may be a "gitdir:" file),
+ * or empty string if the path is not a repository.
+ */
+std::string LocalGitDir(const std::string &path);
+
+/**
+ * Repositories of remotes (pairs of the name and the first URL) with local URLs,
+ * relative URLs are resolved against baseDir; then repositories of "objects/info/alternates" of gitDir.
+ * Every repository is listed once.
+ */
+std::vector<LocalRepo> FindLocalRepos(const std::vector<std::pair<std::string, std::string>> &remoteUrls,
+    const std::string &baseDir, const std::string &gitDir);
+
+/** Appends names of the refs of the namespaces ("refs/heads/", ...) listed in the text of "packed-refs". */
+void ParsePackedRefs(const std::string &text, const std::vector<std::string> &namespaces, std::vector<std::string> &fullNames);
+
+/** Full names of the refs of the namespaces from "packed-refs" and loose ref files, sorted and unique. */
+std::vector<std::string> ReadRefFiles(const std::string &gitDir, const std::vector<std::string> &namespaces);
+
+/** Rereads branches of the repository only if its ref files have changed since they were read into cache. */
+const std::vector<std::string> &CachedLocalBranches(LocalBranches &cache, const std::string &gitDir);
+
+/** "refs/heads/x" of the repository becomes "refs/remotes/<name>/x", as if it was fetched. */
+std::string AsRemoteBranch(const LocalRepo &repo, const std::string &fullName);
+
+#ifdef DEBUG
+void LocalRefsTest();
+#endif
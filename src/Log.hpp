@@ -0,0 +1,20 @@
+#pragma once
+
+#include <mutex>
+#include <ostream>
+
+// The log is written by the main thread and by background threads,
+// so it is written only by LOG, a line at a time under the lock.
+
+extern std::wostream *logFile;
+
+inline std::mutex &LogLock() {
+    static std::mutex lock;
+    return lock;
+}
+
+/** Writes the items and the end of line, e.g. LOG("Plan: " << description.c_str()). */
+#define LOG(...) do { \
+    std::lock_guard<std::mutex> logGuard(LogLock()); \
+    *logFile << __VA_ARGS__ << std::endl; \
+} while (false)
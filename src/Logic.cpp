@@ -2,12 +2,35 @@
 
 #include <cassert>
 #include <algorithm>
+#include <chrono>
+#include <ctime>
 #include <functional>
+#include <map>
+#include <memory>
+#include <thread>
 #include <vector>
 
 #include "GitAutocomplete.hpp"
 #include "Utils.hpp"
-#include "Trie.hpp"
+#include "RefStream.hpp"
+#include "RefsLoader.hpp"
+#include "RefFiles.hpp"
+#include "RefsSnapshot.hpp"
+#include "RefsPlan.hpp"
+#include "GitConfig.hpp"
+#include "CompletionContext.hpp"
+#include "Subcommands.hpp"
+#include "Unicode.hpp"
+#include "CompletionSource.hpp"
+#include "Files.hpp"
+#include "SeenRefs.hpp"
+#include "LocalRefs.hpp"
+#include "ShellHistory.hpp"
+#include "MultiPrefix.hpp"
+#include "NumericRefs.hpp"
+#include "RefQuery.hpp"
+#include "RefPacking.hpp"
+#include "Speculation.hpp"
 #include "RefsDialog.h"
 
 using namespace std;
@@ -15,7 +38,7 @@ using namespace std;
 git_repository* OpenGitRepo(wstring dir) {
     string dirForGit = w2mb(dir);
     if (dirForGit.length() == 0) {
-        *logFile << "Bad dir for Git: " << dir.c_str() << endl;
+        LOG("Bad dir for Git: " << dir.c_str());
         return nullptr;
     }
 
@@ -23,201 +46,1251 @@ git_repository* OpenGitRepo(wstring dir) {
     int error = git_repository_open_ext(&repo, dirForGit.c_str(), 0, nullptr);
     if (error < 0) {
         const git_error *e = giterr_last();
-        *logFile << "libgit2 error " << error << "/" << e->klass << ": " << e->message << endl;
+        LOG("libgit2 error " << error << "/" << e->klass << ": " << e->message);
         return nullptr;
     }
 
     return repo;
 }
 
-static void FilterReferences(const Options &options, const char *ref, function<void (const char *)> filterOneRef) {
-    const char *prefixes[] = { "refs/heads/", "refs/tags/" };
-    for (int i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); ++i) {
-        if (StartsWith(ref, prefixes[i])) {
-            filterOneRef(ref + strlen(prefixes[i]));
-            return;
-        }
+/** Full names of all refs of the repository. */
+static Stream GitRefNames(git_repository *repo) {
+    git_reference_iterator *iter = nullptr;
+    int error = git_reference_iterator_new(&iter, repo);
+    if (error < 0) {
+        const git_error *e = giterr_last();
+        LOG("libgit2 error " << error << "/" << e->klass << ": " << e->message);
+        return EmptyStream();
     }
-    const char *remotePrefix = "refs/remotes/";
-    if (StartsWith(ref, remotePrefix)) {
-        const char *remoteRef = ref + strlen(remotePrefix);
-        filterOneRef(remoteRef);
+    shared_ptr<git_reference_iterator> iterHolder(iter, git_reference_iterator_free);
 
-        if (options.stripRemoteName) {
-            const char *slashPtr = strchr(remoteRef, '/');
-            assert(slashPtr != nullptr);
-            filterOneRef(slashPtr + 1);
+    return [iterHolder](string &refName) -> bool {
+        const char *name;
+        int error = git_reference_next_name(&name, iterHolder.get());
+        if (error == GIT_ITEROVER) {
+            return false;
         }
-        return;
-    }
-    // there are also "refs/stash", "refs/notes"
-    *logFile << "Ignored ref = " << ref << endl;
+        if (error < 0) {
+            const git_error *e = giterr_last();
+            LOG("libgit2 error " << error << "/" << e->klass << ": " << e->message);
+            return false;
+        }
+        refName.assign(name);
+        return true;
+    };
 }
 
-static void ObtainSuitableRefsBy(const Options &options, git_repository *repo, vector<string> &suitableRefs, function<bool (const char *)> isSuitableRef) {
-    git_reference_iterator *iter = NULL;
-    int error = git_reference_iterator_new(&iter, repo);
+/** Everything which is needed to obtain suitable refs, it is passed to the loading thread by value. */
+typedef struct tRefsQuery {
+    Options options;
+    string currentPrefix;
+    string gitDir;
+    QueryPlan plan;
+    shared_ptr<RefsSnapshot> snapshot; // is read by SOURCE_SNAPSHOT, is recorded by the scanning sources
+    bool markNewRefs;                  // false for names which are not refs
+    bool numericOrder;                 // the dialog lists numbered refs ("pull/99/head") by their numbers
+} RefsQuery;
 
-    git_reference *ref;
-    while (!(error = git_reference_next(&ref, iter))) {
-        FilterReferences(options, git_reference_name(ref), [&suitableRefs, isSuitableRef](const char *refName) {
-            if (isSuitableRef(refName)) {
-                suitableRefs.push_back(string(refName));
-            }
-        });
+/** Per-repository statistics, snapshots and parsed config, live while the plugin is loaded. */
+typedef struct tRefCommit {
+    bool valid; // the ref points to a commit, maybe through annotated tags
+    git_oid oid;
+    int64_t time;
+    string authorName;
+    string authorEmail;
+} RefCommit;
+
+static const RefCommit NO_COMMIT = { false };
+
+typedef struct tRepoState {
+    RepoStats stats;
+    shared_ptr<RefsSnapshot> snapshot;
+    shared_ptr<GitConfig> config;
+    FileStamp stashStamp;                 // of the stash reflog, path is empty until it is read
+    vector<string> stashEntries;          // sorted
+    map<string, SourceStats> sourceStats; // by source name
+    map<string, LocalBranches> localBranches; // by git dir of a local remote or an alternate
+    RefFilesFingerprint numericFingerprint; // of the refs in numericRefs, empty until they are indexed
+    NumericIndex numericRefs;
+    QueryStats queryStats;                    // pass rates of the query terms which are checked per ref
+    shared_ptr<RefsSnapshot> commitsSnapshot; // the snapshot whose refs the commits are read for
+    map<string, RefCommit> commits;           // by full name
+    bool pressureReported;                    // many loose refs are reported once until they are packed
+    chrono::steady_clock::time_point packingStart; // of the last packing, the epoch if there was none
+    SpeculationStats speculationStats;        // how often completions were answered in advance
+} RepoState;
+
+static map<string, RepoState> repoStates;
+
+/** Full names are also kept for the dialog, which marks new refs by them without scanning refs again. */
+static Stream ScannedRefNames(const RefsQuery &query, git_repository *repo) {
+    bool keepNames = (query.plan.source == SOURCE_SCAN_AND_SNAPSHOT) || (query.markNewRefs && query.options.showDialog);
+    if (query.plan.source == SOURCE_SCAN_AND_SNAPSHOT) {
+        RefFilesSurvey survey = SurveyRefFiles(query.gitDir);
+        query.snapshot->fingerprint = survey.fingerprint;
+        query.snapshot->looseCount = survey.looseCount;
     }
-    assert(error == GIT_ITEROVER);
+    return RecordingStream(GitRefNames(repo), query.snapshot, keepNames);
 }
 
-static void ObtainSuitableRefsByStrictPrefix(const Options &options, git_repository *repo, string currentPrefix, vector<string> &suitableRefs) {
-    ObtainSuitableRefsBy(options, repo, suitableRefs, [&currentPrefix](const char *refName) -> bool {
+static Stream SuitableRefsByStrictPrefix(const RefsQuery &query, git_repository *repo) {
+    const string &currentPrefix = query.currentPrefix;
+    if (query.plan.source == SOURCE_SNAPSHOT) {
+        RefsSnapshotPrepare(*query.snapshot, query.options.stripRemoteName != 0);
+        return StreamFromSnapshot(query.snapshot, RefsSnapshotPrefixRange(*query.snapshot, currentPrefix));
+    }
+    return FilterStream(ExpandRefNames(ScannedRefNames(query, repo), query.options.stripRemoteName != 0), [currentPrefix](const char *refName) -> bool {
         return StartsWith(refName, currentPrefix.c_str());
     });
 }
 
-/** Returns true for pairs like "cypok/arm/master" with prefix "cy/a/m". */
-static bool RefMayBeEncodedByPartialPrefix(const char *ref, const char *prefix) {
-    const char *p = prefix;
-    const char *r = ref;
-    for (;;) {
-        if (*p == '\0') {
+static Stream SuitableRefsByPartialPrefixes(const RefsQuery &query, git_repository *repo) {
+    const string &currentPrefix = query.currentPrefix;
+    auto predicate = [currentPrefix](const char *refName) -> bool {
+        return RefMayBeEncodedByPartialPrefix(refName, currentPrefix.c_str());
+    };
+    if (query.plan.source == SOURCE_SNAPSHOT) {
+        RefsSnapshotPrepare(*query.snapshot, query.options.stripRemoteName != 0);
+        return FilterStream(StreamFromSnapshot(query.snapshot, RefsSnapshotPartialRange(*query.snapshot, currentPrefix)), predicate);
+    }
+    return FilterStream(ExpandRefNames(ScannedRefNames(query, repo), query.options.stripRemoteName != 0), predicate);
+}
+
+/**
+ * Refs added since the dialog was shown in the repository the last time, the current refs become seen.
+ * Nothing is new when the dialog is shown for the first time.
+ */
+static vector<string> NewRefsSinceLastLook(const RefsSnapshot &snapshot, bool stripRemoteName, const string &gitDir, git_repository *repo) {
+    auto start = chrono::steady_clock::now();
+    vector<string> fullNames;
+    if (snapshot.complete && !snapshot.fullNames.empty()) {
+        fullNames = snapshot.fullNames;
+    } else {
+        Drain(GitRefNames(repo), [&fullNames](const string &name) -> bool {
+            fullNames.push_back(name);
             return true;
-        } else if (ispunct(*p) || isupper(*p)) {
-            r = strchr(r, *p);
-            if (r == nullptr) {
-                return false;
-            }
+        });
+    }
+    if (!is_sorted(fullNames.begin(), fullNames.end())) {
+        sort(fullNames.begin(), fullNames.end());
+    }
+    fullNames.erase(unique(fullNames.begin(), fullNames.end()), fullNames.end());
+
+    vector<string> seen;
+    bool seenBefore = LoadSeenRefs(gitDir, seen);
+    RefsDiff diff = DiffSortedNames(seen, fullNames);
+    if (!seenBefore || !diff.added.empty() || !diff.removed.empty()) {
+        if (!StoreSeenRefs(gitDir, fullNames)) {
+            LOG("Cannot store seen refs");
+        }
+    }
+    LOG("Refs since the last look: " << diff.added.size() << " added, " << diff.removed.size() << " removed in "
+        << (size_t)chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() << " us");
+
+    vector<string> newRefs;
+    if (seenBefore) {
+        CollectSortedUnique(ExpandRefNames(StreamFromVector(diff.added), stripRemoteName), newRefs);
+    }
+    return newRefs;
+}
+
+// Shell histories are shared by all repositories.
+static ShellHistory shellHistory;
+static bool shellHistoryInitialized = false;
+
+/** Ranks by recent git commands of shell histories, only the parts of the files appended since the last time are parsed. */
+static vector<pair<string, double>> ShellHistoryRanks() {
+    if (!shellHistoryInitialized) {
+        ShellHistoryInit(shellHistory, DefaultHistoryFiles());
+        shellHistoryInitialized = true;
+    }
+    auto start = chrono::steady_clock::now();
+    size_t parsed = ShellHistoryScan(shellHistory);
+    LOG("Shell history: " << parsed << " bytes parsed in "
+        << (size_t)chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() << " us, "
+        << shellHistory.commands << " git commands, " << shellHistory.counts.size() << " tokens");
+    return HistoryRanks(shellHistory);
+}
+
+/**
+ * If loader is not null, refs are still being loaded and the dialog takes them as they arrive.
+ * If snapshot is not null, suitable refs are some of its names, so their UTF-16 copies are taken from the snapshot.
+ * If numericOrder is true, numbers in names are ordered by their values.
+ */
+static void ShowDialogAndTransform(const Options &options, CmdLine &cmdLine, const string &currentPrefix, vector<string> &suitableRefs, RefsLoader *loader,
+        const vector<string> &newRefs, shared_ptr<RefsSnapshot> snapshot, bool numericOrder) {
+    string currentSuffix = w2mb(GetSuggestedSuffix(cmdLine));
+    LOG("currentSuffix = \"" << currentSuffix.c_str() << "\"");
+
+    RefsDialogView view;
+    view.treeMode = (loader == nullptr && options.showRefsTree != 0);
+    view.localeOrder = (options.localeOrder != 0);
+    view.numericOrder = numericOrder;
+    view.newRefs = newRefs;
+    view.newRefsFirst = (options.newRefsFirst != 0);
+    if (snapshot) {
+        RefsSnapshotPrepareWide(*snapshot);
+        view.snapshot = snapshot;
+    }
+    if (options.historyRank && !view.treeMode) {
+        view.historyRanks = ShellHistoryRanks();
+    }
+
+    // Yes, we show dialog even if there is only one suitable ref.
+    LOG("Showing dialog...");
+    string selectedRef = (loader != nullptr)
+        ? ShowStreamingRefsDialog(*loader, suitableRefs, currentPrefix + currentSuffix, view)
+        : ShowRefsDialog(suitableRefs, currentPrefix + currentSuffix, view);
+    LOG("Dialog closed, selectedRef = \"" << selectedRef.c_str() << "\"");
+    if (!selectedRef.empty()) {
+        // Use case: we iterate over branches with suggested suffixes
+        // but then we understand that we do not remember branch name
+        // and want to see them as dialog (via extra hotkey).
+        // In this case we should drop last suggested suffix.
+        ReplaceSuggestedSuffix(cmdLine, wstring(L""));
+
+        size_t index = snapshot ? RefsSnapshotFind(*snapshot, selectedRef) : (size_t)-1;
+        if (index != (size_t)-1) {
+            ReplaceUserPrefix(cmdLine, RefsSnapshotWideName(*snapshot, index), RefsSnapshotWideLength(*snapshot, index));
         } else {
-            if (*p != *r) {
-                return false;
-            }
+            ReplaceUserPrefix(cmdLine, mb2w(selectedRef));
         }
+    }
+}
 
-        p++;
-        r++;
+// The dialog with refs which are still being loaded is shown only if loading takes longer than this,
+// otherwise the user sees the complete list at once.
+static const chrono::milliseconds STREAMING_DIALOG_DELAY(200);
+
+/** Runs in the loading thread, which uses its own repository object. */
+static void LoadSuitableRefs(RefsLoader &loader, const RefsQuery query, const string repoPath) {
+    git_repository *repo = nullptr;
+    if (git_repository_open(&repo, repoPath.c_str()) < 0) {
+        RefsLoaderRun(loader, EmptyStream, EmptyStream);
+        return;
     }
+    RefsLoaderRun(loader,
+        [&]() -> Stream { return SuitableRefsByStrictPrefix(query, repo); },
+        [&]() -> Stream { return SuitableRefsByPartialPrefixes(query, repo); });
+    git_repository_free(repo);
 }
 
-static void ObtainSuitableRefsByPartialPrefixes(const Options &options, git_repository *repo, string currentPrefix, vector<string> &suitableRefs) {
-    ObtainSuitableRefsBy(options, repo, suitableRefs, [&currentPrefix](const char *refName) -> bool {
-        return RefMayBeEncodedByPartialPrefix(refName, currentPrefix.c_str());
+/**
+ * The dialog needs all suitable refs, so they are loaded in the background.
+ * Once it is clear that the dialog is going to be shown (refs are matched strictly and have no
+ * common prefix longer than the user prefix), the dialog is opened and refs keep arriving into it.
+ */
+static void TransformCmdLineWithDialog(const RefsQuery &query, CmdLine &cmdLine, git_repository *repo) {
+    const Options &options = query.options;
+    const string &currentPrefix = query.currentPrefix;
+
+    RefsLoader loader;
+    RefsLoaderInit(loader, NotifyRefsDialog);
+    thread loading(LoadSuitableRefs, ref(loader), query, string(git_repository_path(repo)));
+
+    vector<string> suitableRefs;
+    bool strict = true;
+    CommonPrefixFold commonPrefix = CommonPrefixFoldCreate(currentPrefix.length());
+    auto start = chrono::steady_clock::now();
+    bool done = false;
+    bool streaming = false;
+    while (!done && !streaming) {
+        // Nothing but new refs changes the outcome, except the delay once the dialog is certain.
+        if (!options.showRefsTree && strict && CommonPrefixFoldCollapsed(commonPrefix)) {
+            RefsLoaderWaitUntil(loader, start + STREAMING_DIALOG_DELAY);
+        } else {
+            RefsLoaderWait(loader);
+        }
+        size_t firstNewRef = suitableRefs.size();
+        done = RefsLoaderTake(loader, suitableRefs, strict);
+        if (!strict && firstNewRef == 0) {
+            commonPrefix = CommonPrefixFoldCreate(0);
+        }
+        for (size_t i = firstNewRef; i < suitableRefs.size() && !CommonPrefixFoldCollapsed(commonPrefix); ++i) {
+            CommonPrefixFoldAdd(commonPrefix, suitableRefs[i]);
+        }
+        streaming = !done && !options.showRefsTree && strict && CommonPrefixFoldCollapsed(commonPrefix)
+            && chrono::steady_clock::now() - start >= STREAMING_DIALOG_DELAY;
+    }
+
+    // Batches of a presorted source are in order, the loader only drops duplicates.
+    bool sorted = (query.plan.ordering == ORDERING_PRESORTED);
+    if (streaming) {
+        LOG(suitableRefs.size() << " suitable refs so far, showing the dialog while loading");
+        if (!sorted) {
+            sort(suitableRefs.begin(), suitableRefs.end());
+        }
+        // All refs are not known yet, so nothing is marked as new while they are streamed.
+        ShowDialogAndTransform(options, cmdLine, currentPrefix, suitableRefs, &loader, vector<string>(), nullptr, query.numericOrder);
+        RefsLoaderCancel(loader);
+        loading.join();
+        return;
+    }
+    loading.join();
+
+    if (suitableRefs.empty()) {
+        LOG("No suitable refs");
+        return;
+    }
+
+    if (!sorted) {
+        sort(suitableRefs.begin(), suitableRefs.end());
+    }
+    for_each(suitableRefs.begin(), suitableRefs.end(), [](const string &s) {
+        LOG("Suitable ref: " << s.c_str());
     });
+    LOG("Common prefix: " << commonPrefix.prefix.c_str());
+
+    if (commonPrefix.prefix != currentPrefix) {
+        ReplaceUserPrefix(cmdLine, mb2w(commonPrefix.prefix));
+    } else {
+        vector<string> newRefs = query.markNewRefs ? NewRefsSinceLastLook(*query.snapshot, options.stripRemoteName != 0, query.gitDir, repo) : vector<string>();
+        // Names of a single query (not refs) are not worth converting all at once.
+        bool fromSnapshot = (query.plan.source == SOURCE_SNAPSHOT && !query.snapshot->fixedNames);
+        ShowDialogAndTransform(options, cmdLine, currentPrefix, suitableRefs, nullptr, newRefs, fromSnapshot ? query.snapshot : nullptr, query.numericOrder);
+    }
 }
 
-static string FindCommonPrefix(vector<string> &suitableRefs) {
-    Trie *trie = trie_create();
-    for_each(suitableRefs.begin(), suitableRefs.end(), [trie](string s) {
-        trie_add(trie, s);
-    });
-    string maxCommonPrefix = trie_get_common_prefix(trie);
-    trie_free(trie);
-    return maxCommonPrefix;
+static void ApplyInlineSuggestion(CmdLine &cmdLine, const string &currentPrefix, const string &commonPrefix, const string &nextRef) {
+    LOG("Common prefix: " << commonPrefix.c_str());
+
+    if (commonPrefix != currentPrefix) {
+        ReplaceUserPrefix(cmdLine, mb2w(commonPrefix));
+    } else {
+        string newSuffix = DropPrefix(nextRef, currentPrefix);
+        LOG("nextSuffx = \"" << newSuffix.c_str() << "\"");
+        ReplaceSuggestedSuffix(cmdLine, mb2w(newSuffix));
+    }
 }
 
-static string ObtainNextSuggestedSuffix(bool forwardSearch, string currentPrefix, string currentSuffix, vector<string> &suitableRefs) {
-    size_t size = suitableRefs.size();
-    size_t idx = distance(suitableRefs.begin(), find(suitableRefs.begin(), suitableRefs.end(), currentPrefix + currentSuffix));
-    if (idx == size) {
-        idx = forwardSearch ? 0 : (size - 1);
+/** The same as ApplyInlineSuggestion for a strict range of the snapshot, the texts are taken from its UTF-16 pool. */
+static void ApplySnapshotInlineSuggestion(CmdLine &cmdLine, const string &currentPrefix, RefsSnapshot &snapshot, pair<size_t, size_t> range, bool forward, const string &current) {
+    RefsSnapshotPrepareWide(snapshot);
+    const vector<string> &names = snapshot.names;
+    string commonPrefix = SortedRangeCommonPrefix(names, range);
+    LOG("Common prefix: " << commonPrefix.c_str());
+
+    if (commonPrefix != currentPrefix) {
+        ReplaceUserPrefix(cmdLine, RefsSnapshotWideName(snapshot, range.first), WideLength(names[range.first], commonPrefix.length()));
     } else {
-        idx = (idx + (forwardSearch ? 1 : -1) + size) % size;
+        size_t next = SortedRangeNextIndex(names, range, forward, current);
+        LOG("nextSuffx = \"" << names[next].c_str() + currentPrefix.length() << "\"");
+        size_t prefixLength = WideLength(names[next], currentPrefix.length());
+        ReplaceSuggestedSuffix(cmdLine, RefsSnapshotWideName(snapshot, next) + prefixLength, RefsSnapshotWideLength(snapshot, next) - prefixLength);
     }
-    return DropPrefix(suitableRefs[idx], currentPrefix);
 }
 
-void TransformCmdLine(const Options &options, CmdLine &cmdLine, git_repository *repo) {
-    string currentPrefix = w2mb(GetUserPrefix(cmdLine));
-    *logFile << "User prefix = \"" << currentPrefix.c_str() << "\"" << endl;
+/**
+ * Inline suggestions need only the common prefix and the neighbour of the current suggestion,
+ * both are folded right from the stream without collecting, sorting and deduplicating refs.
+ * Strictly matched refs of a snapshot are a sorted range, so both are found by binary search.
+ */
+static void TransformCmdLineInline(const RefsQuery &query, CmdLine &cmdLine, git_repository *repo) {
+    const Options &options = query.options;
+    const string &currentPrefix = query.currentPrefix;
+    string currentSuffix = w2mb(GetSuggestedSuffix(cmdLine));
+    LOG("currentSuffix = \"" << currentSuffix.c_str() << "\"");
 
-    vector<string> suitableRefs;
-    ObtainSuitableRefsByStrictPrefix(options, repo, currentPrefix, suitableRefs);
+    if (query.plan.ordering == ORDERING_PRESORTED) {
+        RefsSnapshot &snapshot = *query.snapshot;
+        RefsSnapshotPrepare(snapshot, options.stripRemoteName != 0);
+        auto range = RefsSnapshotPrefixRange(snapshot, currentPrefix);
+        if (range.first != range.second) {
+            LOG((range.second - range.first) << " suitable refs (strict = 1)");
+            bool forward = (options.suggestNextSuffix != 0);
+            if (snapshot.fixedNames) {
+                // names of a single query are not worth converting all at once
+                ApplyInlineSuggestion(cmdLine, currentPrefix, SortedRangeCommonPrefix(snapshot.names, range),
+                    SortedRangeNextItem(snapshot.names, range, forward, currentPrefix + currentSuffix));
+            } else {
+                ApplySnapshotInlineSuggestion(cmdLine, currentPrefix, snapshot, range, forward, currentPrefix + currentSuffix);
+            }
+            return;
+        }
+    }
 
-    if (suitableRefs.empty()) {
-        ObtainSuitableRefsByPartialPrefixes(options, repo, currentPrefix, suitableRefs);
+    bool strict = true;
+    CommonPrefixFold commonPrefix = CommonPrefixFoldCreate(currentPrefix.length());
+    NextItemFold nextRef = NextItemFoldCreate(options.suggestNextSuffix != 0, currentPrefix + currentSuffix);
+    auto foldOneRef = [&commonPrefix, &nextRef](const string &ref) -> bool {
+        CommonPrefixFoldAdd(commonPrefix, ref);
+        NextItemFoldAdd(nextRef, ref);
+        return true;
+    };
+
+    size_t count = Drain(SuitableRefsByStrictPrefix(query, repo), foldOneRef);
+    if (count == 0) {
+        strict = false;
+        commonPrefix = CommonPrefixFoldCreate(0);
+        count = Drain(SuitableRefsByPartialPrefixes(query, repo), foldOneRef);
     }
 
-    if (suitableRefs.empty()) {
-        *logFile << "No suitable refs" << endl;
+    if (count == 0) {
+        LOG("No suitable refs");
         return;
     }
+    LOG(count << " suitable refs (strict = " << strict << ")");
+    ApplyInlineSuggestion(cmdLine, currentPrefix, commonPrefix.prefix, NextItemFoldResult(nextRef));
+}
 
-    sort(suitableRefs.begin(), suitableRefs.end());
-    suitableRefs.erase(unique(suitableRefs.begin(), suitableRefs.end()), suitableRefs.end());
-    // TODO
-    //if (!options.sortByName) {
-    //    *logFile << "FIXME: sorting by time is not implemented yet" << endl;
-    //}
+/** Validates the snapshot and picks the plan. */
+static RefsQuery PlanRefsQuery(RepoState &state, const Options &options, const string &currentPrefix, const string &gitDir) {
+    bool snapshotValid = false;
+    if (state.snapshot) {
+        auto start = chrono::steady_clock::now();
+        snapshotValid = RefFilesUnchanged(state.snapshot->fingerprint);
+        RepoStatsObserveValidate(state.stats, chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+        if (!snapshotValid) {
+            state.snapshot.reset();
+        }
+    }
+    bool snapshotPrepared = snapshotValid && state.snapshot->namesReady && state.snapshot->stripRemoteName == (options.stripRemoteName != 0);
 
-    for_each(suitableRefs.begin(), suitableRefs.end(), [](string s) {
-        *logFile << "Suitable ref: " << s.c_str() << endl;
-    });
+    RefsQuery query;
+    query.options = options;
+    query.currentPrefix = currentPrefix;
+    query.gitDir = gitDir;
+    query.plan = PlanQuery(state.stats, snapshotValid, snapshotPrepared, options.showDialog != 0);
+    query.snapshot = (query.plan.source == SOURCE_SNAPSHOT) ? state.snapshot : RefsSnapshotCreate();
+    query.markNewRefs = true;
+    query.numericOrder = false;
+    LOG("Plan: " << DescribeQueryPlan(query.plan, state.stats).c_str());
+    return query;
+}
+
+// Loose refs of a repository are packed again not more often than this.
+static const chrono::minutes PACKING_PERIOD(10);
+
+/** Reports loose refs which slow scans down and packs them in the background if it is enabled. */
+static void CheckLooseRefs(RepoState &state, const Options &options, const string &gitDir) {
+    string outcome;
+    if (TakeRefPackingOutcome(outcome)) {
+        LOG(outcome.c_str());
+    }
+    if (!LooseRefsPressing(state.stats)) {
+        state.pressureReported = false;
+        return;
+    }
+    if (!state.pressureReported) {
+        LOG(state.stats.looseCount << " loose refs, packing would save about " << (size_t)(PackingSavingMicros(state.stats) / 1000)
+            << " ms of every scan" << (options.packLooseRefs ? "" : " (enable packing in the config or run \"git pack-refs --all\")"));
+        state.pressureReported = true;
+    }
+    auto now = chrono::steady_clock::now();
+    if (!options.packLooseRefs || (state.packingStart != chrono::steady_clock::time_point() && now - state.packingStart < PACKING_PERIOD)) {
+        return;
+    }
+    if (StartRefPacking(gitDir)) {
+        state.packingStart = now;
+        LOG("Packing of loose refs is started");
+    } else {
+        LOG("Packing of loose refs is postponed: git holds the lock of packed-refs or runs gc, or another packing runs");
+    }
+}
+
+/** Takes the costs observed by the query into account. */
+static void ObserveRefsQuery(RepoState &state, const RefsQuery &query) {
+    RefsSnapshot &snapshot = *query.snapshot;
+    state.stats.queries++;
+    if (query.plan.source != SOURCE_SNAPSHOT && snapshot.complete) {
+        RepoStatsObserveScan(state.stats, snapshot.scanCount, snapshot.scanMicros);
+        if (query.plan.source == SOURCE_SCAN_AND_SNAPSHOT) {
+            RepoStatsObserveSurvey(state.stats, snapshot.looseCount);
+            state.snapshot = query.snapshot;
+        } else {
+            state.snapshot.reset();
+        }
+    }
+    if (snapshot.prepareMicros != 0) {
+        RepoStatsObservePrepare(state.stats, snapshot.prepareMicros);
+        snapshot.prepareMicros = 0;
+    }
+    CheckLooseRefs(state, query.options, query.gitDir);
+}
 
-    string newPrefix = FindCommonPrefix(suitableRefs);
-    *logFile << "Common prefix: " << newPrefix.c_str() << endl;
+static string FoundConfigFile(int (*find)(git_buf *), const string &defaultPath) {
+    git_buf path = { nullptr, 0, 0 };
+    string result = (find(&path) == 0) ? string(path.ptr) : defaultPath;
+    git_buf_free(&path);
+    return result;
+}
+
+/** Parses the config only if any file of it has changed since the last time. */
+static const GitConfig &CachedGitConfig(RepoState &state, git_repository *repo) {
+    // The worktree config and HEAD belong to the worktree, not to the common dir.
+    string gitDir(git_repository_path(repo));
+    if (state.config && state.config->sources.gitDir == gitDir && GitConfigUnchanged(*state.config)) {
+        LOG("Config is unchanged");
+        return *state.config;
+    }
 
-    if (newPrefix != currentPrefix) {
-        ReplaceUserPrefix(cmdLine, mb2w(newPrefix));
+    // Missing global files are watched too, so their creation is noticed.
+    string home = HomeDir();
+    GitConfigSources sources;
+    sources.files.push_back(FoundConfigFile(git_config_find_system, string("")));
+    sources.files.push_back(FoundConfigFile(git_config_find_xdg, home.empty() ? string("") : home + "/.config/git/config"));
+    sources.files.push_back(FoundConfigFile(git_config_find_global, home.empty() ? string("") : home + "/.gitconfig"));
+    sources.files.push_back(string(git_repository_commondir(repo)) + "config");
+    sources.files.push_back(gitDir + "config.worktree");
+    sources.files.erase(remove(sources.files.begin(), sources.files.end(), string("")), sources.files.end());
+    sources.gitDir = gitDir;
+    sources.headFile = gitDir + "HEAD";
+    sources.home = home;
 
+    state.config = make_shared<GitConfig>(LoadGitConfig(sources));
+    LOG("Config is parsed: " << state.config->stamps.size() << " files, " << state.config->entries.size() << " entries");
+    return *state.config;
+}
+
+/** Names which are not refs are completed the same way as refs of a snapshot. */
+static RefsQuery NamesQuery(const Options &options, const string &currentPrefix, const string &gitDir, const vector<string> &names) {
+    RefsQuery query;
+    query.options = options;
+    query.currentPrefix = currentPrefix;
+    query.gitDir = gitDir;
+    query.plan.source = SOURCE_SNAPSHOT;
+    query.plan.matcher = MATCHER_BINARY_SEARCH;
+    query.plan.ordering = ORDERING_PRESORTED;
+    query.plan.scanCost = 0;
+    query.plan.snapshotCost = 0;
+    query.snapshot = RefsSnapshotFromNames(names);
+    query.markNewRefs = false;
+    query.numericOrder = false;
+    return query;
+}
+
+static void TransformCmdLineByQuery(const RefsQuery &query, CmdLine &cmdLine, git_repository *repo) {
+    if (query.options.showDialog) {
+        TransformCmdLineWithDialog(query, cmdLine, repo);
     } else {
-        string currentSuffix = w2mb(GetSuggestedSuffix(cmdLine));
-        *logFile << "currentSuffix = \"" << currentSuffix.c_str() << "\"" << endl;
-
-        if (options.showDialog) {
-            // Yes, we show dialog even if there is only one suitable ref.
-            *logFile << "Showing dialog..." << endl;
-            string selectedRef = ShowRefsDialog(suitableRefs, currentPrefix + currentSuffix);
-            *logFile << "Dialog closed, selectedRef = \"" << selectedRef.c_str() << "\"" << endl;
-            if (!selectedRef.empty()) {
-                // Use case: we iterate over branches with suggested suffixes
-                // but then we understand that we do not remember branch name
-                // and want to see them as dialog (via extra hotkey).
-                // In this case we should drop last suggested suffix.
-                ReplaceSuggestedSuffix(cmdLine, wstring(L""));
-
-                ReplaceUserPrefix(cmdLine, mb2w(selectedRef));
+        TransformCmdLineInline(query, cmdLine, repo);
+    }
+}
+
+/** Entries of the stash reflog ("stash@{0}" is the latest one), the reflog is read only if it has changed. */
+static const vector<string> &CachedStashEntries(RepoState &state, const string &gitDir) {
+    if (!state.stashStamp.path.empty() && StampsUnchanged(vector<FileStamp>{ state.stashStamp })) {
+        return state.stashEntries;
+    }
+    string reflogPath = gitDir + "logs/refs/stash";
+    state.stashStamp = StampFile(reflogPath);
+    state.stashEntries.clear();
+    string reflog;
+    if (state.stashStamp.exists && ReadFileContents(reflogPath, reflog)) {
+        size_t count = (size_t)count_if(reflog.begin(), reflog.end(), [](char c) -> bool { return c == '\n'; });
+        if (!reflog.empty() && reflog.back() != '\n') {
+            count++;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            state.stashEntries.push_back("stash@{" + to_string(i) + "}");
+        }
+        sort(state.stashEntries.begin(), state.stashEntries.end());
+    }
+    return state.stashEntries;
+}
+
+/**
+ * Numbered refs of code review hosts ("pull/12345/head"), they are indexed once per change of ref files.
+ * Names of the last complete scan are indexed if refs have not changed since then.
+ */
+static const NumericIndex &CachedNumericRefs(RepoState &state, const string &gitDir, const string &repoPath) {
+    if (!state.numericFingerprint.stamps.empty() && RefFilesUnchanged(state.numericFingerprint)) {
+        return state.numericRefs;
+    }
+    auto start = chrono::steady_clock::now();
+    shared_ptr<RefsSnapshot> snapshot = state.snapshot;
+    if (snapshot && snapshot->complete && !snapshot->fixedNames && RefFilesUnchanged(snapshot->fingerprint)) {
+        state.numericFingerprint = snapshot->fingerprint;
+        state.numericRefs = NumericIndexCreate(snapshot->fullNames);
+    } else {
+        // The survey goes first: if refs change while they are read, the next fingerprint differs.
+        state.numericFingerprint = SurveyRefFiles(gitDir).fingerprint;
+        vector<string> fullNames;
+        git_repository *repo = nullptr;
+        if (git_repository_open(&repo, repoPath.c_str()) >= 0) {
+            Drain(GitRefNames(repo), [&fullNames](const string &name) -> bool {
+                fullNames.push_back(name);
+                return true;
+            });
+            git_repository_free(repo);
+        }
+        state.numericRefs = NumericIndexCreate(fullNames);
+    }
+    LOG("Numbered refs: " << state.numericRefs.count << " in " << state.numericRefs.shapes.size() << " shapes, indexed in "
+        << (size_t)chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() << " us");
+    return state.numericRefs;
+}
+
+static CompletionSource ContextSource(RepoState &state, const string &name, CompletionContext context,
+        function<void (const SourceRequest &, const atomic<bool> &, vector<string> &)> query) {
+    CompletionSource source;
+    source.name = name;
+    source.applicable = [context](const SourceRequest &request) -> bool {
+        return request.context == context;
+    };
+    source.query = move(query);
+    source.stats = &state.sourceStats[name];
+    return source;
+}
+
+/** Names of remotes with their first URL. */
+static vector<pair<string, string>> RemoteUrls(const GitConfig &config) {
+    vector<pair<string, string>> urls;
+    for (auto it = config.entries.begin(); it != config.entries.end(); ++it) {
+        const string &key = it->key;
+        if (!StartsWith(key, string("remote.")) || key.length() <= 11 || key.compare(key.length() - 4, 4, ".url") != 0) {
+            continue;
+        }
+        string name = key.substr(7, key.length() - 11);
+        bool known = any_of(urls.begin(), urls.end(), [&name](const pair<string, string> &url) -> bool {
+            return url.first == name;
+        });
+        if (!known) {
+            urls.push_back(make_pair(name, it->value));
+        }
+    }
+    return urls;
+}
+
+/** Copies cached names into the result of a source until the source is cancelled. */
+static void CopyNames(const vector<string> &names, const atomic<bool> &cancelled, vector<string> &result) {
+    for (auto name = names.begin(); name != names.end() && !cancelled; ++name) {
+        result.push_back(*name);
+    }
+}
+
+/**
+ * What the sources of a repository bring back. Sources only read the state while they run,
+ * the main thread plans the refs query before and applies the rest to the state after they are joined.
+ */
+typedef struct tSourcesUpdate {
+    RefsQuery refsQuery;
+    map<string, LocalBranches> localBranches; // refreshed caches
+} SourcesUpdate;
+
+/**
+ * All sources of the repository. The config must be loaded before config sources are queried,
+ * refs are scanned by a repository object of the querying thread.
+ * Sources are joined before the completion returns, so they refer to the arguments instead of copying them
+ * (small captures are stored in std::function itself, it is built on every completion).
+ */
+static vector<CompletionSource> RepoSources(RepoState &state, const Options &options, const string &gitDir, const string &repoPath, const string &baseDir,
+        SourcesUpdate &update) {
+    vector<CompletionSource> sources;
+    sources.reserve(8);
+
+    const RepoState *statePtr = &state;
+    // Strictly matched refs win over partially matched ones, as if refs were completed alone.
+    sources.push_back(ContextSource(state, "refs", CONTEXT_REFS,
+        [&update, &repoPath](const SourceRequest &, const atomic<bool> &cancelled, vector<string> &result) {
+            git_repository *repo = nullptr;
+            if (git_repository_open(&repo, repoPath.c_str()) < 0) {
+                return;
+            }
+            const RefsQuery &query = update.refsQuery;
+            auto collect = [&result, &cancelled](const string &ref) -> bool {
+                result.push_back(ref);
+                return !cancelled;
+            };
+            if (Drain(SuitableRefsByStrictPrefix(query, repo), collect) == 0 && !cancelled) {
+                Drain(SuitableRefsByPartialPrefixes(query, repo), collect);
+            }
+            git_repository_free(repo);
+            sort(result.begin(), result.end());
+            result.erase(unique(result.begin(), result.end()), result.end());
+        }));
+
+    // Stash entries are also offered among refs, but only if the user has started typing one.
+    CompletionSource stash = ContextSource(state, "stash", CONTEXT_STASH,
+        [statePtr](const SourceRequest &, const atomic<bool> &cancelled, vector<string> &result) {
+            CopyNames(statePtr->stashEntries, cancelled, result);
+        });
+    stash.applicable = [&state, &gitDir](const SourceRequest &request) -> bool {
+        static const char *STASH_ENTRY = "stash@{";
+        const string &prefix = request.currentPrefix;
+        bool typed = (request.context == CONTEXT_STASH)
+            || (request.context == CONTEXT_REFS && !prefix.empty()
+                && (StartsWith(STASH_ENTRY, prefix.c_str()) || StartsWith(prefix.c_str(), STASH_ENTRY) || RefMayBeEncodedByPartialPrefix(STASH_ENTRY, prefix.c_str())));
+        return typed && !CachedStashEntries(state, gitDir).empty();
+    };
+    sources.push_back(move(stash));
+
+    // Branches of local remotes and alternates are offered as if they were fetched.
+    CompletionSource localRemotes = ContextSource(state, "local remotes", CONTEXT_REFS,
+        [statePtr, &update, &options, &gitDir, &baseDir](const SourceRequest &, const atomic<bool> &cancelled, vector<string> &result) {
+            vector<string> fullNames;
+            vector<LocalRepo> localRepos = FindLocalRepos(RemoteUrls(*statePtr->config), baseDir, gitDir);
+            for (auto repo = localRepos.begin(); repo != localRepos.end() && !cancelled; ++repo) {
+                // The cache is refreshed in a copy, which replaces it in the state after the sources are joined.
+                auto cached = statePtr->localBranches.find(repo->gitDir);
+                LocalBranches &cache = update.localBranches[repo->gitDir];
+                if (cached != statePtr->localBranches.end()) {
+                    cache = cached->second;
+                }
+                const vector<string> &branches = CachedLocalBranches(cache, repo->gitDir);
+                for (auto branch = branches.begin(); branch != branches.end(); ++branch) {
+                    fullNames.push_back(AsRemoteBranch(*repo, *branch));
+                }
+            }
+            CollectSortedUnique(ExpandRefNames(StreamFromVector(fullNames), options.stripRemoteName != 0), result);
+        });
+    localRemotes.applicable = [&options](const SourceRequest &request) -> bool {
+        return options.localRemoteRefs && request.context == CONTEXT_REFS;
+    };
+    sources.push_back(move(localRemotes));
+
+    // Numbered refs are offered once a number is typed ("pull/12"), they come from ranges of the index, not from a scan.
+    CompletionSource numbered = ContextSource(state, "numbered refs", CONTEXT_REFS,
+        [statePtr](const SourceRequest &request, const atomic<bool> &cancelled, vector<string> &result) {
+            result = NumericIndexMatch(statePtr->numericRefs, request.currentPrefix, &cancelled);
+            sort(result.begin(), result.end());
+        });
+    numbered.applicable = [&state, &gitDir, &repoPath](const SourceRequest &request) -> bool {
+        const string &prefix = request.currentPrefix;
+        bool typed = request.context == CONTEXT_REFS && prefix.find_first_of("0123456789") != string::npos;
+        return typed && NumericIndexCount(CachedNumericRefs(state, gitDir, repoPath), prefix) > 0;
+    };
+    sources.push_back(move(numbered));
+
+    sources.push_back(ContextSource(state, "remotes", CONTEXT_REMOTES,
+        [statePtr](const SourceRequest &, const atomic<bool> &cancelled, vector<string> &result) {
+            CopyNames(statePtr->config->remotes, cancelled, result);
+        }));
+    sources.push_back(ContextSource(state, "config keys", CONTEXT_CONFIG_KEYS,
+        [statePtr](const SourceRequest &, const atomic<bool> &cancelled, vector<string> &result) {
+            CopyNames(statePtr->config->keys, cancelled, result);
+        }));
+    sources.push_back(ContextSource(state, "aliases", CONTEXT_SUBCOMMANDS,
+        [statePtr](const SourceRequest &, const atomic<bool> &cancelled, vector<string> &result) {
+            CopyNames(statePtr->config->aliases, cancelled, result);
+        }));
+    // The lookup waits for the first scan of PATH for a while, which is shorter than the deadline.
+    sources.push_back(ContextSource(state, "subcommands", CONTEXT_SUBCOMMANDS,
+        [](const SourceRequest &request, const atomic<bool> &cancelled, vector<string> &result) {
+            if (!cancelled) {
+                LookupSubcommands(request.currentPrefix, result);
+            }
+        }));
+
+    return sources;
+}
+
+// Results of sources which are not ready by then are dropped.
+static const chrono::milliseconds SOURCES_DEADLINE(1000);
+
+/** A typed part of a ref, e.g. "fe" of "git diff fe..ma". */
+typedef struct tRefToken {
+    CmdLineToken token;
+    string prefix; // normalized
+} RefToken;
+
+/**
+ * Tokens of a git command which are completed as refs, wherever the cursor is.
+ * Options, paths after "--" and revision expressions ("HEAD~2", "a^{tree}", "stash@{0}") are not.
+ */
+static vector<RefToken> RefTokens(const CmdLine &cmdLine) {
+    vector<RefToken> refTokens;
+    vector<wstring> words = GetWords(cmdLine);
+    if (words.empty() || words[0] != L"git") {
+        return refTokens;
+    }
+    vector<string> precedingWords;
+    vector<CmdLineToken> tokens = GetTokens(cmdLine);
+    for (auto token = tokens.begin(); token != tokens.end(); ++token) {
+        if (token->word == 0) {
+            continue;
+        }
+        precedingWords.resize(token->word);
+        transform(words.begin(), words.begin() + token->word, precedingWords.begin(), w2mb);
+        if (find(precedingWords.begin(), precedingWords.end(), string("--")) != precedingWords.end()) {
+            break;
+        }
+        string prefix = NormalizeNfc(w2mb(cmdLine.line.substr(token->start, token->end - token->start)));
+        bool expression = (prefix.find_first_of("~^:@{}*?[\\") != string::npos) || (prefix.length() >= 4 && prefix.compare(prefix.length() - 4, 4, "HEAD") == 0);
+        if (expression || StartsWith(w2mb(words[token->word]), string("-"))
+                || DetectCompletionContext(precedingWords, prefix) != CONTEXT_REFS) {
+            continue;
+        }
+        RefToken refToken = { *token, prefix };
+        refTokens.push_back(refToken);
+    }
+    return refTokens;
+}
+
+/**
+ * Completes all ref tokens of the line (e.g. "git diff fe..ma", "git merge-base rel/1 rel/2 ma")
+ * after a single pass over refs which matches them all at once.
+ * A token with a single suitable ref or with a longer common prefix is completed at once, the others
+ * are chosen in the dialog one after another from the refs of that pass (without the dialog they are left as is).
+ * Returns false if the line has less than two ref tokens, they are completed as usual then.
+ */
+static bool TransformCmdLineTokens(RepoState &state, const Options &options, CmdLine &cmdLine, git_repository *repo, const string &gitDir) {
+    // The suggested suffix is not a part of the typed ref.
+    CmdLine line = cmdLine;
+    ReplaceSuggestedSuffix(line, wstring(L""));
+    vector<RefToken> tokens = RefTokens(line);
+    if (tokens.size() < 2) {
+        return false;
+    }
+    vector<string> prefixes;
+    for (auto token = tokens.begin(); token != tokens.end(); ++token) {
+        LOG("Ref token = \"" << token->prefix.c_str() << "\"");
+        prefixes.push_back(token->prefix);
+    }
+
+    // All refs are suitable for the empty prefix, so this is the whole snapshot or a single scan.
+    RefsQuery query = PlanRefsQuery(state, options, string(""), gitDir);
+    MultiPrefixMatcher matcher = MultiPrefixMatcherCreate(prefixes);
+    vector<PrefixMatches> matches(prefixes.size());
+    auto start = chrono::steady_clock::now();
+    size_t count = Drain(SuitableRefsByStrictPrefix(query, repo), [&matcher, &matches](const string &ref) -> bool {
+        MultiPrefixMatcherAdd(matcher, ref, matches);
+        return true;
+    });
+    ObserveRefsQuery(state, query);
+    LOG(count << " refs matched against " << prefixes.size() << " tokens in "
+        << (size_t)chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() << " us");
+
+    vector<wstring> texts(tokens.size());
+    vector<bool> replaced(tokens.size(), false);
+    vector<string> newRefs;
+    bool newRefsKnown = false;
+    bool dialogCancelled = false;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        const string &prefix = tokens[i].prefix;
+        bool strict = !matches[i].strict.empty();
+        vector<string> &suitableRefs = strict ? matches[i].strict : matches[i].partial;
+        sort(suitableRefs.begin(), suitableRefs.end());
+        suitableRefs.erase(unique(suitableRefs.begin(), suitableRefs.end()), suitableRefs.end());
+        if (suitableRefs.empty() || (strict && binary_search(suitableRefs.begin(), suitableRefs.end(), prefix))) {
+            continue; // unknown or complete
+        }
+
+        CommonPrefixFold commonPrefix = CommonPrefixFoldCreate(strict ? prefix.length() : 0);
+        for (auto ref = suitableRefs.begin(); ref != suitableRefs.end() && !CommonPrefixFoldCollapsed(commonPrefix); ++ref) {
+            CommonPrefixFoldAdd(commonPrefix, *ref);
+        }
+        LOG("Token \"" << prefix.c_str() << "\": " << suitableRefs.size() << " suitable refs (strict = " << strict
+            << "), common prefix: " << commonPrefix.prefix.c_str());
+        // Refs of a partial prefix may have a shorter common prefix (e.g. "f" for "f/h"), which completes nothing.
+        if (commonPrefix.prefix.length() > prefix.length()) {
+            texts[i] = mb2w(commonPrefix.prefix);
+            replaced[i] = true;
+        } else if (options.showDialog && !dialogCancelled) {
+            if (!newRefsKnown) {
+                newRefs = NewRefsSinceLastLook(*query.snapshot, options.stripRemoteName != 0, gitDir, repo);
+                newRefsKnown = true;
             }
+            wstring typed = line.line.substr(tokens[i].token.start, tokens[i].token.end - tokens[i].token.start);
+            CmdLine tokenLine = CmdLineCreate(typed, (int)typed.length(), -1, 0);
+            ShowDialogAndTransform(options, tokenLine, prefix, suitableRefs, nullptr, newRefs, nullptr, false);
+            texts[i] = tokenLine.line;
+            replaced[i] = (tokenLine.line != typed);
+            dialogCancelled = !replaced[i];
+        }
+    }
 
+    for (size_t i = tokens.size(); i-- > 0;) {
+        if (replaced[i]) {
+            ReplaceToken(line, tokens[i].token, texts[i]);
+        }
+    }
+    cmdLine = line;
+    return true;
+}
+
+/** Last value of the key in the config, empty if there is none. */
+static string ConfigValue(const GitConfig &config, const string &key) {
+    string value;
+    for (auto it = config.entries.begin(); it != config.entries.end(); ++it) {
+        if (it->key == key) {
+            value = it->value;
+        }
+    }
+    return value;
+}
+
+/** The commit the revision points to, through annotated tags. */
+static RefCommit ReadCommit(git_repository *repo, const string &revision) {
+    RefCommit result = { false };
+    git_object *object = nullptr;
+    if (git_revparse_single(&object, repo, (revision + "^{commit}").c_str()) < 0) {
+        return result;
+    }
+    result.oid = *git_object_id(object);
+    git_object_free(object);
+    git_commit *commit = nullptr;
+    if (git_commit_lookup(&commit, repo, &result.oid) < 0) {
+        return result;
+    }
+    const git_signature *author = git_commit_author(commit);
+    result.valid = true;
+    result.time = (int64_t)git_commit_time(commit);
+    result.authorName = (author->name != nullptr) ? author->name : "";
+    result.authorEmail = (author->email != nullptr) ? author->email : "";
+    git_commit_free(commit);
+    return result;
+}
+
+/** Commits are read once per snapshot, i.e. until refs change. */
+static const RefCommit &CachedRefCommit(RepoState &state, git_repository *repo, const string &fullName) {
+    auto found = state.commits.find(fullName);
+    if (found == state.commits.end()) {
+        found = state.commits.insert(make_pair(fullName, ReadCommit(repo, fullName))).first;
+    }
+    return found->second;
+}
+
+/** The complete snapshot with prepared names and filter bitmaps, refs are scanned if it is stale. */
+static shared_ptr<RefsSnapshot> PreparedCompleteSnapshot(RepoState &state, const Options &options, const string &gitDir, git_repository *repo) {
+    shared_ptr<RefsSnapshot> snapshot = state.snapshot;
+    if (!snapshot || !snapshot->complete || snapshot->fixedNames || !RefFilesUnchanged(snapshot->fingerprint)) {
+        // The survey goes first: if refs change while they are read, the next fingerprint differs.
+        snapshot = RefsSnapshotCreate();
+        RefFilesSurvey survey = SurveyRefFiles(gitDir);
+        snapshot->fingerprint = survey.fingerprint;
+        snapshot->looseCount = survey.looseCount;
+        Drain(RecordingStream(GitRefNames(repo), snapshot, true), [](const string &) -> bool {
+            return true;
+        });
+        RepoStatsObserveScan(state.stats, snapshot->scanCount, snapshot->scanMicros);
+        RepoStatsObserveSurvey(state.stats, survey.looseCount);
+        state.snapshot = snapshot;
+    }
+    RefsSnapshotPrepare(*snapshot, options.stripRemoteName != 0);
+    RefsSnapshotPrepareTable(*snapshot);
+    if (snapshot->prepareMicros != 0) {
+        RepoStatsObservePrepare(state.stats, snapshot->prepareMicros);
+        snapshot->prepareMicros = 0;
+    }
+    return snapshot;
+}
+
+/** Names of one value of a bitmap term. */
+static RefBitmap QueryValueBitmap(RefTable &table, const vector<string> &names, QueryField field, const string &value) {
+    if (field == QUERY_KIND) {
+        return table.kinds[(value == "branch") ? REF_KIND_BRANCH : (value == "tag") ? REF_KIND_TAG : REF_KIND_REMOTE];
+    }
+    if (field == QUERY_REMOTE) {
+        auto found = table.remotes.find(value);
+        return (found != table.remotes.end()) ? found->second : RefBitmap();
+    }
+    return RefTableGlob(table, names, value);
+}
+
+/**
+ * Names of the snapshot for which all terms of the query and the typed prefix hold, in the sorted order.
+ * Bitmap terms are applied at once, then the survivors are checked by the other terms in the order of the plan,
+ * so commits are read and the history is walked only for the refs which are left by then.
+ */
+static vector<string> QueriedRefs(RepoState &state, const Options &options, vector<QueryTerm> terms, const string &currentPrefix,
+        const string &gitDir, git_repository *repo) {
+    shared_ptr<RefsSnapshot> snapshot = PreparedCompleteSnapshot(state, options, gitDir, repo);
+    RefTable &table = snapshot->table;
+    const vector<string> &names = snapshot->names;
+    pair<size_t, size_t> range = RefsSnapshotPrefixRange(*snapshot, currentPrefix);
+    if (!currentPrefix.empty()) {
+        terms.push_back(QueryPrefixTerm(currentPrefix, range.first == range.second));
+    }
+
+    vector<RefBitmap> bitmaps(terms.size());
+    vector<double> knownSelectivities(terms.size(), -1);
+    for (size_t i = 0; i < terms.size(); ++i) {
+        const QueryTerm &term = terms[i];
+        if (!QueryTermIsBitmap(term)) {
+            continue;
+        }
+        if (term.field == QUERY_PREFIX) {
+            bitmaps[i] = RefBitmapRange((uint32_t)range.first, (uint32_t)range.second);
+        }
+        for (auto value = term.values.begin(); value != term.values.end() && term.field != QUERY_PREFIX; ++value) {
+            bitmaps[i] = RefBitmapOr(bitmaps[i], QueryValueBitmap(table, names, term.field, *value));
+        }
+        double share = (table.count == 0) ? 0 : (double)RefBitmapCount(bitmaps[i]) / table.count;
+        knownSelectivities[i] = term.negated ? 1 - share : share;
+    }
+    vector<QueryStep> plan = PlanRefQuery(terms, knownSelectivities, state.queryStats);
+    LOG("Query plan: " << DescribeRefQueryPlan(terms, plan).c_str());
+
+    RefBitmap passed = RefTableAll(table);
+    for (auto step = plan.begin(); step != plan.end(); ++step) {
+        if (QueryTermIsBitmap(terms[step->term])) {
+            const RefBitmap &bitmap = bitmaps[step->term];
+            passed = terms[step->term].negated ? RefBitmapAndNot(passed, bitmap) : RefBitmapAnd(passed, bitmap);
+        }
+    }
+    vector<uint32_t> ids = RefBitmapIds(passed);
+    LOG(ids.size() << " of " << table.count << " refs pass bitmaps");
+
+    if (state.commitsSnapshot != snapshot) {
+        state.commits.clear();
+        state.commitsSnapshot = snapshot;
+    }
+    string userName;
+    string userEmail;
+    if (any_of(terms.begin(), terms.end(), [](const QueryTerm &term) -> bool {
+        return term.field == QUERY_AUTHOR && find(term.values.begin(), term.values.end(), string("me")) != term.values.end();
+    })) {
+        const GitConfig &config = CachedGitConfig(state, repo);
+        userName = ConfigValue(config, "user.name");
+        userEmail = ConfigValue(config, "user.email");
+    }
+    map<string, RefCommit> revisions; // of "merged:" terms
+    int64_t now = (int64_t)time(nullptr);
+
+    for (auto step = plan.begin(); step != plan.end() && !ids.empty(); ++step) {
+        const QueryTerm &term = terms[step->term];
+        if (QueryTermIsBitmap(term)) {
+            continue;
+        }
+        auto start = chrono::steady_clock::now();
+        size_t checked = ids.size();
+        ids.erase(remove_if(ids.begin(), ids.end(), [&](uint32_t id) -> bool {
+            if (term.field == QUERY_PARTIAL_PREFIX) {
+                return !RefMayBeEncodedByPartialPrefix(names[id].c_str(), term.values[0].c_str());
+            }
+            size_t source = table.sources[id];
+            const RefCommit &commit = (source < snapshot->fullNames.size()) ? CachedRefCommit(state, repo, snapshot->fullNames[source]) : NO_COMMIT;
+            bool holds = false;
+            if (commit.valid && term.field == QUERY_AGE) {
+                holds = term.younger ? (now - commit.time < term.seconds) : (now - commit.time > term.seconds);
+            }
+            for (auto value = term.values.begin(); commit.valid && value != term.values.end() && !holds; ++value) {
+                if (term.field == QUERY_AUTHOR && *value == "me") {
+                    holds = (!userEmail.empty() && commit.authorEmail == userEmail) || (!userName.empty() && commit.authorName == userName);
+                } else if (term.field == QUERY_AUTHOR) {
+                    holds = commit.authorName.find(*value) != string::npos || commit.authorEmail.find(*value) != string::npos;
+                } else if (term.field == QUERY_MERGED) {
+                    auto revision = revisions.find(*value);
+                    if (revision == revisions.end()) {
+                        revision = revisions.insert(make_pair(*value, ReadCommit(repo, *value))).first;
+                    }
+                    holds = revision->second.valid && (git_oid_equal(&revision->second.oid, &commit.oid)
+                        || git_graph_descendant_of(repo, &revision->second.oid, &commit.oid) == 1);
+                }
+            }
+            return holds == term.negated;
+        }), ids.end());
+        ObserveQueryTerm(state.queryStats, term, checked, ids.size());
+        LOG("Term " << term.text.c_str() << ": " << ids.size() << " of " << checked << " refs pass in "
+            << (size_t)chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() << " us");
+    }
+
+    vector<string> result;
+    result.reserve(ids.size());
+    for (auto id = ids.begin(); id != ids.end(); ++id) {
+        result.push_back(names[*id]);
+    }
+    return result;
+}
+
+// The completed prefix is extended in advance by this many chars which follow it in the most refs.
+static const size_t SPECULATED_CHARS = 4;
+
+/**
+ * Answers the next completion step in advance on an idle thread (see Speculation.hpp).
+ * Names of the previous speculation are reused while refs are unchanged. Otherwise full names of the last complete scan
+ * are copied if refs have not changed since it (they are never changed, while its names may be prepared again
+ * by the main thread), or refs are scanned by a repository object of the thread.
+ */
+static void SpeculateNextStep(const RepoState &state, const Options &options, const CmdLine &cmdLine, const string &gitDir, const string &repoPath) {
+    string prefix = NormalizeNfc(w2mb(GetUserPrefix(cmdLine)));
+    string suffix = w2mb(GetSuggestedSuffix(cmdLine));
+    bool stripRemoteName = (options.stripRemoteName != 0);
+    shared_ptr<RefsSnapshot> scanned = (state.snapshot && state.snapshot->complete && !state.snapshot->fixedNames) ? state.snapshot : nullptr;
+    StartSpeculation([prefix, suffix, stripRemoteName, scanned, gitDir, repoPath](shared_ptr<const Speculation> previous, Speculation &speculation, const atomic<bool> &cancelled) {
+        shared_ptr<RefsSnapshot> snapshot;
+        if (previous && previous->gitDir == gitDir && previous->snapshot->stripRemoteName == stripRemoteName && RefFilesUnchanged(previous->snapshot->fingerprint)) {
+            snapshot = previous->snapshot;
         } else {
-            string newSuffix = ObtainNextSuggestedSuffix(options.suggestNextSuffix, currentPrefix, currentSuffix, suitableRefs);
-            *logFile << "nextSuffx = \"" << newSuffix.c_str() << "\"" << endl;
-            ReplaceSuggestedSuffix(cmdLine, mb2w(newSuffix));
+            snapshot = RefsSnapshotCreate();
+            if (scanned && RefFilesUnchanged(scanned->fingerprint)) {
+                snapshot->fingerprint = scanned->fingerprint;
+                snapshot->looseCount = scanned->looseCount;
+                snapshot->fullNames = scanned->fullNames;
+                snapshot->complete = true;
+            } else {
+                git_repository *repo = nullptr;
+                if (git_repository_open(&repo, repoPath.c_str()) < 0) {
+                    return;
+                }
+                // The survey goes first: if refs change while they are read, the next fingerprint differs.
+                RefFilesSurvey survey = SurveyRefFiles(gitDir);
+                snapshot->fingerprint = survey.fingerprint;
+                snapshot->looseCount = survey.looseCount;
+                Drain(RecordingStream(GitRefNames(repo), snapshot, true), [&cancelled](const string &) -> bool {
+                    return !cancelled;
+                });
+                git_repository_free(repo);
+            }
+            if (cancelled || !snapshot->complete) {
+                return;
+            }
+            RefsSnapshotPrepare(*snapshot, stripRemoteName);
+            if (cancelled) {
+                return;
+            }
+            RefsSnapshotPrepareWide(*snapshot);
+        }
+        speculation.gitDir = gitDir;
+        speculation.snapshot = snapshot;
+        SpeculateSteps(speculation, prefix, suffix, SPECULATED_CHARS, cancelled);
+    });
+}
+
+/**
+ * Completes the line by the answer of the last speculation if the step was speculated and refs have not changed since then.
+ * Returns false if the step is to be completed as usual.
+ */
+static bool TransformCmdLineBySpeculation(RepoState &state, const Options &options, CmdLine &cmdLine, const string &currentPrefix,
+        const string &gitDir, git_repository *repo) {
+    string currentSuffix = w2mb(GetSuggestedSuffix(cmdLine));
+    bool running = false;
+    shared_ptr<const Speculation> speculation = LastSpeculation(running);
+    const SpeculatedStep *step = nullptr;
+    if (speculation && speculation->gitDir == gitDir && speculation->snapshot->stripRemoteName == (options.stripRemoteName != 0)) {
+        auto found = speculation->steps.find(currentPrefix);
+        // Refs of the dialog do not depend on the suggested suffix.
+        if (found != speculation->steps.end() && (options.showDialog || found->second.current == currentPrefix + currentSuffix)) {
+            step = &found->second;
         }
     }
+    SpeculationOutcome outcome = (step == nullptr) ? (running ? SPECULATION_NOT_READY : SPECULATION_MISS)
+        : RefFilesUnchanged(speculation->snapshot->fingerprint) ? SPECULATION_HIT : SPECULATION_STALE;
+    CountSpeculationOutcome(state.speculationStats, outcome);
+    LOG("Speculation: " << DescribeSpeculationStats(state.speculationStats, outcome).c_str());
+    if (outcome != SPECULATION_HIT) {
+        return false;
+    }
+
+    if (step->count == 0) {
+        LOG("No suitable refs");
+        return true;
+    }
+    LOG(step->count << " suitable refs (strict = " << step->strict << ")");
+    if (!options.showDialog) {
+        ApplyInlineSuggestion(cmdLine, currentPrefix, step->commonPrefix, (options.suggestNextSuffix != 0) ? step->forward : step->backward);
+    } else if (step->commonPrefix != currentPrefix) {
+        LOG("Common prefix: " << step->commonPrefix.c_str());
+        ReplaceUserPrefix(cmdLine, mb2w(step->commonPrefix));
+    } else {
+        vector<string> suitableRefs = RefTableNames(speculation->snapshot->names, step->suitable);
+        vector<string> newRefs = NewRefsSinceLastLook(*speculation->snapshot, options.stripRemoteName != 0, gitDir, repo);
+        ShowDialogAndTransform(options, cmdLine, currentPrefix, suitableRefs, nullptr, newRefs, speculation->snapshot, false);
+    }
+    return true;
+}
+
+void TransformCmdLine(const Options &options, CmdLine &cmdLine, git_repository *repo) {
+    string currentPrefix = NormalizeNfc(w2mb(GetUserPrefix(cmdLine)));
+    LOG("User prefix = \"" << currentPrefix.c_str() << "\"");
+
+    vector<wstring> words = GetPrecedingWords(cmdLine);
+    vector<string> precedingWords(words.size());
+    transform(words.begin(), words.end(), precedingWords.begin(), w2mb);
+    CompletionContext context = DetectCompletionContext(precedingWords, currentPrefix);
+    LOG("Completion context: " << CompletionContextName(context));
+
+    // Refs of all worktrees are stored in the common dir.
+    string gitDir(git_repository_commondir(repo));
+    auto found = repoStates.find(gitDir);
+    if (found == repoStates.end()) {
+        RepoState newState = { RepoStatsCreate(), nullptr, nullptr };
+        found = repoStates.insert(make_pair(gitDir, newState)).first;
+    }
+    RepoState &state = found->second;
+
+    if (context == CONTEXT_REMOTES || context == CONTEXT_CONFIG_KEYS || context == CONTEXT_SUBCOMMANDS
+            || (context == CONTEXT_REFS && options.localRemoteRefs)) {
+        CachedGitConfig(state, repo);
+    }
+
+    // Relative URLs of remotes are relative to the working tree, or to the git dir of a bare repository.
+    const char *workdir = git_repository_workdir(repo);
+    string baseDir = (workdir != nullptr) ? string(workdir) : gitDir;
+
+    if (!options.query.empty() && context == CONTEXT_REFS) {
+        vector<QueryTerm> terms;
+        string error;
+        if (ParseRefQuery(options.query, terms, error)) {
+            TransformCmdLineByQuery(NamesQuery(options, currentPrefix, gitDir, QueriedRefs(state, options, terms, currentPrefix, gitDir, repo)), cmdLine, repo);
+            return;
+        }
+        LOG("Query is ignored: " << error.c_str());
+    }
+
+    if (options.allRefTokens && context == CONTEXT_REFS && TransformCmdLineTokens(state, options, cmdLine, repo, gitDir)) {
+        return;
+    }
+
+    SourceRequest request = { context, precedingWords, currentPrefix };
+    SourcesUpdate update;
+    string repoPath = git_repository_path(repo);
+    vector<CompletionSource> sources = ApplicableSources(RepoSources(state, options, gitDir, repoPath, baseDir, update), request);
+    if (sources.size() == 1 && sources[0].name == "refs") {
+        // Refs alone are planned as a whole: they may be streamed into the dialog,
+        // and inline suggestions may be found in the sorted snapshot without collecting refs.
+        if (!TransformCmdLineBySpeculation(state, options, cmdLine, currentPrefix, gitDir, repo)) {
+            RefsQuery query = PlanRefsQuery(state, options, currentPrefix, gitDir);
+            TransformCmdLineByQuery(query, cmdLine, repo);
+            ObserveRefsQuery(state, query);
+        }
+        SpeculateNextStep(state, options, cmdLine, gitDir, repoPath);
+        return;
+    }
+
+    bool refsQueried = any_of(sources.begin(), sources.end(), [](const CompletionSource &source) -> bool {
+        return source.name == "refs";
+    });
+    if (refsQueried) {
+        update.refsQuery = PlanRefsQuery(state, options, currentPrefix, gitDir);
+        if (update.refsQuery.plan.source == SOURCE_SNAPSHOT) {
+            // The snapshot of the state is only read by the refs source.
+            RefsSnapshotPrepare(*update.refsQuery.snapshot, options.stripRemoteName != 0);
+        }
+    }
+    vector<string> names = QuerySources(sources, request, SOURCES_DEADLINE);
+    if (refsQueried) {
+        ObserveRefsQuery(state, update.refsQuery);
+    }
+    for (auto cache = update.localBranches.begin(); cache != update.localBranches.end(); ++cache) {
+        state.localBranches[cache->first] = move(cache->second);
+    }
+    RefsQuery query = NamesQuery(options, currentPrefix, gitDir, names);
+    query.numericOrder = any_of(sources.begin(), sources.end(), [](const CompletionSource &source) -> bool {
+        return source.name == "numbered refs";
+    });
+    TransformCmdLineByQuery(query, cmdLine, repo);
 }
 
 #ifdef DEBUG
-void LogicTest() {
-    assert(RefMayBeEncodedByPartialPrefix("svn/trunk", "s/t"));
-    assert(RefMayBeEncodedByPartialPrefix("foo/bar/qux", "f/b"));
-    assert(RefMayBeEncodedByPartialPrefix("foo/bar/qux", "f/b/q"));
-    assert(RefMayBeEncodedByPartialPrefix("foo/bar/qux", "f/ba/q"));
-    assert(RefMayBeEncodedByPartialPrefix("foo/bar/qux", "f/bar/q"));
-    assert(RefMayBeEncodedByPartialPrefix("foo/bar/qux", "foo/bar/qux"));
-    assert(RefMayBeEncodedByPartialPrefix("foo/bar-qux", "f/b-q"));
-    assert(RefMayBeEncodedByPartialPrefix("foo/barQux", "f/bQ"));
-
-    assert(!RefMayBeEncodedByPartialPrefix("foo/bar/qux", "fo/baz/q"));
-    assert(!RefMayBeEncodedByPartialPrefix("foo", "f/b"));
-    assert(!RefMayBeEncodedByPartialPrefix("foo/", "f/b"));
-    assert(!RefMayBeEncodedByPartialPrefix("foo/b", "f/bar"));
-    assert(!RefMayBeEncodedByPartialPrefix("foo/bar/qux", "f/q"));
-    assert(!RefMayBeEncodedByPartialPrefix("foo/bar-qux", "f/brq"));
+static string ObtainNextSuggestedSuffix(bool forwardSearch, const string &currentPrefix, const string &currentSuffix, Stream suitableRefs) {
+    NextItemFold fold = NextItemFoldCreate(forwardSearch, currentPrefix + currentSuffix);
+    Drain(suitableRefs, [&fold](const string &ref) -> bool {
+        NextItemFoldAdd(fold, ref);
+        return true;
+    });
+    return DropPrefix(NextItemFoldResult(fold), currentPrefix);
+}
 
+void LogicTest() {
+    // the order of refs does not matter
     {
         vector<string> suitableRefs = { string("abcfoo"), string("abcxyz"), string("abcbar") };
-        assert(string("bar") == ObtainNextSuggestedSuffix(true,  string("abc"), string("xyz"), suitableRefs));
-        assert(string("foo") == ObtainNextSuggestedSuffix(true,  string("abc"), string("bar"), suitableRefs));
-        assert(string("foo") == ObtainNextSuggestedSuffix(true,  string("abc"), string(""), suitableRefs));
-        assert(string("foo") == ObtainNextSuggestedSuffix(false, string("abc"), string("xyz"), suitableRefs));
-        assert(string("bar") == ObtainNextSuggestedSuffix(false, string("abc"), string("foo"), suitableRefs));
-        assert(string("bar") == ObtainNextSuggestedSuffix(false,  string("abc"), string(""), suitableRefs));
+        assert(string("bar") == ObtainNextSuggestedSuffix(true,  string("abc"), string("xyz"), StreamFromVector(suitableRefs)));
+        assert(string("foo") == ObtainNextSuggestedSuffix(true,  string("abc"), string("bar"), StreamFromVector(suitableRefs)));
+        assert(string("bar") == ObtainNextSuggestedSuffix(true,  string("abc"), string(""), StreamFromVector(suitableRefs)));
+        assert(string("foo") == ObtainNextSuggestedSuffix(false, string("abc"), string("xyz"), StreamFromVector(suitableRefs)));
+        assert(string("bar") == ObtainNextSuggestedSuffix(false, string("abc"), string("foo"), StreamFromVector(suitableRefs)));
+        assert(string("xyz") == ObtainNextSuggestedSuffix(false,  string("abc"), string(""), StreamFromVector(suitableRefs)));
     }
     {
         vector<string> suitableRefs = { string("abc"), string("abcxyz"), string("abcbar") };
-        assert(string("")    == ObtainNextSuggestedSuffix(true,  string("abc"), string("bar"), suitableRefs));
-        assert(string("xyz") == ObtainNextSuggestedSuffix(true,  string("abc"), string(""), suitableRefs));
-        assert(string("bar") == ObtainNextSuggestedSuffix(false, string("abc"), string(""), suitableRefs));
-        assert(string("")    == ObtainNextSuggestedSuffix(false, string("abc"), string("xyz"), suitableRefs));
+        assert(string("xyz") == ObtainNextSuggestedSuffix(true,  string("abc"), string("bar"), StreamFromVector(suitableRefs)));
+        assert(string("")    == ObtainNextSuggestedSuffix(true,  string("abc"), string("xyz"), StreamFromVector(suitableRefs)));
+        assert(string("bar") == ObtainNextSuggestedSuffix(true,  string("abc"), string(""), StreamFromVector(suitableRefs)));
+        assert(string("xyz") == ObtainNextSuggestedSuffix(false, string("abc"), string(""), StreamFromVector(suitableRefs)));
+        assert(string("")    == ObtainNextSuggestedSuffix(false, string("abc"), string("bar"), StreamFromVector(suitableRefs)));
     }
 }
 #endif
@@ -9,6 +9,14 @@ typedef struct tOptions {
     int showDialog;
     int stripRemoteName;
     int suggestNextSuffix;
+    int showRefsTree;
+    int localeOrder;
+    int newRefsFirst;
+    int localRemoteRefs;
+    int historyRank;
+    int allRefTokens;
+    int packLooseRefs;
+    std::string query; // filter of refs (see RefQuery), empty if refs are not filtered
 } Options;
 
 git_repository* OpenGitRepo(std::wstring dir);
@@ -0,0 +1,191 @@
+#include "MultiPrefix.hpp"
+
+#include <cassert>
+#include <map>
+
+#include "Utils.hpp"
+
+using namespace std;
+
+static const uint32_t NO_STATE = UINT32_MAX;
+
+PatternAutomaton PatternAutomatonCreate(const vector<string> &patterns) {
+    PatternAutomaton automaton;
+    automaton.delta.assign(256, NO_STATE);
+    automaton.outputs.resize(1);
+
+    // The trie of the patterns, missing transitions are NO_STATE so far.
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        assert(!patterns[i].empty());
+        uint32_t state = 0;
+        for (auto c = patterns[i].begin(); c != patterns[i].end(); ++c) {
+            size_t transition = (size_t)state * 256 + (unsigned char)*c;
+            if (automaton.delta[transition] == NO_STATE) {
+                automaton.delta[transition] = (uint32_t)automaton.outputs.size();
+                automaton.outputs.push_back(vector<uint32_t>());
+                automaton.delta.resize(automaton.delta.size() + 256, NO_STATE);
+            }
+            state = automaton.delta[transition];
+        }
+        automaton.outputs[state].push_back((uint32_t)i);
+        automaton.lengths.push_back(patterns[i].length());
+    }
+
+    // Breadth-first, so the failure state (the longest proper suffix in the trie) of a state is complete before it.
+    // Missing transitions are replaced by those of the failure state, which turns the trie into a DFA.
+    vector<uint32_t> fail(automaton.outputs.size(), 0);
+    vector<uint32_t> queue;
+    for (size_t c = 0; c < 256; ++c) {
+        uint32_t &next = automaton.delta[c];
+        if (next == NO_STATE) {
+            next = 0;
+        } else {
+            queue.push_back(next);
+        }
+    }
+    for (size_t head = 0; head < queue.size(); ++head) {
+        uint32_t state = queue[head];
+        const vector<uint32_t> &inherited = automaton.outputs[fail[state]];
+        automaton.outputs[state].insert(automaton.outputs[state].end(), inherited.begin(), inherited.end());
+        for (size_t c = 0; c < 256; ++c) {
+            uint32_t &next = automaton.delta[(size_t)state * 256 + c];
+            uint32_t failNext = automaton.delta[(size_t)fail[state] * 256 + c];
+            if (next == NO_STATE) {
+                next = failNext;
+            } else {
+                fail[next] = failNext;
+                queue.push_back(next);
+            }
+        }
+    }
+    return automaton;
+}
+
+void PatternAutomatonScan(const PatternAutomaton &automaton, const char *text, vector<unsigned char> &found) {
+    found.assign(automaton.lengths.size(), 0);
+    uint32_t state = 0;
+    for (size_t i = 0; text[i] != '\0'; ++i) {
+        state = automaton.delta[(size_t)state * 256 + (unsigned char)text[i]];
+        const vector<uint32_t> &outputs = automaton.outputs[state];
+        for (auto it = outputs.begin(); it != outputs.end(); ++it) {
+            found[*it] |= (automaton.lengths[*it] == i + 1) ? (PATTERN_FOUND | PATTERN_AT_START) : PATTERN_FOUND;
+        }
+    }
+}
+
+/** "f/h-t" -> "f", "/h", "-t"; "/h" -> "/h". */
+static vector<string> PartialPrefixSegments(const string &prefix) {
+    vector<string> segments;
+    size_t start = 0;
+    for (size_t i = 1; i <= prefix.length(); ++i) {
+        if (i == prefix.length() || IsPartialPrefixAnchor(prefix[i])) {
+            segments.push_back(prefix.substr(start, i - start));
+            start = i;
+        }
+    }
+    return segments;
+}
+
+MultiPrefixMatcher MultiPrefixMatcherCreate(const vector<string> &prefixes) {
+    MultiPrefixMatcher matcher;
+    matcher.prefixes = prefixes;
+
+    // A segment of one prefix may be another prefix, every text is a single pattern.
+    vector<string> patterns;
+    map<string, uint32_t> indices;
+    auto pattern = [&patterns, &indices](const string &text) -> uint32_t {
+        auto found = indices.find(text);
+        if (found != indices.end()) {
+            return found->second;
+        }
+        patterns.push_back(text);
+        return indices[text] = (uint32_t)(patterns.size() - 1);
+    };
+    for (auto prefix = prefixes.begin(); prefix != prefixes.end(); ++prefix) {
+        assert(!prefix->empty());
+        matcher.prefixPatterns.push_back(pattern(*prefix));
+        vector<string> segments = PartialPrefixSegments(*prefix);
+        matcher.segmentPatterns.push_back(vector<uint32_t>());
+        for (auto segment = segments.begin(); segment != segments.end(); ++segment) {
+            matcher.segmentPatterns.back().push_back(pattern(*segment));
+        }
+    }
+    matcher.automaton = PatternAutomatonCreate(patterns);
+    return matcher;
+}
+
+void MultiPrefixMatcherAdd(MultiPrefixMatcher &matcher, const string &ref, vector<PrefixMatches> &matches) {
+    assert(matches.size() == matcher.prefixes.size());
+    PatternAutomatonScan(matcher.automaton, ref.c_str(), matcher.found);
+    const vector<unsigned char> &found = matcher.found;
+
+    for (size_t i = 0; i < matcher.prefixes.size(); ++i) {
+        const string &prefix = matcher.prefixes[i];
+        if (found[matcher.prefixPatterns[i]] & PATTERN_AT_START) {
+            matches[i].strict.push_back(ref);
+            matches[i].partial.push_back(ref);
+            continue;
+        }
+        // The first char is matched literally unless it is an anchor.
+        const vector<uint32_t> &segments = matcher.segmentPatterns[i];
+        bool candidate = (found[segments[0]] & (IsPartialPrefixAnchor(prefix[0]) ? PATTERN_FOUND : PATTERN_AT_START)) != 0;
+        for (size_t j = 1; j < segments.size() && candidate; ++j) {
+            candidate = (found[segments[j]] & PATTERN_FOUND) != 0;
+        }
+        if (candidate && RefMayBeEncodedByPartialPrefix(ref.c_str(), prefix.c_str())) {
+            matches[i].partial.push_back(ref);
+        }
+    }
+}
+
+#ifdef DEBUG
+void MultiPrefixTest() {
+    {
+        PatternAutomaton automaton = PatternAutomatonCreate(vector<string>{ "he", "she", "his", "hers" });
+        vector<unsigned char> found;
+        PatternAutomatonScan(automaton, "ushers", found);
+        assert((vector<unsigned char>{ PATTERN_FOUND, PATTERN_FOUND, 0, PATTERN_FOUND }) == found);
+        PatternAutomatonScan(automaton, "hers", found);
+        unsigned char atStart = PATTERN_FOUND | PATTERN_AT_START;
+        assert((vector<unsigned char>{ atStart, 0, 0, atStart }) == found);
+        PatternAutomatonScan(automaton, "", found);
+        assert((vector<unsigned char>{ 0, 0, 0, 0 }) == found);
+        // a failed match continues from the longest suffix: "shis" contains "his"
+        PatternAutomatonScan(automaton, "shis", found);
+        assert((vector<unsigned char>{ 0, 0, PATTERN_FOUND, 0 }) == found);
+    }
+    {
+        assert((vector<string>{ "f", "/h", "-t" }) == PartialPrefixSegments("f/h-t"));
+        assert((vector<string>{ "/h" }) == PartialPrefixSegments("/h"));
+        assert((vector<string>{ "fe" }) == PartialPrefixSegments("fe"));
+    }
+    {
+        vector<string> prefixes = { "fe", "ma", "f/h", "/t", "master" };
+        MultiPrefixMatcher matcher = MultiPrefixMatcherCreate(prefixes);
+        vector<PrefixMatches> matches(prefixes.size());
+        vector<string> refs = { "feature/x", "master", "main", "fix/help-typo", "origin/fix/help", "fe", "svn/trunk", "mast" };
+        for (auto ref = refs.begin(); ref != refs.end(); ++ref) {
+            MultiPrefixMatcherAdd(matcher, *ref, matches);
+        }
+        assert((vector<string>{ "feature/x", "fe" }) == matches[0].strict);
+        assert((vector<string>{ "feature/x", "fe" }) == matches[0].partial);
+        assert((vector<string>{ "master", "main", "mast" }) == matches[1].strict);
+        assert(matches[2].strict.empty());
+        assert((vector<string>{ "fix/help-typo" }) == matches[2].partial);
+        assert(matches[3].strict.empty());
+        assert((vector<string>{ "svn/trunk" }) == matches[3].partial);
+        assert((vector<string>{ "master" }) == matches[4].strict);
+
+        // the same as matching one by one
+        for (size_t i = 0; i < prefixes.size(); ++i) {
+            vector<string> partial;
+            for (auto ref = refs.begin(); ref != refs.end(); ++ref) {
+                if (RefMayBeEncodedByPartialPrefix(ref->c_str(), prefixes[i].c_str())) {
+                    partial.push_back(*ref);
+                }
+            }
+            assert(partial == matches[i].partial);
+        }
+    }
+}
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Matching of every ref against several prefixes (e.g. "fe" and "ma" of "git diff fe..ma") in one pass.
+//
+// An Aho-Corasick automaton over the prefixes and over the anchored segments of the partial prefixes
+// ("f", "/h" and "-t" of "f/h-t") reads each ref once, a byte per table lookup. A prefix found at the
+// start of the ref is a strict match. A partial match is checked by RefMayBeEncodedByPartialPrefix,
+// but only for the refs which contain all segments of the prefix, i.e. for few of them.
+
+typedef struct tPatternAutomaton {
+    std::vector<uint32_t> delta;                // 256 transitions per state, state 0 is the root
+    std::vector<std::vector<uint32_t>> outputs; // patterns ending in the state, those of its suffixes included
+    std::vector<size_t> lengths;                // by pattern
+} PatternAutomaton;
+
+PatternAutomaton PatternAutomatonCreate(const std::vector<std::string> &patterns);
+
+/** Flags of a pattern found in a text. */
+typedef enum tPatternFound {
+    PATTERN_FOUND = 1,
+    PATTERN_AT_START = 2,
+} PatternFound;
+
+/** found has an entry for each pattern, it gets the flags of the patterns found in the text. */
+void PatternAutomatonScan(const PatternAutomaton &automaton, const char *text, std::vector<unsigned char> &found);
+
+typedef struct tMultiPrefixMatcher {
+    std::vector<std::string> prefixes;
+    PatternAutomaton automaton;
+    std::vector<uint32_t> prefixPatterns;               // by prefix
+    std::vector<std::vector<uint32_t>> segmentPatterns; // by prefix, the first segment must be at the start
+    std::vector<unsigned char> found;                   // of the last scan
+} MultiPrefixMatcher;
+
+/** Suitable refs of one prefix, in the order they were added. */
+typedef struct tPrefixMatches {
+    std::vector<std::string> strict;  // start with the prefix
+    std::vector<std::string> partial; // are encoded by the prefix as a partial one, strict matches included
+} PrefixMatches;
+
+MultiPrefixMatcher MultiPrefixMatcherCreate(const std::vector<std::string> &prefixes);
+
+/** matches has an entry for each prefix, the ref is added to the entries of the prefixes it suits. */
+void MultiPrefixMatcherAdd(MultiPrefixMatcher &matcher, const std::string &ref, std::vector<PrefixMatches> &matches);
+
+#ifdef DEBUG
+void MultiPrefixTest();
+#endif
@@ -0,0 +1,298 @@
+#include "NumericRefs.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <map>
+#include <utility>
+
+#include "Utils.hpp"
+
+using namespace std;
+
+// Any number of this many digits fits into uint64_t, longer digit runs are names.
+static const size_t MAX_DIGITS = 18;
+
+/** "pull/123/head" -> "pull", "123", "head"; "pull/" -> "pull", "". */
+static vector<string> SplitSegments(const string &name) {
+    vector<string> segments;
+    size_t start = 0;
+    size_t slash;
+    while ((slash = name.find('/', start)) != string::npos) {
+        segments.push_back(name.substr(start, slash - start));
+        start = slash + 1;
+    }
+    segments.push_back(name.substr(start));
+    return segments;
+}
+
+/** Only the decimal form of a number is a number, "007" is a name which would not survive formatting. */
+static bool ParseNumber(const string &segment, uint64_t &value) {
+    if (segment.empty() || segment.length() > MAX_DIGITS || (segment[0] == '0' && segment.length() > 1)) {
+        return false;
+    }
+    value = 0;
+    for (auto c = segment.begin(); c != segment.end(); ++c) {
+        if (*c < '0' || *c > '9') {
+            return false;
+        }
+        value = value * 10 + (uint64_t)(*c - '0');
+    }
+    return true;
+}
+
+NumericIndex NumericIndexCreate(const vector<string> &fullNames) {
+    static const string REFS("refs/");
+    // numbers of names by segments of their shape
+    map<vector<string>, vector<vector<uint64_t>>> shapes;
+    for (auto fullName = fullNames.begin(); fullName != fullNames.end(); ++fullName) {
+        if (!StartsWith(*fullName, REFS)) {
+            continue;
+        }
+        vector<string> segments = SplitSegments(fullName->substr(REFS.length()));
+        const string &space = segments[0];
+        if (segments.size() < 2 || space == "heads" || space == "tags" || space == "remotes") {
+            continue;
+        }
+        vector<uint64_t> numbers;
+        for (auto segment = segments.begin(); segment != segments.end(); ++segment) {
+            uint64_t value;
+            if (ParseNumber(*segment, value)) {
+                numbers.push_back(value);
+                segment->clear();
+            }
+        }
+        if (!numbers.empty()) {
+            shapes[segments].push_back(numbers);
+        }
+    }
+
+    NumericIndex index;
+    index.count = 0;
+    for (auto it = shapes.begin(); it != shapes.end(); ++it) {
+        vector<vector<uint64_t>> &names = it->second;
+        sort(names.begin(), names.end());
+        names.erase(unique(names.begin(), names.end()), names.end());
+
+        NumericShape shape;
+        shape.segments = it->first;
+        shape.arity = names[0].size();
+        shape.numbers.reserve(names.size() * shape.arity);
+        for (auto name = names.begin(); name != names.end(); ++name) {
+            shape.numbers.insert(shape.numbers.end(), name->begin(), name->end());
+        }
+        index.count += names.size();
+        index.shapes.push_back(shape);
+    }
+    return index;
+}
+
+/** The first name in [begin, end) whose number in the field is not less than value; names of the range agree on the previous fields. */
+static size_t LowerBound(const NumericShape &shape, size_t begin, size_t end, size_t field, uint64_t value) {
+    while (begin < end) {
+        size_t middle = begin + (end - begin) / 2;
+        if (shape.numbers[middle * shape.arity + field] < value) {
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    return begin;
+}
+
+/**
+ * Appends ranges of names of the shape which start with the segments of a prefix, in the numeric order.
+ * Returns false if the prefix does not narrow numbers of the shape.
+ */
+static bool ShapeRanges(const NumericShape &shape, const vector<string> &prefixSegments, vector<pair<size_t, size_t>> &ranges) {
+    if (prefixSegments.size() > shape.segments.size()) {
+        return false;
+    }
+    size_t begin = 0;
+    size_t end = shape.numbers.size() / shape.arity;
+    size_t field = 0;
+    bool narrowed = false;
+
+    // Complete segments fix numbers one by one.
+    size_t last = prefixSegments.size() - 1;
+    for (size_t i = 0; i < last; ++i) {
+        uint64_t value;
+        if (!shape.segments[i].empty()) {
+            if (shape.segments[i] != prefixSegments[i]) {
+                return false;
+            }
+        } else if (ParseNumber(prefixSegments[i], value)) {
+            size_t first = LowerBound(shape, begin, end, field, value);
+            end = LowerBound(shape, first, end, field, value + 1);
+            begin = first;
+            field++;
+            narrowed = true;
+        } else {
+            return false;
+        }
+    }
+
+    const string &typed = prefixSegments[last];
+    if (!shape.segments[last].empty() || typed.empty()) {
+        if (!StartsWith(shape.segments[last], typed)) {
+            return false;
+        }
+        if (narrowed && begin < end) {
+            ranges.push_back(make_pair(begin, end));
+        }
+        return narrowed;
+    }
+
+    // The typed digits start numbers of each length: [t, t], [t0, t9], [t00, t99], ...
+    uint64_t value;
+    if (!ParseNumber(typed, value)) {
+        return false;
+    }
+    uint64_t low = value;
+    uint64_t high = value;
+    for (size_t digits = typed.length(); digits <= MAX_DIGITS; ++digits) {
+        size_t first = LowerBound(shape, begin, end, field, low);
+        size_t next = LowerBound(shape, first, end, field, high + 1);
+        if (first < next) {
+            ranges.push_back(make_pair(first, next));
+        }
+        if (value == 0 || next == end) {
+            break; // "0" starts no other number, or there are no greater numbers
+        }
+        begin = next;
+        low = low * 10;
+        high = high * 10 + 9;
+    }
+    return true;
+}
+
+size_t NumericIndexCount(const NumericIndex &index, const string &prefix) {
+    vector<string> prefixSegments = SplitSegments(prefix);
+    size_t count = 0;
+    for (auto shape = index.shapes.begin(); shape != index.shapes.end(); ++shape) {
+        vector<pair<size_t, size_t>> ranges;
+        ShapeRanges(*shape, prefixSegments, ranges);
+        for (auto range = ranges.begin(); range != ranges.end(); ++range) {
+            count += range->second - range->first;
+        }
+    }
+    return count;
+}
+
+static string ShapeName(const NumericShape &shape, size_t name) {
+    string result;
+    const uint64_t *numbers = &shape.numbers[name * shape.arity];
+    for (size_t i = 0; i < shape.segments.size(); ++i) {
+        if (i > 0) {
+            result += '/';
+        }
+        result += shape.segments[i].empty() ? to_string(*numbers++) : shape.segments[i];
+    }
+    return result;
+}
+
+vector<string> NumericIndexMatch(const NumericIndex &index, const string &prefix, const atomic<bool> *cancelled) {
+    vector<string> prefixSegments = SplitSegments(prefix);
+    vector<string> names;
+    size_t shapesMatched = 0;
+    for (auto shape = index.shapes.begin(); shape != index.shapes.end(); ++shape) {
+        vector<pair<size_t, size_t>> ranges;
+        ShapeRanges(*shape, prefixSegments, ranges);
+        for (auto range = ranges.begin(); range != ranges.end(); ++range) {
+            for (size_t name = range->first; name < range->second; ++name) {
+                if (cancelled != nullptr && *cancelled) {
+                    return names;
+                }
+                names.push_back(ShapeName(*shape, name));
+            }
+        }
+        shapesMatched += ranges.empty() ? 0 : 1;
+    }
+    // Names of a shape are already in the numeric order, names of several shapes interleave.
+    if (shapesMatched > 1) {
+        sort(names.begin(), names.end(), NumericNameLess);
+    }
+    return names;
+}
+
+static size_t DigitsEnd(const string &s, size_t begin) {
+    while (begin < s.length() && s[begin] >= '0' && s[begin] <= '9') {
+        begin++;
+    }
+    return begin;
+}
+
+bool NumericNameLess(const string &x, const string &y) {
+    size_t i = 0;
+    size_t j = 0;
+    while (i < x.length() && j < y.length()) {
+        bool xDigit = (x[i] >= '0' && x[i] <= '9');
+        bool yDigit = (y[j] >= '0' && y[j] <= '9');
+        if (!xDigit || !yDigit || x[i] == '0' || y[j] == '0') {
+            // Runs with leading zeros are compared as chars, they precede all other runs anyway.
+            if (x[i] != y[j]) {
+                return (unsigned char)x[i] < (unsigned char)y[j];
+            }
+            i++;
+            j++;
+            continue;
+        }
+        size_t xEnd = DigitsEnd(x, i);
+        size_t yEnd = DigitsEnd(y, j);
+        if (xEnd - i != yEnd - j) {
+            return xEnd - i < yEnd - j;
+        }
+        int byDigits = x.compare(i, xEnd - i, y, j, yEnd - j);
+        if (byDigits != 0) {
+            return byDigits < 0;
+        }
+        i = xEnd;
+        j = yEnd;
+    }
+    return x.length() - i < y.length() - j;
+}
+
+#ifdef DEBUG
+void NumericRefsTest() {
+    assert((vector<string>{ "pull", "123", "head" }) == SplitSegments("pull/123/head"));
+    assert((vector<string>{ "pull", "" }) == SplitSegments("pull/"));
+    assert((vector<string>{ "" }) == SplitSegments(""));
+
+    assert(NumericNameLess("pull/99/head", "pull/123/head"));
+    assert(!NumericNameLess("pull/123/head", "pull/99/head"));
+    assert(NumericNameLess("pull/123/head", "pull/123/merge"));
+    assert(NumericNameLess("pull/12", "pull/12/head"));
+    assert(NumericNameLess("a1b", "a12"));
+    assert(NumericNameLess("v007", "v1") && NumericNameLess("v0", "v1") && NumericNameLess("v09", "v10"));
+    assert(!NumericNameLess("pull/5", "pull/5"));
+
+    vector<string> fullNames = {
+        "refs/pull/99/head", "refs/pull/123/head", "refs/pull/1234/head", "refs/pull/12/head", "refs/pull/120/head",
+        "refs/pull/5/head", "refs/pull/123/merge", "refs/pull/0/head", "refs/pull/007/head",
+        "refs/changes/45/12345/3", "refs/changes/45/12345/10", "refs/changes/46/12346/1",
+        "refs/heads/pull/1", "refs/tags/v1/2", "refs/remotes/origin/1", "refs/stash", "HEAD",
+        "refs/pull/99999999999999999999/head",
+    };
+    NumericIndex index = NumericIndexCreate(fullNames);
+    assert(3 == index.shapes.size() && 11 == index.count);
+
+    assert((vector<string>{ "pull/12/head", "pull/120/head", "pull/123/head", "pull/123/merge", "pull/1234/head" })
+        == NumericIndexMatch(index, "pull/12"));
+    assert(5 == NumericIndexCount(index, "pull/12"));
+    assert((vector<string>{ "pull/123/head", "pull/123/merge", "pull/1234/head" }) == NumericIndexMatch(index, "pull/123"));
+    assert((vector<string>{ "pull/123/merge" }) == NumericIndexMatch(index, "pull/123/m"));
+    assert((vector<string>{ "pull/123/head", "pull/123/merge" }) == NumericIndexMatch(index, "pull/123/"));
+    assert((vector<string>{ "pull/0/head" }) == NumericIndexMatch(index, "pull/0"));
+    assert((vector<string>{ "pull/99/head" }) == NumericIndexMatch(index, "pull/9"));
+    assert((vector<string>{ "changes/45/12345/3", "changes/45/12345/10" }) == NumericIndexMatch(index, "changes/45/"));
+    assert((vector<string>{ "changes/45/12345/10" }) == NumericIndexMatch(index, "changes/45/12345/1"));
+    atomic<bool> cancelled(true);
+    assert(NumericIndexMatch(index, "pull/12", &cancelled).empty());
+    assert((vector<string>{ "changes/45/12345/3", "changes/45/12345/10", "changes/46/12346/1" }) == NumericIndexMatch(index, "changes/4"));
+
+    // prefixes which do not narrow numbers
+    assert(0 == NumericIndexCount(index, "") && 0 == NumericIndexCount(index, "pu") && 0 == NumericIndexCount(index, "pull/"));
+    assert(NumericIndexMatch(index, "pull/").empty());
+    assert(0 == NumericIndexCount(index, "pull/00") && 0 == NumericIndexCount(index, "pull/12x") && 0 == NumericIndexCount(index, "pull/77"));
+    assert(0 == NumericIndexCount(index, "heads/pull/1") && 0 == NumericIndexCount(index, "pull/123/head/1"));
+}
+#endif
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Mirrors of code review hosts have hundreds of thousands of refs like "refs/pull/12345/head" or
+// "refs/changes/45/12345/3", which differ only in numbers. Names of one shape ("pull/#/head") keep their
+// numbers in one sorted array, so a typed number is answered by range arithmetic instead of a scan:
+// the numbers whose decimal form starts with "123" are [123, 123], [1230, 1239], [12300, 12399], ...
+
+typedef struct tNumericShape {
+    std::vector<std::string> segments; // of names, an empty segment stands for a number
+    size_t arity;                      // number of numeric segments
+    std::vector<uint64_t> numbers;     // arity numbers per name, names are sorted by them
+} NumericShape;
+
+typedef struct tNumericIndex {
+    std::vector<NumericShape> shapes;
+    size_t count; // names of all shapes
+} NumericIndex;
+
+/**
+ * Indexes refs outside of heads, tags and remotes which have numeric segments.
+ * Names are given without "refs/" ("pull/12345/head"), git resolves them so.
+ */
+NumericIndex NumericIndexCreate(const std::vector<std::string> &fullNames);
+
+/**
+ * Number of names which start with the prefix if the prefix narrows numbers of some shape
+ * ("pull/12", "changes/45/"), otherwise 0 (e.g. "pu" and "pull/" do not).
+ */
+size_t NumericIndexCount(const NumericIndex &index, const std::string &prefix);
+
+/** Names which are counted by NumericIndexCount, in the numeric order. Stops early once cancelled is set. */
+std::vector<std::string> NumericIndexMatch(const NumericIndex &index, const std::string &prefix, const std::atomic<bool> *cancelled = nullptr);
+
+/** Runs of digits are compared by their values: "pull/99/head" < "pull/123/head". */
+bool NumericNameLess(const std::string &x, const std::string &y);
+
+#ifdef DEBUG
+void NumericRefsTest();
+#endif
@@ -0,0 +1,313 @@
+#include "RefBitmap.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <set>
+
+using namespace std;
+
+// A sparse container of this many ids takes as much memory as a dense one.
+static const uint32_t ARRAY_MAX = 4096;
+static const size_t WORDS = 1024;
+
+typedef enum tBitmapOperation {
+    BITMAP_AND,
+    BITMAP_OR,
+    BITMAP_AND_NOT,
+} BitmapOperation;
+
+static uint32_t PopCount(uint64_t x) {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (uint32_t)((x * 0x0101010101010101ULL) >> 56);
+}
+
+static bool IsDense(const BitmapContainer &container) {
+    return !container.words.empty();
+}
+
+static bool ContainerContains(const BitmapContainer &container, uint16_t low) {
+    if (IsDense(container)) {
+        return ((container.words[low >> 6] >> (low & 63)) & 1) != 0;
+    }
+    return binary_search(container.array.begin(), container.array.end(), low);
+}
+
+static vector<uint64_t> ContainerWords(const BitmapContainer &container) {
+    if (IsDense(container)) {
+        return container.words;
+    }
+    vector<uint64_t> words(WORDS, 0);
+    for (auto low = container.array.begin(); low != container.array.end(); ++low) {
+        words[*low >> 6] |= 1ULL << (*low & 63);
+    }
+    return words;
+}
+
+/** Counts the ids and picks the representation by their number. */
+static void Normalize(BitmapContainer &container) {
+    if (!IsDense(container)) {
+        container.count = (uint32_t)container.array.size();
+        if (container.count > ARRAY_MAX) {
+            container.words = ContainerWords(container);
+            container.array.clear();
+        }
+        return;
+    }
+    container.count = 0;
+    for (auto word = container.words.begin(); word != container.words.end(); ++word) {
+        container.count += PopCount(*word);
+    }
+    if (container.count <= ARRAY_MAX) {
+        container.array.clear();
+        for (size_t i = 0; i < WORDS; ++i) {
+            for (uint64_t word = container.words[i], bit = 0; word != 0; word >>= 1, ++bit) {
+                if (word & 1) {
+                    container.array.push_back((uint16_t)(i * 64 + bit));
+                }
+            }
+        }
+        container.words.clear();
+    }
+}
+
+RefBitmap RefBitmapRange(uint32_t begin, uint32_t end) {
+    RefBitmap bitmap;
+    for (uint32_t first = begin; first < end; ) {
+        uint32_t last = min(end, ((first >> 16) + 1) << 16); // the end of the container
+        if (last == 0) {
+            last = end; // ids of the last container wrap around
+        }
+        BitmapContainer container;
+        container.key = (uint16_t)(first >> 16);
+        container.count = last - first;
+        if (container.count <= ARRAY_MAX) {
+            for (uint32_t id = first; id < last; ++id) {
+                container.array.push_back((uint16_t)id);
+            }
+        } else {
+            container.words.assign(WORDS, 0);
+            for (uint32_t id = first; id < last; ++id) {
+                container.words[(id & 0xffff) >> 6] |= 1ULL << (id & 63);
+            }
+        }
+        bitmap.containers.push_back(container);
+        first = last;
+    }
+    return bitmap;
+}
+
+void RefBitmapAdd(RefBitmap &bitmap, uint32_t id) {
+    uint16_t key = (uint16_t)(id >> 16);
+    uint16_t low = (uint16_t)id;
+    vector<BitmapContainer> &containers = bitmap.containers;
+    auto found = (containers.empty() || containers.back().key < key)
+        ? containers.end()
+        : lower_bound(containers.begin(), containers.end(), key, [](const BitmapContainer &container, uint16_t key) -> bool {
+            return container.key < key;
+        });
+    if (found == containers.end() || found->key != key) {
+        BitmapContainer container;
+        container.key = key;
+        container.count = 0;
+        found = containers.insert(found, container);
+    }
+    BitmapContainer &container = *found;
+    if (IsDense(container)) {
+        uint64_t &word = container.words[low >> 6];
+        uint64_t bit = 1ULL << (low & 63);
+        container.count += (word & bit) ? 0 : 1;
+        word |= bit;
+        return;
+    }
+    vector<uint16_t> &array = container.array;
+    if (array.empty() || array.back() < low) {
+        array.push_back(low);
+    } else {
+        auto position = lower_bound(array.begin(), array.end(), low);
+        if (*position == low) {
+            return;
+        }
+        array.insert(position, low);
+    }
+    Normalize(container);
+}
+
+bool RefBitmapContains(const RefBitmap &bitmap, uint32_t id) {
+    uint16_t key = (uint16_t)(id >> 16);
+    auto found = lower_bound(bitmap.containers.begin(), bitmap.containers.end(), key, [](const BitmapContainer &container, uint16_t key) -> bool {
+        return container.key < key;
+    });
+    return found != bitmap.containers.end() && found->key == key && ContainerContains(*found, (uint16_t)id);
+}
+
+size_t RefBitmapCount(const RefBitmap &bitmap) {
+    size_t count = 0;
+    for (auto container = bitmap.containers.begin(); container != bitmap.containers.end(); ++container) {
+        count += container->count;
+    }
+    return count;
+}
+
+static BitmapContainer CombineContainers(const BitmapContainer &x, const BitmapContainer &y, BitmapOperation operation) {
+    assert(x.key == y.key);
+    BitmapContainer result;
+    result.key = x.key;
+    result.count = 0;
+    if (!IsDense(x) && !IsDense(y)) {
+        auto out = back_inserter(result.array);
+        if (operation == BITMAP_AND) {
+            set_intersection(x.array.begin(), x.array.end(), y.array.begin(), y.array.end(), out);
+        } else if (operation == BITMAP_OR) {
+            set_union(x.array.begin(), x.array.end(), y.array.begin(), y.array.end(), out);
+        } else {
+            set_difference(x.array.begin(), x.array.end(), y.array.begin(), y.array.end(), out);
+        }
+    } else if (!IsDense(x) && operation != BITMAP_OR) {
+        // Few ids of x are looked up in the bits of y.
+        bool keepFound = (operation == BITMAP_AND);
+        copy_if(x.array.begin(), x.array.end(), back_inserter(result.array), [&y, keepFound](uint16_t low) -> bool {
+            return ContainerContains(y, low) == keepFound;
+        });
+    } else if (!IsDense(y) && operation == BITMAP_AND) {
+        return CombineContainers(y, x, operation);
+    } else {
+        result.words = ContainerWords(x);
+        vector<uint64_t> converted;
+        const vector<uint64_t> &other = IsDense(y) ? y.words : (converted = ContainerWords(y));
+        for (size_t i = 0; i < WORDS; ++i) {
+            if (operation == BITMAP_AND) {
+                result.words[i] &= other[i];
+            } else if (operation == BITMAP_OR) {
+                result.words[i] |= other[i];
+            } else {
+                result.words[i] &= ~other[i];
+            }
+        }
+    }
+    Normalize(result);
+    return result;
+}
+
+/** Containers of one of the bitmaps are copied as is if the operation keeps them. */
+static RefBitmap Combine(const RefBitmap &x, const RefBitmap &y, BitmapOperation operation) {
+    RefBitmap result;
+    auto xi = x.containers.begin();
+    auto yi = y.containers.begin();
+    while (xi != x.containers.end() || yi != y.containers.end()) {
+        if (yi == y.containers.end() || (xi != x.containers.end() && xi->key < yi->key)) {
+            if (operation != BITMAP_AND) {
+                result.containers.push_back(*xi);
+            }
+            ++xi;
+        } else if (xi == x.containers.end() || yi->key < xi->key) {
+            if (operation == BITMAP_OR) {
+                result.containers.push_back(*yi);
+            }
+            ++yi;
+        } else {
+            BitmapContainer container = CombineContainers(*xi, *yi, operation);
+            if (container.count > 0) {
+                result.containers.push_back(container);
+            }
+            ++xi;
+            ++yi;
+        }
+    }
+    return result;
+}
+
+RefBitmap RefBitmapAnd(const RefBitmap &x, const RefBitmap &y) {
+    return Combine(x, y, BITMAP_AND);
+}
+
+RefBitmap RefBitmapOr(const RefBitmap &x, const RefBitmap &y) {
+    return Combine(x, y, BITMAP_OR);
+}
+
+RefBitmap RefBitmapAndNot(const RefBitmap &x, const RefBitmap &y) {
+    return Combine(x, y, BITMAP_AND_NOT);
+}
+
+vector<uint32_t> RefBitmapIds(const RefBitmap &bitmap) {
+    vector<uint32_t> ids;
+    ids.reserve(RefBitmapCount(bitmap));
+    for (auto container = bitmap.containers.begin(); container != bitmap.containers.end(); ++container) {
+        uint32_t high = (uint32_t)container->key << 16;
+        if (!IsDense(*container)) {
+            for (auto low = container->array.begin(); low != container->array.end(); ++low) {
+                ids.push_back(high | *low);
+            }
+            continue;
+        }
+        for (size_t i = 0; i < WORDS; ++i) {
+            for (uint64_t word = container->words[i], bit = 0; word != 0; word >>= 1, ++bit) {
+                if (word & 1) {
+                    ids.push_back(high | (uint32_t)(i * 64 + bit));
+                }
+            }
+        }
+    }
+    return ids;
+}
+
+#ifdef DEBUG
+void RefBitmapTest() {
+    assert(0 == PopCount(0) && 64 == PopCount(~0ULL) && 3 == PopCount(0x8000000000000101ULL));
+
+    RefBitmap empty;
+    assert(0 == RefBitmapCount(empty) && RefBitmapIds(empty).empty());
+    assert(RefBitmapRange(5, 5).containers.empty());
+
+    // a sparse container turns into bits once it has more ids than ARRAY_MAX and back once it has fewer
+    RefBitmap evens;
+    for (uint32_t id = 0; id < 20000; id += 2) {
+        RefBitmapAdd(evens, id);
+    }
+    assert(IsDense(evens.containers[0]) && 10000 == RefBitmapCount(evens));
+    RefBitmapAdd(evens, 4);
+    assert(10000 == RefBitmapCount(evens));
+    assert(RefBitmapContains(evens, 19998) && !RefBitmapContains(evens, 19999) && !RefBitmapContains(evens, 70000));
+
+    RefBitmap scattered;
+    vector<uint32_t> ids = { 70001, 3, 1000000, 5, 4, 3, 65535, 65536 };
+    for (auto id = ids.begin(); id != ids.end(); ++id) {
+        RefBitmapAdd(scattered, *id);
+    }
+    assert((vector<uint32_t>{ 3, 4, 5, 65535, 65536, 70001, 1000000 }) == RefBitmapIds(scattered));
+    assert(3 == scattered.containers.size() && !IsDense(scattered.containers[0]));
+
+    // ranges span containers
+    RefBitmap range = RefBitmapRange(65530, 140000);
+    assert(3 == range.containers.size() && 140000 - 65530 == RefBitmapCount(range));
+    assert(IsDense(range.containers[1]) && !IsDense(range.containers[0]));
+    assert(RefBitmapContains(range, 65530) && RefBitmapContains(range, 139999) && !RefBitmapContains(range, 140000));
+
+    assert((vector<uint32_t>{ 65535, 65536, 70001 }) == RefBitmapIds(RefBitmapAnd(scattered, range)));
+    assert((vector<uint32_t>{ 4 }) == RefBitmapIds(RefBitmapAnd(scattered, evens)));
+    assert((vector<uint32_t>{ 4 }) == RefBitmapIds(RefBitmapAnd(evens, scattered)));
+    assert((vector<uint32_t>{ 3, 5, 65535, 65536, 70001, 1000000 }) == RefBitmapIds(RefBitmapAndNot(scattered, evens)));
+    assert(10000 + 6 == RefBitmapCount(RefBitmapOr(evens, scattered)));
+
+    // dense with dense, the result of ANDNOT gets sparse
+    RefBitmap firstHalf = RefBitmapRange(0, 10000);
+    RefBitmap odds = RefBitmapAndNot(firstHalf, evens);
+    assert(5000 == RefBitmapCount(odds) && IsDense(odds.containers[0]));
+    RefBitmap tail = RefBitmapAndNot(firstHalf, RefBitmapRange(0, 9990));
+    assert(10 == RefBitmapCount(tail) && !IsDense(tail.containers[0]) && 9990 == RefBitmapIds(tail)[0]);
+    assert(RefBitmapAnd(odds, evens).containers.empty());
+    assert(10000 == RefBitmapCount(RefBitmapOr(odds, firstHalf)));
+
+    // the same as sets of ids
+    set<uint32_t> expected(ids.begin(), ids.end());
+    for (uint32_t id = 0; id < 20000; id += 2) {
+        expected.insert(id);
+    }
+    for (uint32_t id = 65530; id < 140000; ++id) {
+        expected.insert(id);
+    }
+    assert(vector<uint32_t>(expected.begin(), expected.end()) == RefBitmapIds(RefBitmapOr(RefBitmapOr(evens, scattered), range)));
+}
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compressed sets of ref ids in the style of Roaring bitmaps.
+//
+// Ids are split by their high 16 bits into containers. A container keeps the sorted low 16 bits of its ids
+// while it has few of them and switches to 65536 bits once the array would be larger, so a handful of
+// scattered ids and long runs of ids (e.g. all tags, all names with a prefix) are both small,
+// and AND/OR/ANDNOT of two sets cost about the size of the smaller representation.
+
+typedef struct tBitmapContainer {
+    uint16_t key;                 // high 16 bits of the ids
+    uint32_t count;
+    std::vector<uint16_t> array;  // sorted low 16 bits of the ids while the container is sparse
+    std::vector<uint64_t> words;  // bits of all 65536 low values once it is dense, the array is empty then
+} BitmapContainer;
+
+typedef struct tRefBitmap {
+    std::vector<BitmapContainer> containers; // sorted by keys, none is empty
+} RefBitmap;
+
+/** Ids of [begin, end), e.g. of the names with a prefix in a sorted list of names. */
+RefBitmap RefBitmapRange(uint32_t begin, uint32_t end);
+
+/** Ids may be added in any order, ascending ones are appended without a search. */
+void RefBitmapAdd(RefBitmap &bitmap, uint32_t id);
+
+bool RefBitmapContains(const RefBitmap &bitmap, uint32_t id);
+
+size_t RefBitmapCount(const RefBitmap &bitmap);
+
+RefBitmap RefBitmapAnd(const RefBitmap &x, const RefBitmap &y);
+
+RefBitmap RefBitmapOr(const RefBitmap &x, const RefBitmap &y);
+
+/** Ids of x which are not in y. */
+RefBitmap RefBitmapAndNot(const RefBitmap &x, const RefBitmap &y);
+
+/** All ids in ascending order. */
+std::vector<uint32_t> RefBitmapIds(const RefBitmap &bitmap);
+
+#ifdef DEBUG
+void RefBitmapTest();
+#endif
@@ -0,0 +1,55 @@
+#include "RefFiles.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+RefFilesSurvey SurveyRefFiles(const string &gitDir) {
+    RefFilesSurvey survey;
+    FileStamp packed = StampFile(gitDir + "packed-refs");
+    survey.packedSize = packed.exists ? packed.size : 0;
+    survey.fingerprint.stamps.push_back(packed);
+    survey.looseCount = 0;
+
+    vector<string> pending = { gitDir + "refs" };
+    while (!pending.empty()) {
+        string dir = pending.back();
+        pending.pop_back();
+
+        survey.fingerprint.stamps.push_back(StampFile(dir));
+
+        vector<string> subdirs;
+        survey.looseCount += ListDir(dir, subdirs);
+        for (auto it = subdirs.begin(); it != subdirs.end(); ++it) {
+            pending.push_back(dir + "/" + *it);
+        }
+    }
+    return survey;
+}
+
+bool RefFilesUnchanged(const RefFilesFingerprint &fingerprint) {
+    // refs are stored somewhere else (e.g. in a newer format), so the fingerprint proves nothing
+    bool anyExists = any_of(fingerprint.stamps.begin(), fingerprint.stamps.end(), [](const FileStamp &stamp) -> bool {
+        return stamp.exists;
+    });
+    if (!anyExists) {
+        return false;
+    }
+
+    return StampsUnchanged(fingerprint.stamps);
+}
+
+#ifdef DEBUG
+void RefFilesTest() {
+    RefFilesSurvey survey = SurveyRefFiles(string("surely/not/existing/.git/"));
+    assert(0 == survey.looseCount && 0 == survey.packedSize);
+    assert(2 == survey.fingerprint.stamps.size());
+    assert(!survey.fingerprint.stamps[0].exists && !survey.fingerprint.stamps[1].exists);
+    assert(!RefFilesUnchanged(survey.fingerprint));
+
+    RefFilesFingerprint changed = survey.fingerprint;
+    changed.stamps[0].exists = true;
+    assert(!RefFilesUnchanged(changed));
+}
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Files.hpp"
+
+// Cheap look at the files which store refs of a repository, without reading them:
+// "packed-refs" and loose refs under "refs/".
+//
+// Any change of refs either rewrites packed-refs or renames a lock file into a directory of loose refs,
+// so modification times of packed-refs and of all loose refs directories fingerprint the refs.
+
+typedef struct tRefFilesFingerprint {
+    std::vector<FileStamp> stamps; // packed-refs and every directory of loose refs
+} RefFilesFingerprint;
+
+typedef struct tRefFilesSurvey {
+    RefFilesFingerprint fingerprint;
+    size_t looseCount;
+    int64_t packedSize;
+} RefFilesSurvey;
+
+/** Walks all directories of loose refs, gitDir is the path returned by git_repository_commondir. */
+RefFilesSurvey SurveyRefFiles(const std::string &gitDir);
+
+/**
+ * Stats only the files of the fingerprint, so it is much cheaper than a survey.
+ * Returns false if none of the files exists.
+ */
+bool RefFilesUnchanged(const RefFilesFingerprint &fingerprint);
+
+#ifdef DEBUG
+void RefFilesTest();
+#endif
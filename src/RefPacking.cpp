@@ -0,0 +1,103 @@
+#include "RefPacking.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <git2.h>
+
+#include "Files.hpp"
+#include "RefFiles.hpp"
+
+using namespace std;
+
+// The outcome is written by the packing thread and is taken by the main thread, both under lock.
+static mutex packingLock;
+static thread packingThread;
+static atomic<bool> packingRunning(false);
+static bool outcomeReady = false;
+static string packingOutcome;
+
+bool RefPackingBlocked(const string &gitDir) {
+    return StampFile(gitDir + "packed-refs.lock").exists || StampFile(gitDir + "gc.pid").exists;
+}
+
+/** Runs in the packing thread, which uses its own repository object. */
+static void PackRefs(const string gitDir) {
+    auto start = chrono::steady_clock::now();
+    size_t looseBefore = SurveyRefFiles(gitDir).looseCount;
+    string outcome;
+    git_repository *repo = nullptr;
+    git_refdb *refdb = nullptr;
+    int error = git_repository_open(&repo, gitDir.c_str());
+    if (error >= 0) {
+        error = git_repository_refdb(&refdb, repo);
+    }
+    if (error >= 0) {
+        error = git_refdb_compress(refdb);
+    }
+    if (error < 0) {
+        const git_error *e = giterr_last();
+        outcome = "libgit2 error " + to_string(error) + ": " + ((e != nullptr) ? e->message : "");
+    } else {
+        size_t looseAfter = SurveyRefFiles(gitDir).looseCount;
+        outcome = to_string(looseBefore) + " loose refs before, " + to_string(looseAfter) + " after";
+    }
+    if (refdb != nullptr) {
+        git_refdb_free(refdb);
+    }
+    if (repo != nullptr) {
+        git_repository_free(repo);
+    }
+    outcome = "Packing of refs of " + gitDir + ": " + outcome + ", "
+        + to_string((size_t)chrono::duration<double, milli>(chrono::steady_clock::now() - start).count()) + " ms";
+
+    {
+        lock_guard<mutex> guard(packingLock);
+        packingOutcome = outcome;
+        outcomeReady = true;
+    }
+    packingRunning = false;
+}
+
+bool StartRefPacking(const string &gitDir) {
+    if (packingRunning || RefPackingBlocked(gitDir)) {
+        return false;
+    }
+    if (packingThread.joinable()) {
+        packingThread.join();
+    }
+    packingRunning = true;
+    packingThread = thread(PackRefs, gitDir);
+    return true;
+}
+
+bool TakeRefPackingOutcome(string &outcome) {
+    lock_guard<mutex> guard(packingLock);
+    if (!outcomeReady) {
+        return false;
+    }
+    outcome = packingOutcome;
+    outcomeReady = false;
+    return true;
+}
+
+void StopRefPacking() {
+    if (packingThread.joinable()) {
+        packingThread.join();
+    }
+}
+
+#ifdef DEBUG
+void RefPackingTest() {
+    string gitDir("surely/not/existing/.git/");
+    assert(!RefPackingBlocked(gitDir));
+    string outcome;
+    assert(!TakeRefPackingOutcome(outcome));
+    assert(StartRefPacking(gitDir));
+    StopRefPacking();
+    assert(TakeRefPackingOutcome(outcome) && outcome.find(gitDir) != string::npos);
+    assert(!TakeRefPackingOutcome(outcome));
+}
+#endif
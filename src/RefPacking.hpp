@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+// Packing of loose refs in the background, like "git pack-refs --all".
+//
+// Thousands of loose refs (e.g. created by CI scripts) make every enumeration open thousands of files,
+// while packed refs are parsed from one file. Packing is done by libgit2, which takes "packed-refs.lock"
+// like git does and removes a loose ref only under its own lock and only if it still points where it was packed,
+// so refs changed by a concurrent git process are kept. Packing is not started while git holds the lock
+// or runs gc, and a failure to take a lock just postpones it.
+
+/** Git holds the lock of packed-refs or runs gc in the repository, gitDir is the common dir. */
+bool RefPackingBlocked(const std::string &gitDir);
+
+/** Starts packing unless packing of any repository is already running, returns false if it is not started. */
+bool StartRefPacking(const std::string &gitDir);
+
+/** Returns true once per finished packing and describes its outcome. */
+bool TakeRefPackingOutcome(std::string &outcome);
+
+/** Waits for the packing, must be called before the plugin is unloaded. */
+void StopRefPacking();
+
+#ifdef DEBUG
+void RefPackingTest();
+#endif
@@ -0,0 +1,234 @@
+#include "RefQuery.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+
+#include "Utils.hpp"
+
+using namespace std;
+
+// Relative costs of checking a term for one ref: a commit read is the unit.
+static const double BITMAP_COST = 0.001;
+static const double NAME_COST = 0.05;
+static const double COMMIT_COST = 1.0;
+static const double HISTORY_COST = 20.0;
+
+// Guessed shares of refs for which a term holds, until the term is observed often enough.
+static const double PARTIAL_PREFIX_GUESS = 0.1;
+static const double AGE_GUESS = 0.5;
+static const double AUTHOR_GUESS = 0.3;
+static const double MERGED_GUESS = 0.5;
+static const size_t OBSERVED_ENOUGH = 10;
+
+static vector<string> SplitBy(const string &text, char separator) {
+    vector<string> parts;
+    size_t start = 0;
+    size_t end;
+    while ((end = text.find(separator, start)) != string::npos) {
+        parts.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    parts.push_back(text.substr(start));
+    return parts;
+}
+
+/** "30d" -> seconds. */
+static bool ParseAge(const string &text, int64_t &seconds) {
+    static const string UNITS("hdwmy");
+    static const int64_t UNIT_SECONDS[] = { 3600, 86400, 7 * 86400, 30 * 86400, 365 * 86400 };
+    if (text.length() < 2 || UNITS.find(text.back()) == string::npos) {
+        return false;
+    }
+    int64_t count = 0;
+    for (size_t i = 0; i + 1 < text.length(); ++i) {
+        if (text[i] < '0' || text[i] > '9' || count > 1000000) {
+            return false;
+        }
+        count = count * 10 + (text[i] - '0');
+    }
+    seconds = count * UNIT_SECONDS[UNITS.find(text.back())];
+    return true;
+}
+
+static bool ParseTerm(const string &word, QueryTerm &term, string &error) {
+    static const char *FIELDS[] = { "kind", "remote", "name", nullptr, nullptr, "age", "author", "merged" };
+    term.text = word;
+    term.negated = (word[0] == '-');
+    string body = term.negated ? word.substr(1) : word;
+    size_t colon = body.find(':');
+    string key = body.substr(0, colon);
+    string value = (colon == string::npos) ? string("") : body.substr(colon + 1);
+    term.younger = false;
+    term.seconds = 0;
+
+    size_t field = 0;
+    while (field < sizeof(FIELDS) / sizeof(FIELDS[0]) && (FIELDS[field] == nullptr || key != FIELDS[field])) {
+        field++;
+    }
+    if (field == sizeof(FIELDS) / sizeof(FIELDS[0])) {
+        error = "unknown term \"" + word + "\"";
+        return false;
+    }
+    term.field = (QueryField)field;
+    if (term.field == QUERY_MERGED && value.empty()) {
+        value = "HEAD";
+    }
+    if (term.field == QUERY_AGE) {
+        if (value.empty() || (value[0] != '<' && value[0] != '>') || !ParseAge(value.substr(1), term.seconds)) {
+            error = "expected age:<N or age:>N with h, d, w, m or y in \"" + word + "\"";
+            return false;
+        }
+        term.younger = (value[0] == '<');
+        return true;
+    }
+    term.values = SplitBy(value, ',');
+    for (auto it = term.values.begin(); it != term.values.end(); ++it) {
+        bool known = !it->empty() && (term.field != QUERY_KIND || *it == "branch" || *it == "tag" || *it == "remote");
+        if (!known) {
+            error = "bad value \"" + *it + "\" in \"" + word + "\"";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ParseRefQuery(const string &query, vector<QueryTerm> &terms, string &error) {
+    terms.clear();
+    vector<string> words = SplitBy(query, ' ');
+    for (auto word = words.begin(); word != words.end(); ++word) {
+        if (word->empty()) {
+            continue;
+        }
+        QueryTerm term;
+        if (!ParseTerm(*word, term, error)) {
+            terms.clear();
+            return false;
+        }
+        terms.push_back(term);
+    }
+    return true;
+}
+
+QueryTerm QueryPrefixTerm(const string &prefix, bool partial) {
+    QueryTerm term;
+    term.field = partial ? QUERY_PARTIAL_PREFIX : QUERY_PREFIX;
+    term.negated = false;
+    term.values.push_back(prefix);
+    term.younger = false;
+    term.seconds = 0;
+    term.text = (partial ? "partial prefix \"" : "prefix \"") + prefix + "\"";
+    return term;
+}
+
+bool QueryTermIsBitmap(const QueryTerm &term) {
+    return term.field == QUERY_KIND || term.field == QUERY_REMOTE || term.field == QUERY_NAME || term.field == QUERY_PREFIX;
+}
+
+void ObserveQueryTerm(QueryStats &stats, const QueryTerm &term, size_t checked, size_t passed) {
+    assert(passed <= checked);
+    QueryObservation &observation = stats[term.text];
+    observation.checked += checked;
+    observation.passed += passed;
+}
+
+static double TermCost(const QueryTerm &term) {
+    switch (term.field) {
+        case QUERY_PARTIAL_PREFIX:
+            return NAME_COST;
+        case QUERY_AGE:
+        case QUERY_AUTHOR:
+            return COMMIT_COST;
+        case QUERY_MERGED:
+            return HISTORY_COST;
+        default:
+            return BITMAP_COST;
+    }
+}
+
+static double GuessedSelectivity(const QueryTerm &term, const QueryStats &stats) {
+    auto observed = stats.find(term.text);
+    if (observed != stats.end() && observed->second.checked >= OBSERVED_ENOUGH) {
+        return (double)observed->second.passed / observed->second.checked;
+    }
+    double guess = (term.field == QUERY_PARTIAL_PREFIX) ? PARTIAL_PREFIX_GUESS
+        : (term.field == QUERY_AGE) ? AGE_GUESS
+        : (term.field == QUERY_AUTHOR) ? AUTHOR_GUESS
+        : MERGED_GUESS;
+    return term.negated ? 1 - guess : guess;
+}
+
+vector<QueryStep> PlanRefQuery(const vector<QueryTerm> &terms, const vector<double> &knownSelectivities, const QueryStats &stats) {
+    assert(terms.size() == knownSelectivities.size());
+    vector<QueryStep> plan;
+    for (size_t i = 0; i < terms.size(); ++i) {
+        double selectivity = (knownSelectivities[i] >= 0) ? knownSelectivities[i] : GuessedSelectivity(terms[i], stats);
+        QueryStep step = { i, selectivity, TermCost(terms[i]) };
+        plan.push_back(step);
+    }
+    stable_sort(plan.begin(), plan.end(), [](const QueryStep &x, const QueryStep &y) -> bool {
+        return (1 - x.selectivity) / x.cost > (1 - y.selectivity) / y.cost;
+    });
+    return plan;
+}
+
+string DescribeRefQueryPlan(const vector<QueryTerm> &terms, const vector<QueryStep> &plan) {
+    ostringstream description;
+    description.precision(3);
+    for (auto step = plan.begin(); step != plan.end(); ++step) {
+        description << (step == plan.begin() ? "" : " -> ") << terms[step->term].text
+            << " (" << (QueryTermIsBitmap(terms[step->term]) ? "bitmap" : "per ref")
+            << ", selectivity = " << step->selectivity << ", cost = " << step->cost << ")";
+    }
+    return description.str();
+}
+
+#ifdef DEBUG
+void RefQueryTest() {
+    vector<QueryTerm> terms;
+    string error;
+    assert(ParseRefQuery("kind:branch,tag  age:<30d -author:me merged -name:wip/*", terms, error));
+    assert(5 == terms.size());
+    assert(QUERY_KIND == terms[0].field && (vector<string>{ "branch", "tag" }) == terms[0].values && !terms[0].negated);
+    assert(QUERY_AGE == terms[1].field && terms[1].younger && 30 * 86400 == terms[1].seconds);
+    assert(QUERY_AUTHOR == terms[2].field && terms[2].negated && string("-author:me") == terms[2].text);
+    assert(QUERY_MERGED == terms[3].field && (vector<string>{ "HEAD" }) == terms[3].values);
+    assert(QUERY_NAME == terms[4].field && terms[4].negated && (vector<string>{ "wip/*" }) == terms[4].values);
+
+    assert(ParseRefQuery("age:>2y", terms, error) && !terms[0].younger && 2 * 365 * 86400 == terms[0].seconds);
+    assert(ParseRefQuery("", terms, error) && terms.empty());
+    assert(!ParseRefQuery("kind:branch color:red", terms, error) && terms.empty() && !error.empty());
+    assert(!ParseRefQuery("kind:commit", terms, error));
+    assert(!ParseRefQuery("age:30d", terms, error) && !ParseRefQuery("age:<30s", terms, error) && !ParseRefQuery("age:<d", terms, error));
+    assert(!ParseRefQuery("remote:", terms, error) && !ParseRefQuery("name:a,,b", terms, error));
+    assert(!ParseRefQuery("prefix:ma", terms, error));
+
+    // selective bitmaps go first, commits are read for the survivors, the history is walked last
+    assert(ParseRefQuery("merged author:me kind:branch remote:origin", terms, error));
+    terms.push_back(QueryPrefixTerm("fe", false));
+    vector<double> known = { -1, -1, 0.6, 0.3, 0.01 };
+    QueryStats stats;
+    vector<QueryStep> plan = PlanRefQuery(terms, known, stats);
+    vector<size_t> order;
+    for (auto step = plan.begin(); step != plan.end(); ++step) {
+        order.push_back(step->term);
+    }
+    assert((vector<size_t>{ 4, 3, 2, 1, 0 }) == order);
+    assert(AUTHOR_GUESS == plan[3].selectivity);
+    assert(DescribeRefQueryPlan(terms, plan).find("prefix \"fe\" (bitmap") == 0);
+
+    // observations replace guesses once there are enough of them:
+    // the walk of the history which drops all refs goes before the author who is almost always me
+    ObserveQueryTerm(stats, terms[0], 5, 0);
+    assert(MERGED_GUESS == PlanRefQuery(terms, known, stats)[4].selectivity);
+    ObserveQueryTerm(stats, terms[0], 15, 0);
+    ObserveQueryTerm(stats, terms[1], 40, 39);
+    plan = PlanRefQuery(terms, known, stats);
+    assert(0 == plan[3].term && 0.0 == plan[3].selectivity && 1 == plan[4].term);
+
+    // a partial prefix is checked by names, before commits
+    vector<QueryTerm> partial = { terms[1], QueryPrefixTerm("f/h", true) };
+    plan = PlanRefQuery(partial, vector<double>{ -1, -1 }, QueryStats());
+    assert(1 == plan[0].term && !QueryTermIsBitmap(partial[1]) && QueryTermIsBitmap(terms[4]));
+}
+#endif
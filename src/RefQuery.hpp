@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Filter queries of refs, e.g. Plugin.Call("...", "Query=kind:branch age:<30d author:me").
+//
+// Terms are separated by spaces and all of them must hold, "-" negates a term,
+// alternatives of a value are separated by commas ("kind:branch,tag"):
+//
+//   kind:branch|tag|remote, remote:<name>, name:<glob>  are bitmaps of the snapshot (see RefTable);
+//   age:<30d, age:>1y (h, d, w, m, y), author:me|<text>  need the commits of refs;
+//   merged, merged:<revision>                             walk the history.
+//
+// The typed prefix is one more term. The planner orders terms so that those which drop the most refs
+// per unit of cost go first, i.e. bitmaps and the prefix range narrow refs before any commit is read.
+
+typedef enum tQueryField {
+    QUERY_KIND,
+    QUERY_REMOTE,
+    QUERY_NAME,
+    QUERY_PREFIX,         // the range of names which start with the typed prefix
+    QUERY_PARTIAL_PREFIX, // names which may be encoded by the typed prefix, if none starts with it
+    QUERY_AGE,
+    QUERY_AUTHOR,
+    QUERY_MERGED,
+} QueryField;
+
+typedef struct tQueryTerm {
+    QueryField field;
+    bool negated;
+    std::vector<std::string> values; // alternatives, any of them is enough
+    bool younger;                    // "age:<", otherwise "age:>"
+    int64_t seconds;                 // of age
+    std::string text;                // as written, "-" included
+} QueryTerm;
+
+/** Returns false and describes the error if the query is malformed. */
+bool ParseRefQuery(const std::string &query, std::vector<QueryTerm> &terms, std::string &error);
+
+QueryTerm QueryPrefixTerm(const std::string &prefix, bool partial);
+
+/** Terms which are bitmaps over the names, their selectivities are known exactly. */
+bool QueryTermIsBitmap(const QueryTerm &term);
+
+/** How often terms held for the refs they were checked for, by the text of the term. */
+typedef struct tQueryObservation {
+    size_t checked;
+    size_t passed;
+} QueryObservation;
+
+typedef std::map<std::string, QueryObservation> QueryStats;
+
+void ObserveQueryTerm(QueryStats &stats, const QueryTerm &term, size_t checked, size_t passed);
+
+typedef struct tQueryStep {
+    size_t term;        // index of the term
+    double selectivity; // estimated share of refs for which the term holds
+    double cost;        // of checking the term for one ref, a bitmap lookup is the cheapest
+} QueryStep;
+
+/**
+ * Orders terms by (1 - selectivity) / cost. Selectivities of bitmaps are given (negative if unknown),
+ * others are estimated from the observations of the repository or guessed.
+ */
+std::vector<QueryStep> PlanRefQuery(const std::vector<QueryTerm> &terms, const std::vector<double> &knownSelectivities, const QueryStats &stats);
+
+std::string DescribeRefQueryPlan(const std::vector<QueryTerm> &terms, const std::vector<QueryStep> &plan);
+
+#ifdef DEBUG
+void RefQueryTest();
+#endif
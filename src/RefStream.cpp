@@ -0,0 +1,222 @@
+#include "RefStream.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <memory>
+
+#include "Log.hpp"
+#include "Utils.hpp"
+
+using namespace std;
+
+Stream EmptyStream() {
+    return [](string &) -> bool {
+        return false;
+    };
+}
+
+Stream StreamFromVector(const vector<string> &items) {
+    shared_ptr<size_t> next = make_shared<size_t>(0);
+    return [&items, next](string &item) -> bool {
+        if (*next == items.size()) {
+            return false;
+        }
+        item = items[(*next)++];
+        return true;
+    };
+}
+
+size_t ExpandRefName(const char *ref, bool stripRemoteName, string names[2]) {
+    const char *prefixes[] = { "refs/heads/", "refs/tags/" };
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); ++i) {
+        if (StartsWith(ref, prefixes[i])) {
+            names[0].assign(ref + strlen(prefixes[i]));
+            return 1;
+        }
+    }
+    const char *remotePrefix = "refs/remotes/";
+    if (StartsWith(ref, remotePrefix)) {
+        const char *remoteRef = ref + strlen(remotePrefix);
+        names[0].assign(remoteRef);
+
+        if (stripRemoteName) {
+            const char *slashPtr = strchr(remoteRef, '/');
+            assert(slashPtr != nullptr);
+            names[1].assign(slashPtr + 1);
+            return 2;
+        }
+        return 1;
+    }
+    // there are also "refs/stash", "refs/notes"
+    LOG("Ignored ref = " << ref);
+    return 0;
+}
+
+// One ref may give two names, the second one waits here.
+// The buffers are swapped with the items, so once they have grown to the longest name
+// expansion makes no heap calls.
+typedef struct tExpansion {
+    string fullName;
+    string names[2];
+    size_t count;
+    size_t next;
+} Expansion;
+
+Stream ExpandRefNames(Stream fullNames, bool stripRemoteName) {
+    shared_ptr<Expansion> expansion = make_shared<Expansion>();
+    expansion->count = 0;
+    expansion->next = 0;
+    return [fullNames, stripRemoteName, expansion](string &item) -> bool {
+        while (expansion->next == expansion->count) {
+            if (!fullNames(expansion->fullName)) {
+                return false;
+            }
+            expansion->count = ExpandRefName(expansion->fullName.c_str(), stripRemoteName, expansion->names);
+            expansion->next = 0;
+        }
+        item.swap(expansion->names[expansion->next++]);
+        return true;
+    };
+}
+
+Stream FilterStream(Stream source, function<bool (const char *)> predicate) {
+    return [source, predicate](string &item) -> bool {
+        while (source(item)) {
+            if (predicate(item.c_str())) {
+                return true;
+            }
+        }
+        return false;
+    };
+}
+
+size_t Drain(Stream stream, function<bool (const string &)> sink) {
+    size_t count = 0;
+    string item;
+    while (stream(item)) {
+        count++;
+        if (!sink(item)) {
+            break;
+        }
+    }
+    return count;
+}
+
+void CollectSortedUnique(Stream stream, vector<string> &result) {
+    Drain(stream, [&result](const string &item) -> bool {
+        result.push_back(item);
+        return true;
+    });
+    sort(result.begin(), result.end());
+    result.erase(unique(result.begin(), result.end()), result.end());
+}
+
+CommonPrefixFold CommonPrefixFoldCreate(size_t floorLength) {
+    CommonPrefixFold fold = { false, floorLength, string("") };
+    return fold;
+}
+
+void CommonPrefixFoldAdd(CommonPrefixFold &fold, const string &item) {
+    if (!fold.any) {
+        fold.any = true;
+        fold.prefix = item;
+        return;
+    }
+    if (CommonPrefixFoldCollapsed(fold)) {
+        return;
+    }
+    size_t common = 0;
+    size_t maxCommon = min(fold.prefix.length(), item.length());
+    while (common < maxCommon && fold.prefix[common] == item[common]) {
+        common++;
+    }
+    fold.prefix.resize(Utf8Floor(fold.prefix, common));
+}
+
+bool CommonPrefixFoldCollapsed(const CommonPrefixFold &fold) {
+    return fold.any && fold.prefix.length() <= fold.floorLength;
+}
+
+NextItemFold NextItemFoldCreate(bool forward, const string &current) {
+    NextItemFold fold = { forward, current, false, false, false, string(""), string("") };
+    return fold;
+}
+
+void NextItemFoldAdd(NextItemFold &fold, const string &item) {
+    // "Before" in the direction of the search.
+    auto precedes = [&fold](const string &x, const string &y) -> bool {
+        return fold.forward ? (x < y) : (y < x);
+    };
+
+    if (!fold.any || precedes(item, fold.extreme)) {
+        fold.extreme = item;
+    }
+    fold.any = true;
+
+    if (item == fold.current) {
+        fold.currentFound = true;
+    } else if (precedes(fold.current, item) && (!fold.hasNeighbour || precedes(item, fold.neighbour))) {
+        fold.neighbour = item;
+        fold.hasNeighbour = true;
+    }
+}
+
+string NextItemFoldResult(const NextItemFold &fold) {
+    assert(fold.any);
+    return (fold.currentFound && fold.hasNeighbour) ? fold.neighbour : fold.extreme;
+}
+
+#ifdef DEBUG
+void RefStreamTest() {
+    vector<string> fullNames = {
+        string("refs/heads/master"),
+        string("refs/tags/v1.0"),
+        string("refs/remotes/origin/master"),
+        string("refs/remotes/origin/fix"),
+        string("refs/stash"),
+    };
+
+    {
+        vector<string> names;
+        CollectSortedUnique(ExpandRefNames(StreamFromVector(fullNames), true), names);
+        assert((vector<string>{ string("fix"), string("master"), string("origin/fix"), string("origin/master"), string("v1.0") }) == names);
+    }
+    {
+        vector<string> names;
+        CollectSortedUnique(ExpandRefNames(StreamFromVector(fullNames), false), names);
+        assert((vector<string>{ string("master"), string("origin/fix"), string("origin/master"), string("v1.0") }) == names);
+    }
+    {
+        // the consumer stops the pipeline: only the needed refs are pulled from the source
+        size_t pulled = 0;
+        Stream source = StreamFromVector(fullNames);
+        Stream counted = [source, &pulled](string &item) -> bool {
+            bool result = source(item);
+            pulled += result ? 1 : 0;
+            return result;
+        };
+        Stream masters = FilterStream(ExpandRefNames(counted, true), [](const char *name) -> bool {
+            return StartsWith(name, "m");
+        });
+        assert(1 == Drain(masters, [](const string &) -> bool { return false; }));
+        assert(1 == pulled);
+    }
+
+    {
+        CommonPrefixFold fold = CommonPrefixFoldCreate(2);
+        CommonPrefixFoldAdd(fold, string("abcdef"));
+        CommonPrefixFoldAdd(fold, string("abcxyz"));
+        assert(string("abc") == fold.prefix && !CommonPrefixFoldCollapsed(fold));
+        CommonPrefixFoldAdd(fold, string("ab"));
+        assert(string("ab") == fold.prefix && CommonPrefixFoldCollapsed(fold));
+    }
+    {
+        // "\xD0\xB8" and "\xD0\xB0" share the lead byte, which is not a prefix on its own
+        CommonPrefixFold fold = CommonPrefixFoldCreate(0);
+        CommonPrefixFoldAdd(fold, string("fix/\xD0\xB8"));
+        CommonPrefixFoldAdd(fold, string("fix/\xD0\xB0"));
+        assert(string("fix/") == fold.prefix);
+    }
+}
+#endif
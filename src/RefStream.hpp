@@ -0,0 +1,84 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Completion is built as a pull-based pipeline of streams:
+// enumeration -> expansion to short names -> filtering -> consumer.
+// Every stage pulls the next item from its source only when it is asked for one,
+// so a consumer which has got enough stops the whole pipeline.
+
+/** Puts the next item into item and returns true, or returns false if the stream is exhausted. */
+typedef std::function<bool (std::string &item)> Stream;
+
+Stream EmptyStream();
+
+/**
+ * The items are not copied, they must outlive the stream: e.g. a temporary vector may be streamed
+ * only within the full expression which drains the stream.
+ */
+Stream StreamFromVector(const std::vector<std::string> &items);
+
+/**
+ * Turns full ref names into names suitable for completion:
+ * "refs/heads/master" -> "master", "refs/remotes/origin/fix" -> "origin/fix" and also "fix" if stripRemoteName.
+ */
+Stream ExpandRefNames(Stream fullNames, bool stripRemoteName);
+
+/** Puts the names of the ref into names and returns their number, the same as ExpandRefNames for one ref. */
+size_t ExpandRefName(const char *ref, bool stripRemoteName, std::string names[2]);
+
+Stream FilterStream(Stream source, std::function<bool (const char *)> predicate);
+
+/**
+ * Pulls items and passes them to the sink until the stream is exhausted or the sink returns false.
+ * Returns the number of pulled items.
+ */
+size_t Drain(Stream stream, std::function<bool (const std::string &)> sink);
+
+/** Collects sorted and deduplicated items. */
+void CollectSortedUnique(Stream stream, std::vector<std::string> &result);
+
+/**
+ * Incremental longest common prefix.
+ * It stops comparing once the prefix is collapsed to floorLength characters
+ * (e.g. to the user prefix which all strictly matched refs start with).
+ */
+typedef struct tCommonPrefixFold {
+    bool any;
+    size_t floorLength;
+    std::string prefix;
+} CommonPrefixFold;
+
+CommonPrefixFold CommonPrefixFoldCreate(size_t floorLength);
+
+void CommonPrefixFoldAdd(CommonPrefixFold &fold, const std::string &item);
+
+bool CommonPrefixFoldCollapsed(const CommonPrefixFold &fold);
+
+/**
+ * Finds the item following (or preceding) current in the sorted order of the stream,
+ * cycling at the ends. If current is absent, the first (or the last) item is taken.
+ * Neither sorting nor deduplication of the stream is required.
+ */
+typedef struct tNextItemFold {
+    bool forward;
+    std::string current;
+    bool any;
+    bool currentFound;
+    bool hasNeighbour;
+    std::string neighbour; // the nearest item after (before) current
+    std::string extreme;   // the first (last) item
+} NextItemFold;
+
+NextItemFold NextItemFoldCreate(bool forward, const std::string &current);
+
+void NextItemFoldAdd(NextItemFold &fold, const std::string &item);
+
+/** Must not be called if no items were added. */
+std::string NextItemFoldResult(const NextItemFold &fold);
+
+#ifdef DEBUG
+void RefStreamTest();
+#endif
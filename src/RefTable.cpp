@@ -0,0 +1,138 @@
+#include "RefTable.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "RefStream.hpp"
+#include "Utils.hpp"
+
+using namespace std;
+
+/** Bitmaps are made of ascending ids, so ids are appended to containers without searches. */
+static RefBitmap BitmapFromIds(vector<uint32_t> &ids) {
+    sort(ids.begin(), ids.end());
+    RefBitmap bitmap;
+    for (auto id = ids.begin(); id != ids.end(); ++id) {
+        RefBitmapAdd(bitmap, *id);
+    }
+    return bitmap;
+}
+
+void RefTableBuild(RefTable &table, const vector<string> &fullNames, const vector<string> &names, bool stripRemoteName) {
+    static const char *KIND_PREFIXES[REF_KINDS_COUNT] = { "refs/heads/", "refs/tags/", "refs/remotes/" };
+    assert(is_sorted(names.begin(), names.end()));
+    table.count = names.size();
+    table.sources.assign(names.size(), (size_t)-1);
+
+    vector<uint32_t> kindIds[REF_KINDS_COUNT];
+    map<string, vector<uint32_t>> remoteIds;
+    string expanded[2];
+    for (auto fullName = fullNames.begin(); fullName != fullNames.end(); ++fullName) {
+        int kind = 0;
+        while (kind < REF_KINDS_COUNT && !StartsWith(fullName->c_str(), KIND_PREFIXES[kind])) {
+            kind++;
+        }
+        if (kind == REF_KINDS_COUNT) {
+            continue; // other refs are not expanded to names
+        }
+        size_t count = ExpandRefName(fullName->c_str(), stripRemoteName, expanded);
+        vector<uint32_t> *remote = (kind == REF_KIND_REMOTE) ? &remoteIds[expanded[0].substr(0, expanded[0].find('/'))] : nullptr;
+        for (size_t i = 0; i < count; ++i) {
+            auto found = lower_bound(names.begin(), names.end(), expanded[i]);
+            if (found == names.end() || *found != expanded[i]) {
+                continue;
+            }
+            uint32_t id = (uint32_t)(found - names.begin());
+            if (table.sources[id] == (size_t)-1 || kind != REF_KIND_REMOTE) {
+                table.sources[id] = (size_t)(fullName - fullNames.begin());
+            }
+            kindIds[kind].push_back(id);
+            if (remote != nullptr) {
+                remote->push_back(id);
+            }
+        }
+    }
+
+    for (int kind = 0; kind < REF_KINDS_COUNT; ++kind) {
+        table.kinds[kind] = BitmapFromIds(kindIds[kind]);
+    }
+    table.remotes.clear();
+    for (auto it = remoteIds.begin(); it != remoteIds.end(); ++it) {
+        table.remotes[it->first] = BitmapFromIds(it->second);
+    }
+    table.globs.clear();
+}
+
+RefBitmap RefTableAll(const RefTable &table) {
+    return RefBitmapRange(0, (uint32_t)table.count);
+}
+
+const RefBitmap &RefTableGlob(RefTable &table, const vector<string> &names, const string &pattern) {
+    assert(names.size() == table.count);
+    auto found = table.globs.find(pattern);
+    if (found != table.globs.end()) {
+        return found->second;
+    }
+    RefBitmap &matched = table.globs[pattern];
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (GlobMatches(pattern.c_str(), names[i].c_str())) {
+            RefBitmapAdd(matched, (uint32_t)i);
+        }
+    }
+    return matched;
+}
+
+vector<string> RefTableNames(const vector<string> &names, const RefBitmap &ids) {
+    vector<uint32_t> positions = RefBitmapIds(ids);
+    vector<string> result;
+    result.reserve(positions.size());
+    for (auto position = positions.begin(); position != positions.end(); ++position) {
+        result.push_back(names[*position]);
+    }
+    return result;
+}
+
+#ifdef DEBUG
+void RefTableTest() {
+    vector<string> fullNames = {
+        "refs/heads/master", "refs/heads/fix", "refs/tags/v1.0", "refs/remotes/origin/master",
+        "refs/remotes/origin/fix/x", "refs/remotes/upstream/main", "refs/stash",
+    };
+    vector<string> names;
+    CollectSortedUnique(ExpandRefNames(StreamFromVector(fullNames), true), names);
+    assert((vector<string>{ "fix", "fix/x", "main", "master", "origin/fix/x", "origin/master", "upstream/main", "v1.0" }) == names);
+
+    RefTable table;
+    RefTableBuild(table, fullNames, names, true);
+    assert(8 == table.count && 8 == RefBitmapCount(RefTableAll(table)));
+    const RefBitmap &branches = table.kinds[REF_KIND_BRANCH];
+    const RefBitmap &remote = table.kinds[REF_KIND_REMOTE];
+    assert((vector<string>{ "fix", "master" }) == RefTableNames(names, branches));
+    assert(string("refs/heads/master") == fullNames[table.sources[3]] && string("refs/remotes/origin/fix/x") == fullNames[table.sources[1]]);
+    assert((vector<string>{ "v1.0" }) == RefTableNames(names, table.kinds[REF_KIND_TAG]));
+    assert(6 == RefBitmapCount(remote));
+    assert(2 == table.remotes.size());
+    assert((vector<string>{ "fix/x", "master", "origin/fix/x", "origin/master" }) == RefTableNames(names, table.remotes["origin"]));
+
+    // "master" is both a branch and a stripped remote branch
+    assert((vector<string>{ "fix" }) == RefTableNames(names, RefBitmapAndNot(branches, remote)));
+    assert((vector<string>{ "fix", "master", "v1.0" }) == RefTableNames(names, RefBitmapOr(branches, table.kinds[REF_KIND_TAG])));
+
+    // a prefix range is a range of ids
+    auto first = lower_bound(names.begin(), names.end(), string("ma"));
+    RefBitmap prefixed = RefBitmapRange((uint32_t)(first - names.begin()), (uint32_t)(first - names.begin()) + 2);
+    assert((vector<string>{ "main", "master" }) == RefTableNames(names, RefBitmapAnd(prefixed, remote)));
+
+    const RefBitmap &fixes = RefTableGlob(table, names, "*fix*");
+    assert((vector<string>{ "fix", "fix/x", "origin/fix/x" }) == RefTableNames(names, fixes));
+    assert(&fixes == &RefTableGlob(table, names, "*fix*"));
+    assert((vector<string>{ "fix/x", "main", "master" }) == RefTableNames(names, RefBitmapAndNot(RefBitmapAndNot(remote, RefTableGlob(table, names, "*/*/*")), RefTableGlob(table, names, "*/m*"))));
+
+    // without stripping, remote names keep the remote
+    vector<string> unstripped;
+    CollectSortedUnique(ExpandRefNames(StreamFromVector(fullNames), false), unstripped);
+    RefTableBuild(table, fullNames, unstripped, false);
+    assert(table.globs.empty());
+    assert((vector<string>{ "origin/fix/x", "origin/master", "upstream/main" }) == RefTableNames(unstripped, table.kinds[REF_KIND_REMOTE]));
+}
+#endif
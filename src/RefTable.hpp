@@ -0,0 +1,45 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "RefBitmap.hpp"
+
+// Filters over the names of a snapshot. A name's id is its position among the sorted names,
+// and every predicate is a bitmap over the ids, so combinations of filters are AND/OR/ANDNOT of bitmaps
+// before any string matching, and the range of names with a prefix is a range of ids.
+
+typedef enum tRefKind {
+    REF_KIND_BRANCH,
+    REF_KIND_TAG,
+    REF_KIND_REMOTE, // names of remote branches, also stripped ones ("fix" of "origin/fix")
+    REF_KINDS_COUNT,
+} RefKind;
+
+typedef struct tRefTable {
+    size_t count;                             // ids are [0, count)
+    std::vector<size_t> sources;              // index of the full name of every id, a branch or a tag wins over a remote branch
+    RefBitmap kinds[REF_KINDS_COUNT];
+    std::map<std::string, RefBitmap> remotes; // names of the branches of a remote, by remote name
+    std::map<std::string, RefBitmap> globs;   // names matched by a pattern, made on the first use of the pattern
+} RefTable;
+
+/**
+ * Makes bitmaps of the names which the full names expand to (see ExpandRefNames).
+ * A name may be made of several refs (a branch and a stripped remote branch), it gets bits of all of them.
+ */
+void RefTableBuild(RefTable &table, const std::vector<std::string> &fullNames, const std::vector<std::string> &names, bool stripRemoteName);
+
+/** All ids. */
+RefBitmap RefTableAll(const RefTable &table);
+
+/** Names matched by the pattern (see GlobMatches), the names are checked once per pattern. */
+const RefBitmap &RefTableGlob(RefTable &table, const std::vector<std::string> &names, const std::string &pattern);
+
+/** Names of the ids in the sorted order. */
+std::vector<std::string> RefTableNames(const std::vector<std::string> &names, const RefBitmap &ids);
+
+#ifdef DEBUG
+void RefTableTest();
+#endif
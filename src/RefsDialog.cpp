@@ -7,45 +7,28 @@
 #include "Guid.hpp"
 #include "GitAutocompleteLng.hpp"
 #include "Utils.hpp"
+#include "RefsFilter.hpp"
+#include "RefsTree.hpp"
+#include "Unicode.hpp"
+#include "Arena.hpp"
 
 using namespace std;
 
 static size_t MaxLength(const vector<string> &list) {
-    return (*max_element(list.begin(), list.end(), [](string x, string y) -> bool {
-        return x.length() < y.length();
-    })).length();
+    size_t maxLength = 0;
+    for (auto it = list.begin(); it != list.end(); ++it) {
+        maxLength = max(maxLength, Utf8Length(*it));
+    }
+    return maxLength;
 }
 
 static SMALL_RECT GetFarRect() {
     SMALL_RECT farRect;
     Info.AdvControl(&MainGuid, ACTL_GETFARRECT, 0, &farRect);
-    *logFile << "Far rect (l, t, r, b) = (" << farRect.Left << ", " << farRect.Top << ", " << farRect.Right << ", " << farRect.Bottom << ")" << endl;
+    LOG("Far rect (l, t, r, b) = (" << farRect.Left << ", " << farRect.Top << ", " << farRect.Right << ", " << farRect.Bottom << ")");
     return farRect;
 }
 
-static FarListItem * InitializeListItems(const vector<string> &list, const string &initiallySelectedItem) {
-    size_t size = list.size();
-    FarListItem *listItems = new FarListItem[size];
-    size_t initiallySelected = 0;
-    for (size_t i = 0; i < size; ++i) {
-        wstring wstr = mb2w(list[i]);
-        listItems[i].Text = (const wchar_t *)wcsdup(wstr.c_str());
-        listItems[i].Flags = LIF_NONE;
-        if (list[i] == initiallySelectedItem) {
-            initiallySelected = i;
-        }
-    }
-    listItems[initiallySelected].Flags |= LIF_SELECTED;
-    return listItems;
-}
-
-static void FreeListItems(FarListItem *listItems, size_t size) {
-    for (size_t i = 0; i < size; ++i) {
-        free((wchar_t*)listItems[i].Text);
-    }
-    delete[] listItems;
-}
-
 typedef struct tGeometry {
     int left;
     int top;
@@ -97,20 +80,320 @@ static pair<Geometry, Geometry> CalculateListBoxAndDialogGeometry(size_t maxLine
     return pair<Geometry, Geometry>(list, dialog);
 }
 
-static int ShowListAndGetSelected(const vector<string> &list, const string &initiallySelectedItem) {
-    FarList listDesc;
-    listDesc.StructSize = sizeof(listDesc);
-    listDesc.Items = InitializeListItems(list, initiallySelectedItem);
-    listDesc.ItemsNumber = list.size();
+// The list box contains only visible rows, filtering and scrolling are done by the dialog procedure.
+// So neither opening nor filtering of the dialog with many thousands of refs
+// makes Far process all of them.
+//
+// In the tree mode rows are the rows of the tree and the filter is not used.
+//
+// While refs are being loaded, they are taken from the loader and merged into the sorted rows.
+typedef struct tRefsDialogState {
+    const vector<string> *refs;
+    RefsFilter filter;
+    RefsDialogView view;
+    bool treeMode;
+    RefsTree tree;
+    ListWindow window;
+    wstring filterText;
+    int listBoxID;
+    RefsLoader *loader;          // null if all refs are loaded
+    vector<string> *loadedRefs;  // the same as refs, refs from the loader are appended here
+    string initiallySelectedRef;
+    bool userNavigated;
+    Arena *rowsArena;            // texts and items of the visible rows, it is reset by every update
+    bool refsAreSnapshotNames;   // all names of view.snapshot, so a ref has the same index in the snapshot
+} RefsDialogState;
+
+// Refs are loaded at most for one dialog at a time.
+static const intptr_t DM_REFS_LOADED = DM_USER + 1;
+static HANDLE streamingDialog = nullptr;
+
+static size_t RowsCount(const RefsDialogState &state) {
+    return state.treeMode ? state.tree.rows.size() : state.filter.matched.size();
+}
+
+static string RowText(const RefsDialogState &state, size_t row) {
+    return state.treeMode ? RefsTreeRowText(state.tree.rows[row]) : (*state.refs)[state.filter.matched[row]];
+}
+
+static bool IsNewRow(const RefsDialogState &state, size_t row) {
+    const vector<string> &newRefs = state.view.newRefs;
+    if (newRefs.empty() || (state.treeMode && state.tree.rows[row].group)) {
+        return false;
+    }
+    const string &ref = state.treeMode ? state.tree.rows[row].path : (*state.refs)[state.filter.matched[row]];
+    return binary_search(newRefs.begin(), newRefs.end(), ref);
+}
+
+/** UTF-16 copy of the text which lives until the arena is reset. */
+static const wchar_t *ArenaText(Arena &arena, const string &text) {
+    wchar_t *buffer = static_cast<wchar_t *>(ArenaAllocate(arena, (text.length() + 1) * sizeof(wchar_t), alignof(wchar_t)));
+    mb2wBuffer(text, buffer);
+    return buffer;
+}
+
+/** Refs are taken from the UTF-16 copies of the snapshot names, other rows are converted. */
+static const wchar_t *RowWideText(const RefsDialogState &state, size_t row) {
+    const RefsSnapshot *snapshot = state.view.snapshot.get();
+    if (!state.treeMode && snapshot != nullptr) {
+        size_t ref = state.filter.matched[row];
+        size_t index = state.refsAreSnapshotNames ? ref : RefsSnapshotFind(*snapshot, (*state.refs)[ref]);
+        if (index != (size_t)-1) {
+            return RefsSnapshotWideName(*snapshot, index);
+        }
+    }
+    return ArenaText(*state.rowsArena, RowText(state, row));
+}
+
+// Items of all names of the last snapshot. When the dialog lists all of them in the order of names
+// (e.g. everything is shown for the empty prefix), the visible rows are a window of this array.
+// Texts point into the UTF-16 pool of the snapshot, so the items are remade when the pool changes.
+static weak_ptr<const RefsSnapshot> allItemsSnapshot;
+static size_t allItemsGeneration;
+static vector<FarListItem> allItems;
+
+static bool ShowsAllSnapshotItems(const RefsDialogState &state) {
+    const RefsFilter &filter = state.filter;
+    return !state.treeMode && state.refsAreSnapshotNames && state.view.newRefs.empty()
+        && filter.text.empty() && !filter.localeOrder && !filter.numericOrder && filter.firstRefs.empty() && filter.rankedRefs.empty();
+}
+
+static FarListItem *AllSnapshotItems(const shared_ptr<const RefsSnapshot> &snapshot) {
+    if (allItemsSnapshot.lock() != snapshot || allItemsGeneration != snapshot->wideGeneration || allItems.size() != snapshot->names.size()) {
+        allItems.assign(snapshot->names.size(), FarListItem());
+        for (size_t i = 0; i < allItems.size(); ++i) {
+            allItems[i].Text = RefsSnapshotWideName(*snapshot, i);
+            allItems[i].Flags = LIF_NONE;
+        }
+        allItemsSnapshot = snapshot;
+        allItemsGeneration = snapshot->wideGeneration;
+    }
+    return allItems.data();
+}
+
+static void UpdateListBox(HANDLE dialog, const RefsDialogState &state) {
+    // Updates follow every key press, so the rows are rebuilt in the memory of the previous update.
+    Arena &arena = *state.rowsArena;
+    ArenaReset(arena);
+    size_t visibleCount = ListWindowVisibleCount(state.window);
+    vector<FarListItem, ArenaAllocator<FarListItem>> items{ ArenaAllocator<FarListItem>(arena) };
+    FarListItem *visibleItems;
+    if (ShowsAllSnapshotItems(state)) {
+        visibleItems = AllSnapshotItems(state.view.snapshot) + state.window.top;
+    } else {
+        items.resize(visibleCount);
+        for (size_t i = 0; i < visibleCount; ++i) {
+            items[i].Text = RowWideText(state, state.window.top + i);
+            items[i].Flags = IsNewRow(state, state.window.top + i) ? LIF_CHECKED : LIF_NONE;
+        }
+        visibleItems = items.data();
+    }
+    FarList list = { sizeof(FarList), visibleCount, visibleItems };
+
+    Info.SendDlgMessage(dialog, DM_ENABLEREDRAW, FALSE, nullptr);
+
+    Info.SendDlgMessage(dialog, DM_LISTSET, state.listBoxID, &list);
+    if (visibleCount > 0) {
+        FarListPos pos = { sizeof(FarListPos), (intptr_t)(state.window.selected - state.window.top), -1 };
+        Info.SendDlgMessage(dialog, DM_LISTSETCURPOS, state.listBoxID, &pos);
+    }
+
+    wstring bottom = state.treeMode
+        ? to_wstring(state.refs->size())
+        : L"[" + state.filterText + L"] " + to_wstring(state.filter.matched.size()) + L"/" + to_wstring(state.refs->size());
+    if (state.loader != nullptr) {
+        bottom += wstring(L" ") + GetMsg(MLoading);
+    }
+    FarListTitles titles = { sizeof(FarListTitles), 0, GetMsg(MTitle), 0, bottom.c_str() };
+    Info.SendDlgMessage(dialog, DM_LISTSETTITLES, state.listBoxID, &titles);
+
+    Info.SendDlgMessage(dialog, DM_ENABLEREDRAW, TRUE, nullptr);
+}
+
+static size_t SelectedRef(const RefsDialogState &state) {
+    const vector<size_t> &matched = state.filter.matched;
+    return matched.empty() ? (size_t)-1 : matched[state.window.selected];
+}
+
+static void SetFilterText(RefsDialogState &state, const wstring &text) {
+    size_t selectedRef = SelectedRef(state);
+
+    state.filterText = text;
+    RefsFilterSetText(state.filter, NormalizeNfc(w2mb(text)));
+    ListWindowSetCount(state.window, state.filter.matched.size());
+
+    // Keep the same ref selected if it is still matched.
+    size_t row = (selectedRef != (size_t)-1) ? RefsFilterFindRow(state.filter, selectedRef) : (size_t)-1;
+    ListWindowSelect(state.window, (row != (size_t)-1) ? row : 0);
+}
+
+/** Merges newly loaded refs into rows, the selected ref stays on the same line of the list box. */
+static void TakeLoadedRefs(RefsDialogState &state) {
+    vector<string> &refs = *state.loadedRefs;
+    size_t firstNewRef = refs.size();
+    bool strict;
+    if (RefsLoaderTake(*state.loader, refs, strict)) {
+        state.loader = nullptr;
+    }
+    if (refs.size() == firstNewRef) {
+        return;
+    }
+
+    size_t selectedRef = SelectedRef(state);
+    size_t selectedLine = state.window.selected - state.window.top;
+    if (!state.userNavigated) {
+        auto initiallySelected = find(refs.begin() + firstNewRef, refs.end(), state.initiallySelectedRef);
+        if (initiallySelected != refs.end()) {
+            selectedRef = (size_t)distance(refs.begin(), initiallySelected);
+        }
+    }
+
+    RefsFilterAddRefs(state.filter, firstNewRef);
+    ListWindowSetCount(state.window, state.filter.matched.size());
+    size_t row = (selectedRef != (size_t)-1) ? RefsFilterFindRow(state.filter, selectedRef) : (size_t)-1;
+    ListWindowSelectAtLine(state.window, (row != (size_t)-1) ? row : 0, selectedLine);
+}
+
+/** Handles keys which expand and collapse groups, returns true if the key was consumed. */
+static bool ProcessTreeKey(RefsDialogState &state, const KEY_EVENT_RECORD &key) {
+    if (state.window.count == 0) {
+        return false;
+    }
+    size_t selected = state.window.selected;
+    const RefsTreeRow &row = state.tree.rows[selected];
+    switch (key.wVirtualKeyCode) {
+        case VK_RETURN:
+            if (!row.group) {
+                return false; // the ref is chosen
+            }
+            if (row.expanded) {
+                RefsTreeCollapse(state.tree, selected);
+            } else {
+                RefsTreeExpand(state.tree, selected);
+            }
+            break;
+
+        case VK_RIGHT:
+        case VK_ADD:
+            RefsTreeExpand(state.tree, selected);
+            break;
+
+        case VK_LEFT:
+        case VK_SUBTRACT:
+            if (row.group && row.expanded) {
+                RefsTreeCollapse(state.tree, selected);
+            } else {
+                ListWindowSelect(state.window, RefsTreeParent(state.tree, selected));
+            }
+            break;
+
+        default:
+            return false;
+    }
+    ListWindowSetCount(state.window, state.tree.rows.size());
+    return true;
+}
+
+/** Returns true if the input was consumed. */
+static bool ProcessListBoxInput(RefsDialogState &state, const INPUT_RECORD *record) {
+    if (record->EventType == MOUSE_EVENT && (record->Event.MouseEvent.dwEventFlags & MOUSE_WHEELED)) {
+        short wheelDelta = (short)HIWORD(record->Event.MouseEvent.dwButtonState);
+        ListWindowScroll(state.window, (wheelDelta > 0) ? -1 : 1);
+        return true;
+    }
+
+    if (record->EventType != KEY_EVENT || !record->Event.KeyEvent.bKeyDown) {
+        return false;
+    }
+
+    const KEY_EVENT_RECORD &key = record->Event.KeyEvent;
+    ptrdiff_t pageSize = max((ptrdiff_t)state.window.height - 1, (ptrdiff_t)1);
+    switch (key.wVirtualKeyCode) {
+        case VK_UP:    ListWindowMove(state.window, -1);        return true;
+        case VK_DOWN:  ListWindowMove(state.window, 1);         return true;
+        case VK_PRIOR: ListWindowMove(state.window, -pageSize); return true;
+        case VK_NEXT:  ListWindowMove(state.window, pageSize);  return true;
+        case VK_HOME:  ListWindowSelect(state.window, 0);       return true;
+        case VK_END:   ListWindowSelect(state.window, state.window.count - 1); return true;
+    }
+
+    if (state.treeMode) {
+        return ProcessTreeKey(state, key);
+    }
+
+    switch (key.wVirtualKeyCode) {
+        case VK_BACK:
+            if (!state.filterText.empty()) {
+                SetFilterText(state, state.filterText.substr(0, state.filterText.length() - 1));
+            }
+            return true;
+    }
+
+    // AltGr is reported as Ctrl+Alt, it is a part of the usual typing.
+    bool ctrl = (key.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) != 0;
+    bool alt = (key.dwControlKeyState & (LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED)) != 0;
+    if (key.uChar.UnicodeChar >= L' ' && ctrl == alt) {
+        SetFilterText(state, state.filterText + key.uChar.UnicodeChar);
+        return true;
+    }
+
+    return false;
+}
+
+static intptr_t WINAPI RefsDialogProc(HANDLE dialog, intptr_t msg, intptr_t param1, void *param2) {
+    RefsDialogState *state = (RefsDialogState*)Info.SendDlgMessage(dialog, DM_GETDLGDATA, 0, nullptr);
+    switch (msg) {
+        case DN_INITDIALOG:
+            UpdateListBox(dialog, *state);
+            break;
+
+        case DN_LISTCHANGE:
+            if (param1 == state->listBoxID && state->window.count > 0) {
+                // e.g. mouse click on a visible row
+                ListWindowSelect(state->window, state->window.top + (size_t)(intptr_t)param2);
+                state->userNavigated = true;
+            }
+            break;
+
+        case DN_CONTROLINPUT:
+            if (param1 == state->listBoxID && ProcessListBoxInput(*state, (const INPUT_RECORD*)param2)) {
+                state->userNavigated = true;
+                UpdateListBox(dialog, *state);
+                return TRUE;
+            }
+            break;
+
+        case DM_REFS_LOADED:
+            if (state->loader != nullptr) {
+                TakeLoadedRefs(*state);
+                UpdateListBox(dialog, *state);
+            }
+            return TRUE;
+    }
+    return Info.DefDlgProc(dialog, msg, param1, param2);
+}
+
+// Loaded refs are not known yet, so the streaming dialog is made big enough for them in advance.
+static const size_t STREAMING_MIN_LINE_LENGTH = 40;
+static const size_t STREAMING_LINES_COUNT = 1000;
+
+/**
+ * Returns the selected ref or empty string.
+ * If loader is not null, list is loadedList and refs from the loader are appended to it.
+ */
+static string ShowListAndGetSelected(const vector<string> &list, RefsLoader *loader, vector<string> *loadedList, const string &initiallySelectedItem, const RefsDialogView &view) {
+    bool treeMode = view.treeMode;
+    assert(loader == nullptr || (loadedList == &list && !treeMode));
 
     FarDialogItem listBox;
     memset(&listBox, 0, sizeof(listBox));
     listBox.Type = DI_LISTBOX;
     listBox.Data = GetMsg(MTitle);
     listBox.Flags = DIF_NONE;
-    listBox.ListItems = &listDesc;
 
-    auto listAndDialogGeometry = CalculateListBoxAndDialogGeometry(MaxLength(list), list.size());
+    auto listAndDialogGeometry = (loader != nullptr)
+        ? CalculateListBoxAndDialogGeometry(max(MaxLength(list), STREAMING_MIN_LINE_LENGTH), STREAMING_LINES_COUNT)
+        : CalculateListBoxAndDialogGeometry(treeMode ? RefsTreeMaxTextLength(list) : MaxLength(list), list.size());
     Geometry listGeometry = listAndDialogGeometry.first;
     Geometry dialogGeometry = listAndDialogGeometry.second;
 
@@ -123,35 +406,106 @@ static int ShowListAndGetSelected(const vector<string> &list, const string &init
     size_t itemsCount = 1;
     int listBoxID = 0;
 
+    RefsDialogState state;
+    state.refs = &list;
+    state.view = view;
+    state.treeMode = treeMode;
+    if (treeMode) {
+        RefsTreeInit(state.tree, &list);
+    } else {
+        RefsFilterInit(state.filter, &list, view.localeOrder, view.numericOrder);
+        if (view.newRefsFirst && !view.newRefs.empty()) {
+            RefsFilterListFirst(state.filter, view.newRefs);
+        }
+        if (!view.historyRanks.empty()) {
+            RefsFilterRank(state.filter, view.historyRanks);
+        }
+    }
+    state.window = ListWindowCreate(RowsCount(state), listGeometry.height - 2);
+    state.listBoxID = listBoxID;
+    state.loader = loader;
+    state.loadedRefs = loadedList;
+    state.initiallySelectedRef = initiallySelectedItem;
+    state.userNavigated = false;
+    Arena rowsArena;
+    ArenaInit(rowsArena, 64 * 1024);
+    state.rowsArena = &rowsArena;
+    // Refs of a snapshot are some of its sorted unique names, so the same count means the same names.
+    state.refsAreSnapshotNames = view.snapshot && view.snapshot->names.size() == list.size();
+    assert(!view.snapshot || view.snapshot->wideOffsets.size() == view.snapshot->names.size() + 1);
+
+    if (treeMode) {
+        size_t initiallySelectedRow = RefsTreeReveal(state.tree, initiallySelectedItem);
+        ListWindowSetCount(state.window, RowsCount(state));
+        if (initiallySelectedRow != (size_t)-1) {
+            ListWindowSelect(state.window, initiallySelectedRow);
+        }
+    } else {
+        auto initiallySelected = find(list.begin(), list.end(), initiallySelectedItem);
+        if (initiallySelected != list.end()) {
+            ListWindowSelect(state.window, RefsFilterFindRow(state.filter, (size_t)distance(list.begin(), initiallySelected)));
+        }
+    }
+
     assert(dialogGeometry.left == -1 && dialogGeometry.top == -1); // auto centering
-    HANDLE dialog = Info.DialogInit(&MainGuid, &RefsDialogGuid, -1, -1, dialogGeometry.width, dialogGeometry.height, L"Contents", items, itemsCount, 0, FDLG_KEEPCONSOLETITLE, nullptr, nullptr);
+    HANDLE dialog = Info.DialogInit(&MainGuid, &RefsDialogGuid, -1, -1, dialogGeometry.width, dialogGeometry.height, L"Contents", items, itemsCount, 0, FDLG_KEEPCONSOLETITLE, RefsDialogProc, &state);
 
+    if (loader != nullptr) {
+        streamingDialog = dialog;
+        // refs which have arrived before the dialog is opened
+        NotifyRefsDialog();
+    }
     int runResult = (int)Info.DialogRun(dialog);
+    streamingDialog = nullptr;
 
-    int selected;
-    if (runResult != -1) {
-        selected = (int)Info.SendDlgMessage(dialog, DM_LISTGETCURPOS, listBoxID, nullptr);
-        assert(0 <= selected && selected < (int)listBox.ListItems->ItemsNumber);
-    } else {
-        selected = -1;
+    string selected("");
+    if (runResult != -1 && state.window.count > 0) {
+        if (!treeMode) {
+            selected = list[state.filter.matched[state.window.selected]];
+        } else if (!state.tree.rows[state.window.selected].group) {
+            selected = state.tree.rows[state.window.selected].path;
+        }
     }
 
     Info.DialogFree(dialog);
-    FreeListItems(listDesc.Items, listDesc.ItemsNumber);
+    if (treeMode) {
+        RefsTreeFree(state.tree);
+    }
+    ArenaFree(rowsArena);
+
+    return selected;
+}
+
+static void LogSelected(const string &selected) {
+    if (!selected.empty()) {
+        LOG("Dialog succeeded. Selected = " << selected.c_str());
+    } else {
+        LOG("Dialog failed.");
+    }
+}
+
+string ShowRefsDialog(const vector<string> &suitableRefs, const string &initiallySelectedRef, const RefsDialogView &view) {
+    assert(!suitableRefs.empty());
 
+    string selected = ShowListAndGetSelected(suitableRefs, nullptr, nullptr, initiallySelectedRef, view);
+    LogSelected(selected);
     return selected;
 }
 
-string ShowRefsDialog(const vector<string> &suitableRefs, const string &initiallySelectedRef) {
+string ShowStreamingRefsDialog(RefsLoader &loader, vector<string> &suitableRefs, const string &initiallySelectedRef, const RefsDialogView &view) {
     assert(!suitableRefs.empty());
 
-    int selected = ShowListAndGetSelected(suitableRefs, initiallySelectedRef);
-    if (selected >= 0) {
-        *logFile << "Dialog succeeded. Selected = " << selected << endl;
-        assert(0 <= selected && selected < (int)suitableRefs.size());
-        return suitableRefs[selected];
-    } else {
-        *logFile << "Dialog failed." << endl;
-        return string("");
+    string selected = ShowListAndGetSelected(suitableRefs, &loader, &suitableRefs, initiallySelectedRef, view);
+    LogSelected(selected);
+    return selected;
+}
+
+void NotifyRefsDialog() {
+    Info.AdvControl(&MainGuid, ACTL_SYNCHRO, 0, nullptr);
+}
+
+void ProcessRefsDialogSynchro() {
+    if (streamingDialog != nullptr) {
+        Info.SendDlgMessage(streamingDialog, DM_REFS_LOADED, 0, nullptr);
     }
 }
@@ -1,6 +1,31 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
-std::string ShowRefsDialog(const std::vector<std::string> &suitableRefs, const std::string &initiallySelectedRef);
\ No newline at end of file
+#include "RefsLoader.hpp"
+#include "RefsSnapshot.hpp"
+
+/** How refs are shown in the dialog. */
+typedef struct tRefsDialogView {
+    bool treeMode;
+    bool localeOrder;
+    bool numericOrder; // names with numbers ("pull/123/head") are listed by the numbers
+    std::vector<std::string> newRefs; // sorted, they are marked
+    bool newRefsFirst;
+    std::vector<std::pair<std::string, double>> historyRanks; // sorted by names, higher ranks are listed first
+    std::shared_ptr<const RefsSnapshot> snapshot; // null, or refs are its names and its UTF-16 copies are prepared
+} RefsDialogView;
+
+std::string ShowRefsDialog(const std::vector<std::string> &suitableRefs, const std::string &initiallySelectedRef, const RefsDialogView &view);
+
+/** Shows the list of refs loaded so far, refs taken from the loader are appended to suitableRefs. */
+std::string ShowStreamingRefsDialog(RefsLoader &loader, std::vector<std::string> &suitableRefs, const std::string &initiallySelectedRef, const RefsDialogView &view);
+
+/** May be called from any thread to tell the dialog that there are new refs in the loader. */
+void NotifyRefsDialog();
+
+/** Is called on the main thread in response to NotifyRefsDialog. */
+void ProcessRefsDialogSynchro();
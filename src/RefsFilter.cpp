@@ -0,0 +1,350 @@
+#include "RefsFilter.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+
+#include "Utils.hpp"
+#include "Unicode.hpp"
+#include "NumericRefs.hpp"
+
+using namespace std;
+
+bool RefMatchesFilter(const char *ref, const char *filterText) {
+    return StartsWith(ref, filterText) || RefMayBeEncodedByPartialPrefix(ref, filterText);
+}
+
+static function<bool (size_t, size_t)> NamesOrder(const RefsFilter &filter) {
+    const vector<string> &refs = *filter.refs;
+    if (filter.numericOrder) {
+        return [&refs](size_t x, size_t y) -> bool {
+            return NumericNameLess(refs[x], refs[y]);
+        };
+    }
+    if (!filter.localeOrder) {
+        return [&refs](size_t x, size_t y) -> bool {
+            return refs[x] < refs[y];
+        };
+    }
+    // Different refs may have equal keys, bytes make the order strict.
+    const vector<string> &keys = filter.sortKeys;
+    return [&refs, &keys](size_t x, size_t y) -> bool {
+        int byKeys = keys[x].compare(keys[y]);
+        return byKeys < 0 || (byKeys == 0 && refs[x] < refs[y]);
+    };
+}
+
+static function<bool (size_t, size_t)> RefsOrder(const RefsFilter &filter) {
+    auto byNames = NamesOrder(filter);
+    bool byFirst = !filter.firstRefs.empty();
+    bool byRanks = !filter.rankedRefs.empty();
+    if (!byFirst && !byRanks) {
+        return byNames;
+    }
+    const vector<bool> &first = filter.first;
+    const vector<double> &ranks = filter.ranks;
+    return [&first, &ranks, byFirst, byRanks, byNames](size_t x, size_t y) -> bool {
+        if (byFirst && first[x] != first[y]) {
+            return first[x];
+        }
+        if (byRanks && ranks[x] != ranks[y]) {
+            return ranks[x] > ranks[y];
+        }
+        return byNames(x, y);
+    };
+}
+
+/** Sort keys, first flags and ranks are made once per ref, including refs appended later. */
+static void MakeOrderData(RefsFilter &filter) {
+    const vector<string> &refs = *filter.refs;
+    if (filter.localeOrder) {
+        for (size_t i = filter.sortKeys.size(); i < refs.size(); ++i) {
+            filter.sortKeys.push_back(CollationKey(refs[i]));
+        }
+    }
+    if (!filter.firstRefs.empty()) {
+        for (size_t i = filter.first.size(); i < refs.size(); ++i) {
+            filter.first.push_back(binary_search(filter.firstRefs.begin(), filter.firstRefs.end(), refs[i]));
+        }
+    }
+    if (!filter.rankedRefs.empty()) {
+        const vector<pair<string, double>> &ranked = filter.rankedRefs;
+        for (size_t i = filter.ranks.size(); i < refs.size(); ++i) {
+            auto found = lower_bound(ranked.begin(), ranked.end(), refs[i], [](const pair<string, double> &item, const string &ref) -> bool {
+                return item.first < ref;
+            });
+            filter.ranks.push_back((found != ranked.end() && found->first == refs[i]) ? found->second : 0.0);
+        }
+    }
+}
+
+void RefsFilterInit(RefsFilter &filter, const vector<string> *refs, bool localeOrder, bool numericOrder) {
+    filter.refs = refs;
+    filter.localeOrder = localeOrder && !numericOrder;
+    filter.numericOrder = numericOrder;
+    filter.sortKeys.clear();
+    filter.firstRefs.clear();
+    filter.first.clear();
+    filter.rankedRefs.clear();
+    filter.ranks.clear();
+    filter.text = string("");
+    filter.order.resize(refs->size());
+    for (size_t i = 0; i < refs->size(); ++i) {
+        filter.order[i] = i;
+    }
+    if (filter.localeOrder || numericOrder) {
+        MakeOrderData(filter);
+        sort(filter.order.begin(), filter.order.end(), RefsOrder(filter));
+    } else if (!is_sorted(refs->begin(), refs->end())) {
+        sort(filter.order.begin(), filter.order.end(), RefsOrder(filter));
+    }
+    filter.matched = filter.order;
+}
+
+void RefsFilterListFirst(RefsFilter &filter, const vector<string> &sortedRefs) {
+    assert(is_sorted(sortedRefs.begin(), sortedRefs.end()));
+    filter.firstRefs = sortedRefs;
+    filter.first.clear();
+    MakeOrderData(filter);
+    auto order = RefsOrder(filter);
+    sort(filter.order.begin(), filter.order.end(), order);
+    sort(filter.matched.begin(), filter.matched.end(), order);
+}
+
+void RefsFilterRank(RefsFilter &filter, const vector<pair<string, double>> &rankedRefs) {
+    assert(is_sorted(rankedRefs.begin(), rankedRefs.end()));
+    filter.rankedRefs = rankedRefs;
+    filter.ranks.clear();
+    MakeOrderData(filter);
+    auto order = RefsOrder(filter);
+    sort(filter.order.begin(), filter.order.end(), order);
+    sort(filter.matched.begin(), filter.matched.end(), order);
+}
+
+/** Merges sorted additions into sorted indices. */
+static void MergeSorted(vector<size_t> &indices, vector<size_t> &additions, const RefsFilter &filter) {
+    auto order = RefsOrder(filter);
+    sort(additions.begin(), additions.end(), order);
+    size_t oldSize = indices.size();
+    indices.insert(indices.end(), additions.begin(), additions.end());
+    inplace_merge(indices.begin(), indices.begin() + oldSize, indices.end(), order);
+}
+
+void RefsFilterAddRefs(RefsFilter &filter, size_t firstNewRef) {
+    const vector<string> &refs = *filter.refs;
+    MakeOrderData(filter);
+    vector<size_t> added;
+    vector<size_t> matched;
+    for (size_t i = firstNewRef; i < refs.size(); ++i) {
+        added.push_back(i);
+        if (RefMatchesFilter(refs[i].c_str(), filter.text.c_str())) {
+            matched.push_back(i);
+        }
+    }
+    MergeSorted(filter.order, added, filter);
+    MergeSorted(filter.matched, matched, filter);
+}
+
+size_t RefsFilterFindRow(const RefsFilter &filter, size_t ref) {
+    auto it = lower_bound(filter.matched.begin(), filter.matched.end(), ref, RefsOrder(filter));
+    if (it == filter.matched.end() || *it != ref) {
+        return (size_t)-1;
+    }
+    return (size_t)(it - filter.matched.begin());
+}
+
+void RefsFilterSetText(RefsFilter &filter, const string &text) {
+    // Both matchers are monotonic: a ref matched by "ab" is always matched by "a".
+    // So growing text could only narrow the previously matched set.
+    bool narrowing = StartsWith(text, filter.text);
+    filter.text = text;
+
+    const vector<string> &refs = *filter.refs;
+    const char *textPtr = text.c_str();
+    if (narrowing) {
+        auto newEnd = remove_if(filter.matched.begin(), filter.matched.end(), [&refs, textPtr](size_t i) -> bool {
+            return !RefMatchesFilter(refs[i].c_str(), textPtr);
+        });
+        filter.matched.erase(newEnd, filter.matched.end());
+    } else {
+        filter.matched.clear();
+        for (auto it = filter.order.begin(); it != filter.order.end(); ++it) {
+            if (RefMatchesFilter(refs[*it].c_str(), textPtr)) {
+                filter.matched.push_back(*it);
+            }
+        }
+    }
+}
+
+ListWindow ListWindowCreate(size_t count, size_t height) {
+    assert(height > 0);
+    ListWindow window = { count, height, 0, 0 };
+    return window;
+}
+
+static void ListWindowAdjustTop(ListWindow &window) {
+    if (window.selected < window.top) {
+        window.top = window.selected;
+    } else if (window.selected >= window.top + window.height) {
+        window.top = window.selected - window.height + 1;
+    }
+    // do not leave empty rows at the bottom if there is something above
+    if (window.top + window.height > window.count) {
+        window.top = (window.count > window.height) ? (window.count - window.height) : 0;
+    }
+}
+
+void ListWindowSetCount(ListWindow &window, size_t count) {
+    window.count = count;
+    ListWindowSelect(window, window.selected);
+}
+
+void ListWindowSelect(ListWindow &window, size_t selected) {
+    window.selected = (window.count == 0) ? 0 : min(selected, window.count - 1);
+    ListWindowAdjustTop(window);
+}
+
+void ListWindowSelectAtLine(ListWindow &window, size_t selected, size_t line) {
+    ListWindowSelect(window, selected);
+    if (window.count > window.height) {
+        size_t top = (window.selected >= line) ? (window.selected - line) : 0;
+        window.top = min(top, window.count - window.height);
+    }
+}
+
+void ListWindowMove(ListWindow &window, ptrdiff_t delta) {
+    if (window.count == 0) {
+        return;
+    }
+    ptrdiff_t selected = (ptrdiff_t)window.selected + delta;
+    selected = max((ptrdiff_t)0, min(selected, (ptrdiff_t)window.count - 1));
+    ListWindowSelect(window, (size_t)selected);
+}
+
+void ListWindowScroll(ListWindow &window, ptrdiff_t delta) {
+    if (window.count <= window.height) {
+        return;
+    }
+    size_t line = window.selected - window.top;
+    ptrdiff_t top = (ptrdiff_t)window.top + delta;
+    top = max((ptrdiff_t)0, min(top, (ptrdiff_t)(window.count - window.height)));
+    window.top = (size_t)top;
+    window.selected = window.top + line;
+}
+
+size_t ListWindowVisibleCount(const ListWindow &window) {
+    return min(window.height, window.count - window.top);
+}
+
+#ifdef DEBUG
+void RefsFilterTest() {
+    vector<string> refs = { string("feature/abc"), string("feature/xyz"), string("fix/abc"), string("master") };
+    RefsFilter filter;
+    RefsFilterInit(filter, &refs);
+    assert((vector<size_t>{ 0, 1, 2, 3 }) == filter.matched);
+
+    RefsFilterSetText(filter, string("f"));
+    assert((vector<size_t>{ 0, 1, 2 }) == filter.matched);
+
+    RefsFilterSetText(filter, string("f/a"));
+    assert((vector<size_t>{ 0, 2 }) == filter.matched);
+
+    RefsFilterSetText(filter, string("fe"));
+    assert((vector<size_t>{ 0, 1 }) == filter.matched);
+
+    RefsFilterSetText(filter, string("q"));
+    assert(filter.matched.empty());
+
+    RefsFilterSetText(filter, string(""));
+    assert((vector<size_t>{ 0, 1, 2, 3 }) == filter.matched);
+
+    // refs may arrive in any order while the filter is used
+    RefsFilterSetText(filter, string("f"));
+    refs.push_back(string("fix/000"));
+    refs.push_back(string("alpha"));
+    refs.push_back(string("feature/000"));
+    RefsFilterAddRefs(filter, 4);
+    assert((vector<size_t>{ 6, 0, 1, 4, 2 }) == filter.matched);
+    assert(3 == RefsFilterFindRow(filter, 4));
+    assert((size_t)-1 == RefsFilterFindRow(filter, 5));
+    RefsFilterSetText(filter, string(""));
+    assert((vector<size_t>{ 5, 6, 0, 1, 4, 2, 3 }) == filter.matched);
+
+    // collation keys are made once per ref, including arriving ones
+    {
+        vector<string> names = { string("\xD0\xB1"), string("b"), string("\xD0\xB0") };
+        RefsFilter byLocale;
+        RefsFilterInit(byLocale, &names, true);
+        assert(3 == byLocale.sortKeys.size());
+        assert((vector<size_t>{ 1, 2, 0 }) == byLocale.matched);
+        names.push_back(string("a"));
+        RefsFilterAddRefs(byLocale, 3);
+        assert(4 == byLocale.sortKeys.size());
+        assert((vector<size_t>{ 3, 1, 2, 0 }) == byLocale.matched);
+        assert(2 == RefsFilterFindRow(byLocale, 2));
+    }
+
+    // new refs are listed first, also arriving ones
+    {
+        vector<string> names = { string("a"), string("b"), string("c") };
+        RefsFilter newFirst;
+        RefsFilterInit(newFirst, &names);
+        RefsFilterListFirst(newFirst, vector<string>{ string("c"), string("d") });
+        assert((vector<size_t>{ 2, 0, 1 }) == newFirst.matched);
+        names.push_back(string("d"));
+        names.push_back(string("0"));
+        RefsFilterAddRefs(newFirst, 3);
+        assert((vector<size_t>{ 2, 3, 4, 0, 1 }) == newFirst.matched);
+        assert(1 == RefsFilterFindRow(newFirst, 3));
+        RefsFilterSetText(newFirst, string("d"));
+        assert((vector<size_t>{ 3 }) == newFirst.matched);
+    }
+
+    // numbers are ordered by values, also in arriving refs
+    {
+        vector<string> names = { string("pull/123/head"), string("pull/12/head"), string("pull/99/head") };
+        RefsFilter numeric;
+        RefsFilterInit(numeric, &names, true, true);
+        assert(!numeric.localeOrder && numeric.sortKeys.empty());
+        assert((vector<size_t>{ 1, 2, 0 }) == numeric.matched);
+        names.push_back(string("pull/100/head"));
+        RefsFilterAddRefs(numeric, 3);
+        assert((vector<size_t>{ 1, 2, 3, 0 }) == numeric.matched);
+        RefsFilterSetText(numeric, string("pull/1"));
+        assert((vector<size_t>{ 1, 3, 0 }) == numeric.matched);
+    }
+
+    // ranked refs are listed first, but after new ones
+    {
+        vector<string> names = { string("a"), string("b"), string("c"), string("d") };
+        RefsFilter ranked;
+        RefsFilterInit(ranked, &names);
+        RefsFilterRank(ranked, vector<pair<string, double>>{ make_pair(string("b"), 0.5), make_pair(string("c"), 2.0), make_pair(string("x"), 9.0) });
+        assert((vector<size_t>{ 2, 1, 0, 3 }) == ranked.matched);
+        RefsFilterListFirst(ranked, vector<string>{ string("d") });
+        assert((vector<size_t>{ 3, 2, 1, 0 }) == ranked.matched);
+        names.push_back(string("x"));
+        RefsFilterAddRefs(ranked, 4);
+        assert((vector<size_t>{ 3, 4, 2, 1, 0 }) == ranked.matched);
+        RefsFilterSetText(ranked, string("b"));
+        assert((vector<size_t>{ 1 }) == ranked.matched);
+    }
+
+    ListWindow window = ListWindowCreate(10, 3);
+    ListWindowSelect(window, 5);
+    assert(3 == window.top && 5 == window.selected);
+    ListWindowMove(window, -4);
+    assert(1 == window.top && 1 == window.selected);
+    ListWindowMove(window, 100);
+    assert(7 == window.top && 9 == window.selected);
+    ListWindowScroll(window, -2);
+    assert(5 == window.top && 7 == window.selected);
+    ListWindowSelectAtLine(window, 8, 1);
+    assert(7 == window.top && 8 == window.selected);
+    ListWindowSetCount(window, 2);
+    assert(0 == window.top && 1 == window.selected);
+    assert(2 == ListWindowVisibleCount(window));
+    ListWindowSetCount(window, 0);
+    assert(0 == ListWindowVisibleCount(window));
+}
+#endif
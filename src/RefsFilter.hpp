@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Platform independent part of the refs dialog:
+// incremental filtering of refs and the window of visible rows.
+
+typedef struct tRefsFilter {
+    const std::vector<std::string> *refs;
+    bool localeOrder;
+    bool numericOrder;
+    std::vector<std::string> sortKeys; // collation keys of refs if they are sorted in the locale order
+    std::vector<std::string> firstRefs; // sorted, these refs are listed before the others
+    std::vector<bool> first;            // for every ref, empty if firstRefs is empty
+    std::vector<std::pair<std::string, double>> rankedRefs; // sorted by names, higher ranks are listed first
+    std::vector<double> ranks;          // for every ref, empty if rankedRefs is empty
+    std::vector<size_t> order;   // indices of all refs in the sorted order of refs
+    std::string text;
+    std::vector<size_t> matched; // indices of refs matched by text, in the sorted order of refs
+} RefsFilter;
+
+/**
+ * Refs are sorted by bytes (i.e. by code points) or by collation keys made once per ref.
+ * The numeric order ("pull/99/head" before "pull/123/head", see NumericNameLess) takes precedence over the locale one.
+ */
+void RefsFilterInit(RefsFilter &filter, const std::vector<std::string> *refs, bool localeOrder = false, bool numericOrder = false);
+
+/** Lists refs which are present in sortedRefs (e.g. new ones) before the others. */
+void RefsFilterListFirst(RefsFilter &filter, const std::vector<std::string> &sortedRefs);
+
+/** Lists refs with higher ranks (e.g. often used ones) first, refs which are not ranked have rank 0. */
+void RefsFilterRank(RefsFilter &filter, const std::vector<std::pair<std::string, double>> &rankedRefs);
+
+/** Takes into account refs appended to the vector starting from firstNewRef. */
+void RefsFilterAddRefs(RefsFilter &filter, size_t firstNewRef);
+
+/** Returns the position of the ref in matched or -1. */
+size_t RefsFilterFindRow(const RefsFilter &filter, size_t ref);
+
+/**
+ * Refilters refs by the new text. If the new text extends the previous one,
+ * only previously matched refs are checked.
+ */
+void RefsFilterSetText(RefsFilter &filter, const std::string &text);
+
+bool RefMatchesFilter(const char *ref, const char *filterText);
+
+typedef struct tListWindow {
+    size_t count;    // total number of rows
+    size_t height;   // number of visible rows
+    size_t top;      // first visible row
+    size_t selected; // selected row, meaningless if count == 0
+} ListWindow;
+
+ListWindow ListWindowCreate(size_t count, size_t height);
+
+void ListWindowSetCount(ListWindow &window, size_t count);
+
+void ListWindowSelect(ListWindow &window, size_t selected);
+
+/** Selects the row and tries to show it on the given visible line. */
+void ListWindowSelectAtLine(ListWindow &window, size_t selected, size_t line);
+
+/** Moves selection by delta rows, selection stops at the first and the last rows. */
+void ListWindowMove(ListWindow &window, ptrdiff_t delta);
+
+/** Scrolls by delta rows keeping selection on the same visible line. */
+void ListWindowScroll(ListWindow &window, ptrdiff_t delta);
+
+size_t ListWindowVisibleCount(const ListWindow &window);
+
+#ifdef DEBUG
+void RefsFilterTest();
+#endif
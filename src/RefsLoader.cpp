@@ -0,0 +1,159 @@
+#include "RefsLoader.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <thread>
+#include <unordered_set>
+
+using namespace std;
+
+// A batch is flushed when it is big enough or is kept for long enough,
+// so the consumer neither wakes up on every ref nor waits for the slow ones.
+static const size_t BATCH_SIZE = 512;
+static const chrono::milliseconds BATCH_DELAY(20);
+
+void RefsLoaderInit(RefsLoader &loader, function<void ()> notify) {
+    loader.pending.clear();
+    loader.loadedCount = 0;
+    loader.strict = true;
+    loader.done = false;
+    loader.cancelled = false;
+    loader.notify = notify;
+}
+
+static void Flush(RefsLoader &loader, vector<string> &batch, bool done) {
+    {
+        lock_guard<mutex> guard(loader.lock);
+        loader.loadedCount += batch.size();
+        if (loader.pending.empty()) {
+            loader.pending.swap(batch);
+        } else {
+            loader.pending.insert(loader.pending.end(), batch.begin(), batch.end());
+        }
+        loader.done = done;
+    }
+    batch.clear();
+    loader.changed.notify_all();
+    if (loader.notify) {
+        loader.notify();
+    }
+}
+
+/** Returns the number of loaded unique refs. */
+static size_t Load(RefsLoader &loader, Stream refs) {
+    unordered_set<string> seen;
+    vector<string> batch;
+    auto flushed = chrono::steady_clock::now();
+    Drain(refs, [&](const string &ref) -> bool {
+        if (seen.insert(ref).second) {
+            batch.push_back(ref);
+        }
+        auto now = chrono::steady_clock::now();
+        if (batch.size() >= BATCH_SIZE || (!batch.empty() && now - flushed >= BATCH_DELAY)) {
+            Flush(loader, batch, false);
+            flushed = now;
+        }
+        return !loader.cancelled;
+    });
+    if (!batch.empty()) {
+        Flush(loader, batch, false);
+    }
+    return seen.size();
+}
+
+void RefsLoaderRun(RefsLoader &loader, function<Stream ()> strictRefs, function<Stream ()> partialRefs) {
+    if (Load(loader, strictRefs()) == 0 && !loader.cancelled) {
+        {
+            lock_guard<mutex> guard(loader.lock);
+            loader.strict = false;
+        }
+        Load(loader, partialRefs());
+    }
+    vector<string> nothing;
+    Flush(loader, nothing, true);
+}
+
+bool RefsLoaderWait(RefsLoader &loader) {
+    unique_lock<mutex> guard(loader.lock);
+    loader.changed.wait(guard, [&loader]() -> bool {
+        return loader.done || !loader.pending.empty();
+    });
+    return loader.done;
+}
+
+bool RefsLoaderWaitUntil(RefsLoader &loader, chrono::steady_clock::time_point deadline) {
+    unique_lock<mutex> guard(loader.lock);
+    loader.changed.wait_until(guard, deadline, [&loader]() -> bool {
+        return loader.done || !loader.pending.empty();
+    });
+    return loader.done;
+}
+
+bool RefsLoaderTake(RefsLoader &loader, vector<string> &refs, bool &strict) {
+    lock_guard<mutex> guard(loader.lock);
+    refs.insert(refs.end(), loader.pending.begin(), loader.pending.end());
+    loader.pending.clear();
+    strict = loader.strict;
+    return loader.done;
+}
+
+void RefsLoaderCancel(RefsLoader &loader) {
+    loader.cancelled = true;
+}
+
+#ifdef DEBUG
+void RefsLoaderTest() {
+    vector<string> none;
+    vector<string> some;
+    for (size_t i = 0; i < 2000; ++i) {
+        some.push_back("ref" + to_string(i % 1500));
+    }
+
+    {
+        size_t notified = 0;
+        RefsLoader loader;
+        RefsLoaderInit(loader, [&notified]() { ++notified; });
+        thread loading(RefsLoaderRun, ref(loader),
+            [&some]() -> Stream { return StreamFromVector(some); },
+            [&none]() -> Stream { return StreamFromVector(none); });
+
+        vector<string> refs;
+        bool strict = false;
+        bool done = false;
+        while (!done) {
+            RefsLoaderWait(loader);
+            done = RefsLoaderTake(loader, refs, strict);
+        }
+        loading.join();
+        assert(1500 == refs.size() && strict);
+        assert(notified >= 2);
+    }
+    {
+        // partial refs are loaded only if there are no strict ones
+        RefsLoader loader;
+        RefsLoaderInit(loader, nullptr);
+        RefsLoaderRun(loader,
+            [&none]() -> Stream { return StreamFromVector(none); },
+            [&some]() -> Stream { return StreamFromVector(some); });
+
+        vector<string> refs;
+        bool strict = true;
+        assert(RefsLoaderWaitUntil(loader, chrono::steady_clock::now()));
+        assert(RefsLoaderTake(loader, refs, strict));
+        assert(1500 == refs.size() && !strict);
+    }
+    {
+        RefsLoader loader;
+        RefsLoaderInit(loader, nullptr);
+        RefsLoaderCancel(loader);
+        RefsLoaderRun(loader,
+            [&some]() -> Stream { return StreamFromVector(some); },
+            [&some]() -> Stream { return StreamFromVector(some); });
+
+        vector<string> refs;
+        bool strict = false;
+        assert(RefsLoaderTake(loader, refs, strict));
+        assert(1 == refs.size() && strict);
+    }
+}
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "RefStream.hpp"
+
+// Enumeration of suitable refs in a background thread.
+// The dialog may be shown while refs are still arriving: the consumer takes them in batches.
+
+typedef struct tRefsLoader {
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<std::string> pending; // loaded but not taken refs, unique but not sorted
+    size_t loadedCount;
+    bool strict;                      // false once refs are looked up by partial prefixes
+    bool done;
+    std::atomic<bool> cancelled;
+    std::function<void ()> notify;    // is called from the loading thread after each batch
+} RefsLoader;
+
+void RefsLoaderInit(RefsLoader &loader, std::function<void ()> notify);
+
+/**
+ * Loads refs by the strict prefix, or by partial prefixes if there are no strictly matched refs.
+ * Streams are created lazily in the calling (loading) thread.
+ */
+void RefsLoaderRun(RefsLoader &loader, std::function<Stream ()> strictRefs, std::function<Stream ()> partialRefs);
+
+/** Waits until there are refs to take or the loading is done, returns true if it is done. */
+bool RefsLoaderWait(RefsLoader &loader);
+
+/** The same as RefsLoaderWait, but stops waiting at the deadline. */
+bool RefsLoaderWaitUntil(RefsLoader &loader, std::chrono::steady_clock::time_point deadline);
+
+/** Appends loaded refs to refs, returns true if the loading is done and nothing will be appended later. */
+bool RefsLoaderTake(RefsLoader &loader, std::vector<std::string> &refs, bool &strict);
+
+/** Asks the loading thread to stop, it does so after the current ref. */
+void RefsLoaderCancel(RefsLoader &loader);
+
+#ifdef DEBUG
+void RefsLoaderTest();
+#endif
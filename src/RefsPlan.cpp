@@ -0,0 +1,192 @@
+#include "RefsPlan.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <sstream>
+
+using namespace std;
+
+// Priors which are used until the costs of the repository are observed.
+static const double LOOSE_REF_MICROS = 40.0;   // open and read of a file
+static const double PACKED_REF_MICROS = 1.5;   // parsing of a line of packed-refs
+static const double SORT_MICROS = 0.05;        // per n * log2(n)
+static const double VALIDATE_MICROS = 200.0;
+
+// Smaller repositories are scanned without keeping a copy of their refs in memory.
+static const size_t SNAPSHOT_MIN_REFS = 1000;
+
+// Loose refs are worth packing if there are at least so many of them and packing saves at least so much of a scan.
+static const size_t PACKING_MIN_LOOSE_REFS = 1000;
+static const double PACKING_MIN_SAVING_MICROS = 20000.0;
+
+// Weight of the latest observation.
+static const double OBSERVATION_WEIGHT = 0.3;
+
+static void Observe(double &average, double observed) {
+    average = (average == 0) ? observed : (average * (1 - OBSERVATION_WEIGHT) + observed * OBSERVATION_WEIGHT);
+}
+
+RepoStats RepoStatsCreate() {
+    RepoStats stats = { 0, 0, 0, 0, 0, 0 };
+    return stats;
+}
+
+void RepoStatsObserveScan(RepoStats &stats, size_t refCount, double micros) {
+    stats.refCount = refCount;
+    if (refCount > 0) {
+        Observe(stats.scanMicrosPerRef, micros / refCount);
+    }
+}
+
+void RepoStatsObserveSurvey(RepoStats &stats, size_t looseCount) {
+    stats.looseCount = looseCount;
+}
+
+void RepoStatsObserveValidate(RepoStats &stats, double micros) {
+    Observe(stats.validateMicros, micros);
+}
+
+void RepoStatsObservePrepare(RepoStats &stats, double micros) {
+    Observe(stats.prepareMicros, micros);
+}
+
+static double SortCost(size_t count) {
+    return (count > 1) ? SORT_MICROS * count * log2((double)count) : 0;
+}
+
+static double ScanCost(const RepoStats &stats) {
+    if (stats.scanMicrosPerRef != 0) {
+        return stats.refCount * stats.scanMicrosPerRef;
+    }
+    size_t looseCount = min(stats.looseCount, stats.refCount);
+    return looseCount * LOOSE_REF_MICROS + (stats.refCount - looseCount) * PACKED_REF_MICROS;
+}
+
+QueryPlan PlanQuery(const RepoStats &stats, bool snapshotValid, bool snapshotPrepared, bool dialog) {
+    QueryPlan plan;
+    plan.scanCost = ScanCost(stats) + (dialog ? SortCost(stats.refCount) : 0);
+    plan.snapshotCost = 0;
+    if (snapshotValid) {
+        double prepareCost = (stats.prepareMicros != 0) ? stats.prepareMicros : SortCost(stats.refCount);
+        plan.snapshotCost = ((stats.validateMicros != 0) ? stats.validateMicros : VALIDATE_MICROS)
+                          + (snapshotPrepared ? 0 : prepareCost)
+                          + log2((double)stats.refCount + 1);
+    }
+
+    if (stats.refCount == 0) {
+        // nothing is known, the first scan is recorded to learn the repository
+        plan.source = SOURCE_SCAN_AND_SNAPSHOT;
+    } else if (snapshotValid && plan.snapshotCost < plan.scanCost) {
+        plan.source = SOURCE_SNAPSHOT;
+    } else if (stats.refCount >= SNAPSHOT_MIN_REFS) {
+        plan.source = SOURCE_SCAN_AND_SNAPSHOT;
+    } else {
+        plan.source = SOURCE_SCAN;
+    }
+
+    if (plan.source == SOURCE_SNAPSHOT) {
+        plan.matcher = MATCHER_BINARY_SEARCH;
+        plan.ordering = ORDERING_PRESORTED;
+    } else {
+        plan.matcher = MATCHER_PREDICATE;
+        plan.ordering = dialog ? ORDERING_SORT : ORDERING_FOLD;
+    }
+    return plan;
+}
+
+double PackingSavingMicros(const RepoStats &stats) {
+    // Observed scans include both kinds of refs, packed refs would cost the same after packing.
+    size_t looseCount = min(stats.looseCount, stats.refCount);
+    return (looseCount == 0) ? 0 : max(0.0, ScanCost(stats) - stats.refCount * PACKED_REF_MICROS);
+}
+
+bool LooseRefsPressing(const RepoStats &stats) {
+    return stats.looseCount >= PACKING_MIN_LOOSE_REFS && PackingSavingMicros(stats) >= PACKING_MIN_SAVING_MICROS;
+}
+
+static const char *SourceName(RefsSource source) {
+    switch (source) {
+        case SOURCE_SCAN:              return "scan";
+        case SOURCE_SCAN_AND_SNAPSHOT: return "scan+snapshot";
+        case SOURCE_SNAPSHOT:          return "snapshot";
+    }
+    return "?";
+}
+
+static const char *MatcherName(RefsMatcher matcher) {
+    switch (matcher) {
+        case MATCHER_PREDICATE:     return "predicate";
+        case MATCHER_BINARY_SEARCH: return "binary-search";
+    }
+    return "?";
+}
+
+static const char *OrderingName(RefsOrdering ordering) {
+    switch (ordering) {
+        case ORDERING_SORT:      return "sort";
+        case ORDERING_FOLD:      return "fold";
+        case ORDERING_PRESORTED: return "presorted";
+    }
+    return "?";
+}
+
+string DescribeQueryPlan(const QueryPlan &plan, const RepoStats &stats) {
+    ostringstream description;
+    description.precision(1);
+    description << fixed
+        << "source = " << SourceName(plan.source)
+        << ", matcher = " << MatcherName(plan.matcher)
+        << ", ordering = " << OrderingName(plan.ordering)
+        << "; estimated us: scan = " << plan.scanCost << ", snapshot = " << plan.snapshotCost
+        << "; stats: queries = " << stats.queries
+        << ", refs = " << stats.refCount
+        << ", loose = " << stats.looseCount
+        << ", us per scanned ref = " << stats.scanMicrosPerRef
+        << ", validate us = " << stats.validateMicros
+        << ", prepare us = " << stats.prepareMicros;
+    return description.str();
+}
+
+#ifdef DEBUG
+void RefsPlanTest() {
+    RepoStats stats = RepoStatsCreate();
+
+    QueryPlan plan = PlanQuery(stats, false, false, false);
+    assert(SOURCE_SCAN_AND_SNAPSHOT == plan.source && ORDERING_FOLD == plan.ordering);
+
+    // small repository: a scan is cheaper than a check of the snapshot
+    RepoStatsObserveScan(stats, 100, 100 * 1.0);
+    RepoStatsObserveValidate(stats, 300);
+    plan = PlanQuery(stats, true, true, true);
+    assert(SOURCE_SCAN == plan.source && MATCHER_PREDICATE == plan.matcher && ORDERING_SORT == plan.ordering);
+
+    // big repository with many loose refs
+    stats = RepoStatsCreate();
+    RepoStatsObserveSurvey(stats, 50000);
+    RepoStatsObserveScan(stats, 100000, 100000 * 20.0);
+    plan = PlanQuery(stats, false, false, true);
+    assert(SOURCE_SCAN_AND_SNAPSHOT == plan.source);
+    RepoStatsObserveValidate(stats, 500);
+    plan = PlanQuery(stats, true, false, false);
+    assert(SOURCE_SNAPSHOT == plan.source && MATCHER_BINARY_SEARCH == plan.matcher && ORDERING_PRESORTED == plan.ordering);
+    assert(plan.snapshotCost < plan.scanCost);
+    assert(LooseRefsPressing(stats) && fabs(PackingSavingMicros(stats) - 100000 * 18.5) < 1e-6);
+
+    // loose refs which are read fast, or are few, are not worth packing
+    RepoStats fast = RepoStatsCreate();
+    RepoStatsObserveSurvey(fast, 5000);
+    RepoStatsObserveScan(fast, 5000, 5000 * 2.0);
+    assert(!LooseRefsPressing(fast));
+    RepoStatsObserveScan(fast, 5000, 5000 * 30.0);
+    assert(LooseRefsPressing(fast));
+    RepoStatsObserveSurvey(fast, 0);
+    assert(!LooseRefsPressing(fast) && 0 == PackingSavingMicros(fast));
+
+    // observations are averaged
+    RepoStatsObserveValidate(stats, 1500);
+    assert(fabs(stats.validateMicros - (500 * 0.7 + 1500 * 0.3)) < 1e-6);
+
+    assert(!DescribeQueryPlan(plan, stats).empty());
+}
+#endif
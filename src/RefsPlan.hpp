@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+
+// Cost model which picks how suitable refs are obtained for a query.
+//
+// A plain libgit2 scan is the best for small repositories, but it reads every loose ref
+// and the whole packed-refs file on every completion. For big repositories a sorted snapshot
+// of all refs is kept in memory and is validated by the fingerprint of ref files instead.
+
+/** Statistics of one repository, observed costs are in microseconds and are 0 until observed. */
+typedef struct tRepoStats {
+    size_t queries;
+    size_t refCount;         // 0 if no scan is observed yet
+    size_t looseCount;       // as of the last survey of ref files
+    double scanMicrosPerRef; // libgit2 enumeration
+    double validateMicros;   // check of the snapshot fingerprint
+    double prepareMicros;    // expanding and sorting of snapshot names
+} RepoStats;
+
+RepoStats RepoStatsCreate();
+
+void RepoStatsObserveScan(RepoStats &stats, size_t refCount, double micros);
+void RepoStatsObserveSurvey(RepoStats &stats, size_t looseCount);
+void RepoStatsObserveValidate(RepoStats &stats, double micros);
+void RepoStatsObservePrepare(RepoStats &stats, double micros);
+
+typedef enum tRefsSource {
+    SOURCE_SCAN,              // libgit2 enumeration
+    SOURCE_SCAN_AND_SNAPSHOT, // libgit2 enumeration which also records a snapshot for the next queries
+    SOURCE_SNAPSHOT,          // sorted snapshot
+} RefsSource;
+
+typedef enum tRefsMatcher {
+    MATCHER_PREDICATE,        // every ref is checked
+    MATCHER_BINARY_SEARCH,    // refs with the prefix (or its first char) are found in the sorted snapshot
+} RefsMatcher;
+
+typedef enum tRefsOrdering {
+    ORDERING_SORT,            // collected refs are sorted
+    ORDERING_FOLD,            // only the common prefix and the next ref are folded, nothing is sorted
+    ORDERING_PRESORTED,       // refs come sorted, bounded selection by binary search
+} RefsOrdering;
+
+typedef struct tQueryPlan {
+    RefsSource source;
+    RefsMatcher matcher;
+    RefsOrdering ordering;
+    double scanCost;          // estimated microseconds, 0 if unknown
+    double snapshotCost;      // estimated microseconds, 0 if there is no valid snapshot
+} QueryPlan;
+
+/** snapshotPrepared means that snapshot names are made for the options of the query. */
+QueryPlan PlanQuery(const RepoStats &stats, bool snapshotValid, bool snapshotPrepared, bool dialog);
+
+/** Estimated microseconds which packing of loose refs would save on every scan. */
+double PackingSavingMicros(const RepoStats &stats);
+
+/** Loose refs are many and make scans noticeably slower, so they are worth packing. */
+bool LooseRefsPressing(const RepoStats &stats);
+
+/** One line for the log, so decisions can be audited. */
+std::string DescribeQueryPlan(const QueryPlan &plan, const RepoStats &stats);
+
+#ifdef DEBUG
+void RefsPlanTest();
+#endif
@@ -0,0 +1,252 @@
+#include "RefsSnapshot.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+#include "Utils.hpp"
+
+using namespace std;
+
+static double MicrosSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+}
+
+shared_ptr<RefsSnapshot> RefsSnapshotCreate() {
+    shared_ptr<RefsSnapshot> snapshot = make_shared<RefsSnapshot>();
+    snapshot->looseCount = 0;
+    snapshot->complete = false;
+    snapshot->scanCount = 0;
+    snapshot->scanMicros = 0;
+    snapshot->fixedNames = false;
+    snapshot->namesReady = false;
+    snapshot->stripRemoteName = false;
+    snapshot->prepareMicros = 0;
+    snapshot->wideGeneration = 0;
+    snapshot->tableReady = false;
+    return snapshot;
+}
+
+shared_ptr<RefsSnapshot> RefsSnapshotFromNames(const vector<string> &sortedNames) {
+    assert(is_sorted(sortedNames.begin(), sortedNames.end()));
+    shared_ptr<RefsSnapshot> snapshot = RefsSnapshotCreate();
+    snapshot->complete = true;
+    snapshot->fixedNames = true;
+    snapshot->namesReady = true;
+    snapshot->names = sortedNames;
+    return snapshot;
+}
+
+Stream RecordingStream(Stream fullNames, shared_ptr<RefsSnapshot> snapshot, bool keepNames) {
+    shared_ptr<vector<string>> recorded = make_shared<vector<string>>();
+    shared_ptr<size_t> count = make_shared<size_t>(0);
+    auto start = chrono::steady_clock::now();
+    return [fullNames, snapshot, keepNames, recorded, count, start](string &fullName) -> bool {
+        if (!fullNames(fullName)) {
+            if (!snapshot->complete) {
+                snapshot->complete = true;
+                snapshot->scanCount = *count;
+                snapshot->scanMicros = MicrosSince(start);
+                if (keepNames) {
+                    snapshot->fullNames.swap(*recorded);
+                    snapshot->namesReady = false;
+                }
+            }
+            return false;
+        }
+        ++*count;
+        if (keepNames) {
+            recorded->push_back(fullName);
+        }
+        return true;
+    };
+}
+
+void RefsSnapshotPrepare(RefsSnapshot &snapshot, bool stripRemoteName) {
+    assert(snapshot.complete);
+    if (snapshot.fixedNames || (snapshot.namesReady && snapshot.stripRemoteName == stripRemoteName)) {
+        return;
+    }
+    auto start = chrono::steady_clock::now();
+    snapshot.names.clear();
+    snapshot.widePool.clear();
+    snapshot.wideOffsets.clear();
+    snapshot.wideGeneration++;
+    snapshot.tableReady = false;
+    CollectSortedUnique(ExpandRefNames(StreamFromVector(snapshot.fullNames), stripRemoteName), snapshot.names);
+    snapshot.stripRemoteName = stripRemoteName;
+    snapshot.namesReady = true;
+    snapshot.prepareMicros = MicrosSince(start);
+}
+
+void RefsSnapshotPrepareWide(RefsSnapshot &snapshot) {
+    assert(snapshot.namesReady);
+    const vector<string> &names = snapshot.names;
+    if (snapshot.wideOffsets.size() == names.size() + 1) {
+        return;
+    }
+    // There are never more UTF-16 units than UTF-8 bytes, so the pool is allocated once and then shrunk.
+    size_t bytes = 0;
+    for (auto it = names.begin(); it != names.end(); ++it) {
+        bytes += it->length() + 1;
+    }
+    snapshot.widePool.assign(bytes, L'\0');
+    snapshot.wideOffsets.clear();
+    snapshot.wideOffsets.reserve(names.size() + 1);
+    size_t offset = 0;
+    for (auto it = names.begin(); it != names.end(); ++it) {
+        snapshot.wideOffsets.push_back(offset);
+        offset += mb2wBuffer(*it, &snapshot.widePool[offset]) + 1;
+    }
+    snapshot.wideOffsets.push_back(offset);
+    snapshot.widePool.resize(offset);
+    snapshot.wideGeneration++;
+}
+
+void RefsSnapshotPrepareTable(RefsSnapshot &snapshot) {
+    assert(snapshot.namesReady);
+    if (snapshot.tableReady) {
+        return;
+    }
+    RefTableBuild(snapshot.table, snapshot.fullNames, snapshot.names, snapshot.stripRemoteName);
+    snapshot.tableReady = true;
+}
+
+const wchar_t *RefsSnapshotWideName(const RefsSnapshot &snapshot, size_t index) {
+    assert(index + 1 < snapshot.wideOffsets.size());
+    return snapshot.widePool.c_str() + snapshot.wideOffsets[index];
+}
+
+size_t RefsSnapshotWideLength(const RefsSnapshot &snapshot, size_t index) {
+    assert(index + 1 < snapshot.wideOffsets.size());
+    return snapshot.wideOffsets[index + 1] - snapshot.wideOffsets[index] - 1;
+}
+
+size_t RefsSnapshotFind(const RefsSnapshot &snapshot, const string &name) {
+    assert(snapshot.namesReady);
+    auto found = lower_bound(snapshot.names.begin(), snapshot.names.end(), name);
+    return (found != snapshot.names.end() && *found == name) ? (size_t)(found - snapshot.names.begin()) : (size_t)-1;
+}
+
+pair<size_t, size_t> RefsSnapshotPrefixRange(const RefsSnapshot &snapshot, const string &prefix) {
+    assert(snapshot.namesReady);
+    const vector<string> &names = snapshot.names;
+    auto first = lower_bound(names.begin(), names.end(), prefix);
+    // the first name which does not start with prefix
+    auto last = partition_point(first, names.end(), [&prefix](const string &name) -> bool {
+        return StartsWith(name, prefix);
+    });
+    return pair<size_t, size_t>(first - names.begin(), last - names.begin());
+}
+
+pair<size_t, size_t> RefsSnapshotPartialRange(const RefsSnapshot &snapshot, const string &partialPrefix) {
+    char first = partialPrefix.empty() ? '\0' : partialPrefix[0];
+    bool anchored = (first != '\0' && !IsPartialPrefixAnchor(first));
+    return RefsSnapshotPrefixRange(snapshot, anchored ? string(1, first) : string(""));
+}
+
+Stream StreamFromSnapshot(shared_ptr<RefsSnapshot> snapshot, pair<size_t, size_t> range) {
+    shared_ptr<size_t> next = make_shared<size_t>(range.first);
+    size_t end = range.second;
+    return [snapshot, next, end](string &item) -> bool {
+        if (*next >= end) {
+            return false;
+        }
+        item = snapshot->names[(*next)++];
+        return true;
+    };
+}
+
+string SortedRangeCommonPrefix(const vector<string> &items, pair<size_t, size_t> range) {
+    assert(range.first < range.second);
+    const string &first = items[range.first];
+    const string &last = items[range.second - 1];
+    size_t length = 0;
+    while (length < first.length() && length < last.length() && first[length] == last[length]) {
+        length++;
+    }
+    return first.substr(0, Utf8Floor(first, length));
+}
+
+size_t SortedRangeNextIndex(const vector<string> &items, pair<size_t, size_t> range, bool forward, const string &current) {
+    assert(range.first < range.second);
+    size_t first = range.first;
+    size_t last = range.second - 1;
+    size_t it = (size_t)(lower_bound(items.begin() + first, items.begin() + range.second, current) - items.begin());
+    if (it == range.second || items[it] != current) {
+        return forward ? first : last;
+    }
+    if (forward) {
+        return (it != last) ? it + 1 : first;
+    } else {
+        return (it != first) ? it - 1 : last;
+    }
+}
+
+string SortedRangeNextItem(const vector<string> &items, pair<size_t, size_t> range, bool forward, const string &current) {
+    return items[SortedRangeNextIndex(items, range, forward, current)];
+}
+
+#ifdef DEBUG
+void RefsSnapshotTest() {
+    vector<string> fullNames = {
+        string("refs/remotes/origin/master"),
+        string("refs/heads/master"),
+        string("refs/heads/feature/b"),
+        string("refs/heads/feature/a"),
+    };
+
+    shared_ptr<RefsSnapshot> snapshot = RefsSnapshotCreate();
+    Stream recording = RecordingStream(StreamFromVector(fullNames), snapshot, true);
+    Drain(recording, [](const string &) -> bool { return true; });
+    assert(snapshot->complete && 4 == snapshot->scanCount && 4 == snapshot->fullNames.size());
+
+    RefsSnapshotPrepare(*snapshot, true);
+    assert((vector<string>{ string("feature/a"), string("feature/b"), string("master"), string("origin/master") }) == snapshot->names);
+
+    auto features = RefsSnapshotPrefixRange(*snapshot, string("feature/"));
+    assert(0 == features.first && 2 == features.second);
+    assert(string("feature/") == SortedRangeCommonPrefix(snapshot->names, features));
+    assert(string("feature/b") == SortedRangeNextItem(snapshot->names, features, true, string("feature/a")));
+    assert(string("feature/a") == SortedRangeNextItem(snapshot->names, features, true, string("feature/b")));
+    assert(string("feature/b") == SortedRangeNextItem(snapshot->names, features, false, string("feature/")));
+    auto all = RefsSnapshotPrefixRange(*snapshot, string(""));
+    assert(0 == all.first && 4 == all.second);
+    assert(features == RefsSnapshotPartialRange(*snapshot, string("f/b")));
+    assert(make_pair((size_t)0, snapshot->names.size()) == RefsSnapshotPartialRange(*snapshot, string("/b")));
+    auto none = RefsSnapshotPrefixRange(*snapshot, string("x"));
+    assert(none.first == none.second);
+
+    vector<string> streamed;
+    Drain(StreamFromSnapshot(snapshot, RefsSnapshotPrefixRange(*snapshot, string("m"))), [&streamed](const string &name) -> bool {
+        streamed.push_back(name);
+        return true;
+    });
+    assert((vector<string>{ string("master") }) == streamed);
+
+    RefsSnapshotPrepareWide(*snapshot);
+    assert(wstring(L"feature/b") == RefsSnapshotWideName(*snapshot, 1) && 9 == RefsSnapshotWideLength(*snapshot, 1));
+    assert(wstring(L"origin/master") == RefsSnapshotWideName(*snapshot, 3));
+    assert(3 == RefsSnapshotFind(*snapshot, string("origin/master")) && (size_t)-1 == RefsSnapshotFind(*snapshot, string("origin")));
+    RefsSnapshotPrepareTable(*snapshot);
+    assert(snapshot->tableReady && 4 == snapshot->table.count);
+    assert((vector<string>{ string("master"), string("origin/master") }) == RefTableNames(snapshot->names, snapshot->table.kinds[REF_KIND_REMOTE]));
+    size_t generation = snapshot->wideGeneration;
+    RefsSnapshotPrepareWide(*snapshot);
+    assert(generation == snapshot->wideGeneration);
+    RefsSnapshotPrepare(*snapshot, false);
+    assert(snapshot->wideOffsets.empty() && !snapshot->tableReady && generation != snapshot->wideGeneration);
+    generation = snapshot->wideGeneration;
+    RefsSnapshotPrepareWide(*snapshot);
+    assert(generation != snapshot->wideGeneration && wstring(L"master") == RefsSnapshotWideName(*snapshot, 2));
+
+    shared_ptr<RefsSnapshot> remotes = RefsSnapshotFromNames(vector<string>{ string("origin"), string("upstream") });
+    RefsSnapshotPrepare(*remotes, true);
+    assert(1 == RefsSnapshotPrefixRange(*remotes, string("u")).first);
+
+    // a scan stopped by the consumer does not make a snapshot
+    shared_ptr<RefsSnapshot> stopped = RefsSnapshotCreate();
+    Drain(RecordingStream(StreamFromVector(fullNames), stopped, true), [](const string &) -> bool { return false; });
+    assert(!stopped->complete && stopped->fullNames.empty());
+}
+#endif
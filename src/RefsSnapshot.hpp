@@ -0,0 +1,90 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "RefFiles.hpp"
+#include "RefStream.hpp"
+#include "RefTable.hpp"
+
+// Sorted in-memory copy of all refs of a repository, valid while its fingerprint is unchanged.
+// It is filled as a side effect of a libgit2 scan and is used instead of the next scans.
+
+typedef struct tRefsSnapshot {
+    RefFilesFingerprint fingerprint; // taken before the scan, so changes during the scan are noticed later
+    size_t looseCount;
+    std::vector<std::string> fullNames;
+
+    bool complete;                   // the scan was drained to the end
+    size_t scanCount;
+    double scanMicros;
+
+    bool fixedNames;                 // names are not refs and are never expanded
+    bool namesReady;
+    bool stripRemoteName;
+    std::vector<std::string> names;  // expanded, sorted and unique, are made lazily
+    double prepareMicros;
+
+    // UTF-16 copies of the names for the dialog and the command line, they are made lazily once per names.
+    std::wstring widePool;           // all names, each one is zero-terminated
+    std::vector<size_t> wideOffsets; // of every name in the pool, and the end of the pool
+    size_t wideGeneration;           // changes whenever the pool is cleared or rebuilt, pointers into an older pool dangle
+
+    // Bitmaps of filters over the names, they are made lazily once per names.
+    bool tableReady;
+    RefTable table;
+} RefsSnapshot;
+
+std::shared_ptr<RefsSnapshot> RefsSnapshotCreate();
+
+/** Snapshot of sorted unique names which are not refs (e.g. remotes or config keys). */
+std::shared_ptr<RefsSnapshot> RefsSnapshotFromNames(const std::vector<std::string> &sortedNames);
+
+/**
+ * Passes full names through and measures the scan.
+ * If keepNames, the names are also recorded into the snapshot once the scan is drained to the end.
+ */
+Stream RecordingStream(Stream fullNames, std::shared_ptr<RefsSnapshot> snapshot, bool keepNames);
+
+/** Makes names for the given stripRemoteName if they are not made yet. */
+void RefsSnapshotPrepare(RefsSnapshot &snapshot, bool stripRemoteName);
+
+/** Makes UTF-16 copies of the prepared names if they are not made yet. */
+void RefsSnapshotPrepareWide(RefsSnapshot &snapshot);
+
+/** Makes the filter bitmaps of the prepared names if they are not made yet. */
+void RefsSnapshotPrepareTable(RefsSnapshot &snapshot);
+
+/** UTF-16 copy of the prepared name, zero-terminated. */
+const wchar_t *RefsSnapshotWideName(const RefsSnapshot &snapshot, size_t index);
+
+size_t RefsSnapshotWideLength(const RefsSnapshot &snapshot, size_t index);
+
+/** Index of the prepared name or -1. */
+size_t RefsSnapshotFind(const RefsSnapshot &snapshot, const std::string &name);
+
+/** Range of prepared names starting with prefix. */
+std::pair<size_t, size_t> RefsSnapshotPrefixRange(const RefsSnapshot &snapshot, const std::string &prefix);
+
+/**
+ * Range of prepared names which may be encoded by a partial prefix (see RefMayBeEncodedByPartialPrefix),
+ * its names still have to be checked: the first char of the prefix is matched literally unless it is an anchor.
+ */
+std::pair<size_t, size_t> RefsSnapshotPartialRange(const RefsSnapshot &snapshot, const std::string &partialPrefix);
+
+/** Streams prepared names of the range in sorted order, the snapshot is kept alive by the stream. */
+Stream StreamFromSnapshot(std::shared_ptr<RefsSnapshot> snapshot, std::pair<size_t, size_t> range);
+
+/** Longest common prefix of all items of a sorted range is the common prefix of its first and last items. */
+std::string SortedRangeCommonPrefix(const std::vector<std::string> &items, std::pair<size_t, size_t> range);
+
+/** The same as NextItemFold over the range, but with binary search. The range must not be empty. */
+size_t SortedRangeNextIndex(const std::vector<std::string> &items, std::pair<size_t, size_t> range, bool forward, const std::string &current);
+
+std::string SortedRangeNextItem(const std::vector<std::string> &items, std::pair<size_t, size_t> range, bool forward, const std::string &current);
+
+#ifdef DEBUG
+void RefsSnapshotTest();
+#endif
@@ -0,0 +1,179 @@
+#include "RefsTree.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "Utils.hpp"
+
+using namespace std;
+
+static const char SEPARATOR = '/';
+
+/** Children of the group of refs [first, last) with the common prefix, refs of a child group are skipped by binary search. */
+static void InsertChildren(RefsTree &tree, size_t position, const string &prefix, size_t depth, size_t first, size_t last) {
+    const vector<string> &refs = *tree.refs;
+    vector<RefsTreeRow> children;
+    size_t ref = first;
+    while (ref < last) {
+        size_t separator = refs[ref].find(SEPARATOR, prefix.length());
+        if (separator == string::npos) {
+            RefsTreeRow row = { refs[ref], depth, 1, false, false, ref };
+            children.push_back(row);
+            ref++;
+            continue;
+        }
+        string path = refs[ref].substr(0, separator + 1);
+        size_t end = partition_point(refs.begin() + ref, refs.begin() + last, [&path](const string &name) -> bool {
+            return StartsWith(name, path);
+        }) - refs.begin();
+        RefsTreeRow row = { path, depth, end - ref, true, false, ref };
+        children.push_back(row);
+        ref = end;
+    }
+    tree.rows.insert(tree.rows.begin() + position, children.begin(), children.end());
+}
+
+void RefsTreeInit(RefsTree &tree, const vector<string> *refs) {
+    assert(is_sorted(refs->begin(), refs->end()));
+    tree.refs = refs;
+    tree.rows.clear();
+    InsertChildren(tree, 0, string(""), 0, 0, refs->size());
+}
+
+void RefsTreeFree(RefsTree &tree) {
+    tree.refs = nullptr;
+    tree.rows.clear();
+}
+
+void RefsTreeExpand(RefsTree &tree, size_t row) {
+    assert(row < tree.rows.size());
+    RefsTreeRow &group = tree.rows[row];
+    if (!group.group || group.expanded) {
+        return;
+    }
+    group.expanded = true;
+    string prefix = group.path;
+    InsertChildren(tree, row + 1, prefix, group.depth + 1, group.first, group.first + group.count);
+}
+
+void RefsTreeCollapse(RefsTree &tree, size_t row) {
+    assert(row < tree.rows.size());
+    RefsTreeRow &group = tree.rows[row];
+    if (!group.group || !group.expanded) {
+        return;
+    }
+    group.expanded = false;
+    size_t end = row + 1;
+    while (end < tree.rows.size() && tree.rows[end].depth > group.depth) {
+        end++;
+    }
+    tree.rows.erase(tree.rows.begin() + row + 1, tree.rows.begin() + end);
+}
+
+size_t RefsTreeParent(const RefsTree &tree, size_t row) {
+    assert(row < tree.rows.size());
+    size_t depth = tree.rows[row].depth;
+    while (row > 0 && tree.rows[row].depth >= depth && depth > 0) {
+        row--;
+    }
+    return row;
+}
+
+size_t RefsTreeReveal(RefsTree &tree, const string &ref) {
+    size_t row = 0;
+    size_t depth = 0;
+    while (row < tree.rows.size()) {
+        RefsTreeRow &cur = tree.rows[row];
+        if (cur.depth < depth) {
+            break;
+        }
+        if (cur.depth == depth) {
+            if (!cur.group && cur.path == ref) {
+                return row;
+            }
+            if (cur.group && StartsWith(ref, cur.path)) {
+                RefsTreeExpand(tree, row);
+                depth++;
+            }
+        }
+        row++;
+    }
+    return (size_t)-1;
+}
+
+string RefsTreeRowText(const RefsTreeRow &row) {
+    // Show only the last segment, the hierarchy is shown by indentation.
+    size_t nameEnd = row.group ? row.path.length() - 1 : row.path.length();
+    size_t nameStart = row.path.rfind(SEPARATOR, nameEnd - 1);
+    nameStart = (nameStart == string::npos) ? 0 : nameStart + 1;
+    string name = row.path.substr(nameStart);
+
+    string text(row.depth * 2, ' ');
+    if (row.group) {
+        text += row.expanded ? "[-] " : "[+] ";
+        text += name + " (" + to_string(row.count) + ")";
+    } else {
+        text += "    " + name;
+    }
+    return text;
+}
+
+size_t RefsTreeMaxTextLength(const vector<string> &refs) {
+    // A group text ends with its count, which is at most the number of all refs.
+    size_t countLength = to_string(refs.size()).length();
+    size_t maxLength = 0;
+    for (auto ref = refs.begin(); ref != refs.end(); ++ref) {
+        size_t depth = 0;
+        size_t start = 0;
+        size_t separator;
+        while ((separator = ref->find(SEPARATOR, start)) != string::npos) {
+            // "[+] " + "name/" + " (count)"
+            maxLength = max(maxLength, depth * 2 + 4 + Utf8Length(ref->substr(start, separator + 1 - start)) + 3 + countLength);
+            depth++;
+            start = separator + 1;
+        }
+        // "    " + "name"
+        maxLength = max(maxLength, depth * 2 + 4 + Utf8Length(ref->substr(start)));
+    }
+    return maxLength;
+}
+
+#ifdef DEBUG
+void RefsTreeTest() {
+    vector<string> refs = { string("feature"), string("feature/a/x"), string("feature/a/y"), string("feature/b"), string("master") };
+    RefsTree tree;
+    RefsTreeInit(tree, &refs);
+    assert(3 == tree.rows.size());
+    assert(string("feature") == tree.rows[0].path && !tree.rows[0].group);
+    assert(string("feature/") == tree.rows[1].path && tree.rows[1].group && 3 == tree.rows[1].count);
+    assert(string("master") == tree.rows[2].path);
+    assert(string("[+] feature/ (3)") == RefsTreeRowText(tree.rows[1]));
+
+    RefsTreeExpand(tree, 1);
+    assert(5 == tree.rows.size());
+    assert(string("feature/a/") == tree.rows[2].path && 2 == tree.rows[2].count);
+    assert(string("feature/b") == tree.rows[3].path);
+    assert(string("  [+] a/ (2)") == RefsTreeRowText(tree.rows[2]));
+    assert(string("      b") == RefsTreeRowText(tree.rows[3]));
+    assert(1 == RefsTreeParent(tree, 3));
+    assert(0 == RefsTreeParent(tree, 0));
+
+    RefsTreeCollapse(tree, 1);
+    assert(3 == tree.rows.size());
+
+    size_t row = RefsTreeReveal(tree, string("feature/a/y"));
+    assert(4 == row);
+    assert(string("feature/a/y") == tree.rows[row].path);
+    assert(2 == tree.rows[row].depth);
+    assert((size_t)-1 == RefsTreeReveal(tree, string("feature/z")));
+    // "[+] feature/ (3)" is the longest row, the count of a group is bounded by the number of all refs
+    assert(16 == RefsTreeMaxTextLength(refs));
+
+    // a ref which sorts between the refs of a group does not split the group
+    vector<string> dashed = { string("a-b"), string("a/x"), string("a/y"), string("a0") };
+    RefsTreeInit(tree, &dashed);
+    assert(3 == tree.rows.size() && string("a/") == tree.rows[1].path && 2 == tree.rows[1].count && string("a0") == tree.rows[2].path);
+
+    RefsTreeFree(tree);
+}
+#endif
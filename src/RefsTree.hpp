@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Platform independent model of the refs dialog in the tree mode:
+// refs are grouped by "/"-separated segments, groups are expanded lazily.
+// Refs of a group are a range of the sorted refs, so rows are found by binary search without visiting all refs.
+
+typedef struct tRefsTreeRow {
+    std::string path; // e.g. "feature/" for a group or "feature/abc" for a ref
+    size_t depth;
+    size_t count;     // number of refs in the group
+    bool group;
+    bool expanded;
+    size_t first;     // index of the ref or of the first ref of the group
+} RefsTreeRow;
+
+typedef struct tRefsTree {
+    const std::vector<std::string> *refs; // sorted and unique, they must outlive the tree
+    std::vector<RefsTreeRow> rows;        // visible rows in display order
+} RefsTree;
+
+/** Only the top level rows are materialized. */
+void RefsTreeInit(RefsTree &tree, const std::vector<std::string> *refs);
+
+void RefsTreeFree(RefsTree &tree);
+
+void RefsTreeExpand(RefsTree &tree, size_t row);
+
+void RefsTreeCollapse(RefsTree &tree, size_t row);
+
+/** Returns the row of the group containing the given row or the row itself for the top level rows. */
+size_t RefsTreeParent(const RefsTree &tree, size_t row);
+
+/** Expands all groups containing ref and returns its row or -1 if there is no such ref. */
+size_t RefsTreeReveal(RefsTree &tree, const std::string &ref);
+
+std::string RefsTreeRowText(const RefsTreeRow &row);
+
+/** Upper bound of the lengths in chars of the texts of all rows which can be shown. */
+size_t RefsTreeMaxTextLength(const std::vector<std::string> &refs);
+
+#ifdef DEBUG
+void RefsTreeTest();
+#endif
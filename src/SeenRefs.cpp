@@ -0,0 +1,134 @@
+#include "SeenRefs.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "Files.hpp"
+
+using namespace std;
+
+static const string SEEN_REFS_FILE("far-git-autocomplete-seen-refs");
+static const string SEEN_REFS_HEADER("seen refs 1\n");
+
+RefsDiff DiffSortedNames(const vector<string> &before, const vector<string> &after) {
+    assert(is_sorted(before.begin(), before.end()) && is_sorted(after.begin(), after.end()));
+    RefsDiff diff;
+    auto b = before.begin();
+    auto a = after.begin();
+    while (b != before.end() && a != after.end()) {
+        int order = b->compare(*a);
+        if (order < 0) {
+            diff.removed.push_back(*(b++));
+        } else if (order > 0) {
+            diff.added.push_back(*(a++));
+        } else {
+            ++b;
+            ++a;
+        }
+    }
+    diff.removed.insert(diff.removed.end(), b, before.end());
+    diff.added.insert(diff.added.end(), a, after.end());
+    return diff;
+}
+
+static void AppendVarint(string &data, size_t value) {
+    while (value >= 0x80) {
+        data += (char)(0x80 | (value & 0x7F));
+        value >>= 7;
+    }
+    data += (char)value;
+}
+
+static bool ReadVarint(const string &data, size_t &position, size_t &value) {
+    value = 0;
+    for (size_t shift = 0; position < data.length() && shift < 64; shift += 7) {
+        unsigned char byte = (unsigned char)data[position++];
+        value |= (size_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+string EncodeSeenRefs(const vector<string> &sortedNames) {
+    string data(SEEN_REFS_HEADER);
+    const string *previous = nullptr;
+    for (auto it = sortedNames.begin(); it != sortedNames.end(); ++it) {
+        size_t shared = 0;
+        if (previous != nullptr) {
+            size_t maxShared = min(previous->length(), it->length());
+            while (shared < maxShared && (*previous)[shared] == (*it)[shared]) {
+                shared++;
+            }
+        }
+        AppendVarint(data, shared);
+        AppendVarint(data, it->length() - shared);
+        data.append(*it, shared, string::npos);
+        previous = &*it;
+    }
+    return data;
+}
+
+bool DecodeSeenRefs(const string &data, vector<string> &sortedNames) {
+    if (data.compare(0, SEEN_REFS_HEADER.length(), SEEN_REFS_HEADER) != 0) {
+        return false;
+    }
+    vector<string> names;
+    size_t position = SEEN_REFS_HEADER.length();
+    while (position < data.length()) {
+        size_t shared;
+        size_t rest;
+        if (!ReadVarint(data, position, shared) || !ReadVarint(data, position, rest)) {
+            return false;
+        }
+        size_t previousLength = names.empty() ? 0 : names.back().length();
+        if (shared > previousLength || rest > data.length() - position) {
+            return false;
+        }
+        string name = names.empty() ? string("") : names.back().substr(0, shared);
+        name.append(data, position, rest);
+        position += rest;
+        if (!names.empty() && !(names.back() < name)) {
+            return false;
+        }
+        names.push_back(name);
+    }
+    sortedNames.swap(names);
+    return true;
+}
+
+bool LoadSeenRefs(const string &gitDir, vector<string> &sortedNames) {
+    string data;
+    return ReadFileContents(gitDir + SEEN_REFS_FILE, data) && DecodeSeenRefs(data, sortedNames);
+}
+
+bool StoreSeenRefs(const string &gitDir, const vector<string> &sortedNames) {
+    return WriteFileContents(gitDir + SEEN_REFS_FILE, EncodeSeenRefs(sortedNames));
+}
+
+#ifdef DEBUG
+void SeenRefsTest() {
+    vector<string> before = { "refs/heads/feature/a", "refs/heads/master", "refs/remotes/origin/old" };
+    vector<string> after = { "refs/heads/feature/a", "refs/heads/feature/b", "refs/heads/master", "refs/tags/v2" };
+    RefsDiff diff = DiffSortedNames(before, after);
+    assert((vector<string>{ "refs/heads/feature/b", "refs/tags/v2" }) == diff.added);
+    assert((vector<string>{ "refs/remotes/origin/old" }) == diff.removed);
+    assert(DiffSortedNames(after, after).added.empty() && DiffSortedNames(after, after).removed.empty());
+
+    string encoded = EncodeSeenRefs(after);
+    vector<string> decoded;
+    assert(DecodeSeenRefs(encoded, decoded) && after == decoded);
+    // with front coding "refs/heads/feature/b" costs 2 bytes of lengths and 1 byte of its own
+    assert(SEEN_REFS_HEADER.length() + (2 + 20) + (2 + 1) + (2 + 6) + (2 + 7) == encoded.length());
+
+    vector<string> empty;
+    assert(DecodeSeenRefs(EncodeSeenRefs(empty), decoded) && decoded.empty());
+    vector<string> untouched = { "x" };
+    assert(!DecodeSeenRefs(string("garbage"), untouched) && 1 == untouched.size());
+    assert(!DecodeSeenRefs(encoded.substr(0, encoded.length() - 1), untouched));
+
+    vector<string> longName = { string(300, 'r') };
+    assert(DecodeSeenRefs(EncodeSeenRefs(longName), decoded) && longName == decoded);
+}
+#endif
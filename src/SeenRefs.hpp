@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Refs which the user has already seen in the dialog, so new ones (e.g. after a fetch) are marked.
+//
+// Full names of all refs are kept in a file of the git dir as a sorted list with front coding:
+// every name is stored as the length of the prefix shared with the previous name and the rest.
+
+typedef struct tRefsDiff {
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+} RefsDiff;
+
+/** Linear merge of two sorted lists of unique names. */
+RefsDiff DiffSortedNames(const std::vector<std::string> &before, const std::vector<std::string> &after);
+
+std::string EncodeSeenRefs(const std::vector<std::string> &sortedNames);
+
+/** Returns false if data is not a valid encoding. */
+bool DecodeSeenRefs(const std::string &data, std::vector<std::string> &sortedNames);
+
+/** Returns false if refs have never been seen in the repository (or the file is corrupted). */
+bool LoadSeenRefs(const std::string &gitDir, std::vector<std::string> &sortedNames);
+
+bool StoreSeenRefs(const std::string &gitDir, const std::vector<std::string> &sortedNames);
+
+#ifdef DEBUG
+void SeenRefsTest();
+#endif
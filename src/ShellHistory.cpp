@@ -0,0 +1,328 @@
+#include "ShellHistory.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cmath>
+
+#include "Files.hpp"
+#include "Utils.hpp"
+
+using namespace std;
+
+// Per git command, so the count of a token halves in about 70 commands.
+static const double HISTORY_DECAY = 0.99;
+// When the weight reaches it, counts are divided by the weight and tiny ones are forgotten.
+static const double MAX_WEIGHT = 1e6;
+static const double MIN_COUNT = 1e-3;
+
+vector<string> DefaultHistoryFiles() {
+    vector<string> paths;
+    string histfile = EnvironmentVariable("HISTFILE");
+    if (!histfile.empty()) {
+        paths.push_back(histfile);
+    }
+    string home = HomeDir();
+    if (!home.empty()) {
+        paths.push_back(home + "/.bash_history");
+        paths.push_back(home + "/.zsh_history");
+    }
+#ifdef _WIN32
+    string appData = EnvironmentVariable("APPDATA");
+    if (!appData.empty()) {
+        paths.push_back(appData + "/Microsoft/Windows/PowerShell/PSReadLine/ConsoleHost_history.txt");
+    }
+#else
+    if (!home.empty()) {
+        paths.push_back(home + "/.local/share/powershell/PSReadLine/ConsoleHost_history.txt");
+    }
+#endif
+    vector<string> extra = SplitPathList(EnvironmentVariable("FAR_GIT_AUTOCOMPLETE_HISTORY"));
+    for (auto it = extra.begin(); it != extra.end(); ++it) {
+        if (find(paths.begin(), paths.end(), *it) == paths.end()) {
+            paths.push_back(*it);
+        }
+    }
+    return paths;
+}
+
+static void ForgetEverything(ShellHistory &history) {
+    for (auto it = history.files.begin(); it != history.files.end(); ++it) {
+        it->offset = 0;
+        it->partial.clear();
+    }
+    history.counts.clear();
+    history.weight = 1;
+    history.commands = 0;
+}
+
+void ShellHistoryInit(ShellHistory &history, const vector<string> &paths) {
+    history.files.clear();
+    for (auto it = paths.begin(); it != paths.end(); ++it) {
+        history.files.push_back(HistoryFile{ *it, 0, string("") });
+    }
+    ForgetEverything(history);
+}
+
+size_t ShellHistoryScan(ShellHistory &history) {
+    vector<FileStamp> stamps;
+    bool shrunk = false;
+    for (auto it = history.files.begin(); it != history.files.end(); ++it) {
+        stamps.push_back(StampFile(it->path));
+        shrunk = shrunk || (stamps.back().exists ? stamps.back().size < it->offset : it->offset != 0);
+    }
+    // Bytes which have been counted are gone, so the counts can't be corrected by the difference.
+    if (shrunk) {
+        ForgetEverything(history);
+    }
+
+    size_t parsed = 0;
+    for (size_t i = 0; i < history.files.size(); ++i) {
+        HistoryFile &file = history.files[i];
+        if (!stamps[i].exists || stamps[i].size == file.offset) {
+            continue;
+        }
+        string appended;
+        if (!ReadFileFrom(file.path, file.offset, appended)) {
+            continue;
+        }
+        file.offset += (int64_t)appended.length();
+        parsed += appended.length();
+
+        string text = file.partial + appended;
+        size_t begin = 0;
+        for (size_t end = text.find('\n'); end != string::npos; end = text.find('\n', begin)) {
+            ShellHistoryAddLine(history, text.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        file.partial = text.substr(begin);
+    }
+    return parsed;
+}
+
+static bool IsCommandSeparator(const string &word) {
+    return word == ";" || word == "|" || word == "||" || word == "&" || word == "&&";
+}
+
+/** Splits the line into words, quotes group words and are dropped, separators of commands are words of their own. */
+static vector<string> ShellWords(const string &line) {
+    vector<string> words;
+    string word;
+    bool inWord = false;
+    char quote = '\0';
+    auto flush = [&words, &word, &inWord]() {
+        if (inWord) {
+            words.push_back(word);
+        }
+        word.clear();
+        inWord = false;
+    };
+    for (size_t i = 0; i < line.length(); ++i) {
+        char c = line[i];
+        if (quote != '\0') {
+            if (c == quote) {
+                quote = '\0';
+            } else {
+                word += c;
+            }
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+            inWord = true;
+        } else if (isspace((unsigned char)c)) {
+            flush();
+        } else if (c == ';' || c == '|' || c == '&') {
+            flush();
+            string separator(1, c);
+            while (i + 1 < line.length() && (line[i + 1] == '|' || line[i + 1] == '&')) {
+                separator += line[++i];
+            }
+            words.push_back(separator);
+        } else {
+            word += c;
+            inWord = true;
+        }
+    }
+    flush();
+    return words;
+}
+
+static bool IsGitProgram(const string &word) {
+    size_t slash = word.find_last_of("/\\");
+    string name = (slash == string::npos) ? word : word.substr(slash + 1);
+    transform(name.begin(), name.end(), name.begin(), [](char c) -> char { return (char)tolower((unsigned char)c); });
+    return name == "git" || name == "git.exe";
+}
+
+/** Words which may precede the program of a command: "sudo git", "LANG=C git". */
+static bool IsCommandPrefix(const string &word) {
+    return word == "sudo" || word == "time" || word == "env" || word == "command" || word == "nice"
+        || (word.find('=') != string::npos && word[0] != '=');
+}
+
+static bool IsRefLike(const string &token) {
+    if (token.empty() || token == "@" || token == "HEAD" || token[0] == '/' || token[0] == '.' || token.back() == '/' || token.back() == '.') {
+        return false;
+    }
+    return none_of(token.begin(), token.end(), [](char c) -> bool {
+        return (unsigned char)c < 0x20 || c == 0x7F || c == ' ' || c == '*' || c == '?' || c == '[' || c == '\\';
+    });
+}
+
+/** "+a:b" (a refspec), "a..b", "a...b", "a~2", "a^{commit}" and "a@{1}" all mention refs "a" and "b". */
+static void AddRefTokens(string argument, vector<string> &tokens) {
+    if (!argument.empty() && argument[0] == '+') {
+        argument.erase(0, 1);
+    }
+    size_t begin = 0;
+    while (begin <= argument.length()) {
+        size_t end = min(argument.find(':', begin), argument.find("..", begin));
+        if (end == string::npos) {
+            end = argument.length();
+        }
+        string token = argument.substr(begin, end - begin);
+        size_t suffix = min(token.find_first_of("~^"), token.find("@{"));
+        if (suffix != string::npos) {
+            token.resize(suffix);
+        }
+        if (IsRefLike(token)) {
+            tokens.push_back(token);
+        }
+        begin = end + 1;
+        while (begin < argument.length() && argument[begin] == '.') {
+            begin++;
+        }
+    }
+}
+
+/** Appends ref-like arguments of all git commands of the line, returns the number of git commands. */
+static size_t ParseGitCommands(const string &commandLine, vector<string> &tokens) {
+    vector<string> words = ShellWords(commandLine);
+    size_t commands = 0;
+    size_t i = 0;
+    bool commandStart = true;
+    while (i < words.size()) {
+        if (!commandStart || !IsGitProgram(words[i])) {
+            commandStart = IsCommandSeparator(words[i]) || (commandStart && IsCommandPrefix(words[i]));
+            i++;
+            continue;
+        }
+        commands++;
+        i++;
+        // global options, some of them have a separate value
+        while (i < words.size() && !words[i].empty() && words[i][0] == '-') {
+            const string &option = words[i];
+            bool hasValue = option == "-C" || option == "-c" || option == "--git-dir" || option == "--work-tree" || option == "--namespace";
+            i += hasValue ? 2 : 1;
+        }
+        if (i < words.size() && !IsCommandSeparator(words[i])) {
+            i++; // the subcommand
+        }
+        bool paths = false;
+        for (; i < words.size() && !IsCommandSeparator(words[i]); ++i) {
+            const string &word = words[i];
+            if (paths || word.empty()) {
+                continue;
+            }
+            if (word == "--") {
+                paths = true;
+            } else if (word[0] != '-') {
+                AddRefTokens(word, tokens);
+            } else if (StartsWith(word, string("--")) && word.find('=') != string::npos) {
+                // "--onto=main"
+                AddRefTokens(word.substr(word.find('=') + 1), tokens);
+            }
+        }
+    }
+    return commands;
+}
+
+vector<string> GitRefTokens(const string &commandLine) {
+    vector<string> tokens;
+    ParseGitCommands(commandLine, tokens);
+    return tokens;
+}
+
+void ShellHistoryAddLine(ShellHistory &history, const string &line) {
+    string command = line;
+    if (!command.empty() && command.back() == '\r') {
+        command.pop_back();
+    }
+    // zsh extended history: ": <start>:<elapsed>;<command>"
+    if (StartsWith(command, string(": "))) {
+        size_t semicolon = command.find(';');
+        if (semicolon != string::npos) {
+            command.erase(0, semicolon + 1);
+        }
+    }
+    // bash timestamps: "#<seconds>"
+    if (command.empty() || command[0] == '#') {
+        return;
+    }
+
+    vector<string> tokens;
+    size_t commands = ParseGitCommands(command, tokens);
+    if (commands == 0) {
+        return;
+    }
+    history.commands += commands;
+    history.weight /= pow(HISTORY_DECAY, (double)commands);
+    for (auto it = tokens.begin(); it != tokens.end(); ++it) {
+        history.counts[*it] += history.weight;
+    }
+
+    if (history.weight >= MAX_WEIGHT) {
+        for (auto it = history.counts.begin(); it != history.counts.end();) {
+            it->second /= history.weight;
+            it = (it->second < MIN_COUNT) ? history.counts.erase(it) : next(it);
+        }
+        history.weight = 1;
+    }
+}
+
+vector<pair<string, double>> HistoryRanks(const ShellHistory &history) {
+    vector<pair<string, double>> ranks;
+    ranks.reserve(history.counts.size());
+    for (auto it = history.counts.begin(); it != history.counts.end(); ++it) {
+        ranks.push_back(make_pair(it->first, it->second / history.weight));
+    }
+    return ranks;
+}
+
+#ifdef DEBUG
+void ShellHistoryTest() {
+    assert((vector<string>{ string("feature/x") }) == GitRefTokens(string("git checkout feature/x")));
+    assert((vector<string>{ string("a"), string("b") }) == GitRefTokens(string("git log --oneline a..b~2 -- x")));
+    assert((vector<string>{ string("a"), string("b") }) == GitRefTokens(string("git diff a...b^{commit}")));
+    assert((vector<string>{ string("origin"), string("main"), string("dev") }) == GitRefTokens(string("git -C \"../other repo\" push origin +main:dev")));
+    assert((vector<string>{ string("main"), string("x") }) == GitRefTokens(string("cd x && git rebase --onto=main HEAD@{1} || /usr/bin/git co 'x'")));
+    assert(GitRefTokens(string("ls ../git && echo git")).empty());
+    assert((vector<string>{ string("x") }) == GitRefTokens(string("sudo LANG=C git show x; git; git")));
+
+    ShellHistory history;
+    ShellHistoryInit(history, vector<string>{ string("surely/not/existing/history") });
+    assert(0 == ShellHistoryScan(history));
+
+    ShellHistoryAddLine(history, string(": 1700000000:0;git checkout old"));
+    ShellHistoryAddLine(history, string("#1700000001"));
+    ShellHistoryAddLine(history, string("make"));
+    for (int i = 0; i < 10; ++i) {
+        ShellHistoryAddLine(history, string("git checkout recent\r"));
+    }
+    assert(11 == history.commands);
+    vector<pair<string, double>> ranks = HistoryRanks(history);
+    assert(2 == ranks.size() && string("old") == ranks[0].first && string("recent") == ranks[1].first);
+    assert(ranks[0].second < 1 && ranks[1].second > 9 && ranks[1].second < 10);
+
+    for (int i = 0; i < 500; ++i) {
+        ShellHistoryAddLine(history, string("git fetch"));
+    }
+    ranks = HistoryRanks(history);
+    assert(2 == ranks.size() && ranks[1].second > 0.05 && ranks[1].second < 0.1);
+
+    // forgotten after renormalization
+    for (int i = 0; i < 2000; ++i) {
+        ShellHistoryAddLine(history, string("git fetch"));
+    }
+    assert(history.weight < MAX_WEIGHT && HistoryRanks(history).empty());
+}
+#endif
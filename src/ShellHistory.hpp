@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Refs typed in recent git commands are likely to be wanted again, so shell histories rank refs in the dialog.
+//
+// History files of bash, zsh, PowerShell (and any plain list of commands, e.g. an export of Far's history)
+// are tailed: a scan parses only the bytes appended since the previous one.
+// Every git command decays the counts of all tokens, so recent commands outweigh old ones.
+
+typedef struct tHistoryFile {
+    std::string path;
+    int64_t offset;      // bytes parsed so far
+    std::string partial; // the last line if it is not complete yet
+} HistoryFile;
+
+typedef struct tShellHistory {
+    std::vector<HistoryFile> files;
+    // Counts are not decayed one by one: the weight of the next occurrence grows instead,
+    // and a token's decayed count is its raw count divided by the current weight.
+    std::map<std::string, double> counts;
+    double weight;
+    size_t commands;     // git commands parsed
+} ShellHistory;
+
+/** Histories of bash, zsh, PowerShell and files listed in FAR_GIT_AUTOCOMPLETE_HISTORY (like PATH). */
+std::vector<std::string> DefaultHistoryFiles();
+
+void ShellHistoryInit(ShellHistory &history, const std::vector<std::string> &paths);
+
+/**
+ * Parses bytes appended to the files since the previous scan.
+ * If a file has shrunk (it was rewritten), all files are parsed again from the start.
+ * Returns the number of parsed bytes.
+ */
+size_t ShellHistoryScan(ShellHistory &history);
+
+/** Counts ref-like tokens of git commands in one line of any supported history format. */
+void ShellHistoryAddLine(ShellHistory &history, const std::string &line);
+
+/** Ref-like arguments of git commands in the command line: "git log a..b~2 -- x" gives "a" and "b". */
+std::vector<std::string> GitRefTokens(const std::string &commandLine);
+
+/**
+ * Decayed counts of tokens, sorted by tokens. The count of the latest occurrence is 1.
+ * Tokens which are not refs of the repository are simply never matched.
+ */
+std::vector<std::pair<std::string, double>> HistoryRanks(const ShellHistory &history);
+
+#ifdef DEBUG
+void ShellHistoryTest();
+#endif
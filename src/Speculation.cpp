@@ -0,0 +1,273 @@
+#include "Speculation.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "RefStream.hpp"
+#include "Utils.hpp"
+
+using namespace std;
+
+// Every run has its own flags, so the main thread never waits for a cancelled run, which may be starved
+// by the idle priority for a while: the run is retired and is joined once it has finished or when the plugin is unloaded.
+// Runs are started and retired by the main thread only.
+typedef struct tSpeculationRun {
+    thread worker;
+    shared_ptr<atomic<bool>> cancelled;
+    shared_ptr<atomic<bool>> finished;
+} SpeculationRun;
+
+static SpeculationRun currentRun;
+static vector<SpeculationRun> retiredRuns;
+
+// The last speculation is replaced by the speculating thread and is taken by the main thread, both under lock.
+static mutex speculationLock;
+static shared_ptr<const Speculation> lastSpeculation;
+
+/** The same answer as the folds over strictly or partially matched names of a stream give. */
+static SpeculatedStep SpeculateStep(const RefsSnapshot &snapshot, const string &prefix, const string &current) {
+    const vector<string> &names = snapshot.names;
+    SpeculatedStep step;
+    step.current = current;
+    pair<size_t, size_t> range = RefsSnapshotPrefixRange(snapshot, prefix);
+    step.strict = (range.first != range.second);
+    step.count = range.second - range.first;
+    if (step.strict) {
+        step.suitable = RefBitmapRange((uint32_t)range.first, (uint32_t)range.second);
+        step.commonPrefix = SortedRangeCommonPrefix(names, range);
+        step.forward = SortedRangeNextItem(names, range, true, current);
+        step.backward = SortedRangeNextItem(names, range, false, current);
+        return step;
+    }
+
+    range = RefsSnapshotPartialRange(snapshot, prefix);
+    CommonPrefixFold commonPrefix = CommonPrefixFoldCreate(0);
+    NextItemFold forward = NextItemFoldCreate(true, current);
+    NextItemFold backward = NextItemFoldCreate(false, current);
+    for (size_t i = range.first; i < range.second; ++i) {
+        if (!RefMayBeEncodedByPartialPrefix(names[i].c_str(), prefix.c_str())) {
+            continue;
+        }
+        RefBitmapAdd(step.suitable, (uint32_t)i);
+        step.count++;
+        CommonPrefixFoldAdd(commonPrefix, names[i]);
+        NextItemFoldAdd(forward, names[i]);
+        NextItemFoldAdd(backward, names[i]);
+    }
+    if (step.count != 0) {
+        step.commonPrefix = commonPrefix.prefix;
+        step.forward = NextItemFoldResult(forward);
+        step.backward = NextItemFoldResult(backward);
+    }
+    return step;
+}
+
+void SpeculateSteps(Speculation &speculation, const string &prefix, const string &suffix, size_t extensions, const atomic<bool> &cancelled) {
+    const RefsSnapshot &snapshot = *speculation.snapshot;
+    assert(snapshot.namesReady);
+    const vector<string> &names = snapshot.names;
+    const SpeculatedStep &step = speculation.steps[prefix] = SpeculateStep(snapshot, prefix, prefix + suffix);
+    if (!step.strict) {
+        return; // a partial prefix is an abbreviation, chars which follow it are not predictable
+    }
+
+    // Names with the same next char are a subrange of the range, so subranges are skipped by binary search.
+    vector<pair<size_t, string>> counts;
+    pair<size_t, size_t> range = RefsSnapshotPrefixRange(snapshot, prefix);
+    size_t position = range.first;
+    while (position < range.second && !cancelled) {
+        if (names[position].length() == prefix.length()) {
+            position++;
+            continue;
+        }
+        size_t length = prefix.length();
+        DecodeUtf8(names[position], length);
+        string extended = names[position].substr(0, length);
+        size_t end = partition_point(names.begin() + position, names.begin() + range.second, [&extended](const string &name) -> bool {
+            return StartsWith(name, extended);
+        }) - names.begin();
+        counts.push_back(make_pair(end - position, extended));
+        position = end;
+    }
+    stable_sort(counts.begin(), counts.end(), [](const pair<size_t, string> &x, const pair<size_t, string> &y) -> bool {
+        return x.first > y.first;
+    });
+    for (size_t i = 0; i < counts.size() && i < extensions && !cancelled; ++i) {
+        speculation.steps[counts[i].second] = SpeculateStep(snapshot, counts[i].second, counts[i].second);
+    }
+}
+
+/** Runs in the speculating thread. */
+static void Speculate(SpeculationTask task, shared_ptr<const Speculation> previous, shared_ptr<atomic<bool>> cancelled, shared_ptr<atomic<bool>> finished) {
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_IDLE);
+#endif
+    shared_ptr<Speculation> speculation = make_shared<Speculation>();
+    task(previous, *speculation, *cancelled);
+    {
+        lock_guard<mutex> guard(speculationLock);
+        if (!*cancelled && speculation->snapshot) {
+            lastSpeculation = speculation;
+        }
+    }
+    *finished = true;
+}
+
+/** Cancels the current run and retires it without waiting for it. */
+static void RetireCurrentRun() {
+    if (currentRun.worker.joinable()) {
+        *currentRun.cancelled = true;
+        retiredRuns.push_back(move(currentRun));
+    }
+}
+
+void StartSpeculation(SpeculationTask task) {
+    RetireCurrentRun();
+    // Finished runs are joined at once, the others are left until the next time.
+    for (auto run = retiredRuns.begin(); run != retiredRuns.end();) {
+        if (*run->finished) {
+            run->worker.join();
+            run = retiredRuns.erase(run);
+        } else {
+            ++run;
+        }
+    }
+    shared_ptr<const Speculation> previous;
+    {
+        lock_guard<mutex> guard(speculationLock);
+        previous = lastSpeculation;
+    }
+    currentRun.cancelled = make_shared<atomic<bool>>(false);
+    currentRun.finished = make_shared<atomic<bool>>(false);
+    currentRun.worker = thread(Speculate, task, previous, currentRun.cancelled, currentRun.finished);
+}
+
+shared_ptr<const Speculation> LastSpeculation(bool &running) {
+    running = currentRun.worker.joinable() && !*currentRun.finished;
+    lock_guard<mutex> guard(speculationLock);
+    return lastSpeculation;
+}
+
+void StopSpeculation() {
+    RetireCurrentRun();
+    for (auto run = retiredRuns.begin(); run != retiredRuns.end(); ++run) {
+        run->worker.join();
+    }
+    retiredRuns.clear();
+}
+
+void CountSpeculationOutcome(SpeculationStats &stats, SpeculationOutcome outcome) {
+    stats.outcomes[outcome]++;
+}
+
+string DescribeSpeculationStats(const SpeculationStats &stats, SpeculationOutcome last) {
+    static const char *OUTCOME_NAMES[SPECULATION_OUTCOMES_COUNT] = { "hit", "missed", "not ready", "stale" };
+    size_t total = 0;
+    for (int outcome = 0; outcome < SPECULATION_OUTCOMES_COUNT; ++outcome) {
+        total += stats.outcomes[outcome];
+    }
+    ostringstream description;
+    description << OUTCOME_NAMES[last] << ", " << stats.outcomes[SPECULATION_HIT] << " of " << total << " steps hit ("
+        << ((total == 0) ? 0 : stats.outcomes[SPECULATION_HIT] * 100 / total) << "%)";
+    for (int outcome = SPECULATION_HIT + 1; outcome < SPECULATION_OUTCOMES_COUNT; ++outcome) {
+        description << ((outcome == SPECULATION_HIT + 1) ? ": " : ", ") << stats.outcomes[outcome] << " " << OUTCOME_NAMES[outcome];
+    }
+    return description.str();
+}
+
+#ifdef DEBUG
+void SpeculationTest() {
+    vector<string> fullNames = {
+        "refs/heads/feature/a", "refs/heads/feature/b", "refs/heads/fix/help-typo", "refs/heads/master",
+        "refs/remotes/origin/feature/c", "refs/tags/\xD1\x8F/1", "refs/tags/\xD1\x8F/2",
+    };
+    shared_ptr<RefsSnapshot> snapshot = RefsSnapshotCreate();
+    Drain(RecordingStream(StreamFromVector(fullNames), snapshot, true), [](const string &) -> bool { return true; });
+    RefsSnapshotPrepare(*snapshot, true);
+    // feature/a, feature/b, feature/c, fix/help-typo, master, origin/feature/c and two tags with a Cyrillic first char
+
+    atomic<bool> notCancelled(false);
+    Speculation speculation;
+    speculation.snapshot = snapshot;
+    SpeculateSteps(speculation, "fe", "ature/b", 2, notCancelled);
+    const SpeculatedStep &cycle = speculation.steps["fe"];
+    assert(cycle.strict && 3 == cycle.count && string("feature/") == cycle.commonPrefix);
+    assert(string("feature/c") == cycle.forward && string("feature/a") == cycle.backward);
+    assert((vector<uint32_t>{ 0, 1, 2 }) == RefBitmapIds(cycle.suitable));
+    // "fe" has a single extension
+    assert(2 == speculation.steps.size() && string("feature/") == speculation.steps["fea"].commonPrefix);
+
+    // extensions of the empty prefix by the most frequent chars, a multibyte char is taken whole
+    speculation.steps.clear();
+    SpeculateSteps(speculation, "", "", 2, notCancelled);
+    assert(3 == speculation.steps.size() && 1 == speculation.steps.count("f") && 1 == speculation.steps.count("\xD1\x8F"));
+    const SpeculatedStep &typed = speculation.steps["f"];
+    assert(typed.strict && 4 == typed.count && string("f") == typed.current && string("feature/a") == typed.forward && string("fix/help-typo") == typed.backward);
+    assert(string("\xD1\x8F/") == speculation.steps["\xD1\x8F"].commonPrefix);
+
+    // a partial prefix is not extended
+    speculation.steps.clear();
+    SpeculateSteps(speculation, "f/h", "", 8, notCancelled);
+    const SpeculatedStep &partial = speculation.steps["f/h"];
+    assert(1 == speculation.steps.size() && !partial.strict && 1 == partial.count && string("fix/help-typo") == partial.commonPrefix);
+    assert((vector<uint32_t>{ 3 }) == RefBitmapIds(partial.suitable));
+    SpeculateSteps(speculation, "x/y", "", 8, notCancelled);
+    assert(0 == speculation.steps["x/y"].count);
+
+    // a cancelled speculation answers only the step itself
+    speculation.steps.clear();
+    atomic<bool> cancelled(true);
+    SpeculateSteps(speculation, "", "", 2, cancelled);
+    assert(1 == speculation.steps.size());
+
+    // the thread keeps only speculations with a snapshot, the next one gets the previous one
+    bool running = false;
+    shared_ptr<const Speculation> before = LastSpeculation(running);
+    StartSpeculation([](shared_ptr<const Speculation>, Speculation &, const atomic<bool> &) {});
+    StopSpeculation();
+    assert(before == LastSpeculation(running));
+    StartSpeculation([snapshot](shared_ptr<const Speculation>, Speculation &next, const atomic<bool> &) {
+        next.snapshot = snapshot;
+    });
+    while (LastSpeculation(running) == before || running) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    shared_ptr<const Speculation> first = LastSpeculation(running);
+    shared_ptr<const Speculation> passed;
+    StartSpeculation([&passed](shared_ptr<const Speculation> previous, Speculation &, const atomic<bool> &) {
+        passed = previous;
+    });
+    StopSpeculation();
+    assert(first == passed && snapshot == first->snapshot && first == LastSpeculation(running));
+
+    // a stuck run is not waited for by the next one and does not replace its result
+    atomic<bool> release(false);
+    StartSpeculation([&release, snapshot](shared_ptr<const Speculation>, Speculation &next, const atomic<bool> &) {
+        while (!release) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        next.snapshot = snapshot;
+    });
+    StartSpeculation([](shared_ptr<const Speculation>, Speculation &, const atomic<bool> &) {});
+    release = true;
+    StopSpeculation();
+    assert(first == LastSpeculation(running) && !running);
+
+    SpeculationStats stats = {};
+    assert(string("missed, 0 of 0 steps hit (0%): 0 missed, 0 not ready, 0 stale") == DescribeSpeculationStats(stats, SPECULATION_MISS));
+    CountSpeculationOutcome(stats, SPECULATION_HIT);
+    CountSpeculationOutcome(stats, SPECULATION_HIT);
+    CountSpeculationOutcome(stats, SPECULATION_HIT);
+    CountSpeculationOutcome(stats, SPECULATION_STALE);
+    assert(string("hit, 3 of 4 steps hit (75%): 0 missed, 0 not ready, 1 stale") == DescribeSpeculationStats(stats, SPECULATION_HIT));
+}
+#endif
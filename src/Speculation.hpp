@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "RefBitmap.hpp"
+#include "RefsSnapshot.hpp"
+
+// Speculative precomputation of the next completion step.
+//
+// After a completion of refs the next keystroke is predictable: the hotkey again cycles the suggestion,
+// the dialog hotkey lists the same refs, or one more char is typed and completed. While the user looks
+// at the line, an idle thread answers these steps from its own snapshot of refs, and the next completion
+// takes the answer instead of planning a query, if ref files have not changed since the snapshot was taken.
+
+typedef struct tSpeculatedStep {
+    std::string current;      // the prefix and the suggested suffix which the step starts from
+    bool strict;              // names start with the prefix, otherwise they may be encoded by it partially
+    RefBitmap suitable;       // ids of the suitable names, a range if they are matched strictly
+    size_t count;
+    std::string commonPrefix; // the prefix is replaced by it if it differs
+    std::string forward;      // the next suggestion after current, cycling
+    std::string backward;     // the previous one
+} SpeculatedStep;
+
+typedef struct tSpeculation {
+    std::string gitDir;
+    std::shared_ptr<RefsSnapshot> snapshot;      // complete, names and their UTF-16 copies are prepared, it is never changed
+    std::map<std::string, SpeculatedStep> steps; // by the user prefix: the completed one and its extensions by one char
+} Speculation;
+
+/**
+ * Answers the step from the prefix with the suggested suffix, and the steps from the prefix extended
+ * by one of the chars which follow it in the most names (a typed char replaces the suggested suffix).
+ */
+void SpeculateSteps(Speculation &speculation, const std::string &prefix, const std::string &suffix, size_t extensions, const std::atomic<bool> &cancelled);
+
+typedef std::function<void (std::shared_ptr<const Speculation> previous, Speculation &speculation, const std::atomic<bool> &cancelled)> SpeculationTask;
+
+/**
+ * Runs the task on an idle thread, a running speculation is cancelled but is not waited for.
+ * The task gets the last finished speculation, e.g. to reuse its snapshot, and its result is kept if it has a snapshot
+ * and the task is not cancelled. The task should check cancelled in its loops, so a cancelled one ends soon.
+ */
+void StartSpeculation(SpeculationTask task);
+
+/** The last finished speculation, nullptr if there is none. Sets running if a newer one is still being computed. Main thread only. */
+std::shared_ptr<const Speculation> LastSpeculation(bool &running);
+
+/** Cancels the speculation and waits for all runs, must be called before the plugin is unloaded. */
+void StopSpeculation();
+
+typedef enum tSpeculationOutcome {
+    SPECULATION_HIT,
+    SPECULATION_MISS,      // the step was not speculated
+    SPECULATION_NOT_READY, // it was not speculated yet
+    SPECULATION_STALE,     // refs have changed since then
+    SPECULATION_OUTCOMES_COUNT,
+} SpeculationOutcome;
+
+typedef struct tSpeculationStats {
+    size_t outcomes[SPECULATION_OUTCOMES_COUNT];
+} SpeculationStats;
+
+void CountSpeculationOutcome(SpeculationStats &stats, SpeculationOutcome outcome);
+
+/** E.g. "hit, 45 of 60 steps hit (75%): 8 missed, 4 not ready, 3 stale". */
+std::string DescribeSpeculationStats(const SpeculationStats &stats, SpeculationOutcome last);
+
+#ifdef DEBUG
+void SpeculationTest();
+#endif
@@ -0,0 +1,202 @@
+#include "Subcommands.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "Files.hpp"
+#include "Trie.hpp"
+#include "Utils.hpp"
+
+using namespace std;
+
+static const vector<string> BUILTIN_SUBCOMMANDS = {
+    "add", "am", "apply", "archive", "bisect", "blame", "branch", "bundle",
+    "cat-file", "checkout", "cherry", "cherry-pick", "clean", "clone", "commit", "config",
+    "describe", "diff", "difftool", "fetch", "for-each-ref", "format-patch", "fsck",
+    "gc", "grep", "help", "init", "log", "ls-files", "ls-remote", "ls-tree",
+    "maintenance", "merge", "merge-base", "mergetool", "mv", "notes", "prune", "pull", "push",
+    "range-diff", "rebase", "reflog", "remote", "repack", "replace", "reset", "restore",
+    "rev-list", "rev-parse", "revert", "rm", "shortlog", "show", "show-branch", "show-ref",
+    "sparse-checkout", "stash", "status", "submodule", "switch", "symbolic-ref", "tag",
+    "update-ref", "worktree",
+};
+
+// Extensions of executables which git runs on Windows, files without extension are scripts.
+static const vector<string> EXECUTABLE_EXTENSIONS = { ".exe", ".cmd", ".bat", ".com", ".sh" };
+
+// PATH directories are checked again not more often than this.
+static const chrono::seconds REFRESH_PERIOD(2);
+
+// The first completion waits for the first listing of PATH directories at most this long.
+static const chrono::milliseconds FIRST_REFRESH_WAIT(300);
+
+typedef struct tPathDir {
+    FileStamp stamp;
+    vector<string> subcommands;
+} PathDir;
+
+// The trie is replaced by the refreshing thread and is read by the main thread, both under lock.
+// PATH directories are used only by the refreshing thread.
+static mutex subcommandsLock;
+static condition_variable subcommandsRefreshed;
+static Trie *subcommands = nullptr;
+static bool anyRefreshDone = false;
+static map<string, PathDir> pathDirs;
+static vector<string> lastPathDirs;
+static thread refreshThread;
+static atomic<bool> refreshRunning(false);
+static chrono::steady_clock::time_point lastRefreshStart;
+
+static bool EndsWithIgnoringCase(const string &str, const string &suffix) {
+    if (str.length() < suffix.length()) {
+        return false;
+    }
+    return equal(suffix.begin(), suffix.end(), str.end() - suffix.length(), [](char x, char y) -> bool {
+        return tolower((unsigned char)x) == tolower((unsigned char)y);
+    });
+}
+
+string SubcommandOfExecutable(const string &fileName) {
+    string name = fileName;
+    if (!StartsWith(name, string("git-"))) {
+        return string("");
+    }
+    for (auto it = EXECUTABLE_EXTENSIONS.begin(); it != EXECUTABLE_EXTENSIONS.end(); ++it) {
+        if (EndsWithIgnoringCase(name, *it)) {
+            name = name.substr(0, name.length() - it->length());
+            break;
+        }
+    }
+    if (name.find('.') != string::npos) {
+        return string(""); // e.g. "git-lfs.pdb"
+    }
+    return name.substr(4);
+}
+
+/** Runs in the refreshing thread. */
+static void RefreshSubcommands() {
+    vector<string> dirs = SearchPathDirs();
+    bool changed = (dirs != lastPathDirs);
+    for (auto it = dirs.begin(); it != dirs.end(); ++it) {
+        FileStamp stamp = StampFile(*it);
+        auto found = pathDirs.find(*it);
+        if (found != pathDirs.end() && found->second.stamp.exists == stamp.exists && found->second.stamp.modified == stamp.modified) {
+            continue;
+        }
+
+        PathDir pathDir;
+        pathDir.stamp = stamp;
+        vector<string> subdirs;
+        vector<string> files;
+        ListDir(*it, subdirs, &files);
+        for (auto file = files.begin(); file != files.end(); ++file) {
+            string subcommand = SubcommandOfExecutable(*file);
+            if (!subcommand.empty()) {
+                pathDir.subcommands.push_back(subcommand);
+            }
+        }
+        pathDirs[*it] = pathDir;
+        changed = true;
+    }
+    lastPathDirs = dirs;
+
+    Trie *updated = nullptr;
+    if (changed || !anyRefreshDone) {
+        updated = trie_create();
+        for (auto it = BUILTIN_SUBCOMMANDS.begin(); it != BUILTIN_SUBCOMMANDS.end(); ++it) {
+            trie_add(updated, *it);
+        }
+        for (auto dir = dirs.begin(); dir != dirs.end(); ++dir) {
+            const vector<string> &found = pathDirs[*dir].subcommands;
+            for (auto it = found.begin(); it != found.end(); ++it) {
+                trie_add(updated, *it);
+            }
+        }
+    }
+
+    Trie *outdated = nullptr;
+    {
+        lock_guard<mutex> guard(subcommandsLock);
+        if (updated != nullptr) {
+            outdated = subcommands;
+            subcommands = updated;
+        }
+        anyRefreshDone = true;
+    }
+    subcommandsRefreshed.notify_all();
+    if (outdated != nullptr) {
+        trie_free(outdated);
+    }
+    refreshRunning = false;
+}
+
+static void StartRefreshIfNeeded() {
+    auto now = chrono::steady_clock::now();
+    if (refreshRunning || (anyRefreshDone && now - lastRefreshStart < REFRESH_PERIOD)) {
+        return;
+    }
+    if (refreshThread.joinable()) {
+        refreshThread.join();
+    }
+    lastRefreshStart = now;
+    refreshRunning = true;
+    refreshThread = thread(RefreshSubcommands);
+}
+
+void LookupSubcommands(const string &prefix, vector<string> &result) {
+    StartRefreshIfNeeded();
+
+    unique_lock<mutex> guard(subcommandsLock);
+    subcommandsRefreshed.wait_for(guard, FIRST_REFRESH_WAIT, []() -> bool { return anyRefreshDone; });
+    if (subcommands == nullptr) {
+        result.insert(result.end(), BUILTIN_SUBCOMMANDS.begin(), BUILTIN_SUBCOMMANDS.end());
+        sort(result.begin(), result.end());
+        return;
+    }
+
+    // Chars of a partial prefix are matched literally up to the first anchor.
+    size_t literalLength = 0;
+    while (literalLength < prefix.length() && !IsPartialPrefixAnchor(prefix[literalLength])) {
+        literalLength++;
+    }
+    trie_get_top_k(subcommands, prefix.substr(0, literalLength), (size_t)-1, result);
+}
+
+void StopSubcommandsRefresh() {
+    if (refreshThread.joinable()) {
+        refreshThread.join();
+    }
+    lock_guard<mutex> guard(subcommandsLock);
+    if (subcommands != nullptr) {
+        trie_free(subcommands);
+        subcommands = nullptr;
+    }
+    anyRefreshDone = false;
+    pathDirs.clear();
+    lastPathDirs.clear();
+}
+
+#ifdef DEBUG
+void SubcommandsTest() {
+    assert(string("lfs") == SubcommandOfExecutable(string("git-lfs.exe")));
+    assert(string("lfs") == SubcommandOfExecutable(string("git-lfs.EXE")));
+    assert(string("absorb") == SubcommandOfExecutable(string("git-absorb")));
+    assert(string("") == SubcommandOfExecutable(string("git-lfs.pdb")));
+    assert(string("") == SubcommandOfExecutable(string("gitk.exe")));
+
+    vector<string> found;
+    LookupSubcommands(string("che"), found);
+    assert(!found.empty() && string("checkout") == found[0] && is_sorted(found.begin(), found.end()));
+    found.clear();
+    LookupSubcommands(string("c-p"), found);
+    assert(find(found.begin(), found.end(), string("cherry-pick")) != found.end());
+    StopSubcommandsRefresh();
+}
+#endif
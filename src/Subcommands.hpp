@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Git subcommands: builtin ones and "git-*" executables found in PATH directories.
+//
+// Listing of PATH directories is slow (especially for network directories), so it is done
+// in a background thread. A directory is listed again only if its modification time has changed.
+// Found names are kept in a trie, so completion of a subcommand is a lookup.
+
+/**
+ * Appends sorted subcommands which may be completed from prefix: ones starting with prefix
+ * or, if there are none, candidates for partial prefixes.
+ * Starts a background refresh if the last one was long ago.
+ */
+void LookupSubcommands(const std::string &prefix, std::vector<std::string> &result);
+
+/** Waits for the background refresh, must be called before the plugin is unloaded. */
+void StopSubcommandsRefresh();
+
+/** "git-lfs.exe" -> "lfs", returns empty string for other files. */
+std::string SubcommandOfExecutable(const std::string &fileName);
+
+#ifdef DEBUG
+void SubcommandsTest();
+#endif
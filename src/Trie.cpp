@@ -1,93 +1,365 @@
 #include "Trie.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <limits>
 #include <cstring>
 #include <cstdlib>
+#include <queue>
 
 using namespace std;
 
+static const int64_t NO_SCORE = numeric_limits<int64_t>::min();
+
+static const size_t BITMAP_WORD_BITS = 32;
+static const size_t BITMAP_WORDS = (UCHAR_MAX + 1) / BITMAP_WORD_BITS;
+
+// Chains of single-child nodes are compressed into one node (Patricia trie).
+// Labels of the edges are not copied: every edge references a slice
+// of the name pool owned by the trie.
 typedef struct tNode {
-    struct tNode *children[UCHAR_MAX + 1];
+    size_t edge_offset; // the edge leading to this node is pool[edge_offset, edge_offset + edge_length)
+    size_t edge_length;
+    uint32_t children_bitmap[BITMAP_WORDS]; // bit c is set if there is a child whose edge starts with c
+    struct tNode **children; // ordered by the first character of the child's edge
     size_t children_count;
     bool leaf;
+    size_t leaf_count; // number of leaves in the subtree including the node itself
+    int64_t score;     // score of the leaf itself
+    int64_t max_score; // maximum score of all leaves in the subtree
 } Node;
 
 struct tTrie {
     Node *root;
+    char *pool;
+    size_t pool_size;
+    size_t pool_capacity;
 };
 
-static Node* node_create() {
+static size_t bit_count(uint32_t x) {
+#if defined(__GNUC__)
+    return (size_t)__builtin_popcount(x);
+#else
+    // no POPCNT instruction: we do not require any instruction set extensions
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    x = (x + (x >> 4)) & 0x0F0F0F0F;
+    return (size_t)((x * 0x01010101) >> 24);
+#endif
+}
+
+static Node* node_create(size_t edge_offset, size_t edge_length) {
     Node *node = (Node*)malloc(sizeof(Node));
     assert(node != nullptr);
+    node->edge_offset = edge_offset;
+    node->edge_length = edge_length;
+    memset(node->children_bitmap, 0, sizeof(node->children_bitmap));
+    node->children = nullptr;
     node->children_count = 0;
     node->leaf = false;
-    memset(node->children, 0, sizeof(node->children));
+    node->leaf_count = 0;
+    node->score = NO_SCORE;
+    node->max_score = NO_SCORE;
     return node;
 }
 
 Trie* trie_create() {
     Trie *trie = (Trie*)malloc(sizeof(Trie));
     assert(trie != nullptr);
-    trie->root = node_create();
+    trie->root = node_create(0, 0);
+    trie->pool = nullptr;
+    trie->pool_size = 0;
+    trie->pool_capacity = 0;
     return trie;
 }
 
 static void node_free(Node *node) {
-    for (int i = 0; i <= UCHAR_MAX; i++) {
-        Node *child = node->children[i];
-        if (child != nullptr) {
-            node_free(child);
-        }
+    vector<Node*> stack(1, node);
+    while (!stack.empty()) {
+        Node *cur = stack.back();
+        stack.pop_back();
+        stack.insert(stack.end(), cur->children, cur->children + cur->children_count);
+        free(cur->children);
+        free(cur);
     }
-    free(node);
 }
 
 void trie_free(Trie *trie) {
     node_free(trie->root);
+    free(trie->pool);
     free(trie);
 }
 
-static void trie_add(Node *node, const char *str) {
-    unsigned char ch = (unsigned char)str[0];
-    if (ch == '\0') {
-        node->leaf = true;
-        return;
+static bool node_has_child(Node *node, unsigned char ch) {
+    return (node->children_bitmap[ch / BITMAP_WORD_BITS] >> (ch % BITMAP_WORD_BITS)) & 1;
+}
+
+/** Returns the number of children whose edges start with characters less than ch. */
+static size_t node_child_rank(Node *node, unsigned char ch) {
+    size_t word = ch / BITMAP_WORD_BITS;
+    size_t rank = 0;
+    for (size_t i = 0; i < word; i++) {
+        rank += bit_count(node->children_bitmap[i]);
     }
+    uint32_t lower_bits_mask = ((uint32_t)1 << (ch % BITMAP_WORD_BITS)) - 1;
+    return rank + bit_count(node->children_bitmap[word] & lower_bits_mask);
+}
 
-    Node **child = &(node->children[ch]);
-    if (*child == nullptr) {
-        *child = node_create();
-        node->children_count++;
+static Node* node_find_child(Node *node, unsigned char ch) {
+    if (!node_has_child(node, ch)) {
+        return nullptr;
     }
-    trie_add(*child, str + 1);
+    return node->children[node_child_rank(node, ch)];
 }
 
-void trie_add(Trie* trie, string str) {
-    trie_add(trie->root, str.c_str());
+/** Returns the place in the parent where the child with the given first character is stored. */
+static Node** node_child_slot(Node *node, unsigned char ch) {
+    assert(node_has_child(node, ch));
+    return &node->children[node_child_rank(node, ch)];
 }
 
-void build_common_prefix(Node *node, string &prefix) {
-    if (!node->leaf && node->children_count == 1) {
-        int single_child = -1;
-        for (int i = 0; i <= UCHAR_MAX; i++) {
-            if (node->children[i] != nullptr) {
-                single_child = i;
-                break;
+static void node_insert_child(Node *node, unsigned char ch, Node *child) {
+    assert(!node_has_child(node, ch));
+    size_t rank = node_child_rank(node, ch);
+    node->children = (Node**)realloc(node->children, (node->children_count + 1) * sizeof(Node*));
+    assert(node->children != nullptr);
+    memmove(node->children + rank + 1, node->children + rank, (node->children_count - rank) * sizeof(Node*));
+    node->children[rank] = child;
+    node->children_count++;
+    node->children_bitmap[ch / BITMAP_WORD_BITS] |= (uint32_t)1 << (ch % BITMAP_WORD_BITS);
+}
+
+/** Appends str to the name pool and returns its offset. */
+static size_t pool_append(Trie *trie, const char *str, size_t length) {
+    if (trie->pool_size + length > trie->pool_capacity) {
+        size_t capacity = max(trie->pool_capacity * 2, trie->pool_size + length);
+        trie->pool = (char*)realloc(trie->pool, capacity);
+        assert(trie->pool != nullptr);
+        trie->pool_capacity = capacity;
+    }
+    size_t offset = trie->pool_size;
+    memcpy(trie->pool + offset, str, length);
+    trie->pool_size += length;
+    return offset;
+}
+
+static const char* edge_label(Trie *trie, Node *node) {
+    return trie->pool + node->edge_offset;
+}
+
+static void node_update_max_score(Node *node) {
+    int64_t max_score = node->leaf ? node->score : NO_SCORE;
+    for (size_t i = 0; i < node->children_count; i++) {
+        max_score = max(max_score, node->children[i]->max_score);
+    }
+    node->max_score = max_score;
+}
+
+static void node_set_leaf(Node *node, bool scored, int64_t score) {
+    bool decreased = node->leaf && scored && score < node->score;
+    if (!node->leaf || scored) {
+        node->score = scored ? score : NO_SCORE;
+    }
+    node->leaf = true;
+    if (decreased) {
+        node_update_max_score(node);
+    } else if (node->score > node->max_score) {
+        node->max_score = node->score;
+    }
+}
+
+/** Splits the edge of the child at the given length by inserting a new node, returns the new node. */
+static Node* node_split_child(Trie *trie, Node *node, Node *child, size_t length) {
+    assert(0 < length && length < child->edge_length);
+    Node *middle = node_create(child->edge_offset, length);
+    child->edge_offset += length;
+    child->edge_length -= length;
+    node_insert_child(middle, (unsigned char)edge_label(trie, child)[0], child);
+    middle->max_score = child->max_score;
+    middle->leaf_count = child->leaf_count;
+    *node_child_slot(node, (unsigned char)edge_label(trie, middle)[0]) = middle;
+    return middle;
+}
+
+static void trie_add(Trie *trie, const char *str, size_t length, bool scored, int64_t score) {
+    // Nodes on the path from the root and their max scores before the insertion.
+    vector<Node*> path(1, trie->root);
+    vector<int64_t> old_max_scores(1, trie->root->max_score);
+
+    Node *node = trie->root;
+    while (length > 0) {
+        unsigned char ch = (unsigned char)str[0];
+        Node *child = node_find_child(node, ch);
+        if (child == nullptr) {
+            child = node_create(pool_append(trie, str, length), length);
+            node_insert_child(node, ch, child);
+            str += length;
+            length = 0;
+        } else {
+            size_t common = 0;
+            size_t max_common = min(child->edge_length, length);
+            const char *label = edge_label(trie, child);
+            while (common < max_common && label[common] == str[common]) {
+                common++;
+            }
+            if (common < child->edge_length) {
+                child = node_split_child(trie, node, child, common);
             }
+            str += common;
+            length -= common;
+        }
+        path.push_back(child);
+        old_max_scores.push_back(child->max_score);
+        node = child;
+    }
+    if (!node->leaf) {
+        for (size_t i = 0; i < path.size(); i++) {
+            path[i]->leaf_count++;
+        }
+    }
+    node_set_leaf(node, scored, score);
+
+    // Max scores are recalculated from scratch only if the score was decreased.
+    for (size_t i = path.size() - 1; i > 0; i--) {
+        Node *child = path[i];
+        Node *parent = path[i - 1];
+        if (child->max_score > parent->max_score) {
+            parent->max_score = child->max_score;
+        } else if (child->max_score < old_max_scores[i] && old_max_scores[i] == parent->max_score) {
+            node_update_max_score(parent);
+        } else {
+            break;
         }
-        assert(single_child != -1);
-        prefix.push_back((char)single_child);
-        build_common_prefix(node->children[single_child], prefix);
     }
 }
 
+void trie_add(Trie* trie, string str) {
+    trie_add(trie, str.c_str(), str.length(), false, 0);
+}
+
+void trie_add_scored(Trie* trie, const string &str, int64_t score) {
+    trie_add(trie, str.c_str(), str.length(), true, score);
+}
+
 string trie_get_common_prefix(Trie* trie) {
     string prefix("");
-    build_common_prefix(trie->root, prefix);
+    Node *node = trie->root;
+    while (!node->leaf && node->children_count == 1) {
+        node = node->children[0];
+        prefix.append(edge_label(trie, node), node->edge_length);
+    }
     return prefix;
 }
 
+/**
+ * Finds the node whose path is the shortest one starting with prefix.
+ * Returns nullptr if there is no such node.
+ */
+static Node* trie_find(Trie *trie, const string &prefix, string &path) {
+    Node *node = trie->root;
+    path = string("");
+    while (path.length() < prefix.length()) {
+        node = node_find_child(node, (unsigned char)prefix[path.length()]);
+        if (node == nullptr) {
+            return nullptr;
+        }
+        size_t compared = min(node->edge_length, prefix.length() - path.length());
+        if (memcmp(edge_label(trie, node), prefix.c_str() + path.length(), compared) != 0) {
+            return nullptr;
+        }
+        path.append(edge_label(trie, node), node->edge_length);
+    }
+    return node;
+}
+
+void trie_get_segments(Trie* trie, const string &prefix, char separator, vector<TrieSegment> &result) {
+    string path;
+    Node *node = trie_find(trie, prefix, path);
+    if (node == nullptr) {
+        return;
+    }
+
+    typedef struct tSegmentsEntry {
+        Node *node;
+        string path;          // path to the node
+        size_t scanned_length; // part of the path already known to contain no separators
+    } SegmentsEntry;
+
+    // Depth first search in the reverse order of children, so segments are found in the sorted order.
+    vector<SegmentsEntry> stack;
+    stack.push_back(SegmentsEntry{ node, path, prefix.length() });
+    while (!stack.empty()) {
+        SegmentsEntry entry = stack.back();
+        stack.pop_back();
+
+        size_t separator_pos = entry.path.find(separator, entry.scanned_length);
+        if (separator_pos != string::npos) {
+            // all strings of the subtree share this segment
+            result.push_back(TrieSegment{ entry.path.substr(0, separator_pos + 1), entry.node->leaf_count, false });
+            continue;
+        }
+
+        Node *cur = entry.node;
+        if (cur->leaf && entry.path.length() > prefix.length()) {
+            result.push_back(TrieSegment{ entry.path, 1, true });
+        }
+        for (size_t i = cur->children_count; i > 0; i--) {
+            Node *child = cur->children[i - 1];
+            stack.push_back(SegmentsEntry{ child, entry.path + string(edge_label(trie, child), child->edge_length), entry.path.length() });
+        }
+    }
+}
+
+typedef struct tTopKEntry {
+    int64_t bound;
+    Node *node;
+    bool leaf; // the entry represents the leaf of the node, not its subtree
+    string str;
+} TopKEntry;
+
+/** Orders entries so that the priority queue pops the best one first. */
+static bool top_k_entry_is_worse(const TopKEntry &x, const TopKEntry &y) {
+    if (x.bound != y.bound) {
+        return x.bound < y.bound;
+    }
+    if (x.str != y.str) {
+        return x.str > y.str;
+    }
+    return !x.leaf && y.leaf;
+}
+
+void trie_get_top_k(Trie* trie, const string &prefix, size_t k, vector<string> &result) {
+    // The prefix may end in the middle of an edge, so the path to the found node may be longer.
+    string path;
+    Node *node = trie_find(trie, prefix, path);
+    if (node == nullptr || k == 0) {
+        return;
+    }
+
+    priority_queue<TopKEntry, vector<TopKEntry>, bool (*)(const TopKEntry &, const TopKEntry &)> queue(top_k_entry_is_worse);
+    queue.push(TopKEntry{ node->max_score, node, false, path });
+    size_t found = 0;
+    while (!queue.empty() && found < k) {
+        TopKEntry entry = queue.top();
+        queue.pop();
+
+        if (entry.leaf) {
+            result.push_back(entry.str);
+            found++;
+            continue;
+        }
+
+        Node *cur = entry.node;
+        if (cur->leaf) {
+            queue.push(TopKEntry{ cur->score, cur, true, entry.str });
+        }
+        for (size_t i = 0; i < cur->children_count; i++) {
+            Node *child = cur->children[i];
+            queue.push(TopKEntry{ child->max_score, child, false, entry.str + string(edge_label(trie, child), child->edge_length) });
+        }
+    }
+}
+
 #ifdef DEBUG
 void trie_test() {
     Trie *trie = trie_create();
@@ -103,6 +375,77 @@ void trie_test() {
     trie_add(trie, string("ab"));
     assert(string("ab") == trie_get_common_prefix(trie));
 
+    trie_add(trie, string("abcdefgh"));
+    trie_add(trie, string(""));
+    assert(string("") == trie_get_common_prefix(trie));
+
+    trie_free(trie);
+
+    trie = trie_create();
+    string deep(100000, 'a');
+    trie_add(trie, deep);
+    trie_add(trie, deep + "b");
+    for (size_t i = 1; i < 200; i++) {
+        trie_add(trie, deep.substr(0, deep.length() - i) + "c");
+    }
+    assert(deep.substr(0, deep.length() - 199) == trie_get_common_prefix(trie));
+    trie_free(trie);
+
+    trie = trie_create();
+    trie_add_scored(trie, string("master"), 10);
+    trie_add_scored(trie, string("feature/a"), 30);
+    trie_add_scored(trie, string("feature/b"), 20);
+    trie_add_scored(trie, string("feature"), 5);
+    trie_add_scored(trie, string("fix"), 20);
+    {
+        vector<string> top;
+        trie_get_top_k(trie, string(""), 3, top);
+        assert((vector<string>{ string("feature/a"), string("feature/b"), string("fix") }) == top);
+    }
+    {
+        vector<string> top;
+        trie_get_top_k(trie, string("fe"), 10, top);
+        assert((vector<string>{ string("feature/a"), string("feature/b"), string("feature") }) == top);
+    }
+    {
+        // decreasing the score must lower the subtree bounds as well
+        trie_add_scored(trie, string("feature/a"), 1);
+        vector<string> top;
+        trie_get_top_k(trie, string("f"), 2, top);
+        assert((vector<string>{ string("feature/b"), string("fix") }) == top);
+    }
+    {
+        vector<string> top;
+        trie_get_top_k(trie, string("xyz"), 2, top);
+        assert(top.empty());
+    }
+    {
+        // the prefix ends in the middle of the compressed "eature" edge, which is split at the leaf "feature"
+        vector<string> top;
+        trie_get_top_k(trie, string("feat"), 1, top);
+        assert((vector<string>{ string("feature/b") }) == top);
+    }
+    {
+        vector<string> top;
+        trie_get_top_k(trie, string("featx"), 1, top);
+        assert(top.empty());
+    }
+    {
+        vector<TrieSegment> segments;
+        trie_get_segments(trie, string(""), '/', segments);
+        assert(4 == segments.size());
+        assert(string("feature") == segments[0].str && segments[0].leaf && 1 == segments[0].count);
+        assert(string("feature/") == segments[1].str && !segments[1].leaf && 2 == segments[1].count);
+        assert(string("fix") == segments[2].str && segments[2].leaf);
+        assert(string("master") == segments[3].str && segments[3].leaf);
+    }
+    {
+        vector<TrieSegment> segments;
+        trie_get_segments(trie, string("feature/"), '/', segments);
+        assert(2 == segments.size());
+        assert(string("feature/a") == segments[0].str && segments[0].leaf);
+        assert(string("feature/b") == segments[1].str && segments[1].leaf);
+    }
     trie_free(trie);
 }
 #endif
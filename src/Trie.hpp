@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 typedef struct tTrie Trie;
 
@@ -10,8 +12,31 @@ void trie_free(Trie *trie);
 
 void trie_add(Trie* trie, std::string str);
 
+/** Adds str with the given score or updates the score of already added str. */
+void trie_add_scored(Trie* trie, const std::string &str, int64_t score);
+
 std::string trie_get_common_prefix(Trie* trie);
 
+/**
+ * Returns at most k strings starting with prefix, ordered by descending score
+ * (and by name for equal scores). Only the branches which may contain
+ * one of the k best strings are visited.
+ */
+void trie_get_top_k(Trie* trie, const std::string &prefix, size_t k, std::vector<std::string> &result);
+
+typedef struct tTrieSegment {
+    std::string str; // the whole string up to the end of the segment (including the separator)
+    size_t count;    // number of strings starting with str
+    bool leaf;       // str itself was added to the trie and it does not end with the separator
+} TrieSegment;
+
+/**
+ * Returns distinct segments following prefix: e.g. for strings "a/b/c", "a/b/d", "a/x"
+ * and prefix "a/" the segments are "a/b/" (2 strings) and "a/x" (leaf).
+ * Only the part of the trie up to the next separators is visited.
+ */
+void trie_get_segments(Trie* trie, const std::string &prefix, char separator, std::vector<TrieSegment> &result);
+
 #ifdef DEBUG
 void trie_test();
 #endif
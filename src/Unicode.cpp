@@ -0,0 +1,148 @@
+#include "Unicode.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cwchar>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "Utils.hpp"
+
+using namespace std;
+
+static bool IsAscii(const string &str) {
+    return all_of(str.begin(), str.end(), [](char c) -> bool { return (unsigned char)c < 0x80; });
+}
+
+#ifdef _WIN32
+string NormalizeNfc(const string &str) {
+    if (IsAscii(str)) {
+        return str;
+    }
+    wstring wide = mb2w(str);
+    int length = NormalizeString(NormalizationC, wide.c_str(), (int)wide.length(), nullptr, 0);
+    if (length <= 0) {
+        return str;
+    }
+    wstring normalized(length, L'\0');
+    length = NormalizeString(NormalizationC, wide.c_str(), (int)wide.length(), &normalized[0], length);
+    if (length <= 0) {
+        return str;
+    }
+    normalized.resize(length);
+    return w2mb(normalized);
+}
+
+string CollationKey(const string &str) {
+    wstring wide = mb2w(str);
+    int size = LCMapStringEx(LOCALE_NAME_USER_DEFAULT, LCMAP_SORTKEY, wide.c_str(), (int)wide.length(), nullptr, 0, nullptr, nullptr, 0);
+    if (size <= 0) {
+        return str;
+    }
+    // The sort key is an array of bytes, its size is also in bytes.
+    string key(size, '\0');
+    size = LCMapStringEx(LOCALE_NAME_USER_DEFAULT, LCMAP_SORTKEY, wide.c_str(), (int)wide.length(), (LPWSTR)&key[0], size, nullptr, nullptr, 0);
+    if (size <= 0) {
+        return str;
+    }
+    key.resize(size - 1); // without the terminating zero
+    return key;
+}
+#else
+typedef struct tComposition {
+    uint16_t base;
+    uint16_t mark;
+    uint16_t composed;
+} Composition;
+
+// Canonical compositions of Latin-1 and Cyrillic letters, sorted by base and mark.
+static const Composition COMPOSITIONS[] = {
+    { 0x0041, 0x0300, 0x00C0 }, { 0x0041, 0x0301, 0x00C1 }, { 0x0041, 0x0302, 0x00C2 },
+    { 0x0041, 0x0303, 0x00C3 }, { 0x0041, 0x0308, 0x00C4 }, { 0x0041, 0x030A, 0x00C5 },
+    { 0x0043, 0x0327, 0x00C7 }, { 0x0045, 0x0300, 0x00C8 }, { 0x0045, 0x0301, 0x00C9 },
+    { 0x0045, 0x0302, 0x00CA }, { 0x0045, 0x0308, 0x00CB }, { 0x0049, 0x0300, 0x00CC },
+    { 0x0049, 0x0301, 0x00CD }, { 0x0049, 0x0302, 0x00CE }, { 0x0049, 0x0308, 0x00CF },
+    { 0x004E, 0x0303, 0x00D1 }, { 0x004F, 0x0300, 0x00D2 }, { 0x004F, 0x0301, 0x00D3 },
+    { 0x004F, 0x0302, 0x00D4 }, { 0x004F, 0x0303, 0x00D5 }, { 0x004F, 0x0308, 0x00D6 },
+    { 0x0055, 0x0300, 0x00D9 }, { 0x0055, 0x0301, 0x00DA }, { 0x0055, 0x0302, 0x00DB },
+    { 0x0055, 0x0308, 0x00DC }, { 0x0059, 0x0301, 0x00DD }, { 0x0061, 0x0300, 0x00E0 },
+    { 0x0061, 0x0301, 0x00E1 }, { 0x0061, 0x0302, 0x00E2 }, { 0x0061, 0x0303, 0x00E3 },
+    { 0x0061, 0x0308, 0x00E4 }, { 0x0061, 0x030A, 0x00E5 }, { 0x0063, 0x0327, 0x00E7 },
+    { 0x0065, 0x0300, 0x00E8 }, { 0x0065, 0x0301, 0x00E9 }, { 0x0065, 0x0302, 0x00EA },
+    { 0x0065, 0x0308, 0x00EB }, { 0x0069, 0x0300, 0x00EC }, { 0x0069, 0x0301, 0x00ED },
+    { 0x0069, 0x0302, 0x00EE }, { 0x0069, 0x0308, 0x00EF }, { 0x006E, 0x0303, 0x00F1 },
+    { 0x006F, 0x0300, 0x00F2 }, { 0x006F, 0x0301, 0x00F3 }, { 0x006F, 0x0302, 0x00F4 },
+    { 0x006F, 0x0303, 0x00F5 }, { 0x006F, 0x0308, 0x00F6 }, { 0x0075, 0x0300, 0x00F9 },
+    { 0x0075, 0x0301, 0x00FA }, { 0x0075, 0x0302, 0x00FB }, { 0x0075, 0x0308, 0x00FC },
+    { 0x0079, 0x0301, 0x00FD }, { 0x0079, 0x0308, 0x00FF }, { 0x0406, 0x0308, 0x0407 },
+    { 0x0413, 0x0301, 0x0403 }, { 0x0415, 0x0300, 0x0400 }, { 0x0415, 0x0308, 0x0401 },
+    { 0x0418, 0x0300, 0x040D }, { 0x0418, 0x0306, 0x0419 }, { 0x041A, 0x0301, 0x040C },
+    { 0x0423, 0x0306, 0x040E }, { 0x0433, 0x0301, 0x0453 }, { 0x0435, 0x0300, 0x0450 },
+    { 0x0435, 0x0308, 0x0451 }, { 0x0438, 0x0300, 0x045D }, { 0x0438, 0x0306, 0x0439 },
+    { 0x043A, 0x0301, 0x045C }, { 0x0443, 0x0306, 0x045E }, { 0x0456, 0x0308, 0x0457 },
+};
+
+static uint32_t Compose(uint32_t base, uint32_t mark) {
+    Composition key = { (uint16_t)base, (uint16_t)mark, 0 };
+    auto end = COMPOSITIONS + sizeof(COMPOSITIONS) / sizeof(COMPOSITIONS[0]);
+    auto found = lower_bound(COMPOSITIONS, end, key, [](const Composition &x, const Composition &y) -> bool {
+        return x.base < y.base || (x.base == y.base && x.mark < y.mark);
+    });
+    return (base <= 0xFFFF && mark <= 0xFFFF && found != end && found->base == base && found->mark == mark) ? found->composed : 0;
+}
+
+string NormalizeNfc(const string &str) {
+    if (IsAscii(str)) {
+        return str;
+    }
+    wstring composed;
+    size_t position = 0;
+    while (position < str.length()) {
+        uint32_t c = DecodeUtf8(str, position);
+        uint32_t withPrevious = composed.empty() ? 0 : Compose((uint32_t)composed.back(), c);
+        if (withPrevious != 0) {
+            composed.back() = (wchar_t)withPrevious;
+        } else {
+            composed += (wchar_t)c; // wchar_t is 32 bits wide outside of Windows
+        }
+    }
+    return w2mb(composed);
+}
+
+string CollationKey(const string &str) {
+    wstring wide = mb2w(str);
+    size_t length = wcsxfrm(nullptr, wide.c_str(), 0);
+    wstring transformed(length + 1, L'\0');
+    wcsxfrm(&transformed[0], wide.c_str(), length + 1);
+    transformed.resize(length);
+    // Big endian bytes are ordered as the wide chars compared by wcscmp.
+    string key;
+    key.reserve(length * 4);
+    for (auto it = transformed.begin(); it != transformed.end(); ++it) {
+        uint32_t c = (uint32_t)*it;
+        key += (char)(c >> 24);
+        key += (char)(c >> 16);
+        key += (char)(c >> 8);
+        key += (char)c;
+    }
+    return key;
+}
+#endif
+
+#ifdef DEBUG
+void UnicodeTest() {
+    assert(string("feature/x") == NormalizeNfc(string("feature/x")));
+    // "e" + combining diaeresis, Cyrillic "i" + combining breve
+    assert(string("\xC3\xAB") == NormalizeNfc(string("e\xCC\x88")));
+    assert(string("\xD0\xB9") == NormalizeNfc(string("\xD0\xB8\xCC\x86")));
+    assert(string("\xD0\xB2\xD0\xB5\xD1\x82\xD0\xBA\xD0\xB0") == NormalizeNfc(string("\xD0\xB2\xD0\xB5\xD1\x82\xD0\xBA\xD0\xB0")));
+
+    // keys are compared as bytes and keep at least the order of different letters
+    assert(CollationKey(string("a")) < CollationKey(string("b")));
+    assert(CollationKey(string("\xD0\xB0")) < CollationKey(string("\xD0\xB1")));
+    assert(CollationKey(string("x")) == CollationKey(string("x")));
+}
+#endif
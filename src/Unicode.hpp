@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+// Ref names are UTF-8 strings. Everything which is compared by bytes (sorted snapshots, prefixes)
+// stays in the code point order, the locale order is used only for showing refs to the user.
+
+/** Composes "e" + U+0308 into U+00EB and so on, so a typed prefix matches precomposed ref names. */
+std::string NormalizeNfc(const std::string &str);
+
+/**
+ * Returns a key whose byte order is the order of strings in the user's locale.
+ * It is relatively expensive, so keys are made once and then compared as plain strings.
+ */
+std::string CollationKey(const std::string &str);
+
+#ifdef DEBUG
+void UnicodeTest();
+#endif
@@ -1,26 +1,117 @@
 ﻿#include "Utils.hpp"
 
 #include <cassert>
-
-#include "GitAutocomplete.hpp"
+#include <cstring>
 
 using namespace std;
 
-string w2mb(wstring wstr) {
-    size_t mbstrSize = wstr.length() * 2 + 1;
-    char *mbstr = (char*)malloc(mbstrSize); // this is enough for all ;) FIXME
-    bool convertedOk = (wcstombs(mbstr, wstr.c_str(), mbstrSize) != (size_t)-1);
-    if (!convertedOk) {
-        *logFile << "Cannot convert some string to multi-byte string :(" << endl;
-        return string("");
+// Both conversions are between UTF-8 and UTF-16 (or UTF-32 where wchar_t is 32 bits wide),
+// invalid sequences are replaced by U+FFFD.
+static const uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+static void AppendUtf8(string &str, uint32_t c) {
+    if (c < 0x80) {
+        str += (char)c;
+    } else if (c < 0x800) {
+        str += (char)(0xC0 | (c >> 6));
+        str += (char)(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        str += (char)(0xE0 | (c >> 12));
+        str += (char)(0x80 | ((c >> 6) & 0x3F));
+        str += (char)(0x80 | (c & 0x3F));
+    } else {
+        str += (char)(0xF0 | (c >> 18));
+        str += (char)(0x80 | ((c >> 12) & 0x3F));
+        str += (char)(0x80 | ((c >> 6) & 0x3F));
+        str += (char)(0x80 | (c & 0x3F));
+    }
+}
+
+string w2mb(const wstring &wstr) {
+    string result;
+    result.reserve(wstr.length());
+    for (size_t i = 0; i < wstr.length(); ++i) {
+        uint32_t c = (uint32_t)wstr[i];
+        if (c >= 0xD800 && c <= 0xDBFF && i + 1 < wstr.length() && (uint32_t)wstr[i + 1] >= 0xDC00 && (uint32_t)wstr[i + 1] <= 0xDFFF) {
+            c = 0x10000 + ((c - 0xD800) << 10) + ((uint32_t)wstr[++i] - 0xDC00);
+        } else if ((c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF) {
+            c = REPLACEMENT_CHARACTER;
+        }
+        AppendUtf8(result, c);
     }
-    string result = string(mbstr);
-    free(mbstr);
     return result;
 }
 
-wstring mb2w(string str) {
-    return wstring(str.begin(), str.end());
+uint32_t DecodeUtf8(const string &str, size_t &position) {
+    unsigned char lead = (unsigned char)str[position++];
+    if (lead < 0x80) {
+        return lead;
+    }
+    size_t continuations = (lead >= 0xF0 && lead <= 0xF4) ? 3 : (lead >= 0xE0) ? 2 : (lead >= 0xC2 && lead <= 0xDF) ? 1 : 0;
+    if (continuations == 0 || lead > 0xF4) {
+        return REPLACEMENT_CHARACTER;
+    }
+    uint32_t c = lead & (0x3F >> continuations);
+    for (size_t i = 0; i < continuations; ++i) {
+        if (position == str.length() || ((unsigned char)str[position] & 0xC0) != 0x80) {
+            return REPLACEMENT_CHARACTER;
+        }
+        c = (c << 6) | ((unsigned char)str[position++] & 0x3F);
+    }
+    static const uint32_t MIN_BY_LENGTH[] = { 0, 0x80, 0x800, 0x10000 };
+    if (c < MIN_BY_LENGTH[continuations] || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+        return REPLACEMENT_CHARACTER; // overlong or not a scalar value
+    }
+    return c;
+}
+
+wstring mb2w(const string &str) {
+    wstring result(str.length() + 1, L'\0');
+    result.resize(mb2wBuffer(str, &result[0]));
+    return result;
+}
+
+size_t mb2wBuffer(const string &str, wchar_t *buffer) {
+    size_t length = 0;
+    size_t position = 0;
+    while (position < str.length()) {
+        uint32_t c = DecodeUtf8(str, position);
+        if (sizeof(wchar_t) == 2 && c >= 0x10000) {
+            buffer[length++] = (wchar_t)(0xD800 + ((c - 0x10000) >> 10));
+            buffer[length++] = (wchar_t)(0xDC00 + ((c - 0x10000) & 0x3FF));
+        } else {
+            buffer[length++] = (wchar_t)c;
+        }
+    }
+    buffer[length] = L'\0';
+    return length;
+}
+
+size_t Utf8Floor(const string &str, size_t length) {
+    while (length > 0 && length < str.length() && ((unsigned char)str[length] & 0xC0) == 0x80) {
+        length--;
+    }
+    return length;
+}
+
+size_t WideLength(const string &str, size_t bytes) {
+    size_t length = 0;
+    size_t position = 0;
+    while (position < bytes) {
+        uint32_t c = DecodeUtf8(str, position);
+        length += (sizeof(wchar_t) == 2 && c >= 0x10000) ? 2 : 1;
+    }
+    return length;
+}
+
+size_t Utf8Length(const string &str) {
+    size_t length = 0;
+    for (auto it = str.begin(); it != str.end(); ++it) {
+        if (((unsigned char)*it & 0xC0) != 0x80) {
+            length++;
+        }
+    }
+    return length;
 }
 
 bool StartsWith(const char *str, const char *prefix) {
@@ -41,6 +132,97 @@ string DropPrefix(const string &str, const string &prefix) {
     return str.substr(prefix.length());
 }
 
+bool IsPartialPrefixAnchor(char c) {
+    // Bytes of multi-byte UTF-8 sequences are never anchors whatever the current locale says.
+    return (unsigned char)c < 0x80 && (ispunct((unsigned char)c) || isupper((unsigned char)c));
+}
+
+bool RefMayBeEncodedByPartialPrefix(const char *ref, const char *prefix) {
+    const char *p = prefix;
+    const char *r = ref;
+    for (;;) {
+        if (*p == '\0') {
+            return true;
+        } else if (IsPartialPrefixAnchor(*p)) {
+            r = strchr(r, *p);
+            if (r == nullptr) {
+                return false;
+            }
+        } else {
+            if (*p != *r) {
+                return false;
+            }
+        }
+
+        p++;
+        r++;
+    }
+}
+
+/** Matches the "[...]" class which starts the pattern and moves the pattern past it. An unclosed "[" is a literal. */
+static bool ClassMatches(const char *&pattern, char c) {
+    const char *p = pattern + 1;
+    bool negated = (*p == '!' || *p == '^');
+    if (negated) {
+        p++;
+    }
+    bool matched = false;
+    for (const char *first = p; *p != '\0' && (*p != ']' || p == first); ++p) {
+        unsigned char low = (unsigned char)*p;
+        unsigned char high = low;
+        if (p[1] == '-' && p[2] != '\0' && p[2] != ']') {
+            high = (unsigned char)p[2];
+            p += 2;
+        }
+        matched = matched || (low <= (unsigned char)c && (unsigned char)c <= high);
+    }
+    if (*p != ']') {
+        pattern++;
+        return c == '[';
+    }
+    pattern = p + 1;
+    return matched != negated;
+}
+
+bool GlobMatches(const char *pattern, const char *text) {
+    // The last star and the text it was tried at: a mismatch makes the star take one more char.
+    const char *starPattern = nullptr;
+    const char *starText = nullptr;
+    while (*text != '\0') {
+        if (*pattern == '*') {
+            starPattern = ++pattern;
+            starText = text;
+            continue;
+        }
+        const char *next = pattern + 1;
+        bool matched;
+        if (*pattern == '?') {
+            matched = true;
+        } else if (*pattern == '[') {
+            next = pattern;
+            matched = ClassMatches(next, *text);
+        } else if (*pattern == '\\' && pattern[1] != '\0') {
+            matched = (pattern[1] == *text);
+            next = pattern + 2;
+        } else {
+            matched = (*pattern != '\0' && *pattern == *text);
+        }
+        if (matched) {
+            pattern = next;
+            text++;
+        } else if (starPattern != nullptr) {
+            pattern = starPattern;
+            text = ++starText;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
 #ifdef DEBUG
 void UtilsTest() {
     assert(StartsWith("abcdef", "abc"));
@@ -55,6 +237,45 @@ void UtilsTest() {
     assert(string("") == DropPrefix(string("abc"), string("abc")));
 
     assert(wstring(L"Excelsior loves Far") == mb2w(string("Excelsior loves Far")));
-    assert(string("") == w2mb(wstring(L"Excelsior ❤ Far")));
+    assert(string("Excelsior \xE2\x9D\xA4 Far") == w2mb(wstring(L"Excelsior \x2764 Far")));
+    assert(wstring(L"\x0432\x0435\x0442\x043A\x0430") == mb2w(string("\xD0\xB2\xD0\xB5\xD1\x82\xD0\xBA\xD0\xB0")));
+    assert(string("\xF0\x9F\x8C\xB2") == w2mb(mb2w(string("\xF0\x9F\x8C\xB2"))));
+    assert(wstring(L"a\xFFFD" L"b\xFFFD\xFFFD") == mb2w(string("a\xD0" "b\xC0\xAF")));
+    {
+        wchar_t buffer[5];
+        assert(2 == mb2wBuffer(string("\xD0\xB2\xD0\xB5"), buffer) && wstring(L"\x0432\x0435") == buffer);
+    }
+    assert(2 == Utf8Floor(string("\xD0\xB2\xD0\xB5"), 3) && 4 == Utf8Floor(string("\xD0\xB2\xD0\xB5"), 4));
+    assert(3 == Utf8Length(string("a\xD0\xB2\xF0\x9F\x8C\xB2")));
+    assert(2 == WideLength(string("a\xD0\xB2\xF0\x9F\x8C\xB2"), 3) && mb2w(string("a\xD0\xB2\xF0\x9F\x8C\xB2")).length() == WideLength(string("a\xD0\xB2\xF0\x9F\x8C\xB2"), 7));
+
+    assert(RefMayBeEncodedByPartialPrefix("svn/trunk", "s/t"));
+    assert(RefMayBeEncodedByPartialPrefix("foo/bar/qux", "f/b"));
+    assert(RefMayBeEncodedByPartialPrefix("foo/bar/qux", "f/b/q"));
+    assert(RefMayBeEncodedByPartialPrefix("foo/bar/qux", "f/ba/q"));
+    assert(RefMayBeEncodedByPartialPrefix("foo/bar/qux", "f/bar/q"));
+    assert(RefMayBeEncodedByPartialPrefix("foo/bar/qux", "foo/bar/qux"));
+    assert(RefMayBeEncodedByPartialPrefix("foo/bar-qux", "f/b-q"));
+    assert(RefMayBeEncodedByPartialPrefix("foo/barQux", "f/bQ"));
+
+    assert(!RefMayBeEncodedByPartialPrefix("foo/bar/qux", "fo/baz/q"));
+    assert(!RefMayBeEncodedByPartialPrefix("foo", "f/b"));
+    assert(!RefMayBeEncodedByPartialPrefix("foo/", "f/b"));
+    assert(!RefMayBeEncodedByPartialPrefix("foo/b", "f/bar"));
+    assert(!RefMayBeEncodedByPartialPrefix("foo/bar/qux", "f/q"));
+    assert(!RefMayBeEncodedByPartialPrefix("foo/bar-qux", "f/brq"));
+
+    // "\xD0\x92" (Cyrillic capital Ve) is matched literally, not as an anchor
+    assert(RefMayBeEncodedByPartialPrefix("fix/\xD0\x92\xD0\xB5\xD1\x82\xD0\xBA\xD0\xB0", "f/\xD0\x92"));
+    assert(!RefMayBeEncodedByPartialPrefix("fix/a\xD0\x92", "f/\xD0\x92"));
+
+    assert(GlobMatches("release/*", "release/1.0") && !GlobMatches("release/*", "feature/release/1.0"));
+    assert(GlobMatches("*", "a/b") && GlobMatches("*", "") && GlobMatches("", "") && !GlobMatches("", "a"));
+    assert(GlobMatches("*fix*", "feature/fix-1") && !GlobMatches("*fix*", "feature/fi-x"));
+    assert(GlobMatches("v1.?", "v1.2") && !GlobMatches("v1.?", "v1.10") && !GlobMatches("v1.?", "v1."));
+    assert(GlobMatches("[ab]*", "beta") && !GlobMatches("[!ab]*", "beta") && GlobMatches("[^ab]*", "gamma"));
+    assert(GlobMatches("f[a-z]x", "fox") && !GlobMatches("f[a-z]x", "fOx") && GlobMatches("[]x]", "]"));
+    assert(GlobMatches("a[", "a[") && GlobMatches("a\\*", "a*") && !GlobMatches("a\\*", "ab"));
+    assert(GlobMatches("*a*b", "xaxab") && !GlobMatches("*a*b", "xaxa"));
 }
 #endif
@@ -1,10 +1,31 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 
-std::string w2mb(std::wstring wstr);
+/** UTF-16 to UTF-8. */
+std::string w2mb(const std::wstring &wstr);
 
-std::wstring mb2w(std::string str);
+/** UTF-8 to UTF-16. */
+std::wstring mb2w(const std::string &str);
+
+/**
+ * UTF-8 to UTF-16 into a buffer of at least str.length() + 1 chars (there are never more UTF-16 units than bytes),
+ * returns the length without the terminating zero.
+ */
+size_t mb2wBuffer(const std::string &str, wchar_t *buffer);
+
+/** Decodes the code point starting at position and moves position past it. */
+uint32_t DecodeUtf8(const std::string &str, size_t &position);
+
+/** Shortens length so str is not cut inside of a UTF-8 sequence. */
+size_t Utf8Floor(const std::string &str, size_t length);
+
+/** Number of wchar_t units which encode the first bytes of str, bytes must not cut a UTF-8 sequence. */
+size_t WideLength(const std::string &str, size_t bytes);
+
+/** Number of code points. */
+size_t Utf8Length(const std::string &str);
 
 bool StartsWith(const char *str, const char *prefix);
 
@@ -12,6 +33,15 @@ bool StartsWith(const std::string &str, const std::string &prefix);
 
 std::string DropPrefix(const std::string &str, const std::string &prefix);
 
+/** ASCII punctuation and capital letters of a partial prefix match the next such char of a ref. */
+bool IsPartialPrefixAnchor(char c);
+
+/** Returns true for pairs like "cypok/arm/master" with prefix "cy/a/m". */
+bool RefMayBeEncodedByPartialPrefix(const char *ref, const char *prefix);
+
+/** Shell-like patterns of git with "*", "?" and "[...]", a star also matches slashes like in "git branch --list". */
+bool GlobMatches(const char *pattern, const char *text);
+
 #ifdef DEBUG
 void UtilsTest();
 #endif
@@ -0,0 +1,194 @@
+// Writes a synthetic repository with the anonymized refs of a real one, e.g. to share a benchmark corpus:
+//
+//   AnonymizeRefs <git dir or working tree> <new dir> <secret phrase>
+//
+// Packed refs stay packed and loose refs stay loose, so the costs of reading them are alike.
+// The repository has no objects: refs point to anonymized ids, which is enough to enumerate them.
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Files.hpp"
+#include "Utils.hpp"
+#include "RefsAnonymizer.hpp"
+
+using namespace std;
+
+typedef struct tPackedRef {
+    string oid;
+    string name;
+    string peeled; // empty if the line is not followed by "^<oid>"
+} PackedRef;
+
+/** The contents of a loose ref or of HEAD: "<oid>" or "ref: <name>". */
+typedef struct tLooseRef {
+    string name;
+    string contents;
+} LooseRef;
+
+static string TrimLineEnd(const string &line) {
+    size_t end = line.find_last_not_of("\r\n");
+    return (end == string::npos) ? string("") : line.substr(0, end + 1);
+}
+
+static vector<PackedRef> ParsePackedRefs(const string &text) {
+    vector<PackedRef> refs;
+    size_t begin = 0;
+    while (begin < text.length()) {
+        size_t end = text.find('\n', begin);
+        if (end == string::npos) {
+            end = text.length();
+        }
+        string line = TrimLineEnd(text.substr(begin, end - begin));
+        size_t space = line.find(' ');
+        if (!line.empty() && line[0] == '^' && !refs.empty()) {
+            refs.back().peeled = line.substr(1);
+        } else if (!line.empty() && line[0] != '#' && space != string::npos) {
+            PackedRef ref = { line.substr(0, space), line.substr(space + 1), string("") };
+            refs.push_back(ref);
+        }
+        begin = end + 1;
+    }
+    return refs;
+}
+
+/** Git refuses names with a component ending in ".lock", a permuted word may turn into one. */
+static bool IsValidImage(const string &name) {
+    static const string LOCK(".lock");
+    size_t end = 0;
+    while (end != string::npos) {
+        end = name.find('/', end + 1);
+        size_t componentEnd = (end == string::npos) ? name.length() : end;
+        if (componentEnd >= LOCK.length() && name.compare(componentEnd - LOCK.length(), LOCK.length(), LOCK) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void ListLooseRefs(const string &gitDir, vector<LooseRef> &refs) {
+    vector<string> pending = { string("refs") };
+    while (!pending.empty()) {
+        string dir = pending.back();
+        pending.pop_back();
+
+        vector<string> subdirs;
+        vector<string> files;
+        ListDir(gitDir + dir, subdirs, &files);
+        for (auto it = subdirs.begin(); it != subdirs.end(); ++it) {
+            pending.push_back(dir + "/" + *it);
+        }
+        for (auto it = files.begin(); it != files.end(); ++it) {
+            LooseRef ref = { dir + "/" + *it, string("") };
+            if (!IsValidImage(ref.name)) {
+                continue; // a lock file of a ref being updated
+            }
+            if (ReadFileContents(gitDir + ref.name, ref.contents)) {
+                ref.contents = TrimLineEnd(ref.contents);
+                refs.push_back(ref);
+            }
+        }
+    }
+}
+
+static string AnonymizeContents(const AnonymizerKey &key, const string &contents) {
+    static const string SYMBOLIC("ref: ");
+    return StartsWith(contents, SYMBOLIC)
+        ? SYMBOLIC + AnonymizeRefName(key, contents.substr(SYMBOLIC.length()))
+        : AnonymizeOid(key, contents);
+}
+
+static bool WriteFile(const string &path, const string &contents) {
+    size_t slash = path.rfind('/');
+    if ((slash != string::npos && !CreateDirs(path.substr(0, slash))) || !WriteFileContents(path, contents)) {
+        fprintf(stderr, "Cannot write %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+static int Run(const vector<string> &args) {
+    if (args.size() != 4) {
+        fprintf(stderr, "Usage: AnonymizeRefs <git dir or working tree> <new dir> <secret phrase>\n");
+        return 2;
+    }
+    string gitDir = args[1] + "/";
+    string head;
+    if (ReadFileContents(gitDir + ".git/HEAD", head)) {
+        gitDir += ".git/";
+    } else if (!ReadFileContents(gitDir + "HEAD", head)) {
+        fprintf(stderr, "Not a git dir: %s\n", args[1].c_str());
+        return 1;
+    }
+    string targetDir = args[2] + "/";
+    AnonymizerKey key = AnonymizerKeyCreate(args[3]);
+
+    string packedText;
+    vector<PackedRef> packed = ReadFileContents(gitDir + "packed-refs", packedText) ? ParsePackedRefs(packedText) : vector<PackedRef>();
+    vector<LooseRef> loose;
+    ListLooseRefs(gitDir, loose);
+
+    size_t skipped = 0;
+    vector<PackedRef> packedImages;
+    for (auto it = packed.begin(); it != packed.end(); ++it) {
+        PackedRef image = { AnonymizeOid(key, it->oid), AnonymizeRefName(key, it->name), it->peeled.empty() ? string("") : AnonymizeOid(key, it->peeled) };
+        if (IsValidImage(image.name)) {
+            packedImages.push_back(image);
+        } else {
+            skipped++;
+        }
+    }
+    sort(packedImages.begin(), packedImages.end(), [](const PackedRef &x, const PackedRef &y) -> bool {
+        return x.name < y.name;
+    });
+
+    bool ok = CreateDirs(targetDir + "objects/info") && CreateDirs(targetDir + "objects/pack")
+        && CreateDirs(targetDir + "refs/heads") && CreateDirs(targetDir + "refs/tags");
+    ok = ok && WriteFile(targetDir + "config", "[core]\n\trepositoryformatversion = 0\n\tbare = true\n");
+    ok = ok && WriteFile(targetDir + "HEAD", AnonymizeContents(key, TrimLineEnd(head)) + "\n");
+
+    string packedImagesText("# pack-refs with: peeled fully-peeled sorted \n");
+    for (auto it = packedImages.begin(); it != packedImages.end(); ++it) {
+        packedImagesText += it->oid + " " + it->name + "\n";
+        if (!it->peeled.empty()) {
+            packedImagesText += "^" + it->peeled + "\n";
+        }
+    }
+    ok = ok && WriteFile(targetDir + "packed-refs", packedImagesText);
+
+    size_t looseWritten = 0;
+    for (auto it = loose.begin(); it != loose.end() && ok; ++it) {
+        string name = AnonymizeRefName(key, it->name);
+        if (!IsValidImage(name)) {
+            skipped++;
+            continue;
+        }
+        ok = WriteFile(targetDir + name, AnonymizeContents(key, it->contents) + "\n");
+        looseWritten++;
+    }
+    if (!ok) {
+        return 1;
+    }
+    printf("%u packed and %u loose refs are written to %s, %u are skipped\n",
+        (unsigned)packedImages.size(), (unsigned)looseWritten, args[2].c_str(), (unsigned)skipped);
+    return 0;
+}
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t *argv[]) {
+    vector<string> args;
+    for (int i = 0; i < argc; ++i) {
+        args.push_back(w2mb(wstring(argv[i])));
+    }
+#else
+int main(int argc, char *argv[]) {
+    vector<string> args(argv, argv + argc);
+#endif
+#ifdef DEBUG
+    RefsAnonymizerTest();
+#endif
+    return Run(args);
+}
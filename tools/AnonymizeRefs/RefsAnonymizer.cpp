@@ -0,0 +1,212 @@
+#include "RefsAnonymizer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <set>
+#include <vector>
+
+#include "Utils.hpp"
+
+using namespace std;
+
+static uint64_t Rotl(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+static void SipRound(uint64_t &v0, uint64_t &v1, uint64_t &v2, uint64_t &v3) {
+    v0 += v1; v1 = Rotl(v1, 13); v1 ^= v0; v0 = Rotl(v0, 32);
+    v2 += v3; v3 = Rotl(v3, 16); v3 ^= v2;
+    v0 += v3; v3 = Rotl(v3, 21); v3 ^= v0;
+    v2 += v1; v1 = Rotl(v1, 17); v1 ^= v2; v2 = Rotl(v2, 32);
+}
+
+uint64_t SipHash24(const AnonymizerKey &key, const char *data, size_t length) {
+    uint64_t v0 = key.k0 ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = key.k1 ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = key.k0 ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = key.k1 ^ 0x7465646279746573ULL;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+
+    size_t full = length - length % 8;
+    for (size_t i = 0; i < full; i += 8) {
+        uint64_t m = 0;
+        for (int j = 7; j >= 0; --j) {
+            m = (m << 8) | bytes[i + j];
+        }
+        v3 ^= m;
+        SipRound(v0, v1, v2, v3);
+        SipRound(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+    uint64_t last = (uint64_t)(length & 0xff) << 56;
+    for (size_t j = full; j < length; ++j) {
+        last |= (uint64_t)bytes[j] << (8 * (j - full));
+    }
+    v3 ^= last;
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    v0 ^= last;
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; ++i) {
+        SipRound(v0, v1, v2, v3);
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+AnonymizerKey AnonymizerKeyCreate(const string &secret) {
+    AnonymizerKey first = { 0, 0 };
+    AnonymizerKey second = { 0, 1 };
+    AnonymizerKey key = { SipHash24(first, secret.data(), secret.length()), SipHash24(second, secret.data(), secret.length()) };
+    return key;
+}
+
+/** Image of index under the permutation of n items which is chosen by the key, the char class and the context. */
+static unsigned PermutedIndex(const AnonymizerKey &key, char charClass, const string &context, unsigned index, unsigned n) {
+    assert(index < n && n <= 64);
+    string input = charClass + context;
+    uint64_t state = SipHash24(key, input.data(), input.length());
+    unsigned permutation[64];
+    iota(permutation, permutation + n, 0u);
+    // Fisher-Yates driven by splitmix64
+    for (unsigned i = n - 1; i > 0; --i) {
+        state += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z ^= z >> 31;
+        swap(permutation[i], permutation[z % (i + 1)]);
+    }
+    return permutation[index];
+}
+
+/** The continuation byte after these lead bytes has a narrower range, it is kept so the name stays valid UTF-8. */
+static bool IsRestrictedLead(unsigned char c) {
+    return c == 0xE0 || c == 0xED || c == 0xF0 || c == 0xF4;
+}
+
+string AnonymizeName(const AnonymizerKey &key, const string &name) {
+    string image(name);
+    string word; // chars of the current word after its anchor
+    for (size_t i = 0; i < name.length(); ++i) {
+        unsigned char c = (unsigned char)name[i];
+        if (IsPartialPrefixAnchor((char)c)) {
+            if (c >= 'A' && c <= 'Z') {
+                image[i] = (char)('A' + PermutedIndex(key, 'A', string(""), c - 'A', 26));
+            }
+            word.clear();
+            continue;
+        }
+        if (c >= 'a' && c <= 'z') {
+            image[i] = (char)('a' + PermutedIndex(key, 'a', word, c - 'a', 26));
+        } else if (c >= '0' && c <= '9') {
+            image[i] = (char)('0' + PermutedIndex(key, '0', word, c - '0', 10));
+        } else if (c >= 0x80 && c < 0xC0 && !(i > 0 && IsRestrictedLead((unsigned char)name[i - 1]))) {
+            image[i] = (char)(0x80 + PermutedIndex(key, 'u', word, c - 0x80, 64));
+        }
+        word += (char)c;
+    }
+    return image;
+}
+
+string AnonymizeRefName(const AnonymizerKey &key, const string &fullName) {
+    static const string REFS("refs/");
+    static const string HEAD("HEAD");
+    size_t namespaceEnd = StartsWith(fullName, REFS) ? fullName.find('/', REFS.length()) : string::npos;
+    if (namespaceEnd == string::npos) {
+        return fullName; // "HEAD", "refs/stash"
+    }
+    string name = fullName.substr(namespaceEnd + 1);
+    size_t lastSlash = name.rfind('/');
+    string last = (lastSlash == string::npos) ? name : name.substr(lastSlash + 1);
+    string image = (last == HEAD)
+        ? ((lastSlash == string::npos) ? HEAD : AnonymizeName(key, name.substr(0, lastSlash)) + "/" + HEAD)
+        : AnonymizeName(key, name);
+    return fullName.substr(0, namespaceEnd + 1) + image;
+}
+
+string AnonymizeOid(const AnonymizerKey &key, const string &oid) {
+    static const char HEX[] = "0123456789abcdef";
+    bool hex = !oid.empty() && all_of(oid.begin(), oid.end(), [](char c) -> bool {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+    });
+    if (!hex) {
+        return oid;
+    }
+    string image;
+    for (char part = 0; image.length() < oid.length(); ++part) {
+        string input = "oid" + oid + part;
+        uint64_t hash = SipHash24(key, input.data(), input.length());
+        for (int i = 0; i < 16 && image.length() < oid.length(); ++i, hash >>= 4) {
+            image += HEX[hash & 0xf];
+        }
+    }
+    return image;
+}
+
+#ifdef DEBUG
+void RefsAnonymizerTest() {
+    {
+        // the reference vectors of SipHash-2-4
+        AnonymizerKey key = { 0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL };
+        char message[15];
+        for (int i = 0; i < 15; ++i) {
+            message[i] = (char)i;
+        }
+        assert(0x726fdb47dd0e0e31ULL == SipHash24(key, message, 0));
+        assert(0xa129ca6149be45e5ULL == SipHash24(key, message, 15));
+    }
+
+    AnonymizerKey key = AnonymizerKeyCreate(string("secret"));
+    AnonymizerKey otherKey = AnonymizerKeyCreate(string("other secret"));
+    vector<string> names = {
+        "master", "main", "feature/abc", "feature/abd", "feature/ABC-12", "fix/help-typo", "origin/fix/help-typo",
+        "release/1.0", "release/1.0.1", "svn/trunk", "JIRA-123-fixLogin", "fix",
+        "fix/\xD0\xB2\xD0\xB5\xD1\x82\xD0\xBA\xD0\xB0", "fix/\xE0\xA4\x95\xED\x95\x9C",
+    };
+    vector<string> prefixes = { "f/h", "f/a", "r/1", "F/A", "J-1", "o/f/h", "/t", "fL", "f/ABC-1", "f/\xD0\xB2" };
+    for (auto name = names.begin(); name != names.end(); ++name) {
+        for (size_t length = 0; length <= name->length(); ++length) {
+            prefixes.push_back(name->substr(0, length));
+        }
+    }
+
+    set<string> images;
+    for (auto name = names.begin(); name != names.end(); ++name) {
+        string image = AnonymizeName(key, *name);
+        assert(image == AnonymizeName(key, *name));
+        assert(image != AnonymizeName(otherKey, *name));
+        assert(image.length() == name->length());
+        assert(mb2w(image).find(L'\xFFFD') == wstring::npos);
+        for (size_t i = 0; i < name->length(); ++i) {
+            assert(IsPartialPrefixAnchor((*name)[i]) == IsPartialPrefixAnchor(image[i]));
+            assert(!ispunct((unsigned char)(*name)[i]) || (*name)[i] == image[i]);
+        }
+        images.insert(image);
+    }
+    assert(images.size() == names.size());
+    assert(AnonymizeName(key, "feature/abc").substr(0, 10) == AnonymizeName(key, "feature/abd").substr(0, 10));
+    assert(AnonymizeName(key, "origin/fix/help-typo") == AnonymizeName(key, "origin") + "/" + AnonymizeName(key, "fix/help-typo"));
+
+    // completion behaves identically
+    for (auto name = names.begin(); name != names.end(); ++name) {
+        string image = AnonymizeName(key, *name);
+        for (auto prefix = prefixes.begin(); prefix != prefixes.end(); ++prefix) {
+            string prefixImage = AnonymizeName(key, *prefix);
+            assert(StartsWith(*name, *prefix) == StartsWith(image, prefixImage));
+            assert(RefMayBeEncodedByPartialPrefix(name->c_str(), prefix->c_str()) == RefMayBeEncodedByPartialPrefix(image.c_str(), prefixImage.c_str()));
+        }
+    }
+
+    assert("refs/heads/" + AnonymizeName(key, "feature/abc") == AnonymizeRefName(key, "refs/heads/feature/abc"));
+    assert("refs/remotes/" + AnonymizeName(key, "origin") + "/HEAD" == AnonymizeRefName(key, "refs/remotes/origin/HEAD"));
+    assert(string("refs/stash") == AnonymizeRefName(key, "refs/stash"));
+    assert(string("HEAD") == AnonymizeRefName(key, "HEAD"));
+
+    string oid("0123456789abcdef0123456789abcdef01234567");
+    string oidImage = AnonymizeOid(key, oid);
+    assert(oidImage.length() == oid.length() && oidImage != oid && oidImage == AnonymizeOid(key, oid));
+    assert(oidImage.find_first_not_of("0123456789abcdef") == string::npos);
+    assert(AnonymizeOid(key, oid.substr(0, 39) + "8") != oidImage);
+}
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Keyed anonymization of ref names which keeps what completion depends on.
+//
+// A name is a sequence of words: a word starts at an anchor (see IsPartialPrefixAnchor) or at the start
+// of the name. Punctuation is kept as is, uppercase letters are permuted by one permutation for the whole name,
+// and every other char is permuted within its class (lowercase letters, digits, UTF-8 continuation bytes)
+// by a permutation which depends on the key and on the chars before it in its word. So:
+//
+//   - lengths, segment counts, punctuation and anchors stay in place, the name stays valid UTF-8;
+//   - names which share a prefix share the prefix of their images, different names stay different;
+//   - the same word gives the same image anywhere ("fix" of "fix" and of "origin/fix"),
+//     so short names of remote branches are images of the short names;
+//   - StartsWith and RefMayBeEncodedByPartialPrefix give the same answer for images of a ref and a prefix.
+
+typedef struct tAnonymizerKey {
+    uint64_t k0, k1;
+} AnonymizerKey;
+
+/** The key is derived from a secret phrase, the same phrase gives the same images. */
+AnonymizerKey AnonymizerKeyCreate(const std::string &secret);
+
+uint64_t SipHash24(const AnonymizerKey &key, const char *data, size_t length);
+
+/** Image of a name, e.g. of a short ref name or of a prefix typed for it. */
+std::string AnonymizeName(const AnonymizerKey &key, const std::string &name);
+
+/**
+ * Image of a full ref name: "refs/" and the namespace ("heads", "tags", "remotes", ...) are kept,
+ * the rest is anonymized, a last component "HEAD" ("refs/remotes/origin/HEAD") is kept too.
+ */
+std::string AnonymizeRefName(const AnonymizerKey &key, const std::string &fullName);
+
+/** Hex object id of the same length, refs which point to the same object keep pointing to the same one. */
+std::string AnonymizeOid(const AnonymizerKey &key, const std::string &oid);
+
+#ifdef DEBUG
+void RefsAnonymizerTest();
+#endif
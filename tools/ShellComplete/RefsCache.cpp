@@ -0,0 +1,162 @@
+#include "RefsCache.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <sstream>
+
+#include "Files.hpp"
+#include "LocalRefs.hpp"
+#include "RefStream.hpp"
+#include "Utils.hpp"
+
+using namespace std;
+
+static const string CACHE_HEADER("far-git-autocomplete refs 1");
+
+// Only these refs are expanded to names (see ExpandRefNames).
+static const vector<string> NAMESPACES = { "refs/heads/", "refs/tags/", "refs/remotes/" };
+
+/** FNV-1a, the name of a cache file only has to be stable, the file itself names its repository. */
+static uint64_t HashOf(const string &text) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (auto it = text.begin(); it != text.end(); ++it) {
+        hash = (hash ^ (unsigned char)*it) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+string RefsCachePath(const string &cacheDir, const string &gitDir, bool stripRemoteName) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx-%d", (unsigned long long)HashOf(gitDir), stripRemoteName ? 1 : 0);
+    return cacheDir + name;
+}
+
+string FormatRefsCache(const RefsCache &cache) {
+    ostringstream text;
+    text << CACHE_HEADER << "\n" << cache.gitDir << "\n" << (cache.stripRemoteName ? 1 : 0) << "\n"
+        << cache.fingerprint.stamps.size() << "\n";
+    for (auto stamp = cache.fingerprint.stamps.begin(); stamp != cache.fingerprint.stamps.end(); ++stamp) {
+        text << (stamp->exists ? 1 : 0) << " " << stamp->modified << " " << stamp->size << " " << stamp->path << "\n";
+    }
+    text << cache.names.size() << "\n";
+    for (auto name = cache.names.begin(); name != cache.names.end(); ++name) {
+        text << *name << "\n";
+    }
+    return text.str();
+}
+
+/** Reads the line at position and moves position past it, returns false at the end of the text. */
+static bool NextLine(const string &text, size_t &position, string &line) {
+    if (position >= text.length()) {
+        return false;
+    }
+    size_t end = text.find('\n', position);
+    if (end == string::npos) {
+        end = text.length();
+    }
+    line.assign(text, position, end - position);
+    position = end + 1;
+    return true;
+}
+
+bool ParseRefsCache(const string &text, RefsCache &cache, const string &namesPrefix) {
+    size_t position = 0;
+    string line;
+    if (!NextLine(text, position, line) || line != CACHE_HEADER || !NextLine(text, position, cache.gitDir) || !NextLine(text, position, line)) {
+        return false;
+    }
+    cache.stripRemoteName = (line == "1");
+    size_t count = 0;
+    if (!NextLine(text, position, line) || sscanf(line.c_str(), "%zu", &count) != 1) {
+        return false;
+    }
+    cache.fingerprint.stamps.clear();
+    for (size_t i = 0; i < count; ++i) {
+        FileStamp stamp;
+        int exists = 0;
+        long long modified = 0;
+        long long size = 0;
+        int pathStart = 0;
+        if (!NextLine(text, position, line) || sscanf(line.c_str(), "%d %lld %lld %n", &exists, &modified, &size, &pathStart) != 3 || pathStart == 0) {
+            return false;
+        }
+        stamp.exists = (exists != 0);
+        stamp.modified = modified;
+        stamp.size = size;
+        stamp.path = line.substr(pathStart);
+        cache.fingerprint.stamps.push_back(stamp);
+    }
+    if (!NextLine(text, position, line) || sscanf(line.c_str(), "%zu", &count) != 1) {
+        return false;
+    }
+    // Lines are compared in place, only the names with the prefix are copied.
+    cache.names.clear();
+    size_t lines = 0;
+    for (; lines < count && position < text.length(); ++lines) {
+        size_t end = text.find('\n', position);
+        if (end == string::npos) {
+            end = text.length();
+        }
+        if (text.compare(position, min(namesPrefix.length(), end - position), namesPrefix) == 0) {
+            cache.names.push_back(text.substr(position, end - position));
+        }
+        position = end + 1;
+    }
+    return lines == count;
+}
+
+bool LoadRefsCache(const string &path, const string &gitDir, bool stripRemoteName, const string &namesPrefix, RefsCache &cache) {
+    string text;
+    if (ReadFileContents(path, text) && ParseRefsCache(text, cache, namesPrefix) && cache.gitDir == gitDir
+            && cache.stripRemoteName == stripRemoteName && RefFilesUnchanged(cache.fingerprint)) {
+        return false;
+    }
+
+    // The survey goes first: if refs change while they are read, the next fingerprint differs.
+    cache.gitDir = gitDir;
+    cache.stripRemoteName = stripRemoteName;
+    cache.fingerprint = SurveyRefFiles(gitDir).fingerprint;
+    cache.names.clear();
+    CollectSortedUnique(ExpandRefNames(StreamFromVector(ReadRefFiles(gitDir, NAMESPACES)), stripRemoteName), cache.names);
+    // A cache which cannot be written only makes the next run slower.
+    WriteFileContents(path, FormatRefsCache(cache));
+    auto first = lower_bound(cache.names.begin(), cache.names.end(), namesPrefix);
+    auto last = partition_point(first, cache.names.end(), [&namesPrefix](const string &name) -> bool {
+        return StartsWith(name, namesPrefix);
+    });
+    cache.names = vector<string>(first, last);
+    return true;
+}
+
+#ifdef DEBUG
+void RefsCacheTest() {
+    RefsCache cache;
+    cache.gitDir = "/home/me/project/.git/";
+    cache.stripRemoteName = true;
+    FileStamp packed = { "/home/me/project/.git/packed-refs", true, 1234567890123456789LL, 42 };
+    FileStamp loose = { "/home/me/project/.git/refs/heads/my dir", false, 0, 0 };
+    cache.fingerprint.stamps = { packed, loose };
+    cache.names = { "feature/x", "master" };
+
+    RefsCache parsed;
+    assert(ParseRefsCache(FormatRefsCache(cache), parsed, string("")));
+    assert(parsed.gitDir == cache.gitDir && parsed.stripRemoteName && parsed.names == cache.names);
+    assert(2 == parsed.fingerprint.stamps.size() && loose.path == parsed.fingerprint.stamps[1].path && !parsed.fingerprint.stamps[1].exists);
+    assert(packed.modified == parsed.fingerprint.stamps[0].modified && 42 == parsed.fingerprint.stamps[0].size);
+
+    assert(ParseRefsCache(FormatRefsCache(cache), parsed, string("m")) && (vector<string>{ "master" }) == parsed.names);
+    assert(ParseRefsCache(FormatRefsCache(cache), parsed, string("feature/xy")) && parsed.names.empty());
+
+    string truncated = FormatRefsCache(cache);
+    assert(!ParseRefsCache(truncated.substr(0, truncated.length() - 7), parsed, string("")));
+    assert(!ParseRefsCache(string("something else\n"), parsed, string("")));
+    cache.names.clear();
+    assert(ParseRefsCache(FormatRefsCache(cache), parsed, string("")) && parsed.names.empty());
+
+    assert(RefsCachePath("/c/", "/a/.git/", true) != RefsCachePath("/c/", "/a/.git/", false));
+    assert(RefsCachePath("/c/", "/a/.git/", true) != RefsCachePath("/c/", "/b/.git/", true));
+    assert(0 == RefsCachePath("/c/", "/a/.git/", true).find("/c/"));
+}
+#endif
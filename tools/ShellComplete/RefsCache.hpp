@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "RefFiles.hpp"
+
+// Names of refs of a repository kept in a file between runs of a short-lived process.
+//
+// The file holds the fingerprint of the ref files it was made from, so a run only stats packed-refs
+// and the directories of loose refs (see RefFilesUnchanged), and rereads refs only if any of them has changed.
+
+typedef struct tRefsCache {
+    std::string gitDir;
+    bool stripRemoteName;
+    RefFilesFingerprint fingerprint;
+    std::vector<std::string> names; // expanded, sorted and unique; only those with the requested prefix once it is loaded
+} RefsCache;
+
+/** File of the repository in cacheDir, one per git dir and stripRemoteName. */
+std::string RefsCachePath(const std::string &cacheDir, const std::string &gitDir, bool stripRemoteName);
+
+std::string FormatRefsCache(const RefsCache &cache);
+
+/** Keeps only the names which start with namesPrefix, returns false if the text is not a cache. */
+bool ParseRefsCache(const std::string &text, RefsCache &cache, const std::string &namesPrefix);
+
+/**
+ * Names of branches, tags and remote branches of the repository which start with namesPrefix.
+ * The cache file is used if it is made for the same repository and its ref files are unchanged,
+ * otherwise refs are reread and the file is rewritten with all names. Returns true if refs are reread.
+ */
+bool LoadRefsCache(const std::string &path, const std::string &gitDir, bool stripRemoteName, const std::string &namesPrefix, RefsCache &cache);
+
+#ifdef DEBUG
+void RefsCacheTest();
+#endif
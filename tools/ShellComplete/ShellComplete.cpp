@@ -0,0 +1,178 @@
+// Completion of refs in bash and zsh with the semantics of the plugin, see shell-complete.sh:
+//
+//   ShellComplete [--bash] [--full-remote-name] <command line up to the cursor>
+//
+// Prints the names which suit the word under the cursor, one per line: those starting with it or,
+// if there are none, those which it may encode as a partial prefix ("f/h" -> "fix/help-typo").
+// Exits with 1 if the word is not a ref or there is no repository, so the shell falls back to git's own completion.
+//
+// Refs are read from packed-refs and loose ref files into a cache file (see RefsCache),
+// a run usually stats the ref files, reads the cache and copies only the names with the first char of the word.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "CmdLine.hpp"
+#include "CompletionContext.hpp"
+#include "Files.hpp"
+#include "LocalRefs.hpp"
+#include "Log.hpp"
+#include "RefsSnapshot.hpp"
+#include "Unicode.hpp"
+#include "Utils.hpp"
+#include "RefsCache.hpp"
+
+using namespace std;
+
+wostream *logFile;
+
+static string CurrentDir() {
+#ifdef _WIN32
+    wchar_t *dir = _wgetcwd(nullptr, 0);
+    string result = (dir != nullptr) ? w2mb(wstring(dir)) : string("");
+#else
+    char *dir = getcwd(nullptr, 0);
+    string result = (dir != nullptr) ? string(dir) : string("");
+#endif
+    free(dir);
+    return result;
+}
+
+/** Git dir of $GIT_DIR or of the current directory or its nearest parent, refs of linked worktrees are in the common dir. */
+static string FindGitDir() {
+    string gitDir = EnvironmentVariable("GIT_DIR");
+    if (!gitDir.empty()) {
+        return LocalGitDir(gitDir);
+    }
+    string dir = CurrentDir();
+    while (!dir.empty()) {
+        gitDir = LocalGitDir(dir);
+        if (!gitDir.empty()) {
+            return gitDir;
+        }
+        size_t slash = dir.find_last_of("/\\");
+        dir = (slash == string::npos || slash == 0) ? string("") : dir.substr(0, slash);
+    }
+    return string("");
+}
+
+/** $XDG_CACHE_HOME, ~/.cache or %LOCALAPPDATA%, with a trailing slash, or empty string. */
+static string CacheDir() {
+#ifdef _WIN32
+    string base = EnvironmentVariable("LOCALAPPDATA");
+#else
+    string base = EnvironmentVariable("XDG_CACHE_HOME");
+    if (base.empty() && !HomeDir().empty()) {
+        base = HomeDir() + "/.cache";
+    }
+#endif
+    if (base.empty()) {
+        return string("");
+    }
+    string dir = base + "/far-git-autocomplete/";
+    return CreateDirs(dir) ? dir : string("");
+}
+
+/**
+ * Names which suit the prefix, the same ones TransformCmdLine offers in its dialog.
+ * For bash, partial matches without a longer common prefix are dropped, since bash would replace the word by that prefix.
+ */
+static vector<string> SuitableNames(const RefsSnapshot &snapshot, const string &prefix, bool forBash) {
+    const vector<string> &names = snapshot.names;
+    pair<size_t, size_t> range = RefsSnapshotPrefixRange(snapshot, prefix);
+    if (range.first != range.second) {
+        return vector<string>(names.begin() + range.first, names.begin() + range.second);
+    }
+    vector<string> result;
+    range = RefsSnapshotPartialRange(snapshot, prefix);
+    for (size_t i = range.first; i < range.second; ++i) {
+        if (RefMayBeEncodedByPartialPrefix(names[i].c_str(), prefix.c_str())) {
+            result.push_back(names[i]);
+        }
+    }
+    if (forBash && result.size() > 1) {
+        CommonPrefixFold commonPrefix = CommonPrefixFoldCreate(0);
+        for (auto name = result.begin(); name != result.end() && !CommonPrefixFoldCollapsed(commonPrefix); ++name) {
+            CommonPrefixFoldAdd(commonPrefix, *name);
+        }
+        if (commonPrefix.prefix.length() <= prefix.length()) {
+            result.clear();
+        }
+    }
+    return result;
+}
+
+static int Run(const vector<string> &args) {
+    bool forBash = false;
+    bool stripRemoteName = true;
+    size_t argIndex = 1;
+    for (; argIndex < args.size() && StartsWith(args[argIndex], string("--")); ++argIndex) {
+        if (args[argIndex] == "--bash") {
+            forBash = true;
+        } else if (args[argIndex] == "--full-remote-name") {
+            stripRemoteName = false;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", args[argIndex].c_str());
+            return 2;
+        }
+    }
+    if (argIndex + 1 != args.size()) {
+        fprintf(stderr, "Usage: ShellComplete [--bash] [--full-remote-name] <command line up to the cursor>\n");
+        return 2;
+    }
+
+    wstring line = mb2w(args[argIndex]);
+    CmdLine cmdLine = CmdLineCreate(line, (int)line.length(), -1, 0);
+    string prefix = NormalizeNfc(w2mb(GetUserPrefix(cmdLine)));
+    vector<wstring> words = GetPrecedingWords(cmdLine);
+    vector<string> precedingWords(words.size());
+    transform(words.begin(), words.end(), precedingWords.begin(), w2mb);
+    if (precedingWords.empty() || DetectCompletionContext(precedingWords, prefix) != CONTEXT_REFS) {
+        return 1;
+    }
+    string gitDir = FindGitDir();
+    if (gitDir.empty()) {
+        return 1;
+    }
+
+    // Both strict and partial matches start with the first char of the prefix, unless it is an anchor (see RefsSnapshotPartialRange).
+    // Without a cache dir the cache is just not kept.
+    string namesPrefix = (!prefix.empty() && !IsPartialPrefixAnchor(prefix[0])) ? prefix.substr(0, 1) : string("");
+    string cacheDir = CacheDir();
+    RefsCache cache;
+    LoadRefsCache(cacheDir.empty() ? string("") : RefsCachePath(cacheDir, gitDir, stripRemoteName), gitDir, stripRemoteName, namesPrefix, cache);
+    shared_ptr<RefsSnapshot> snapshot = RefsSnapshotFromNames(cache.names);
+    vector<string> names = SuitableNames(*snapshot, prefix, forBash);
+    for (auto name = names.begin(); name != names.end(); ++name) {
+        printf("%s\n", name->c_str());
+    }
+    return 0;
+}
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t *argv[]) {
+    vector<string> args;
+    for (int i = 0; i < argc; ++i) {
+        args.push_back(w2mb(wstring(argv[i])));
+    }
+#else
+int main(int argc, char *argv[]) {
+    vector<string> args(argv, argv + argc);
+#endif
+    logFile = new wostream(nullptr);
+#ifdef DEBUG
+    RefsCacheTest();
+#endif
+    return Run(args);
+}
@@ -0,0 +1,47 @@
+#!/bin/bash
+# Tab latency of ShellComplete against git-completion.bash for "git checkout fe<Tab>" in a synthetic repository:
+#
+#   bench.sh [packed refs] [loose refs] [runs]
+#
+# ShellComplete and git must be in PATH, GIT_COMPLETION may point to git-completion.bash.
+
+PACKED=${1:-20000}
+LOOSE=${2:-2000}
+RUNS=${3:-50}
+GIT_COMPLETION=${GIT_COMPLETION:-/usr/share/bash-completion/completions/git}
+
+REPO=$(mktemp -d)
+export XDG_CACHE_HOME="$REPO/cache"
+trap 'rm -rf "$REPO"' EXIT
+cd "$REPO" || exit 1
+git init -q repo && cd repo || exit 1
+git -c user.name=bench -c user.email=bench@localhost commit -q --allow-empty -m bench
+OID=$(git rev-parse HEAD)
+{
+    echo "# pack-refs with: peeled fully-peeled sorted "
+    for ((i = 0; i < PACKED; i++)); do
+        echo "$OID refs/remotes/origin/topic/$((i % 100))/change-$i"
+    done | sort -k2
+} > .git/packed-refs
+for ((i = 0; i < LOOSE; i++)); do
+    mkdir -p ".git/refs/heads/feature/$((i % 50))"
+    echo "$OID" > ".git/refs/heads/feature/$((i % 50))/work-$i"
+done
+
+source "$GIT_COMPLETION"
+TIMEFORMAT=%R
+
+# What git-completion.bash does for a ref argument of "git checkout": it forks git for-each-ref.
+GIT_SECONDS=$( { time (for ((i = 0; i < RUNS; i++)); do
+    COMP_WORDS=(git checkout fe); COMP_CWORD=2; cur=fe; COMPREPLY=()
+    __git_complete_refs --cur=fe
+done) ; } 2>&1 )
+
+ShellComplete --bash "git checkout fe" > /dev/null # the cache is made once
+CLIENT_SECONDS=$( { time (for ((i = 0; i < RUNS; i++)); do
+    ShellComplete --bash "git checkout fe" > /dev/null
+done) ; } 2>&1 )
+
+echo "$PACKED packed and $LOOSE loose refs, ms per Tab:"
+awk -v s="$GIT_SECONDS" -v n="$RUNS" 'BEGIN { printf "  git-completion.bash: %.1f\n", s * 1000 / n }'
+awk -v s="$CLIENT_SECONDS" -v n="$RUNS" 'BEGIN { printf "  ShellComplete:       %.1f\n", s * 1000 / n }'
@@ -0,0 +1,36 @@
+# Completion of refs in git commands by ShellComplete, for bash and zsh.
+# Put ShellComplete into PATH and source this file after git's own completion, e.g. in ~/.bashrc or ~/.zshrc:
+#
+#   source /path/to/shell-complete.sh
+#
+# Other words, and refs which are not found, are completed by git's own completion.
+
+if [ -n "$BASH_VERSION" ]; then
+    _far_git_complete() {
+        local reply
+        if reply=$(ShellComplete --bash "${COMP_LINE:0:COMP_POINT}" 2>/dev/null) && [ -n "$reply" ]; then
+            local IFS=$'\n'
+            COMPREPLY=($reply)
+            # git's completion is registered with "-o nospace", so a complete name gets its space here
+            if [ ${#COMPREPLY[@]} -eq 1 ]; then
+                COMPREPLY[0]+=" "
+            fi
+            return 0
+        fi
+        if declare -F __git_wrap__git_main >/dev/null; then
+            __git_wrap__git_main
+        fi
+    }
+    complete -o bashdefault -o default -o nospace -F _far_git_complete git
+elif [ -n "$ZSH_VERSION" ]; then
+    _far_git_complete() {
+        local reply
+        if reply=$(ShellComplete "${(j: :)words[1,CURRENT-1]} $PREFIX" 2>/dev/null) && [[ -n $reply ]]; then
+            # names of partial prefixes do not start with the word
+            compadd -U -Q -- ${(f)reply}
+            return 0
+        fi
+        _git "$@"
+    }
+    compdef _far_git_complete git
+fi